@@ -0,0 +1,69 @@
+#include "tbp/log/LogDaemon.h"
+#include "tbp/log/ShmClient.h"
+#include "tbp/log/Config.h"
+#include "tbp/log/Injector.h"
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <csignal>
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+std::atomic<bool> g_stop(false);
+
+void OnStop(int /*signalNumber*/)
+{
+   g_stop.store(true);
+}
+
+}
+
+int MainFunction(int argc, char** argv)
+{
+   if (argc != 4)
+   {
+      std::cerr << "usage: tbp-logd <registry name> <output dir> <file prefix>" << std::endl;
+      return 1;
+   }
+   std::signal(SIGINT, OnStop);
+   std::signal(SIGTERM, OnStop);
+   //
+   int res = 0;
+   try
+   {
+      ShmConfig shmConfig(argv[1], 0, 0); // the ring and dictionary capacities are chosen by the clients
+      Config config(argv[2], argv[3]);
+      Injector injector;
+      LogDaemon daemon(shmConfig, config, injector);
+      while (!g_stop.load())
+      {
+         if (!daemon.Poll())
+         {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+         }
+      }
+      daemon.Poll();
+   }
+   catch (std::exception& e)
+   {
+      std::cerr << "exception in main: " << e.what() << std::endl;
+      res = 1;
+   }
+   return res;
+}
+
+}
+}
+
+int main(int argc, char** argv)
+{
+   return tbp::log::MainFunction(argc, argv);
+}
@@ -0,0 +1,80 @@
+#include "tbp/log/Blob.h"
+#include <algorithm>
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+constexpr std::size_t CHUNK_SIZE = 512; // characters written at once
+
+void WriteHex(fmt::MemoryWriter& writer, const unsigned char* data, std::size_t size)
+{
+   static const char digits[] = "0123456789abcdef";
+   char chunk[CHUNK_SIZE];
+   while (size)
+   {
+      std::size_t n = std::min(size, CHUNK_SIZE / 2);
+      for (std::size_t i = 0; i < n; ++i)
+      {
+         chunk[2 * i] = digits[data[i] >> 4];
+         chunk[2 * i + 1] = digits[data[i] & 0xF];
+      }
+      writer << fmt::StringRef(chunk, 2 * n);
+      data += n;
+      size -= n;
+   }
+}
+
+void WriteBase64(fmt::MemoryWriter& writer, const unsigned char* data, std::size_t size)
+{
+   static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+   char chunk[CHUNK_SIZE];
+   std::size_t length = 0;
+   for (; size >= 3; data += 3, size -= 3)
+   {
+      std::uint32_t v = (data[0] << 16) | (data[1] << 8) | data[2];
+      chunk[length++] = digits[v >> 18];
+      chunk[length++] = digits[(v >> 12) & 0x3F];
+      chunk[length++] = digits[(v >> 6) & 0x3F];
+      chunk[length++] = digits[v & 0x3F];
+      if (length == CHUNK_SIZE)
+      {
+         writer << fmt::StringRef(chunk, length);
+         length = 0;
+      }
+   }
+   if (size)
+   {
+      std::uint32_t v = (data[0] << 16) | (size == 2 ? data[1] << 8 : 0);
+      chunk[length++] = digits[v >> 18];
+      chunk[length++] = digits[(v >> 12) & 0x3F];
+      chunk[length++] = size == 2 ? digits[(v >> 6) & 0x3F] : '=';
+      chunk[length++] = '=';
+   }
+   if (length)
+   {
+      writer << fmt::StringRef(chunk, length);
+   }
+}
+
+}
+
+void WriteBlob(fmt::MemoryWriter& writer, const BlobField& v)
+{
+   const unsigned char* data = reinterpret_cast<const unsigned char*>(v.m_data);
+   if (v.m_format == BlobFormat::base64)
+   {
+      WriteBase64(writer, data, v.m_size);
+   }
+   else
+   {
+      WriteHex(writer, data, v.m_size);
+   }
+}
+
+}
+}
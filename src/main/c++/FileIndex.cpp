@@ -0,0 +1,301 @@
+#include "tbp/log/FileIndex.h"
+#include "tbp/log/LogMerger.h"
+#include "tbp/common/ConfigurationException.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <ostream>
+#include <sys/stat.h>
+
+namespace tbp
+{
+namespace log
+{
+
+constexpr char FileIndex::MAGIC[];
+
+FileIndex::FileIndex(const IndexPolicy& policy)
+   : m_maxLines(policy.m_lines ? policy.m_lines : std::numeric_limits<std::size_t>::max()),
+   m_interval(policy.m_interval.count() ? policy.m_interval.count() : std::numeric_limits<std::int64_t>::max())
+{}
+
+bool FileIndex::Open(const std::string& logPath)
+{
+   m_file.open(logPath + ".idx", std::ios::binary | std::ios::trunc);
+   if (!m_file.is_open())
+   {
+      return false;
+   }
+   m_file.write(MAGIC, sizeof(MAGIC) - 1);
+   m_nbLines = 0;
+   m_ids.clear();
+   m_counts.clear();
+   m_lastCategory = nullptr;
+   return true;
+}
+
+void FileIndex::Close(std::uint64_t end)
+{
+   if (!m_file.is_open())
+   {
+      return;
+   }
+   if (m_nbLines)
+   {
+      WriteBlock(end);
+   }
+   m_file.close();
+}
+
+void FileIndex::WriteBlock(std::uint64_t end)
+{
+   std::uint32_t nbCounts = static_cast<std::uint32_t>(std::count_if(m_counts.begin(), m_counts.end(), [](std::uint32_t count)
+   {
+      return count != 0;
+   }));
+   BlockRecord record{ BLOCK, nbCounts, m_offset, end - m_offset, m_firstTime, m_lastTime, m_nbLines };
+   m_file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+   for (std::uint32_t id = 0; id < m_counts.size(); ++id)
+   {
+      if (m_counts[id])
+      {
+         std::uint32_t pair[2] = { id, m_counts[id] };
+         m_file.write(reinterpret_cast<const char*>(pair), sizeof(pair));
+         m_counts[id] = 0;
+      }
+   }
+   m_nbLines = 0;
+}
+
+FileIndexReader::FileIndexReader(const std::string& logPath) : m_logPath(logPath)
+{
+   std::ifstream file(logPath + ".idx", std::ios::binary);
+   char magic[sizeof(FileIndex::MAGIC) - 1];
+   if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, FileIndex::MAGIC, sizeof(magic)) != 0)
+   {
+      throw common::ConfigurationException("FileIndexReader cannot read the index of file[" + logPath + "]");
+   }
+   std::uint32_t type = 0;
+   while (file.read(reinterpret_cast<char*>(&type), sizeof(type)))
+   {
+      // the last record can be incomplete (file being written)
+      if (type == FileIndex::CATEGORY)
+      {
+         FileIndex::CategoryRecord record;
+         if (!file.read(reinterpret_cast<char*>(&record) + sizeof(type), sizeof(record) - sizeof(type)))
+         {
+            break;
+         }
+         std::string label(record.m_size, '\0');
+         if (!file.read(&label[0], label.size()))
+         {
+            break;
+         }
+         if (m_categories.size() <= record.m_id)
+         {
+            m_categories.resize(record.m_id + 1);
+         }
+         m_categories[record.m_id] = std::move(label);
+      }
+      else if (type == FileIndex::BLOCK)
+      {
+         FileIndex::BlockRecord record;
+         if (!file.read(reinterpret_cast<char*>(&record) + sizeof(type), sizeof(record) - sizeof(type)))
+         {
+            break;
+         }
+         Block block;
+         block.m_offset = record.m_offset;
+         block.m_size = record.m_size;
+         block.m_firstTime = record.m_firstTime;
+         block.m_lastTime = record.m_lastTime;
+         block.m_nbLines = record.m_nbLines;
+         block.m_counts.resize(record.m_nbCounts);
+         if (record.m_nbCounts && !file.read(reinterpret_cast<char*>(block.m_counts.data()), record.m_nbCounts * 2 * sizeof(std::uint32_t)))
+         {
+            break;
+         }
+         m_blocks.emplace_back(std::move(block));
+      }
+      else
+      {
+         throw common::ConfigurationException("FileIndexReader: invalid record in the index of file[" + logPath + "]");
+      }
+   }
+}
+
+std::vector<FileIndexReader::Range> FileIndexReader::Find(std::uint64_t from, std::uint64_t to,
+      const std::vector<std::string>& categories) const
+{
+   std::vector<bool> selected(m_categories.size(), false);
+   for (std::size_t id = 0; id < m_categories.size(); ++id)
+   {
+      selected[id] = std::find(categories.begin(), categories.end(), m_categories[id]) != categories.end();
+   }
+   std::vector<Range> ranges;
+   auto add = [&ranges](std::uint64_t offset, std::uint64_t size, std::uint64_t firstTime)
+   {
+      if (!ranges.empty() && ranges.back().m_offset + ranges.back().m_size == offset)
+      {
+         ranges.back().m_size += size;
+      }
+      else
+      {
+         ranges.push_back(Range{ offset, size, firstTime });
+      }
+   };
+   std::uint64_t end = 0;
+   std::uint64_t lastTime = from;
+   for (const auto& block : m_blocks)
+   {
+      end = block.m_offset + block.m_size;
+      lastTime = block.m_lastTime;
+      if (block.m_lastTime < from || block.m_firstTime > to)
+      {
+         continue;
+      }
+      bool found = categories.empty() || std::any_of(block.m_counts.begin(), block.m_counts.end(),
+            [&selected](const std::pair<std::uint32_t, std::uint32_t>& count)
+      {
+         return count.first < selected.size() && selected[count.first];
+      });
+      if (found)
+      {
+         add(block.m_offset, block.m_size, block.m_firstTime);
+      }
+   }
+   struct stat st;
+   if (::stat(m_logPath.c_str(), &st) == 0 && static_cast<std::uint64_t>(st.st_size) > end)
+   {
+      add(end, st.st_size - end, lastTime);
+   }
+   return ranges;
+}
+
+namespace
+{
+
+constexpr std::uint64_t NANOS_PER_SECOND = 1000000000;
+constexpr std::uint64_t NANOS_PER_DAY = 86400 * NANOS_PER_SECOND;
+constexpr std::size_t QUERY_CHUNK = 4 * 1024 * 1024;
+
+// local midnight of the day of 'time' (nanoseconds since the epoch)
+std::uint64_t GetMidnight(std::uint64_t time)
+{
+   std::time_t seconds = static_cast<std::time_t>(time / NANOS_PER_SECOND);
+   std::tm tm;
+   localtime_r(&seconds, &tm);
+   tm.tm_hour = 0;
+   tm.tm_min = 0;
+   tm.tm_sec = 0;
+   tm.tm_isdst = -1;
+   return static_cast<std::uint64_t>(std::mktime(&tm)) * NANOS_PER_SECOND;
+}
+
+// label of the category of a line: [time][tid][level][category]
+bool HasCategory(const char* line, const char* end, const std::vector<std::string>& categories)
+{
+   const char* label = line;
+   for (int field = 0; field < 3; ++field)
+   {
+      label = static_cast<const char*>(std::memchr(label, ']', end - label));
+      if (!label)
+      {
+         return false;
+      }
+      ++label;
+   }
+   if (label == end || *label != '[')
+   {
+      return false;
+   }
+   ++label;
+   const char* labelEnd = static_cast<const char*>(std::memchr(label, ']', end - label));
+   if (!labelEnd)
+   {
+      return false;
+   }
+   std::size_t size = labelEnd - label;
+   return std::any_of(categories.begin(), categories.end(), [label, size](const std::string& category)
+   {
+      return category.size() == size && std::memcmp(category.data(), label, size) == 0;
+   });
+}
+
+}
+
+std::size_t FileIndexReader::Query(std::uint64_t from, std::uint64_t to, const std::vector<std::string>& categories, std::ostream& out) const
+{
+   std::ifstream file(m_logPath, std::ios::binary);
+   if (!file.is_open())
+   {
+      throw common::ConfigurationException("FileIndexReader cannot open file[" + m_logPath + "]");
+   }
+   std::size_t nbRecords = 0;
+   std::vector<char> data;
+   for (const auto& range : Find(from, to, categories))
+   {
+      file.clear();
+      file.seekg(range.m_offset);
+      std::uint64_t remaining = range.m_size;
+      // time of the previous record, the day of a time of day is the nearest to it
+      std::uint64_t previous = range.m_firstTime;
+      std::uint64_t midnight = GetMidnight(previous);
+      bool selected = false;
+      data.clear();
+      // the range is read by chunks, the incomplete line at the end of a chunk is kept for the next one
+      while (remaining)
+      {
+         std::size_t kept = data.size();
+         std::size_t size = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, QUERY_CHUNK));
+         data.resize(kept + size);
+         file.read(data.data() + kept, size);
+         size = file.gcount();
+         data.resize(kept + size);
+         remaining = size ? remaining - size : 0;
+         const char* line = data.data();
+         const char* end = line + data.size();
+         while (line < end)
+         {
+            const char* next = static_cast<const char*>(std::memchr(line, '\n', end - line));
+            if (!next && remaining)
+            {
+               break;
+            }
+            next = next ? next + 1 : end;
+            std::uint64_t nanosOfDay = 0;
+            if (LogMerger::ParseTime(line, next - line, nanosOfDay))
+            {
+               std::uint64_t time = midnight + nanosOfDay;
+               if (time + NANOS_PER_DAY / 2 < previous)
+               {
+                  time += NANOS_PER_DAY;
+               }
+               else if (time > previous + NANOS_PER_DAY / 2)
+               {
+                  time -= NANOS_PER_DAY;
+               }
+               if (time < midnight || time >= midnight + NANOS_PER_DAY)
+               {
+                  // next day (or previous day), the length of the day can change (DST)
+                  midnight = GetMidnight(time);
+                  time = midnight + nanosOfDay;
+               }
+               previous = time;
+               selected = time >= from && time <= to && (categories.empty() || HasCategory(line, next, categories));
+               nbRecords += selected;
+            }
+            if (selected)
+            {
+               out.write(line, next - line);
+            }
+            line = next;
+         }
+         data.erase(data.begin(), data.begin() + (line - data.data()));
+      }
+   }
+   return nbRecords;
+}
+
+}
+}
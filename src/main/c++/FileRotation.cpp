@@ -0,0 +1,73 @@
+#include "tbp/log/FileRotation.h"
+#include <future>
+
+namespace tbp
+{
+namespace log
+{
+
+FileOpener::FileOpener()
+{
+   m_thread = std::thread([this] { Run(); });
+}
+
+FileOpener::~FileOpener()
+{
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+   }
+   m_posted.notify_one();
+   m_thread.join();
+}
+
+void FileOpener::Post(std::function<void()> task)
+{
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_tasks.emplace_back(std::move(task));
+   }
+   m_posted.notify_one();
+}
+
+void FileOpener::Wait()
+{
+   std::promise<void> done;
+   std::future<void> future = done.get_future();
+   Post([&done] { done.set_value(); });
+   future.wait();
+}
+
+void FileOpener::Run()
+{
+   std::unique_lock<std::mutex> lock(m_mutex);
+   while (true)
+   {
+      m_posted.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+      if (m_tasks.empty())
+      {
+         break;
+      }
+      auto task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+      lock.unlock();
+      task();
+      lock.lock();
+   }
+}
+
+std::time_t GetNextBoundary(std::time_t now, std::chrono::seconds period)
+{
+   std::tm tm;
+   localtime_r(&now, &tm);
+   tm.tm_hour = 0;
+   tm.tm_min = 0;
+   tm.tm_sec = 0;
+   tm.tm_isdst = -1;
+   std::time_t midnight = std::mktime(&tm);
+   std::time_t seconds = period.count();
+   return midnight + ((now - midnight) / seconds + 1) * seconds;
+}
+
+}
+}
@@ -4,6 +4,10 @@
 #include <experimental/filesystem>
 #include <sstream>
 #include <iomanip>
+#include <thread>
+#include <limits>
+#include <fcntl.h>
+#include <unistd.h>
 
 // do not use boost::filesystem to avoid a dependency on boost
 namespace fs = std::experimental::filesystem;
@@ -25,14 +29,73 @@ std::string LocalTimeToString(const char* fmt)
    return oss.str();
 }
 
+// executed by the FileOpener, 'next' is shared with the FileWriter
+void OpenFile(const std::shared_ptr<PreparedFile>& next, FileBackend backend, std::size_t preallocate, bool sync)
+{
+   next->m_file.Open(next->m_path, backend);
+   if (next->m_file.IsOpen() && (preallocate || sync))
+   {
+      int fd = ::open(next->m_path.c_str(), O_WRONLY | O_CLOEXEC);
+      if (fd >= 0)
+      {
+         if (preallocate)
+         {
+            // the blocks are reserved, the size of the file does not change (no zeros at the end of the file)
+            ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(preallocate));
+         }
+         if (sync)
+         {
+            next->m_syncFd = fd;
+         }
+         else
+         {
+            ::close(fd);
+         }
+      }
+   }
+   int expected = PreparedFile::pending;
+   if (!next->m_state.compare_exchange_strong(expected, PreparedFile::ready))
+   {
+      // the FileWriter is destroyed, the file is not used
+      next->m_file.Close();
+      if (next->m_syncFd >= 0)
+      {
+         ::close(next->m_syncFd);
+      }
+      ::unlink(next->m_path.c_str());
+   }
 }
 
-FileWriter::FileWriter(const Config& config, common::ThreadId tid)
+// executed by the FileOpener, the last ticket of the file is waited for before closing 'syncFd' (the descriptor can be reused)
+void CloseFile(const std::shared_ptr<PreparedFile>& rotated, GroupCommit* groupCommit, int syncFd, std::uint64_t ticket)
+{
+   rotated->m_file.Close();
+   if (syncFd >= 0)
+   {
+      groupCommit->Wait(ticket);
+      ::fdatasync(syncFd);
+      ::close(syncFd);
+   }
+}
+
+}
+
+FileWriter::FileWriter(const Config& config, common::ThreadId tid, FileBackend backend) : m_backend(backend)
+{
+   Open(config, std::to_string(tid), config.GetFlushPolicy());
+}
+
+FileWriter::FileWriter(const Config& config, const std::string& name, FileBackend backend) : m_backend(backend)
+{
+   Open(config, name, config.GetFlushPolicy(name));
+}
+
+std::string FileWriter::MakePath(const Config& config, const std::string& suffix)
 {
    std::ostringstream oss;
    oss << config.GetFilePrefix();
    oss << "_" << LocalTimeToString("%Y%m%d-%H%M%S");
-   oss << "-" + std::to_string(tid);
+   oss << "-" + suffix;
    oss << ".log";
    fs::path outDir = config.GetOutputDir();
    if (!fs::exists(outDir))
@@ -41,23 +104,277 @@ FileWriter::FileWriter(const Config& config, common::ThreadId tid)
    }
    fs::path logFile = outDir;
    logFile /= oss.str();
-   m_file.open(logFile.string());
-   if (!m_file.is_open())
+   return logFile.string();
+}
+
+void FileWriter::Open(const Config& config, const std::string& suffix, const FlushPolicy& policy)
+{
+   std::string logFile = MakePath(config, suffix);
+   if (!m_file.Open(logFile, m_backend))
    {
       std::ostringstream oss;
       oss << "FileWriter cannot open file[" << logFile << "]";
       throw common::ConfigurationException(oss.str());
    }
+   m_path = logFile;
+   SetFlushPolicy(policy);
+   const RotationPolicy& rotationPolicy = config.GetRotationPolicy();
+   if (rotationPolicy.IsEnabled())
+   {
+      m_rotation = std::make_unique<RotationData>();
+      m_rotation->m_policy = rotationPolicy;
+      m_rotation->m_basePath = m_path.substr(0, m_path.size() - 4); // .log
+      m_rotation->m_maxSize = rotationPolicy.m_maxSize ? rotationPolicy.m_maxSize : std::numeric_limits<std::size_t>::max();
+      if (rotationPolicy.m_period.count())
+      {
+         m_rotation->m_nextBoundary = GetNextBoundary(std::time(nullptr), rotationPolicy.m_period);
+      }
+      PrepareNextFile();
+   }
+   const IndexPolicy& indexPolicy = config.GetIndexPolicy();
+   if (indexPolicy.IsEnabled())
+   {
+      m_index = std::make_unique<IndexData>(indexPolicy);
+      if (!m_index->m_index.Open(m_path))
+      {
+         throw common::ConfigurationException("FileWriter cannot open the index of file[" + m_path + "]");
+      }
+   }
+}
+
+void FileWriter::PrepareNextFile()
+{
+   RotationData& rotation = *m_rotation;
+   auto next = std::make_shared<PreparedFile>();
+   next->m_path = rotation.m_basePath + "." + std::to_string(rotation.m_index + 1) + ".log";
+   std::size_t preallocate = rotation.m_policy.m_preallocate;
+   bool sync = m_sync != nullptr;
+   FileBackend backend = m_backend;
+   rotation.m_next = next;
+   if (rotation.m_policy.m_opener)
+   {
+      rotation.m_policy.m_opener->Post([next, backend, preallocate, sync] { OpenFile(next, backend, preallocate, sync); });
+   }
+   else
+   {
+      OpenFile(next, backend, preallocate, sync);
+   }
+}
+
+// called by the thread writing the file
+void FileWriter::Rotate()
+{
+   RotationData& rotation = *m_rotation;
+   std::shared_ptr<PreparedFile> next = rotation.m_next;
+   if (next->m_state.load(std::memory_order_acquire) != PreparedFile::ready)
+   {
+      // retried on the next write
+      return;
+   }
+   if (!next->m_file.IsOpen())
+   {
+      // the current file is kept, the next one is tried again later
+      PrepareNextFile();
+      return;
+   }
+   m_file.Swap(next->m_file);
+   GroupCommit* groupCommit = nullptr;
+   int syncFd = -1;
+   std::uint64_t ticket = 0;
+   if (m_sync)
+   {
+      groupCommit = &m_sync->m_groupCommit;
+      syncFd = m_sync->m_fd;
+      ticket = m_sync->m_ticket.load(std::memory_order_relaxed);
+      // the flush policy has been changed after the preparation of the file
+      m_sync->m_fd = next->m_syncFd >= 0 ? next->m_syncFd : ::open(next->m_path.c_str(), O_WRONLY | O_CLOEXEC);
+      next->m_syncFd = -1;
+   }
+   m_path.swap(next->m_path);
+   if (m_index)
+   {
+      // the lines written before the rotation are in the rotated file
+      m_index->m_index.Close(m_index->m_offset);
+      m_index->m_index.Open(m_path);
+      m_index->m_offset = 0;
+   }
+   // 'next' now owns the rotated stream
+   if (rotation.m_policy.m_opener)
+   {
+      rotation.m_policy.m_opener->Post([next, groupCommit, syncFd, ticket] { CloseFile(next, groupCommit, syncFd, ticket); });
+   }
+   else
+   {
+      CloseFile(next, groupCommit, syncFd, ticket);
+   }
+   ++rotation.m_index;
+   rotation.m_fileSize = 0;
+   if (rotation.m_nextBoundary)
+   {
+      rotation.m_nextBoundary = GetNextBoundary(std::time(nullptr), rotation.m_policy.m_period);
+   }
+   PrepareNextFile();
 }
 
 FileWriter::~FileWriter()
 {
-   if (m_file.is_open())
+   StopWriterStage();
+   if (m_sync)
    {
-      m_file.close();
+      // the end of the file is durable too
+      FlushFile();
+      m_sync->m_groupCommit.Wait(m_sync->m_ticket.load());
+      ::close(m_sync->m_fd);
    }
+   if (m_index)
+   {
+      m_index->m_index.Close(m_index->m_offset);
+   }
+   m_file.Close();
+   if (m_rotation)
+   {
+      auto& next = m_rotation->m_next;
+      int expected = PreparedFile::pending;
+      if (!next->m_state.compare_exchange_strong(expected, PreparedFile::cancelled))
+      {
+         // the next file is ready but empty
+         next->m_file.Close();
+         if (next->m_syncFd >= 0)
+         {
+            ::close(next->m_syncFd);
+         }
+         ::unlink(next->m_path.c_str());
+      }
+   }
+}
+
+void FileWriter::SetFlushPolicy(const FlushPolicy& policy)
+{
+   if (m_sync)
+   {
+      Wait();
+      ::close(m_sync->m_fd);
+      m_sync.reset();
+   }
+   m_flushPolicy = policy;
+   m_lastFlush = GetCoarseNanos();
+   if (policy.m_groupCommit)
+   {
+      int fd = ::open(m_path.c_str(), O_WRONLY | O_CLOEXEC);
+      if (fd < 0)
+      {
+         throw common::ConfigurationException("FileWriter cannot open file[" + m_path + "] for fdatasync");
+      }
+      m_sync = std::make_unique<SyncData>(*policy.m_groupCommit, fd);
+   }
+}
+
+void FileWriter::FlushFile()
+{
+   m_file.Flush();
+   if (m_index)
+   {
+      m_index->m_index.Flush();
+   }
+   if (m_sync)
+   {
+      m_sync->m_ticket.store(m_sync->m_groupCommit.Request(m_sync->m_fd), std::memory_order_release);
+   }
+}
+void FileWriter::SetWriterStage(WriterStage& stage, std::size_t blockSize)
+{
+   m_stage = std::make_unique<StageData>(stage, blockSize);
+}
+
+void FileWriter::StopWriterStage()
+{
+   if (m_stage)
+   {
+      Submit(true);
+      Wait();
+      while (WriterBlock* block = m_stage->m_freeBlocks.Dequeue())
+      {
+         delete block;
+      }
+      m_stage.reset();
+   }
+}
+
+void FileWriter::Wait() const
+{
+   if (m_stage)
+   {
+      while (m_stage->m_pending.load(std::memory_order_acquire))
+      {
+         std::this_thread::yield();
+      }
+   }
+   if (m_sync)
+   {
+      std::uint64_t ticket = m_sync->m_ticket.load(std::memory_order_acquire);
+      if (ticket)
+      {
+         m_sync->m_groupCommit.Wait(ticket);
+      }
+   }
+}
+
+void FileWriter::Submit(bool flush)
+{
+   WriterBlock* block = m_stage->m_block;
+   if (!block)
+   {
+      if (!flush)
+      {
+         return;
+      }
+      // empty block only used to flush the file
+      block = m_stage->m_freeBlocks.Dequeue();
+      if (!block)
+      {
+         block = new WriterBlock;
+         block->m_fileWriter = this;
+      }
+   }
+   m_stage->m_block = nullptr;
+   block->m_flush = flush;
+   m_stage->m_pending.fetch_add(1, std::memory_order_relaxed);
+   m_stage->m_stage.Submit(block);
 }
 
+// called by the thread writing the file (WriterStage or SyncFlusher)
+void FileWriter::WriteBlockData(WriterBlock& block)
+{
+   if (m_rotation)
+   {
+      RotateIfNeeded(block.m_data.size());
+   }
+   m_file.Write(block.m_data.data(), block.m_data.size());
+   if (m_index)
+   {
+      for (const auto& line : block.m_lines)
+      {
+         m_index->m_index.Add(m_index->m_offset + line.first, line.second);
+      }
+      m_index->m_offset += block.m_data.size();
+   }
+   block.m_lines.clear();
+   OnFileWritten(m_file.GetStream());
+   if (block.m_flush)
+   {
+      FlushFile();
+   }
+   block.m_data.clear();
 }
+
+// called by the WriterStage thread
+void FileWriter::WriteBlock(WriterBlock* block)
+{
+   WriteBlockData(*block);
+   m_stage->m_freeBlocks.Enqueue(block);
+   // IMPORTANT: the FileWriter can be destroyed as soon as m_pending is decremented
+   m_stage->m_pending.fetch_sub(1, std::memory_order_release);
 }
 
+}
+}
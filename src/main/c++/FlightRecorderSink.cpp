@@ -0,0 +1,63 @@
+#include "tbp/log/FlightRecorderSink.h"
+#include <algorithm>
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+// bounded: DumpAll() can be called from a fatal signal handler, maybe by a thread which holds a lock
+constexpr std::size_t DUMP_LOCK_SPINS = 1 << 20;
+
+struct Registry
+{
+   FlightRecorderLock m_lock;
+   std::vector<FlightRecorderEntry*> m_entries;
+};
+
+Registry& GetRegistry()
+{
+   static Registry registry;
+   return registry;
+}
+
+}
+
+void FlightRecorderTrigger::DumpAll(const FlightRecorderEntry* caller)
+{
+   auto& registry = GetRegistry();
+   if (!registry.m_lock.TryLock(DUMP_LOCK_SPINS))
+   {
+      return;
+   }
+   for (FlightRecorderEntry* entry : registry.m_entries)
+   {
+      if (entry != caller && entry->TryLock(DUMP_LOCK_SPINS))
+      {
+         entry->DumpRecords();
+         entry->Unlock();
+      }
+   }
+   registry.m_lock.Unlock();
+}
+
+void FlightRecorderTrigger::Register(FlightRecorderEntry& entry)
+{
+   auto& registry = GetRegistry();
+   FlightRecorderLock::Guard guard(registry.m_lock);
+   registry.m_entries.push_back(&entry);
+}
+
+void FlightRecorderTrigger::Unregister(FlightRecorderEntry& entry)
+{
+   auto& registry = GetRegistry();
+   FlightRecorderLock::Guard guard(registry.m_lock);
+   auto& entries = registry.m_entries;
+   entries.erase(std::remove(entries.begin(), entries.end(), &entry), entries.end());
+}
+
+}
+}
@@ -0,0 +1,77 @@
+#include "tbp/log/FlushPolicy.h"
+#include <algorithm>
+#include <unistd.h>
+
+namespace tbp
+{
+namespace log
+{
+
+GroupCommit::GroupCommit() : m_nbSyncs(0), m_nbErrors(0)
+{
+   m_thread = std::thread([this] { Run(); });
+}
+
+GroupCommit::~GroupCommit()
+{
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+   }
+   m_requested.notify_one();
+   m_thread.join();
+}
+
+std::uint64_t GroupCommit::Request(int fd)
+{
+   std::uint64_t ticket = 0;
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      //
+      if (std::find(m_fds.begin(), m_fds.end(), fd) == m_fds.end())
+      {
+         m_fds.push_back(fd);
+      }
+      ticket = m_nextBatch;
+   }
+   m_requested.notify_one();
+   return ticket;
+}
+
+void GroupCommit::Wait(std::uint64_t ticket)
+{
+   std::unique_lock<std::mutex> lock(m_mutex);
+   m_synced.wait(lock, [this, ticket] { return m_syncedBatch >= ticket; });
+}
+
+void GroupCommit::Run()
+{
+   std::vector<int> fds;
+   std::unique_lock<std::mutex> lock(m_mutex);
+   while (true)
+   {
+      m_requested.wait(lock, [this] { return m_stop || !m_fds.empty(); });
+      if (m_fds.empty())
+      {
+         break;
+      }
+      fds.swap(m_fds);
+      std::uint64_t batch = m_nextBatch++;
+      lock.unlock();
+      for (int fd : fds)
+      {
+         if (::fdatasync(fd) != 0)
+         {
+            m_nbErrors.fetch_add(1, std::memory_order_relaxed);
+         }
+         m_nbSyncs.fetch_add(1, std::memory_order_relaxed);
+      }
+      fds.clear();
+      lock.lock();
+      m_syncedBatch = batch;
+      m_synced.notify_all();
+   }
+}
+
+}
+}
@@ -12,7 +12,12 @@ Injector::~Injector()
 
 std::unique_ptr<FileWriter> Injector::CreateFileWriter(const log::Config& config, common::ThreadId tid) const
 {
-   return std::make_unique<FileWriter>(config, tid);
+   return std::make_unique<FileWriter>(config, tid, m_fileBackend);
+}
+
+std::unique_ptr<FileWriter> Injector::CreateSharedFileWriter(const log::Config& config, const std::string& name) const
+{
+   return std::make_unique<FileWriter>(config, name, m_fileBackend);
 }
 
 }
@@ -0,0 +1,84 @@
+#include "tbp/log/LoadShedder.h"
+#include <algorithm>
+
+namespace tbp
+{
+namespace log
+{
+
+Level LoadShedder::GetLevel(double ratio) const
+{
+   Level level = Level::none;
+   if (ratio >= 4.)
+   {
+      level = Level::error;
+   }
+   else if (ratio >= 2.)
+   {
+      level = Level::warn;
+   }
+   else if (ratio >= 1.)
+   {
+      level = Level::info;
+   }
+   // the messages below the shedding level are dropped
+   Level maxLevel = static_cast<Level>(static_cast<std::uint8_t>(std::min(m_policy.m_maxLevel, Level::warn)) + 1);
+   return std::min(level, maxLevel);
+}
+
+void LoadShedder::Update(std::size_t nbMessages, std::chrono::nanoseconds age)
+{
+   if (!m_policy.IsEnabled())
+   {
+      return;
+   }
+   double ratio = 0.;
+   if (m_policy.m_nbMessages)
+   {
+      ratio = static_cast<double>(nbMessages) / m_policy.m_nbMessages;
+   }
+   if (m_policy.m_age.count())
+   {
+      ratio = std::max(ratio, static_cast<double>(age.count()) / m_policy.m_age.count());
+   }
+   Level current = GetLevel();
+   Level level = GetLevel(ratio);
+   if (level < current && GetLevel(2. * ratio) >= current)
+   {
+      level = current; // hysteresis
+   }
+   if (level != current)
+   {
+      m_level.store(level, std::memory_order_relaxed);
+      m_nbChanges.fetch_add(1, std::memory_order_relaxed);
+   }
+}
+void LoadShedder::Register(ShedCounters& counters) const
+{
+   std::lock_guard<std::mutex> lock(m_countersMutex);
+   m_counters.push_back(&counters);
+}
+
+void LoadShedder::Unregister(ShedCounters& counters) const
+{
+   std::lock_guard<std::mutex> lock(m_countersMutex);
+   m_counters.erase(std::remove(m_counters.begin(), m_counters.end(), &counters), m_counters.end());
+}
+
+void LoadShedder::Collect(common::ThreadId tid, std::vector<std::pair<const Category*, ShedCounters::Counts>>& counts)
+{
+   std::lock_guard<std::mutex> lock(m_countersMutex);
+   for (ShedCounters* counters : m_counters)
+   {
+      if (counters->GetThreadId() == tid)
+      {
+         counters->Collect([&counts](const Category& category, const ShedCounters::Counts& nbShed)
+         {
+            counts.emplace_back(&category, nbShed);
+         });
+      }
+   }
+}
+
+}
+}
@@ -0,0 +1,312 @@
+#include "tbp/log/LogDaemon.h"
+#include "tbp/log/FileWriter.h"
+#include "tbp/log/Injector.h"
+#include "tbp/common/Compiler.h"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <signal.h>
+#include <unistd.h>
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+// scanning the slots is not free, it is only done every SCAN_PERIOD calls to Poll()
+constexpr std::size_t SCAN_PERIOD = 16;
+constexpr std::size_t CHECK_PROCESS_PERIOD = 1024;
+
+bool IsProcessAlive(std::int32_t pid)
+{
+   return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+}
+
+LogDaemon::LogDaemon(const ShmConfig& shmConfig, const Config& config, const Injector& injector)
+   : m_shmConfig(shmConfig), m_config(config), m_injector(injector)
+{
+   m_registry = ShmSegment::OpenOrCreate(m_shmConfig.GetRegistryName(), sizeof(ShmRegistryHeader));
+   GetRegistry().m_daemonPid.store(getpid(), std::memory_order_release);
+   AttachClients();
+   CheckClients(); // the clients which died while no daemon was running
+}
+
+LogDaemon::~LogDaemon()
+{
+   std::int32_t pid = getpid();
+   GetRegistry().m_daemonPid.compare_exchange_strong(pid, 0);
+}
+
+void LogDaemon::AttachClients()
+{
+   auto& registry = GetRegistry();
+   for (std::size_t i = 0; i < SHM_MAX_CLIENTS; ++i)
+   {
+      auto& slot = registry.m_clients[i];
+      auto state = slot.m_state.load(std::memory_order_acquire);
+      if (state != ShmSlotState::READY && state != ShmSlotState::CLOSED)
+      {
+         continue;
+      }
+      auto iter = std::find_if(m_clients.begin(), m_clients.end(), [i](const std::unique_ptr<ClientData>& client)
+      {
+         return client->m_slot == i;
+      });
+      if (iter != m_clients.end())
+      {
+         (*iter)->m_closed |= state == ShmSlotState::CLOSED;
+         continue;
+      }
+      ShmSegment segment = ShmSegment::Open(std::string(slot.m_name, strnlen(slot.m_name, SHM_NAME_SIZE)));
+      if (!segment.IsValid())
+      {
+         continue; // released by CheckClients() if the process is dead
+      }
+      auto client = std::make_unique<ClientData>();
+      client->m_slot = i;
+      client->m_pid = slot.m_pid;
+      client->m_segment = std::move(segment);
+      client->m_closed = state == ShmSlotState::CLOSED;
+      m_clients.emplace_back(std::move(client));
+   }
+}
+
+void LogDaemon::AttachRings(ClientData& client)
+{
+   auto& header = GetHeader(client);
+   for (std::size_t i = 0; i < SHM_MAX_RINGS; ++i)
+   {
+      auto& slot = header.m_rings[i];
+      auto state = slot.m_state.load(std::memory_order_acquire);
+      if (state != ShmSlotState::READY && state != ShmSlotState::CLOSED)
+      {
+         continue;
+      }
+      auto iter = std::find_if(client.m_rings.begin(), client.m_rings.end(), [i](const std::unique_ptr<RingData>& ring)
+      {
+         return ring->m_slot == i;
+      });
+      if (iter != client.m_rings.end())
+      {
+         continue;
+      }
+      ShmSegment segment = ShmSegment::Open(std::string(slot.m_name, strnlen(slot.m_name, SHM_NAME_SIZE)));
+      if (!segment.IsValid())
+      {
+         if (state == ShmSlotState::CLOSED)
+         {
+            slot.m_state.store(ShmSlotState::FREE, std::memory_order_release); // closed before a daemon could attach to it
+         }
+         continue;
+      }
+      auto ring = std::make_unique<RingData>();
+      ring->m_slot = i;
+      ring->m_segment = std::move(segment);
+      ring->m_tid = slot.m_pid;
+      ring->m_fileWriter = m_injector.CreateFileWriter(m_config, ring->m_tid);
+      if (likely(IsValidRing(ring->m_segment)))
+      {
+         ring->m_ring = ShmRing(ring->m_segment.Get());
+      }
+      else
+      {
+         CloseCorrupt(client, *ring);
+      }
+      client.m_rings.emplace_back(std::move(ring));
+   }
+}
+
+void LogDaemon::CheckClients()
+{
+   auto& registry = GetRegistry();
+   for (std::size_t i = 0; i < SHM_MAX_CLIENTS; ++i)
+   {
+      auto& slot = registry.m_clients[i];
+      auto state = slot.m_state.load(std::memory_order_acquire);
+      if (state == ShmSlotState::FREE || state == ShmSlotState::CLAIMED)
+      {
+         continue;
+      }
+      auto iter = std::find_if(m_clients.begin(), m_clients.end(), [i](const std::unique_ptr<ClientData>& client)
+      {
+         return client->m_slot == i;
+      });
+      if (iter != m_clients.end())
+      {
+         // the rings are consumed before the client is detached
+         (*iter)->m_closed = state == ShmSlotState::CLOSED || !IsProcessAlive(slot.m_pid);
+      }
+      else if (state == ShmSlotState::CLOSED || !IsProcessAlive(slot.m_pid))
+      {
+         ShmSegment::Unlink(std::string(slot.m_name, strnlen(slot.m_name, SHM_NAME_SIZE)));
+         slot.m_state.store(ShmSlotState::FREE, std::memory_order_release);
+      }
+   }
+}
+
+void LogDaemon::Detach(ClientData& client)
+{
+   auto& header = GetHeader(client);
+   for (std::size_t i = 0; i < SHM_MAX_RINGS; ++i)
+   {
+      auto& slot = header.m_rings[i];
+      if (slot.m_state.load(std::memory_order_acquire) != ShmSlotState::FREE)
+      {
+         ShmSegment::Unlink(std::string(slot.m_name, strnlen(slot.m_name, SHM_NAME_SIZE))); // the client process may have crashed
+      }
+   }
+   ShmSegment::Unlink(client.m_segment.GetName());
+   GetRegistry().m_clients[client.m_slot].m_state.store(ShmSlotState::FREE, std::memory_order_release);
+}
+
+const char* LogDaemon::GetString(const ClientData& client, ShmDictionaryId id) const
+{
+   const auto& header = GetHeader(client);
+   if (id == SHM_INVALID_ID || id >= header.m_dictionarySize.load(std::memory_order_acquire))
+   {
+      return nullptr; // the client segment is not trusted
+   }
+   return client.m_segment.Get() + ShmClientDictionaryOffset() + id + sizeof(std::uint32_t);
+}
+
+const Category& LogDaemon::GetCategory(ClientData& client, ShmDictionaryId id)
+{
+   auto iter = client.m_categories.find(id);
+   if (likely(iter != client.m_categories.end()))
+   {
+      return iter->second;
+   }
+   const char* label = GetString(client, id);
+   return client.m_categories.emplace(id, Category(label ? label : "unknown", Level::none)).first->second;
+}
+
+bool LogDaemon::IsValidRing(const ShmSegment& segment)
+{
+   if (segment.GetSize() < ShmRingDataOffset())
+   {
+      return false;
+   }
+   std::uint64_t capacity = reinterpret_cast<const ShmRingHeader*>(segment.Get())->m_capacity;
+   return capacity >= sizeof(ShmRecord) && (capacity & (capacity - 1)) == 0 && ShmRing::GetSegmentSize(capacity) <= segment.GetSize();
+}
+
+void LogDaemon::CloseCorrupt(ClientData& client, RingData& data)
+{
+   data.m_corrupt = true;
+   timespec now;
+   ::clock_gettime(CLOCK_REALTIME, &now);
+   auto& fileWriter = *data.m_fileWriter.get();
+   fileWriter.WriteHeader(now, data.m_tid, Level::error, GetCategory(client, SHM_INVALID_ID));
+   fileWriter.GetWriter() << "[tbp-log corrupt ring, the next records are not read]";
+   fileWriter.WriteToFile();
+   fileWriter.Flush();
+}
+
+std::size_t LogDaemon::Drain(ClientData& client, RingData& data)
+{
+   if (unlikely(data.m_corrupt))
+   {
+      return 0;
+   }
+   std::size_t count = 0;
+   auto& ring = data.m_ring;
+   auto& fileWriter = *data.m_fileWriter.get();
+   auto& writer = fileWriter.GetWriter();
+   ShmDictionaryId overflowId = GetHeader(client).m_overflowId;
+   while (const ShmRecord* record = ring.Peek())
+   {
+      timespec time;
+      time.tv_sec = record->m_sec;
+      time.tv_nsec = record->m_nsec;
+      fileWriter.WriteHeader(time, data.m_tid, record->m_level, GetCategory(client, record->m_category));
+      const char* fmt = GetString(client, record->m_fmt);
+      if (likely(fmt && record->m_fmt != overflowId))
+      {
+         // the ring memory is only read by the Decoder
+         char* fields = record->m_size > sizeof(ShmRecord) ? const_cast<char*>(reinterpret_cast<const char*>(record + 1)) : nullptr;
+         Buffer<Allocator> buffer(fields);
+         m_formatter.Format(fmt, buffer, writer);
+      }
+      else
+      {
+         writer << fmt::StringRef(fmt ? fmt : "[tbp-log unknown format]");
+      }
+      fileWriter.WriteToFile();
+      fileWriter.FlushIfNeeded(record->m_level);
+      //
+      ring.Release(record);
+      ++count;
+   }
+   if (count)
+   {
+      ring.Publish();
+   }
+   if (unlikely(ring.IsCorrupt()))
+   {
+      CloseCorrupt(client, data);
+   }
+   fileWriter.FlushAfterDrain();
+   return count;
+}
+
+std::size_t LogDaemon::Poll()
+{
+   bool scan = m_nbPolls % SCAN_PERIOD == 0;
+   if (unlikely(m_nbPolls % CHECK_PROCESS_PERIOD == 0))
+   {
+      CheckClients();
+   }
+   ++m_nbPolls;
+   if (unlikely(scan))
+   {
+      AttachClients();
+   }
+   //
+   std::size_t count = 0;
+   for (auto& client : m_clients)
+   {
+      if (unlikely(scan || client->m_closed))
+      {
+         AttachRings(*client);
+      }
+      auto& header = GetHeader(*client);
+      auto& rings = client->m_rings;
+      for (auto& ring : rings)
+      {
+         count += Drain(*client, *ring);
+      }
+      // the rings closed by the client are released once consumed: the ring is not written anymore once the slot is CLOSED
+      rings.erase(std::remove_if(rings.begin(), rings.end(), [&header, &client, this](const std::unique_ptr<RingData>& ring)
+      {
+         auto& slot = header.m_rings[ring->m_slot];
+         if (slot.m_state.load(std::memory_order_acquire) != ShmSlotState::CLOSED && !client->m_closed)
+         {
+            return false;
+         }
+         Drain(*client, *ring);
+         ShmSegment::Unlink(ring->m_segment.GetName()); // the client never unlinks its rings
+         slot.m_state.store(ShmSlotState::FREE, std::memory_order_release);
+         return true;
+      }), rings.end());
+   }
+   //
+   auto end = std::remove_if(m_clients.begin(), m_clients.end(), [this](const std::unique_ptr<ClientData>& client)
+   {
+      if (!client->m_closed)
+      {
+         return false;
+      }
+      Detach(*client);
+      return true;
+   });
+   m_clients.erase(end, m_clients.end());
+   return count;
+}
+
+}
+}
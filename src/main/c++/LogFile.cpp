@@ -0,0 +1,197 @@
+#include "tbp/log/LogFile.h"
+#include "tbp/common/ConfigurationException.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace tbp
+{
+namespace log
+{
+
+RawFileBuf::RawFileBuf(FileBackend backend, std::size_t bufferSize)
+   : m_backend(backend), m_bufferSize((bufferSize + ALIGN - 1) & ~(ALIGN - 1))
+{
+   void* buffer = nullptr;
+   if (posix_memalign(&buffer, ALIGN, m_bufferSize) != 0)
+   {
+      throw common::ConfigurationException("RawFileBuf cannot allocate its buffer");
+   }
+   m_buffer.reset(static_cast<char*>(buffer));
+   setp(m_buffer.get(), m_buffer.get() + m_bufferSize);
+}
+
+RawFileBuf::~RawFileBuf()
+{
+   Close();
+}
+
+bool RawFileBuf::Open(const std::string& path)
+{
+   int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+   if (m_backend == FileBackend::direct)
+   {
+      m_fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+      m_direct = m_fd >= 0;
+   }
+   if (m_fd < 0)
+   {
+      // O_DIRECT not supported by the file system (tmpfs, ...)
+      m_fd = ::open(path.c_str(), flags, 0644);
+   }
+   return m_fd >= 0;
+}
+
+void RawFileBuf::Close()
+{
+   if (m_fd < 0)
+   {
+      return;
+   }
+   sync();
+   if (m_direct && m_tailWritten)
+   {
+      // the padding of the last partial block
+      ::ftruncate(m_fd, m_offset + static_cast<off_t>(m_tailWritten));
+   }
+   Advise(true);
+   ::close(m_fd);
+   m_fd = -1;
+}
+
+bool RawFileBuf::WriteAll(const char* data, std::size_t size, off_t offset)
+{
+   while (size)
+   {
+      ssize_t res = ::pwrite(m_fd, data, size, offset);
+      if (res < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         return false;
+      }
+      data += res;
+      size -= res;
+      offset += res;
+   }
+   return true;
+}
+
+// the buffer is full: its size and the file offset are aligned
+bool RawFileBuf::WriteBuffer()
+{
+   std::size_t size = pptr() - pbase();
+   bool res = WriteAll(pbase(), size, m_offset);
+   m_offset += size;
+   m_tailWritten = 0;
+   setp(m_buffer.get(), m_buffer.get() + m_bufferSize);
+   Advise(false);
+   return res;
+}
+
+RawFileBuf::int_type RawFileBuf::overflow(int_type c)
+{
+   if (m_fd < 0 || !WriteBuffer())
+   {
+      return traits_type::eof();
+   }
+   if (!traits_type::eq_int_type(c, traits_type::eof()))
+   {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+   }
+   return traits_type::not_eof(c);
+}
+
+int RawFileBuf::sync()
+{
+   if (m_fd < 0)
+   {
+      return -1;
+   }
+   std::size_t size = pptr() - pbase();
+   if (!m_direct)
+   {
+      if (!size)
+      {
+         return 0;
+      }
+      return WriteBuffer() ? 0 : -1;
+   }
+   if (size == m_tailWritten)
+   {
+      return 0;
+   }
+   // O_DIRECT: the last partial block is padded, the padding is removed by Close()
+   std::size_t full = size & ~(ALIGN - 1);
+   std::size_t tail = size - full;
+   std::size_t padded = (size + ALIGN - 1) & ~(ALIGN - 1);
+   std::memset(pbase() + size, 0, padded - size);
+   bool res = WriteAll(pbase(), padded, m_offset);
+   if (tail)
+   {
+      std::memmove(m_buffer.get(), pbase() + full, tail);
+   }
+   m_offset += full;
+   m_tailWritten = tail;
+   setp(m_buffer.get(), m_buffer.get() + m_bufferSize);
+   pbump(static_cast<int>(tail));
+   return res ? 0 : -1;
+}
+
+void RawFileBuf::Advise(bool all)
+{
+   if (m_direct)
+   {
+      return;
+   }
+   // start the writeback of the new lines
+   if (m_offset > m_started)
+   {
+      ::sync_file_range(m_fd, m_started, m_offset - m_started, SYNC_FILE_RANGE_WRITE);
+      m_started = m_offset;
+   }
+   // drop the ranges written back, one chunk is kept between the dropped range and the end of the file
+   off_t end = all ? m_offset : m_offset - static_cast<off_t>(ADVISE_CHUNK);
+   if (end - m_dropped >= static_cast<off_t>(all ? 1 : ADVISE_CHUNK))
+   {
+      ::sync_file_range(m_fd, m_dropped, end - m_dropped, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+      ::posix_fadvise(m_fd, m_dropped, end - m_dropped, POSIX_FADV_DONTNEED);
+      m_dropped = end;
+   }
+}
+
+bool LogFile::Open(const std::string& path, FileBackend backend)
+{
+   if (backend == FileBackend::stream)
+   {
+      m_stream->open(path);
+      return m_stream->is_open();
+   }
+   m_buf = std::make_unique<RawFileBuf>(backend);
+   if (!m_buf->Open(path))
+   {
+      m_buf.reset();
+      return false;
+   }
+   static_cast<std::ostream&>(*m_stream).rdbuf(m_buf.get());
+   return true;
+}
+
+void LogFile::Close()
+{
+   if (m_buf)
+   {
+      m_buf->Close();
+   }
+   else if (m_stream && m_stream->is_open())
+   {
+      m_stream->close();
+   }
+}
+
+}
+}
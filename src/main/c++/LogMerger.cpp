@@ -0,0 +1,469 @@
+#include "tbp/log/LogMerger.h"
+#include "tbp/common/ConfigurationException.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+constexpr std::uint64_t NANOS_PER_SEC = 1000000000ULL;
+constexpr std::uint64_t NANOS_PER_DAY = 86400ULL * NANOS_PER_SEC;
+constexpr std::uint64_t HALF_DAY = NANOS_PER_DAY / 2;
+
+inline bool IsDigit(char c)
+{
+   return static_cast<unsigned char>(c - '0') <= 9;
+}
+
+inline unsigned Digit(char c)
+{
+   return static_cast<unsigned>(c - '0');
+}
+
+bool ParseTimeScalar(const char* p, std::uint64_t& nanosOfDay)
+{
+   static const char pattern[] = "[dd:dd:dd.ddddddddd]";
+   for (std::size_t i = 0; i < LogMerger::HEADER_SIZE; ++i)
+   {
+      if (pattern[i] == 'd' ? !IsDigit(p[i]) : p[i] != pattern[i])
+      {
+         return false;
+      }
+   }
+   unsigned hours = Digit(p[1]) * 10 + Digit(p[2]);
+   unsigned minutes = Digit(p[4]) * 10 + Digit(p[5]);
+   unsigned seconds = Digit(p[7]) * 10 + Digit(p[8]);
+   std::uint64_t nanos = 0;
+   for (std::size_t i = 10; i < 19; ++i)
+   {
+      nanos = nanos * 10 + Digit(p[i]);
+   }
+   if (hours >= 24 || minutes >= 60 || seconds >= 60)
+   {
+      return false;
+   }
+   nanosOfDay = ((hours * 60 + minutes) * 60 + seconds) * NANOS_PER_SEC + nanos;
+   return true;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/*
+- the 16 bytes after [HH are checked and converted at once: :MM:SS.nnnnnnnnn
+- the digits are shuffled to [M M S S 0 0 0 n | n n n n n n n n], then multiplied/added by pairs:
+(10, 1) -> [MM SS 0 n nn nn nn nn], then (60, 1) (0, 1) (100, 1) (100, 1) -> [MM * 60 + SS, n, nnnn, nnnn]
+*/
+__attribute__((target("ssse3"))) bool ParseTimeSsse3(const char* p, std::uint64_t& nanosOfDay)
+{
+   if (p[0] != '[' || !IsDigit(p[1]) || !IsDigit(p[2]) || p[19] != ']')
+   {
+      return false;
+   }
+   const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 3));
+   const __m128i sepMask = _mm_setr_epi8(-1, 0, 0, -1, 0, 0, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+   const __m128i seps = _mm_setr_epi8(':', 0, 0, ':', 0, 0, '.', 0, 0, 0, 0, 0, 0, 0, 0, 0);
+   const __m128i nine = _mm_set1_epi8(9);
+   __m128i digits = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+   __m128i isDigit = _mm_cmpeq_epi8(_mm_max_epu8(digits, nine), nine);
+   __m128i isSep = _mm_cmpeq_epi8(v, seps);
+   __m128i ok = _mm_or_si128(_mm_and_si128(sepMask, isSep), _mm_andnot_si128(sepMask, isDigit));
+   if (_mm_movemask_epi8(ok) != 0xFFFF)
+   {
+      return false;
+   }
+   digits = _mm_shuffle_epi8(digits, _mm_setr_epi8(1, 2, 4, 5, -128, -128, -128, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+   __m128i pairs = _mm_maddubs_epi16(digits, _mm_set1_epi16(0x010A));
+   __m128i values = _mm_madd_epi16(pairs, _mm_setr_epi16(60, 1, 0, 1, 100, 1, 100, 1));
+   alignas(16) std::uint32_t parts[4];
+   _mm_store_si128(reinterpret_cast<__m128i*>(parts), values);
+   unsigned hours = Digit(p[1]) * 10 + Digit(p[2]);
+   unsigned minutes = Digit(p[4]);
+   unsigned seconds = Digit(p[7]);
+   if (hours >= 24 || minutes >= 6 || seconds >= 6)
+   {
+      return false;
+   }
+   nanosOfDay = (hours * 3600ULL + parts[0]) * NANOS_PER_SEC + parts[1] * 100000000ULL + parts[2] * 10000ULL + parts[3];
+   return true;
+}
+#endif
+
+using ParseFunc = bool (*)(const char*, std::uint64_t&);
+
+ParseFunc SelectParseTime()
+{
+#if defined(__x86_64__) || defined(__i386__)
+   if (__builtin_cpu_supports("ssse3"))
+   {
+      return ParseTimeSsse3;
+   }
+#endif
+   return ParseTimeScalar;
+}
+
+const ParseFunc g_parseTime = SelectParseTime();
+
+// days since 1970-01-01 of a civil date (H. Hinnant)
+std::int64_t DaysFromCivil(std::int64_t y, unsigned m, unsigned d)
+{
+   y -= m <= 2;
+   const std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+   const unsigned yoe = static_cast<unsigned>(y - era * 400);
+   const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+   const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+   return era * 146097 + static_cast<std::int64_t>(doe) - 719468;
+}
+
+// <prefix>_<YYYYmmdd-HHMMSS>-<suffix>: start of the file in local time (nanoseconds since 1970-01-01), 0 if not found
+std::uint64_t ParseFileStart(const std::string& name)
+{
+   static const char pattern[] = "_dddddddd-dddddd-";
+   const std::size_t size = sizeof(pattern) - 1;
+   for (std::size_t pos = name.size() >= size ? name.size() - size + 1 : 0; pos-- > 0;)
+   {
+      bool match = true;
+      for (std::size_t i = 0; i < size && match; ++i)
+      {
+         match = pattern[i] == 'd' ? IsDigit(name[pos + i]) : name[pos + i] == pattern[i];
+      }
+      if (match)
+      {
+         const char* p = name.c_str() + pos + 1;
+         auto number = [p](std::size_t first, std::size_t count)
+         {
+            unsigned res = 0;
+            for (std::size_t i = first; i < first + count; ++i)
+            {
+               res = res * 10 + Digit(p[i]);
+            }
+            return res;
+         };
+         std::int64_t days = DaysFromCivil(number(0, 4), number(4, 2), number(6, 2));
+         std::uint64_t seconds = number(9, 2) * 3600 + number(11, 2) * 60 + number(13, 2);
+         return days > 0 ? static_cast<std::uint64_t>(days) * NANOS_PER_DAY + seconds * NANOS_PER_SEC : 0;
+      }
+   }
+   return 0;
+}
+
+// <base>.<n>.log -> (<base>.log, n)
+std::pair<std::string, std::size_t> SplitRotationIndex(const std::string& path)
+{
+   static const std::string ext = ".log";
+   if (path.size() <= ext.size() || path.compare(path.size() - ext.size(), ext.size(), ext) != 0)
+   {
+      return std::make_pair(path, 0);
+   }
+   std::size_t end = path.size() - ext.size();
+   std::size_t dot = path.rfind('.', end - 1);
+   if (dot == std::string::npos || dot + 1 == end || !std::all_of(path.begin() + dot + 1, path.begin() + end, IsDigit))
+   {
+      return std::make_pair(path, 0);
+   }
+   return std::make_pair(path.substr(0, dot) + ext, std::stoul(path.substr(dot + 1, end - dot - 1)));
+}
+
+class MappedFile
+{
+public:
+   MappedFile(const std::string& path, bool write, std::size_t size);
+   ~MappedFile();
+   MappedFile(const MappedFile&) = delete;
+   MappedFile& operator=(const MappedFile&) = delete;
+   //
+   char* GetData() const { return m_data; }
+   std::size_t GetSize() const { return m_size; }
+
+private:
+   int m_fd = -1;
+   char* m_data = nullptr;
+   std::size_t m_size = 0;
+};
+
+MappedFile::MappedFile(const std::string& path, bool write, std::size_t size)
+{
+   m_fd = write ? ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+   if (m_fd < 0)
+   {
+      throw common::ConfigurationException("LogMerger cannot open file[" + path + "]");
+   }
+   if (write)
+   {
+      if (::ftruncate(m_fd, static_cast<off_t>(size)) != 0)
+      {
+         ::close(m_fd);
+         throw common::ConfigurationException("LogMerger cannot resize file[" + path + "]");
+      }
+      m_size = size;
+   }
+   else
+   {
+      struct stat st;
+      if (::fstat(m_fd, &st) != 0)
+      {
+         ::close(m_fd);
+         throw common::ConfigurationException("LogMerger cannot stat file[" + path + "]");
+      }
+      m_size = static_cast<std::size_t>(st.st_size);
+   }
+   if (m_size)
+   {
+      void* data = ::mmap(nullptr, m_size, write ? PROT_READ | PROT_WRITE : PROT_READ, write ? MAP_SHARED : MAP_PRIVATE, m_fd, 0);
+      if (data == MAP_FAILED)
+      {
+         ::close(m_fd);
+         throw common::ConfigurationException("LogMerger cannot map file[" + path + "]");
+      }
+      m_data = static_cast<char*>(data);
+      ::madvise(m_data, m_size, MADV_SEQUENTIAL);
+   }
+}
+
+MappedFile::~MappedFile()
+{
+   if (m_data)
+   {
+      ::munmap(m_data, m_size);
+   }
+   ::close(m_fd);
+}
+
+// run func(index) for index in [0, count) on 'nbThreads' threads
+void ParallelFor(std::size_t count, std::size_t nbThreads, const std::function<void(std::size_t)>& func)
+{
+   std::atomic<std::size_t> next(0);
+   auto run = [&]
+   {
+      for (std::size_t i = next++; i < count; i = next++)
+      {
+         func(i);
+      }
+   };
+   std::vector<std::thread> threads;
+   for (std::size_t i = 1; i < std::min(count, nbThreads); ++i)
+   {
+      threads.emplace_back(run);
+   }
+   run();
+   for (auto& thread : threads)
+   {
+      thread.join();
+   }
+}
+
+}
+
+struct LogMerger::Input
+{
+   explicit Input(const std::string& path) : m_path(path), m_file(path, false, 0) {}
+   //
+   std::string m_path;
+   MappedFile m_file;
+};
+
+// the files of a thread: the first file and its rotated files
+struct LogMerger::Stream
+{
+   std::vector<std::pair<std::size_t, std::unique_ptr<Input>>> m_inputs; // rotation index, file
+   std::uint64_t m_start = 0; // cf ParseFileStart
+   std::vector<Record> m_records;
+   std::vector<std::uint64_t> m_offsets; // output offset of each record relative to the stream, and total size at the end
+};
+
+LogMerger::LogMerger(std::size_t nbThreads) : m_nbThreads(std::max<std::size_t>(nbThreads, 1))
+{
+}
+
+bool LogMerger::ParseTime(const char* line, std::size_t size, std::uint64_t& nanosOfDay)
+{
+   return size >= HEADER_SIZE && g_parseTime(line, nanosOfDay);
+}
+
+void LogMerger::Index(Stream& stream)
+{
+   std::sort(stream.m_inputs.begin(), stream.m_inputs.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+   stream.m_start = ParseFileStart(stream.m_inputs.front().second->m_path);
+   std::uint64_t day = stream.m_start / NANOS_PER_DAY * NANOS_PER_DAY;
+   std::uint64_t prev = stream.m_start % NANOS_PER_DAY;
+   bool first = !stream.m_start;
+   auto& records = stream.m_records;
+   for (const auto& input : stream.m_inputs)
+   {
+      const char* data = input.second->m_file.GetData();
+      const char* end = data + input.second->m_file.GetSize();
+      // the first lines of a file are not appended to the last record of the previous file
+      const std::size_t firstRecord = records.size();
+      while (data != end)
+      {
+         const char* eol = static_cast<const char*>(std::memchr(data, '\n', end - data));
+         const char* next = eol ? eol + 1 : end;
+         std::size_t size = static_cast<std::size_t>(next - data) + (eol ? 0 : 1);
+         std::uint64_t time = 0;
+         if (ParseTime(data, next - data, time))
+         {
+            if (first)
+            {
+               prev = time;
+               first = false;
+            }
+            if (time + HALF_DAY < prev)
+            {
+               day += NANOS_PER_DAY;
+            }
+            prev = time;
+            records.push_back(Record{ day + time, data, size });
+         }
+         else if (records.size() == firstRecord)
+         {
+            records.push_back(Record{ day + prev, data, size });
+         }
+         else
+         {
+            records.back().m_size += size;
+         }
+         data = next;
+      }
+   }
+   if (!std::is_sorted(records.begin(), records.end(), [](const Record& lhs, const Record& rhs) { return lhs.m_key < rhs.m_key; }))
+   {
+      // a file shared by several threads (cf Config::GetMaxFileWriters)
+      std::stable_sort(records.begin(), records.end(), [](const Record& lhs, const Record& rhs) { return lhs.m_key < rhs.m_key; });
+   }
+}
+
+std::size_t LogMerger::Merge(const std::vector<std::string>& inputs, const std::string& output)
+{
+   // the rotated files are read after the file they follow
+   std::vector<Stream> streams;
+   std::map<std::string, std::size_t> streamIndexes;
+   for (const auto& path : inputs)
+   {
+      auto split = SplitRotationIndex(path);
+      auto iter = streamIndexes.emplace(split.first, streams.size()).first;
+      if (iter->second == streams.size())
+      {
+         streams.emplace_back();
+      }
+      streams[iter->second].m_inputs.emplace_back(split.second, std::make_unique<Input>(path));
+   }
+   ParallelFor(streams.size(), m_nbThreads, [this, &streams](std::size_t i) { Index(streams[i]); });
+   //
+   // chunks of keys: the keys are sampled in each stream, the same key is always in the same chunk
+   std::size_t nbRecords = 0;
+   std::vector<std::uint64_t> samples;
+   for (auto& stream : streams)
+   {
+      nbRecords += stream.m_records.size();
+      std::size_t step = std::max<std::size_t>(stream.m_records.size() / 64, 1);
+      for (std::size_t i = 0; i < stream.m_records.size(); i += step)
+      {
+         samples.push_back(stream.m_records[i].m_key);
+      }
+   }
+   std::sort(samples.begin(), samples.end());
+   std::size_t nbChunks = std::min(m_nbThreads * 4, std::max<std::size_t>(samples.size(), 1));
+   std::vector<std::uint64_t> splits; // chunk i: [splits[i], splits[i + 1])
+   splits.push_back(0);
+   for (std::size_t i = 1; i < nbChunks; ++i)
+   {
+      std::uint64_t split = samples[i * samples.size() / nbChunks];
+      if (split > splits.back())
+      {
+         splits.push_back(split);
+      }
+   }
+   splits.push_back(std::numeric_limits<std::uint64_t>::max());
+   nbChunks = splits.size() - 1;
+   //
+   // range of records of each stream in each chunk, and output offset of each chunk
+   std::vector<std::vector<std::size_t>> bounds(streams.size()); // bounds[stream][chunk]: first record
+   std::vector<std::uint64_t> chunkOffsets(nbChunks + 1, 0);
+   for (std::size_t s = 0; s < streams.size(); ++s)
+   {
+      auto& stream = streams[s];
+      auto& offsets = stream.m_offsets;
+      offsets.resize(stream.m_records.size() + 1, 0);
+      for (std::size_t i = 0; i < stream.m_records.size(); ++i)
+      {
+         offsets[i + 1] = offsets[i] + stream.m_records[i].m_size;
+      }
+      for (std::size_t c = 0; c <= nbChunks; ++c)
+      {
+         auto iter = std::lower_bound(stream.m_records.begin(), stream.m_records.end(), splits[c],
+               [](const Record& record, std::uint64_t key) { return record.m_key < key; });
+         bounds[s].push_back(c == nbChunks ? stream.m_records.size() : iter - stream.m_records.begin());
+      }
+      for (std::size_t c = 0; c < nbChunks; ++c)
+      {
+         chunkOffsets[c + 1] += offsets[bounds[s][c + 1]] - offsets[bounds[s][c]];
+      }
+   }
+   for (std::size_t c = 0; c < nbChunks; ++c)
+   {
+      chunkOffsets[c + 1] += chunkOffsets[c];
+   }
+   //
+   MappedFile out(output, true, chunkOffsets[nbChunks]);
+   ParallelFor(nbChunks, m_nbThreads, [&](std::size_t c)
+   {
+      // k-way merge, the order of the streams breaks the ties
+      using Head = std::pair<std::uint64_t, std::size_t>;
+      std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heap;
+      std::vector<std::size_t> positions(streams.size());
+      for (std::size_t s = 0; s < streams.size(); ++s)
+      {
+         positions[s] = bounds[s][c];
+         if (positions[s] < bounds[s][c + 1])
+         {
+            heap.emplace(streams[s].m_records[positions[s]].m_key, s);
+         }
+      }
+      char* dest = out.GetData() + chunkOffsets[c];
+      while (!heap.empty())
+      {
+         std::size_t s = heap.top().second;
+         heap.pop();
+         const auto& records = streams[s].m_records;
+         std::size_t end = bounds[s][c + 1];
+         std::size_t& pos = positions[s];
+         std::uint64_t key = records[pos].m_key;
+         // (key, s) is the smallest head: the records of the stream with the same key are copied in a row
+         do
+         {
+            const Record& record = records[pos];
+            std::memcpy(dest, record.m_data, record.m_size - 1);
+            dest[record.m_size - 1] = '\n';
+            dest += record.m_size;
+            ++pos;
+         }
+         while (pos < end && records[pos].m_key == key);
+         if (pos < end)
+         {
+            heap.emplace(records[pos].m_key, s);
+         }
+      }
+   });
+   return nbRecords;
+}
+
+}
+}
@@ -12,43 +12,215 @@ namespace log
 {
 
 Loggers::Loggers(const Categories& categories, const Config& config, const Injector& injector)
-   : m_categories(categories), m_config(config), m_injector(injector)
+   : m_snapshot(nullptr), m_categories(categories), m_config(config), m_injector(injector), m_loadShedder(config.GetLoadShedPolicy())
 {
-   m_categories.ForEach([this](CategoryId id, const Category& category)
+   auto snapshot = new LevelSnapshot;
+   m_categories.ForEach([snapshot](CategoryId id, const Category& category)
    {
-      m_levels.emplace(id, category.GetInitialLevel());
+      snapshot->m_levels.emplace(id, category.GetInitialLevel());
    });
+   m_snapshot.store(snapshot);
+}
+
+Loggers::~Loggers()
+{
+   Chunk* chunk = m_head.m_next.load();
+   while (chunk)
+   {
+      Chunk* next = chunk->m_next.load();
+      delete chunk;
+      chunk = next;
+   }
+   delete m_snapshot.load();
+}
+
+template <typename FUNC>
+void Loggers::ForEachLogger(FUNC func)
+{
+   EpochGuard guard(m_epoch);
+   for (Chunk* chunk = &m_head; chunk; chunk = chunk->m_next.load())
+   {
+      for (auto& slot : chunk->m_slots)
+      {
+         ILogger* logger = slot.load();
+         if (logger)
+         {
+            func(*logger);
+         }
+      }
+   }
+}
+
+void Loggers::ClaimSlot(ILogger& logger)
+{
+   Chunk* chunk = &m_head;
+   while (true)
+   {
+      for (auto& slot : chunk->m_slots)
+      {
+         ILogger* expected = nullptr;
+         if (slot.load() == nullptr && slot.compare_exchange_strong(expected, &logger))
+         {
+            return;
+         }
+      }
+      Chunk* next = chunk->m_next.load();
+      if (!next)
+      {
+         auto newChunk = new Chunk;
+         if (chunk->m_next.compare_exchange_strong(next, newChunk))
+         {
+            next = newChunk;
+         }
+         else
+         {
+            delete newChunk; // another thread added a chunk, 'next' is updated by the CAS
+         }
+      }
+      chunk = next;
+   }
+}
+
+bool Loggers::ReleaseSlot(const ILogger& logger)
+{
+   for (Chunk* chunk = &m_head; chunk; chunk = chunk->m_next.load())
+   {
+      for (auto& slot : chunk->m_slots)
+      {
+         ILogger* expected = const_cast<ILogger*>(&logger);
+         if (slot.load() == expected && slot.compare_exchange_strong(expected, nullptr))
+         {
+            // the readers (level changes, AddLogger) which can still use the logger must be done before the logger is destroyed
+            m_epoch.Synchronize();
+            return true;
+         }
+      }
+   }
+   return false;
 }
 
 void Loggers::AddLogger(ILogger& logger)
 {
-   std::lock_guard<std::mutex> lock(m_mutex);
+   ClaimSlot(logger);
    //
    const string& loggerName = logger.GetName();
-   auto iter = m_loggers.find(loggerName);
-   if (iter != m_loggers.end())
+   bool duplicate = false;
+   ForEachLogger([&logger, &loggerName, &duplicate](const ILogger& other)
+   {
+      duplicate |= &other != &logger && other.GetName() == loggerName;
+   });
+   if (duplicate)
    {
+      /*
+      if 2 loggers with the same name are added at the same time, both calls can throw
+      it is a configuration error anyway
+      */
+      ReleaseSlot(logger);
       std::ostringstream oss;
       oss << "Loggers::CreateThreadLocalLogger Logger with name[" << loggerName << "] already exists";
       throw common::ConfigurationException(oss.str());
    }
-   for (const auto& p : m_levels)
+   /*
+   the slot is visible before the levels are applied: a concurrent level change either sees the slot, or publishes its snapshot before it is read below
+   the levels are applied again if a new snapshot has been published in the meantime
+   */
+   EpochGuard guard(m_epoch);
+   const LevelSnapshot* snapshot = m_snapshot.load();
+   while (true)
    {
-      logger.SetLevel(p.first, p.second);
+      ApplyLevels(*snapshot, logger);
+      const LevelSnapshot* current = m_snapshot.load();
+      if (current == snapshot)
+      {
+         break;
+      }
+      snapshot = current;
    }
-   m_loggers.emplace(loggerName, &logger);
 }
 
 bool Loggers::RemoveLogger(const ILogger& logger)
 {
-   std::lock_guard<std::mutex> lock(m_mutex);
-   //
-   auto count = m_loggers.erase(logger.GetName());
-   assert(count == 1);
-   return count == 1 ? true : false;
+   bool res = ReleaseSlot(logger);
+   assert(res);
+   if (res)
+   {
+      ResetExitedThreadLevels(logger.GetThreadId());
+   }
+   return res;
 }
 
-bool Loggers::SetLevelImpl(const Category& category, Level level)
+void Loggers::ResetExitedThreadLevels(common::ThreadId tid)
+{
+   {
+      // most threads have no override: no lock
+      EpochGuard guard(m_epoch);
+      const LevelSnapshot* snapshot = m_snapshot.load();
+      if (snapshot->m_threadLevels.find(tid) == snapshot->m_threadLevels.end())
+      {
+         return;
+      }
+   }
+   bool used = false;
+   ForEachLogger([tid, &used](const ILogger& other)
+   {
+      used |= other.GetThreadId() == tid;
+   });
+   if (!used)
+   {
+      ResetThreadLevels(tid);
+   }
+}
+
+template <typename FUNC>
+void Loggers::Publish(FUNC modify)
+{
+   const LevelSnapshot* previous = m_snapshot.load();
+   auto snapshot = new LevelSnapshot(*previous);
+   modify(*snapshot);
+   m_snapshot.store(snapshot);
+   // the loggers are updated after the snapshot is published (cf AddLogger)
+   ForEachLogger([snapshot](ILogger& logger)
+   {
+      ApplyLevels(*snapshot, logger);
+   });
+   m_epoch.Synchronize();
+   delete previous;
+}
+
+Level Loggers::GetLevel(const LevelSnapshot& snapshot, const ILogger& logger, CategoryId id)
+{
+   auto threadIter = snapshot.m_threadLevels.find(logger.GetThreadId());
+   if (threadIter != snapshot.m_threadLevels.end())
+   {
+      auto iter = threadIter->second.find(id);
+      if (iter != threadIter->second.end())
+      {
+         return iter->second;
+      }
+   }
+   auto loggerIter = snapshot.m_loggerLevels.find(logger.GetName());
+   if (loggerIter != snapshot.m_loggerLevels.end())
+   {
+      auto iter = loggerIter->second.find(id);
+      if (iter != loggerIter->second.end())
+      {
+         return iter->second;
+      }
+   }
+   auto iter = snapshot.m_levels.find(id);
+   assert(iter != snapshot.m_levels.end());
+   return iter->second;
+}
+
+void Loggers::ApplyLevels(const LevelSnapshot& snapshot, ILogger& logger)
+{
+   for (const auto& p : snapshot.m_levels)
+   {
+      logger.SetLevel(p.first, GetLevel(snapshot, logger, p.first)); // std::atomic
+   }
+}
+
+bool Loggers::SetLevelImpl(LevelSnapshot& snapshot, const Category& category, Level level)
 {
    CategoryId id = m_categories.FindCategoryId(category);
    if (id <= 0)
@@ -56,17 +228,13 @@ bool Loggers::SetLevelImpl(const Category& category, Level level)
       assert(false);
       return false;
    }
-   auto iter = m_levels.find(id);
-   if (iter == m_levels.end())
+   auto iter = snapshot.m_levels.find(id);
+   if (iter == snapshot.m_levels.end())
    {
       assert(false);
       return false;
    }
    iter->second = level;
-   for (auto& p : m_loggers)
-   {
-      p.second->SetLevel(id, level); // std::atomic
-   }
    return true;
 }
 
@@ -74,7 +242,12 @@ bool Loggers::SetLevel(const Category& category, Level level)
 {
    std::lock_guard<std::mutex> lock(m_mutex);
    //
-   return SetLevelImpl(category, level);
+   bool res = true;
+   Publish([this, &res, &category, level](LevelSnapshot& snapshot)
+   {
+      res = SetLevelImpl(snapshot, category, level);
+   });
+   return res;
 }
 
 bool Loggers::SetLevels(Level level)
@@ -82,13 +255,69 @@ bool Loggers::SetLevels(Level level)
    std::lock_guard<std::mutex> lock(m_mutex);
    //
    bool res = true;
-   m_categories.ForEach([this, &res, level](CategoryId /*id*/, const Category& category)
+   Publish([this, &res, level](LevelSnapshot& snapshot)
    {
-      res &= SetLevelImpl(category, level);
+      m_categories.ForEach([this, &res, &snapshot, level](CategoryId /*id*/, const Category& category)
+      {
+         res &= SetLevelImpl(snapshot, category, level);
+      });
    });
    return res;
 }
 
+bool Loggers::SetLoggerLevel(const string& loggerName, const Category& category, Level level)
+{
+   CategoryId id = m_categories.FindCategoryId(category);
+   if (id <= 0)
+   {
+      assert(false);
+      return false;
+   }
+   std::lock_guard<std::mutex> lock(m_mutex);
+   //
+   Publish([&loggerName, id, level](LevelSnapshot& snapshot)
+   {
+      snapshot.m_loggerLevels[loggerName][id] = level;
+   });
+   return true;
+}
+
+bool Loggers::SetThreadLevel(common::ThreadId tid, const Category& category, Level level)
+{
+   CategoryId id = m_categories.FindCategoryId(category);
+   if (id <= 0)
+   {
+      assert(false);
+      return false;
+   }
+   std::lock_guard<std::mutex> lock(m_mutex);
+   //
+   Publish([tid, id, level](LevelSnapshot& snapshot)
+   {
+      snapshot.m_threadLevels[tid][id] = level;
+   });
+   return true;
+}
+
+void Loggers::ResetLoggerLevels(const string& loggerName)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   //
+   Publish([&loggerName](LevelSnapshot& snapshot)
+   {
+      snapshot.m_loggerLevels.erase(loggerName);
+   });
 }
+
+void Loggers::ResetThreadLevels(common::ThreadId tid)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   //
+   Publish([tid](LevelSnapshot& snapshot)
+   {
+      snapshot.m_threadLevels.erase(tid);
+   });
 }
 
+}
+}
@@ -0,0 +1,152 @@
+#include "tbp/log/Numa.h"
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <climits>
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+// cf linux/mempolicy.h, not available without the libnuma headers
+constexpr int MPOL_BIND_MODE = 2;
+constexpr unsigned MPOL_MF_MOVE_FLAG = 1 << 1;
+constexpr std::size_t MAX_NODES = 1024;
+
+// "0-3,8,10-11" -> 0 1 2 3 8 10 11
+std::vector<int> ParseList(const std::string& list)
+{
+   std::vector<int> values;
+   std::istringstream stream(list);
+   std::string range;
+   while (std::getline(stream, range, ','))
+   {
+      if (range.empty() || range == "\n")
+      {
+         continue;
+      }
+      int first = 0;
+      int last = 0;
+      char dash = 0;
+      std::istringstream rangeStream(range);
+      rangeStream >> first;
+      if (!(rangeStream >> dash >> last) || dash != '-')
+      {
+         last = first;
+      }
+      for (int value = first; value <= last; ++value)
+      {
+         values.push_back(value);
+      }
+   }
+   return values;
+}
+
+bool ReadFile(const std::string& path, std::string& content)
+{
+   std::ifstream file(path);
+   return file && std::getline(file, content);
+}
+
+std::size_t GetPageSize()
+{
+   static const std::size_t pageSize = ::sysconf(_SC_PAGESIZE);
+   return pageSize;
+}
+
+std::size_t RoundToPages(std::size_t size)
+{
+   std::size_t pageSize = GetPageSize();
+   return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+}
+
+std::size_t NumaGetNbNodes()
+{
+   std::string online;
+   if (!ReadFile("/sys/devices/system/node/online", online))
+   {
+      return 1;
+   }
+   std::vector<int> nodes = ParseList(online);
+   return nodes.empty() ? 1 : nodes.back() + 1;
+}
+
+NumaNode NumaGetCurrentNode()
+{
+   unsigned cpu = 0;
+   unsigned node = 0;
+   if (::syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+   {
+      return 0;
+   }
+   return static_cast<NumaNode>(node);
+}
+
+std::vector<int> NumaGetCpus(NumaNode node)
+{
+   std::string cpulist;
+   if (node >= 0 && ReadFile("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", cpulist))
+   {
+      return ParseList(cpulist);
+   }
+   std::vector<int> cpus;
+   long nbCpus = ::sysconf(_SC_NPROCESSORS_CONF);
+   for (int cpu = 0; cpu < nbCpus; ++cpu)
+   {
+      cpus.push_back(cpu);
+   }
+   return cpus;
+}
+
+bool NumaSetAffinity(const std::vector<int>& cpus)
+{
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   for (int cpu : cpus)
+   {
+      if (cpu >= 0 && cpu < CPU_SETSIZE)
+      {
+         CPU_SET(cpu, &set);
+      }
+   }
+   return CPU_COUNT(&set) && ::sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+void* NumaAlloc(std::size_t size, NumaNode node)
+{
+   std::size_t length = RoundToPages(size);
+   void* ptr = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (ptr == MAP_FAILED)
+   {
+      return nullptr;
+   }
+   if (node >= 0 && static_cast<std::size_t>(node) < MAX_NODES)
+   {
+      unsigned long mask[MAX_NODES / (sizeof(unsigned long) * CHAR_BIT)] = {};
+      mask[node / (sizeof(unsigned long) * CHAR_BIT)] = 1UL << (node % (sizeof(unsigned long) * CHAR_BIT));
+      // the error is ignored: the pages are then placed on the node of the first thread touching them
+      ::syscall(SYS_mbind, ptr, length, MPOL_BIND_MODE, mask, MAX_NODES + 1, MPOL_MF_MOVE_FLAG);
+   }
+   return ptr;
+}
+
+void NumaFree(void* ptr, std::size_t size)
+{
+   if (ptr)
+   {
+      ::munmap(ptr, RoundToPages(size));
+   }
+}
+
+}
+}
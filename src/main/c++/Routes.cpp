@@ -0,0 +1,45 @@
+#include "tbp/log/Routes.h"
+#include "tbp/common/ConfigurationException.h"
+#include <algorithm>
+#include <sstream>
+
+namespace tbp
+{
+namespace log
+{
+
+void Routes::AddDestination(const std::string& categoryLabel, std::string name, Level level)
+{
+   if (name.empty() || level == Level::none)
+   {
+      std::ostringstream oss;
+      oss << "Routes::AddDestination category[" << categoryLabel << "] invalid destination[" << name << "]";
+      throw common::ConfigurationException(oss.str());
+   }
+   auto& destinations = m_routes[categoryLabel].m_destinations;
+   auto iter = std::find_if(destinations.begin(), destinations.end(), [&name](const Destination& destination)
+   {
+      return destination.m_name == name;
+   });
+   if (iter != destinations.end())
+   {
+      std::ostringstream oss;
+      oss << "Routes::AddDestination category[" << categoryLabel << "] destination[" << name << "] already defined";
+      throw common::ConfigurationException(oss.str());
+   }
+   destinations.emplace_back(std::move(name), level);
+}
+
+void Routes::SetKeepDefault(const std::string& categoryLabel, bool keepDefault)
+{
+   m_routes[categoryLabel].m_keepDefault = keepDefault;
+}
+
+const Routes::Route* Routes::FindRoute(const std::string& categoryLabel) const
+{
+   auto iter = m_routes.find(categoryLabel);
+   return iter == m_routes.end() ? nullptr : &iter->second;
+}
+
+}
+}
@@ -0,0 +1,77 @@
+#include "tbp/log/SharedFile.h"
+#include "tbp/log/FileWriter.h"
+#include "tbp/log/Config.h"
+#include "tbp/common/ConfigurationException.h"
+#include <algorithm>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace tbp
+{
+namespace log
+{
+
+SharedFile::SharedFile(const Config& config, const std::string& name, std::size_t capacity)
+   : m_path(FileWriter::MakePath(config, name)), m_capacity(capacity), m_offset(0), m_nbDropped(0), m_synced(false)
+{
+   m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   bool valid = m_fd >= 0 && capacity && ::ftruncate(m_fd, static_cast<off_t>(capacity)) == 0;
+   if (valid)
+   {
+      // the blocks are reserved: a write in the mapping cannot fail with SIGBUS if the disk is full (the error is ignored if not supported)
+      ::fallocate(m_fd, 0, 0, static_cast<off_t>(capacity));
+      void* data = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+      valid = data != MAP_FAILED;
+      m_data = valid ? static_cast<char*>(data) : nullptr;
+   }
+   if (!valid)
+   {
+      if (m_fd >= 0)
+      {
+         ::close(m_fd);
+      }
+      std::ostringstream oss;
+      oss << "SharedFile cannot map file[" << m_path << "] capacity[" << capacity << "]";
+      throw common::ConfigurationException(oss.str());
+   }
+}
+
+SharedFile::~SharedFile()
+{
+   std::size_t size = m_synced.load() ? m_syncedSize : GetSize(m_offset.load(std::memory_order_relaxed));
+   ::munmap(m_data, m_capacity);
+   ::ftruncate(m_fd, static_cast<off_t>(size));
+   ::close(m_fd);
+}
+
+std::size_t SharedFile::GetSize(std::uint64_t offset) const
+{
+   std::size_t size = std::min<std::uint64_t>(offset, m_capacity);
+   // the range reserved by a dropped line at the end of the file is not written
+   while (size && !m_data[size - 1])
+   {
+      --size;
+   }
+   return size;
+}
+
+void SharedFile::Sync()
+{
+   if (m_synced.exchange(true))
+   {
+      return; // several threads logging a signal
+   }
+   // the ranges reserved from now on are past the capacity: no line is written beyond the end of the truncated file
+   std::uint64_t offset = m_offset.fetch_add(m_capacity + 1, std::memory_order_relaxed);
+   m_syncedSize = GetSize(offset);
+   if (m_syncedSize)
+   {
+      ::msync(m_data, m_syncedSize, MS_SYNC);
+   }
+   ::ftruncate(m_fd, static_cast<off_t>(m_syncedSize));
+}
+
+}
+}
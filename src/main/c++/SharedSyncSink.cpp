@@ -0,0 +1,23 @@
+#include "tbp/log/SharedSyncSink.h"
+#include "tbp/log/SignalManager.h"
+
+namespace tbp
+{
+namespace log
+{
+
+SharedSyncSink::SharedSyncSink(std::shared_ptr<SharedFile> file, common::ThreadId tid, SignalManager* signals)
+   : m_file(std::move(file)), m_tid(tid), m_signals(signals)
+{
+}
+
+void SharedSyncSink::ExitWithDefaultSignalHandler(common::SigNum signalNumber)
+{
+   if (m_signals)
+   {
+      m_signals->ExitWithDefaultSignalHandler(signalNumber, false);
+   }
+}
+
+}
+}
@@ -0,0 +1,176 @@
+#include "tbp/log/ShmClient.h"
+#include "tbp/log/ShmRing.h"
+#include "tbp/common/ConfigurationException.h"
+#include <atomic>
+#include <cstring>
+#include <cassert>
+#include <cerrno>
+#include <signal.h>
+#include <unistd.h>
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+std::atomic<std::size_t> g_nbClients(0); // several ShmClient can be created in the same process (unittests, ...)
+
+bool ClaimSlot(ShmSlot& slot, std::int32_t pid, const std::string& name)
+{
+   ShmSlotState expected = ShmSlotState::FREE;
+   if (!slot.m_state.compare_exchange_strong(expected, ShmSlotState::CLAIMED))
+   {
+      return false;
+   }
+   slot.m_pid = pid;
+   ShmCopyName(slot.m_name, name);
+   slot.m_state.store(ShmSlotState::READY, std::memory_order_release);
+   return true;
+}
+
+}
+
+ShmClient::ShmClient(const ShmConfig& config) : m_config(config), m_pid(getpid())
+{
+   std::size_t capacity = m_config.GetRingCapacity();
+   if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+   {
+      throw common::ConfigurationException("ShmClient ring capacity must be a power of 2");
+   }
+   std::string name = "/tbp-log-" + std::to_string(m_pid) + "-" + std::to_string(g_nbClients.fetch_add(1));
+   ShmSegment::Unlink(name); // left by a previous process with the same pid
+   m_segment = ShmSegment::Create(name, ShmClientDictionaryOffset() + m_config.GetDictionaryCapacity());
+   auto& header = GetHeader();
+   header.m_dictionaryCapacity = m_config.GetDictionaryCapacity();
+   header.m_dictionarySize.store(sizeof(std::uint32_t), std::memory_order_release); // offset 0 is SHM_INVALID_ID
+   header.m_overflowId = InternImpl("[tbp-log dictionary full]");
+   if (header.m_overflowId == SHM_INVALID_ID)
+   {
+      throw common::ConfigurationException("ShmClient dictionary capacity is too small");
+   }
+   Register();
+}
+
+ShmClient::~ShmClient()
+{
+   if (m_registrySlot < SHM_MAX_CLIENTS)
+   {
+      auto header = reinterpret_cast<ShmRegistryHeader*>(m_registry.Get());
+      header->m_clients[m_registrySlot].m_state.store(ShmSlotState::CLOSED, std::memory_order_release);
+   }
+   // the segment is unlinked by the daemon (LogDaemon::Detach) once all the rings are consumed, it may not be attached yet
+}
+
+void ShmClient::Register()
+{
+   m_registry = ShmSegment::OpenOrCreate(m_config.GetRegistryName(), sizeof(ShmRegistryHeader));
+   auto header = reinterpret_cast<ShmRegistryHeader*>(m_registry.Get());
+   for (std::size_t i = 0; i < SHM_MAX_CLIENTS; ++i)
+   {
+      if (ClaimSlot(header->m_clients[i], m_pid, m_segment.GetName()))
+      {
+         m_registrySlot = i;
+         return;
+      }
+   }
+   m_registrySlot = SHM_MAX_CLIENTS;
+   throw common::ConfigurationException("ShmClient registry is full");
+}
+
+void ShmClient::CheckConnection()
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   //
+   ShmSegment registry = ShmSegment::Open(m_config.GetRegistryName());
+   if (registry.IsValid() && registry.GetSize() >= sizeof(ShmRegistryHeader))
+   {
+      auto header = reinterpret_cast<ShmRegistryHeader*>(registry.Get());
+      const ShmSlot& slot = header->m_clients[m_registrySlot < SHM_MAX_CLIENTS ? m_registrySlot : 0];
+      bool registered = m_registrySlot < SHM_MAX_CLIENTS && slot.m_state.load(std::memory_order_acquire) == ShmSlotState::READY
+         && slot.m_pid == m_pid && strncmp(slot.m_name, m_segment.GetName().c_str(), SHM_NAME_SIZE - 1) == 0;
+      if (registered)
+      {
+         return;
+      }
+   }
+   Register();
+}
+
+bool ShmClient::IsDaemonAlive() const
+{
+   auto header = reinterpret_cast<const ShmRegistryHeader*>(m_registry.Get());
+   std::int32_t pid = header->m_daemonPid.load(std::memory_order_acquire);
+   return pid != 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+ShmDictionaryId ShmClient::Intern(const char* str)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   //
+   ShmDictionaryId id = InternImpl(str);
+   return id != SHM_INVALID_ID ? id : GetHeader().m_overflowId;
+}
+
+ShmDictionaryId ShmClient::InternImpl(const char* str)
+{
+   auto iter = m_dictionary.find(str);
+   if (iter != m_dictionary.end())
+   {
+      return iter->second;
+   }
+   auto& header = GetHeader();
+   std::uint32_t length = strlen(str);
+   std::uint32_t offset = header.m_dictionarySize.load(std::memory_order_relaxed);
+   std::size_t size = ShmAlign(sizeof(length) + length + 1, sizeof(length));
+   if (offset + size > header.m_dictionaryCapacity)
+   {
+      return SHM_INVALID_ID;
+   }
+   char* entry = m_segment.Get() + ShmClientDictionaryOffset() + offset;
+   memcpy(entry, &length, sizeof(length));
+   memcpy(entry + sizeof(length), str, length + 1);
+   header.m_dictionarySize.store(offset + size, std::memory_order_release);
+   m_dictionary.emplace(str, offset);
+   return offset;
+}
+
+std::size_t ShmClient::CreateRing(common::ThreadId tid, ShmSegment& segment)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   //
+   auto& header = GetHeader();
+   for (std::size_t i = 0; i < SHM_MAX_RINGS; ++i)
+   {
+      auto& slot = header.m_rings[i];
+      if (slot.m_state.load(std::memory_order_acquire) != ShmSlotState::FREE)
+      {
+         continue;
+      }
+      std::string name = m_segment.GetName() + "-" + std::to_string(m_nbRings++);
+      ShmSegment::Unlink(name);
+      segment = ShmSegment::Create(name, ShmRing::GetSegmentSize(m_config.GetRingCapacity()));
+      ShmRing::Init(segment.Get(), m_config.GetRingCapacity());
+      if (!ClaimSlot(slot, tid, name)) // only this process claims its own ring slots
+      {
+         assert(false);
+      }
+      return i;
+   }
+   throw common::ConfigurationException("ShmClient too many rings");
+}
+
+void ShmClient::CloseRing(std::size_t slot)
+{
+   auto& header = GetHeader();
+   /*
+   - the daemon may not have attached to the ring yet (short-lived thread): the segment must still be there when it does
+   - the daemon unlinks the segment once the ring is consumed, then it marks the slot as FREE
+   */
+   header.m_rings[slot].m_state.store(ShmSlotState::CLOSED, std::memory_order_release);
+}
+
+}
+}
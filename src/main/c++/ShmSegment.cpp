@@ -0,0 +1,134 @@
+#include "tbp/log/ShmSegment.h"
+#include "tbp/common/ConfigurationException.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+void ThrowError(const char* function, const std::string& name)
+{
+   std::ostringstream oss;
+   oss << "ShmSegment " << function << " name[" << name << "] error[" << strerror(errno) << "]";
+   throw common::ConfigurationException(oss.str());
+}
+
+}
+
+ShmSegment::ShmSegment(std::string name, int fd, std::size_t size) : m_name(std::move(name)), m_size(size)
+{
+   void* data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd); // the mapping remains valid
+   if (data == MAP_FAILED)
+   {
+      ThrowError("mmap", m_name);
+   }
+   m_data = static_cast<char*>(data);
+}
+
+ShmSegment::~ShmSegment()
+{
+   Close();
+}
+
+ShmSegment::ShmSegment(ShmSegment&& rhs) : m_name(std::move(rhs.m_name)), m_data(rhs.m_data), m_size(rhs.m_size)
+{
+   rhs.m_data = nullptr;
+   rhs.m_size = 0;
+}
+
+ShmSegment& ShmSegment::operator=(ShmSegment&& rhs)
+{
+   Close();
+   m_name = std::move(rhs.m_name);
+   m_data = rhs.m_data;
+   m_size = rhs.m_size;
+   rhs.m_data = nullptr;
+   rhs.m_size = 0;
+   return *this;
+}
+
+void ShmSegment::Close()
+{
+   if (m_data)
+   {
+      munmap(m_data, m_size);
+      m_data = nullptr;
+   }
+}
+
+ShmSegment ShmSegment::Create(const std::string& name, std::size_t size)
+{
+   int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+   if (fd < 0)
+   {
+      ThrowError("shm_open", name);
+   }
+   if (ftruncate(fd, size) < 0)
+   {
+      close(fd);
+      shm_unlink(name.c_str());
+      ThrowError("ftruncate", name);
+   }
+   return ShmSegment(name, fd, size);
+}
+
+ShmSegment ShmSegment::OpenOrCreate(const std::string& name, std::size_t size)
+{
+   int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+   if (fd < 0)
+   {
+      ThrowError("shm_open", name);
+   }
+   struct stat st;
+   if (fstat(fd, &st) < 0)
+   {
+      close(fd);
+      ThrowError("fstat", name);
+   }
+   // several processes can race to create the segment: ftruncate to the same size is idempotent
+   if (static_cast<std::size_t>(st.st_size) < size && ftruncate(fd, size) < 0)
+   {
+      close(fd);
+      ThrowError("ftruncate", name);
+   }
+   return ShmSegment(name, fd, size);
+}
+
+ShmSegment ShmSegment::Open(const std::string& name)
+{
+   int fd = shm_open(name.c_str(), O_RDWR, 0600);
+   if (fd < 0)
+   {
+      if (errno == ENOENT)
+      {
+         return ShmSegment();
+      }
+      ThrowError("shm_open", name);
+   }
+   struct stat st;
+   if (fstat(fd, &st) < 0 || st.st_size == 0)
+   {
+      close(fd);
+      return ShmSegment();
+   }
+   return ShmSegment(name, fd, st.st_size);
+}
+
+void ShmSegment::Unlink(const std::string& name)
+{
+   shm_unlink(name.c_str());
+}
+
+}
+}
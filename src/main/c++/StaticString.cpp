@@ -0,0 +1,74 @@
+#include "tbp/log/StaticString.h"
+#include <link.h>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <cstdint>
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+using Region = std::pair<std::uintptr_t, std::uintptr_t>; // [begin, end)
+
+std::mutex g_mutex;
+std::vector<Region> g_registered;
+
+int AddObject(dl_phdr_info* info, std::size_t /*size*/, void* data)
+{
+   auto& regions = *static_cast<std::vector<Region>*>(data);
+   for (int i = 0; i < info->dlpi_phnum; ++i)
+   {
+      const auto& header = info->dlpi_phdr[i];
+      if (header.p_type == PT_LOAD)
+      {
+         std::uintptr_t begin = info->dlpi_addr + header.p_vaddr;
+         regions.emplace_back(begin, begin + header.p_memsz);
+      }
+   }
+   return 0;
+}
+
+bool Contains(const std::vector<Region>& regions, std::uintptr_t address)
+{
+   for (const auto& region : regions)
+   {
+      if (address >= region.first && address < region.second)
+      {
+         return true;
+      }
+   }
+   return false;
+}
+
+}
+
+void RegisterStaticRegion(const void* data, std::size_t size)
+{
+   std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(data);
+   std::lock_guard<std::mutex> lock(g_mutex);
+   g_registered.emplace_back(begin, begin + size);
+}
+
+bool IsStaticAddress(const void* data)
+{
+   std::uintptr_t address = reinterpret_cast<std::uintptr_t>(data);
+   {
+      std::lock_guard<std::mutex> lock(g_mutex);
+      if (Contains(g_registered, address))
+      {
+         return true;
+      }
+   }
+   // the segments of the executable and of the shared libraries (loaded now), read-only data and static variables
+   std::vector<Region> objects;
+   dl_iterate_phdr(AddObject, &objects);
+   return Contains(objects, address);
+}
+
+}
+}
@@ -0,0 +1,110 @@
+#include "tbp/log/SyncFlusher.h"
+#include "tbp/log/FileWriter.h"
+#include <algorithm>
+
+namespace tbp
+{
+namespace log
+{
+
+SyncBuffers::SyncBuffers(FileWriter& fileWriter, std::size_t bufferSize) : m_fileWriter(fileWriter), m_active(0), m_appending(false)
+{
+   for (unsigned i = 0; i < 2; ++i)
+   {
+      m_sizes[i].store(0);
+      m_firsts[i].store(0);
+      m_blocks[i].m_fileWriter = &fileWriter;
+      m_blocks[i].m_flush = true;
+      // the buffers are cleared after each write, they keep their capacity: no allocation in Append() once they are big enough
+      m_blocks[i].m_data.reserve(bufferSize);
+      if (fileWriter.IsIndexed())
+      {
+         m_blocks[i].m_lines.reserve(bufferSize / 64);
+      }
+   }
+}
+
+SyncFlusher::SyncFlusher(std::size_t bufferSize, std::chrono::nanoseconds interval)
+   : m_bufferSize(bufferSize), m_interval(interval.count()), m_stop(false)
+{
+   m_thread = std::thread([this] { Run(); });
+}
+
+SyncFlusher::~SyncFlusher()
+{
+   m_stop.store(true);
+   m_thread.join();
+}
+
+void SyncFlusher::Add(SyncBuffers& buffers)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   m_buffers.push_back(&buffers);
+}
+
+void SyncFlusher::Remove(SyncBuffers& buffers)
+{
+   {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_buffers.erase(std::remove(m_buffers.begin(), m_buffers.end(), &buffers), m_buffers.end());
+      m_written.wait(lock, [this, &buffers] { return m_writing != &buffers; });
+   }
+   Flush(buffers);
+}
+
+void SyncFlusher::Write(SyncBuffers& buffers, bool force)
+{
+   std::lock_guard<std::mutex> lock(buffers.m_mutex);
+   // m_active is only changed below, under the lock
+   unsigned active = buffers.m_active.load(std::memory_order_relaxed);
+   std::size_t size = buffers.m_sizes[active].load(std::memory_order_relaxed);
+   if (!size)
+   {
+      return;
+   }
+   if (!force && size < m_bufferSize && FileWriter::GetCoarseNanos() - buffers.m_firsts[active].load(std::memory_order_relaxed) < m_interval)
+   {
+      return;
+   }
+   // IMPORTANT: seq_cst, if the sink reads the previous m_active, its m_appending is seen below (cf SyncBuffers::Append)
+   buffers.m_active.store(active ^ 1);
+   while (buffers.m_appending.load())
+   {
+      std::this_thread::yield();
+   }
+   WriterBlock& block = buffers.m_blocks[active];
+   buffers.m_fileWriter.WriteBlockData(block);
+   buffers.m_sizes[active].store(0, std::memory_order_relaxed);
+   buffers.m_firsts[active].store(0, std::memory_order_relaxed);
+}
+
+void SyncFlusher::Run()
+{
+   // the time threshold is checked a few times per interval
+   auto period = std::chrono::nanoseconds(std::min<std::int64_t>(std::max<std::int64_t>(m_interval / 4, 50000), 1000000));
+   while (!m_stop.load(std::memory_order_acquire))
+   {
+      // the buffers added or removed during the pass can be skipped, they are written by the next pass (or by Remove)
+      for (std::size_t i = 0; ; ++i)
+      {
+         SyncBuffers* buffers = nullptr;
+         {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_writing = nullptr;
+            if (i >= m_buffers.size())
+            {
+               break;
+            }
+            buffers = m_buffers[i];
+            m_writing = buffers;
+         }
+         m_written.notify_all();
+         Write(*buffers, false);
+      }
+      m_written.notify_all();
+      std::this_thread::sleep_for(period);
+   }
+}
+
+}
+}
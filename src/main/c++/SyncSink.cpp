@@ -9,9 +9,23 @@ namespace tbp
 namespace log
 {
 
-SyncSink::SyncSink(const Config& config, common::ThreadId tid, SignalManager* signals)
-   : m_fileWriter(config, tid), m_tid(tid), m_signals(signals)
+SyncSink::SyncSink(const Config& config, common::ThreadId tid, SignalManager* signals, SyncFlusher* flusher)
+   : m_fileWriter(std::make_unique<FileWriter>(config, tid)), m_tid(tid), m_signals(signals), m_flusher(flusher)
 {
+   if (m_flusher)
+   {
+      m_buffers = std::make_unique<SyncBuffers>(*m_fileWriter, m_flusher->GetBufferSize());
+      m_flusher->Add(*m_buffers);
+   }
+}
+
+SyncSink::~SyncSink()
+{
+   // a moved SyncSink has no buffers
+   if (m_buffers)
+   {
+      m_flusher->Remove(*m_buffers);
+   }
 }
 
 void SyncSink::ExitWithDefaultSignalHandler(common::SigNum signalNumber)
@@ -0,0 +1,55 @@
+#include "tbp/log/WriterStage.h"
+#include "tbp/log/FileWriter.h"
+#include <chrono>
+
+namespace tbp
+{
+namespace log
+{
+
+WriterStage::WriterStage() : m_stop(false)
+{
+   m_thread = std::thread([this] { Run(); });
+}
+
+WriterStage::~WriterStage()
+{
+   m_stop.store(true);
+   m_thread.join();
+}
+
+bool WriterStage::WriteBlocks()
+{
+   bool written = false;
+   while (WriterBlock* block = m_blocks.Dequeue())
+   {
+      block->m_fileWriter->WriteBlock(block);
+      written = true;
+   }
+   return written;
+}
+
+void WriterStage::Run()
+{
+   std::size_t idle = 0;
+   while (!m_stop.load(std::memory_order_acquire))
+   {
+      if (WriteBlocks())
+      {
+         idle = 0;
+      }
+      else if (++idle < 1000)
+      {
+         std::this_thread::yield();
+      }
+      else
+      {
+         // nothing to write for a while, the latency of the first block after an idle period does not matter
+         std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+   }
+   WriteBlocks();
+}
+
+}
+}
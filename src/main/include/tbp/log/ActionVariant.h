@@ -16,7 +16,7 @@ class ActionVariant
 {
 public:
    using AddMsg = AsyncLoggerAddMsg<SpscQueue, Allocator>;
-   using RemoveMsg = AsyncLoggerRemoveMsg<SpscQueue>;
+   using RemoveMsg = AsyncLoggerRemoveMsg<SpscQueue, Allocator>;
    //
    ~ActionVariant()
    {
@@ -2,24 +2,33 @@
 
 #include "tbp/common/OS.h"
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace tbp
 {
 namespace log
 {
 
+class FileWriter;
+template <typename Allocator> class Msg;
+
 template <typename SpscQueue, typename Allocator>
 struct AsyncLoggerAddMsg
 {
    std::unique_ptr<SpscQueue> m_queue;
+   std::unique_ptr<SpscQueue> m_priorityQueue; // optional: lane of the messages with a level >= Config::GetPriorityLevel()
    common::ThreadId m_tid = 0;
    std::unique_ptr<Allocator> m_allocator;
+   std::unique_ptr<FileWriter> m_fileWriter; // set if the queue is taken from the pool of the AsyncLogger
+   std::string m_group; // optional: the queues of the same group share the same FileWriter
 };
 
-template <typename SpscQueue>
+template <typename SpscQueue, typename Allocator>
 struct AsyncLoggerRemoveMsg
 {
    SpscQueue* m_queue = nullptr;
+   std::vector<Msg<Allocator>> m_pending; // messages not enqueued (cf StallPolicy), written after the queue
 };
 
 }
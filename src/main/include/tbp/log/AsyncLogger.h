@@ -2,17 +2,29 @@
 
 #include "tbp/log/AsyncLogger.fwd.h"
 #include "tbp/log/Msg.h"
-#include "tbp/log/Formatter.h"
+#include "tbp/log/MsgFormatter.h"
+#include "tbp/log/JsonFormatter.h"
 #include "tbp/log/FileWriter.h"
-#include "tbp/log/Decoder.h"
 #include "tbp/log/DefaultTypes.h"
 #include "tbp/log/Injector.h"
+#include "tbp/log/Config.h"
 #include "tbp/log/ActionVariant.h"
+#include "tbp/log/LoadShedder.h"
+#include "tbp/log/ConsumerHeartbeat.h"
 #include "tbp/common/Compiler.h"
 #include "tbp/common/OS.h"
+#include "tbp/common/ConfigurationException.h"
 #include <memory>
 #include <vector>
+#include <unordered_map>
+#include <utility>
+#include <string>
 #include <algorithm>
+#include <functional>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <time.h>
 
 namespace tbp
 {
@@ -21,6 +33,8 @@ namespace tbp
       class Config;
       class FileWriter;
       class Injector;
+      class WriterStage;
+      class SignalManager;
    }
 }
 
@@ -34,31 +48,93 @@ class AsyncLogger
 {
 public:
    using AddMsg = AsyncLoggerAddMsg<SpscQueue, Allocator>;
-   using RemoveMsg = AsyncLoggerRemoveMsg<SpscQueue>;
+   using RemoveMsg = AsyncLoggerRemoveMsg<SpscQueue, Allocator>;
+   using QueueFactory = std::function<std::unique_ptr<SpscQueue>()>;
+   using AllocatorFactory = std::function<std::unique_ptr<Allocator>()>;
    //
    AsyncLogger(const Config& config, const Injector& injector) : m_injector(injector), m_config(config) {}
-   ~AsyncLogger() {}
+   ~AsyncLogger();
    //
+   /*
+   - the priority lanes of all the queues are drained first, then each queue up to Config::GetDrainBudget() messages
+   all the queues are drained if a message with a signal is written
+   - returns the signal of the first message with a signal (cf SignalManager), 0 otherwise
+   */
    common::SigNum LogMessages();
    void AddQueue(AddMsg msg);
    void RemoveQueue(RemoveMsg msg);
+   /*
+   - pool of the queues removed by the sinks (the queue, its allocator and its FileWriter are kept together)
+   a sink created with CheckOut() costs a pool checkout instead of new allocations and a new log file
+   - the factories are used when the pool is empty
+   - CheckOut() can be called by any thread, it is not on the critical path
+   */
+   void SetPool(std::size_t maxSize, QueueFactory createQueue, AllocatorFactory createAllocator);
+   AddMsg CheckOut(common::ThreadId tid);
+   std::size_t GetPoolSize();
+   /*
+   - the files are written by the WriterStage thread instead of the thread calling LogMessages() (cf PipelinedConsumer)
+   - must be called before the first queue is added, the WriterStage must outlive the AsyncLogger
+   */
+   void SetWriterStage(WriterStage& stage) { m_writerStage = &stage; }
+   /*
+   - AddQueue() throws a ConfigurationException for a queue with a group (AddMsg::m_group)
+   used when several AsyncLoggers would truncate and write the same group file (cf PipelinedConsumer)
+   */
+   void DisableGroups() { m_groupsDisabled = true; }
+   /*
+   - appended to the names of the files shared by several queues (groups, routes, Config::GetMaxFileWriters): "<name>-<suffix>"
+   used when several AsyncLoggers write their own shared files (cf NumaConsumer), the flush policy is still the one of <name>
+   - must be called before the first queue is added
+   */
+   void SetSharedFileSuffix(std::string suffix) { m_sharedFileSuffix = std::move(suffix); }
+   /*
+   - the lag of each LogMessages() pass is reported to the LoadShedder (cf Loggers::GetLoadShedder)
+   - once the shedding stops, the messages shed by the threads of the queues are reported in their files (cf ShedCounters)
+   - the LoadShedder must outlive the AsyncLogger
+   */
+   void SetLoadShedder(LoadShedder& shedder) { m_loadShedder = &shedder; }
+   // cf Config::GetPriorityLevel()
+   Level GetPriorityLevel() const { return m_config.GetPriorityLevel(); }
+   const Config& GetConfig() const { return m_config; }
+   const Injector& GetInjector() const { return m_injector; }
+   /*
+   - used by the AsyncSinks which cannot enqueue a message with a signal because the consumer is stalled (cf StallPolicy)
+   they write it in their emergency file and call ExitWithDefaultSignalHandler() themselves
+   - the SignalManager must outlive the AsyncLogger
+   */
+   void SetSignalManager(SignalManager& signals) { m_signals = &signals; }
+   SignalManager* GetSignalManager() const { return m_signals; }
+   // progress of the thread calling LogMessages(), cf Config::GetStallPolicy()
+   const ConsumerHeartbeat& GetHeartbeat() const { return m_heartbeat; }
    //
    void OnAddQueue(AddMsg& msg);
-   void OnRemoveQueue(const RemoveMsg& msg);
+   void OnRemoveQueue(RemoveMsg& msg);
 
 private:
+   /*
+   - it is not straightforward to order log messages (Msg) by timestamp (Msg::m_time)
+   anything can happen between the point where the timestamp is taken and the call to Enqueue()
+   if only one log file is used, a "newer" Msg can be logged even before an "older" Msg is enqueued
+   - by default each queue writes in a different file, the user has to merge/sort them if needed
+   - a FileWriter is shared by several queues if the queues have the same group (AddMsg::m_group)
+   or if the number of log files is limited (Config::GetMaxFileWriters): at most that many "shared<N>" files
+   the shared FileWriters are kept until the AsyncLogger is destroyed (a new one would truncate the file)
+   */
+   struct WriterData
+   {
+      std::unique_ptr<FileWriter> m_fileWriter;
+      std::string m_group;
+      std::size_t m_nbQueues = 0;
+      bool m_shared = false;
+   };
    struct QueueData
    {
       std::unique_ptr<Allocator> m_allocator;
       std::unique_ptr<SpscQueue> m_queue;
+      std::unique_ptr<SpscQueue> m_priorityQueue;
       common::ThreadId m_tid = 0;
-      /*
-      - it is not straightforward to order log messages (Msg) by timestamp (Msg::m_time)
-      anything can happen between the point where the timestamp is taken and the call to Enqueue()
-      if only one log file is used, a "newer" Msg can be logged even before an "older" Msg is enqueued
-      - currently each queue writes in a different file, the user has to merge/sort them if needed
-      */
-      std::unique_ptr<FileWriter> m_fileWriter;
+      WriterData* m_writer = nullptr;
    };
    using Action = ActionVariant<SpscQueue, Allocator>;
    struct Node : public MpscQueue::Node
@@ -66,12 +142,54 @@ private:
       Action m_msg;
    };
    //
+   // the messages of a category are written in the destinations of its route (cf Routes), the destinations are group FileWriters
+   struct RouteData
+   {
+      std::vector<std::pair<WriterData*, Level>> m_destinations;
+      bool m_keepDefault = true;
+   };
+   //
+   WriterData& GetWriter(AddMsg& msg);
+   WriterData& GetGroupWriter(const std::string& group);
+   std::unique_ptr<FileWriter> CreateSharedFileWriter(const std::string& name);
+   const RouteData& GetRoute(const Category& category);
+   void WriteToRoute(const Msg<Allocator>& msg, FileWriter& fileWriter);
+   void ReleaseWriter(QueueData& data, AddMsg* pooled);
+   void ProcessActions();
+   // the FileWriter of a pooled queue which is not reused
+   void ReleasePooledWriter(AddMsg& msg);
+   /*
+   - write at most 'budget' messages of one lane of the queue (0: all the messages), returns the number of messages written
+   - 'oldest' is lowered to the time of the oldest message written if a LoadShedder is set
+   */
+   std::size_t Drain(QueueData& data, SpscQueue& queue, std::size_t budget, common::SigNum& signal, std::int64_t& oldest);
+   void Write(QueueData& data, Msg<Allocator>& msg, common::SigNum& signal, std::int64_t& oldest);
+   // the messages are formatted by the consumer: the allocators belong to the producers
+   void TBP_NOINLINE ReportShed();
+   //
    std::vector<QueueData> m_queues;
-   Formatter m_formatter;
+   std::vector<std::unique_ptr<WriterData>> m_writers;
+   std::unordered_map<const Category*, RouteData> m_routeCache;
+   MsgFormatter<TypeId, Allocator> m_formatter;
+   JsonFormatter<TypeId, Allocator> m_jsonFormatter;
    const Injector& m_injector;
    const Config& m_config;
    MpscQueue m_actions;
    std::vector<RemoveMsg> m_toRemove;
+   std::mutex m_poolMutex;
+   std::vector<AddMsg> m_pool;
+   std::size_t m_maxPoolSize = 0;
+   QueueFactory m_createQueue;
+   AllocatorFactory m_createAllocator;
+   WriterStage* m_writerStage = nullptr;
+   LoadShedder* m_loadShedder = nullptr;
+   SignalManager* m_signals = nullptr;
+   bool m_shedding = false;
+   std::vector<std::pair<const Category*, ShedCounters::Counts>> m_shedCounts;
+   std::string m_shedText;
+   ConsumerHeartbeat m_heartbeat;
+   bool m_groupsDisabled = false;
+   std::string m_sharedFileSuffix;
 
 };
 
@@ -89,7 +207,7 @@ public:
    {
       m_logger.OnAddQueue(msg);
    }
-   void operator()(const typename Logger::RemoveMsg& msg)
+   void operator()(typename Logger::RemoveMsg& msg)
    {
       m_logger.OnRemoveQueue(msg);
    }
@@ -105,116 +223,254 @@ template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allo
 inline common::SigNum AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::LogMessages()
 {
    common::SigNum signal = 0;
-   while (Node* node = static_cast<Node*>(m_actions.Dequeue()))
+   m_heartbeat.Beat();
+   ProcessActions();
+   // the queues being removed are drained: their messages must be written before their FileWriter is released
+   std::size_t budget = m_toRemove.empty() ? m_config.GetDrainBudget() : 0;
+   std::size_t nbMessages = 0;
+   std::int64_t oldest = INT64_MAX;
+   for (auto& data : m_queues)
    {
-      details::Visitor<TypeId, SpscQueue, MpscQueue, Allocator> visitor(*this);
-      node->m_msg.ApplyVisitor(visitor);
-      //
-      delete node;
+      if (data.m_priorityQueue)
+      {
+         nbMessages += Drain(data, *data.m_priorityQueue, 0, signal, oldest);
+      }
    }
-   //
    for (auto& data : m_queues)
    {
-      auto& queue = *data.m_queue.get();
-      auto& allocator = *data.m_allocator.get();
-      auto& fileWriter = *data.m_fileWriter.get();
-      auto& writer = fileWriter.GetWriter();
-      Msg<Allocator> msg;
-      while (queue.Dequeue(msg))
+      nbMessages += Drain(data, *data.m_queue, budget, signal, oldest);
+      m_heartbeat.Beat();
+   }
+   if (unlikely(signal && budget))
+   {
+      // the process is about to die: the messages beyond the budget would be lost
+      for (auto& data : m_queues)
       {
-         common::SigNum sig = msg.GetSignal();
-         if (unlikely(sig && !signal))
-         {
-            signal = sig;
-         }
-         fileWriter.WriteHeader(msg.GetTime(), data.m_tid, msg.GetLevel(), msg.GetCategory());
-         const auto& msgBuffer = msg.GetBuffer();
-         if (msgBuffer.Get())
-         {
-            Decoder<TypeId, Allocator> decoder(msg.GetBuffer());
-            m_formatter.Format(msg.GetFormat(), writer, [&decoder](const char* fmt, fmt::MemoryWriter& writer)
-            {
-               assert(decoder.HasNext() == true);
-               auto p = decoder.Next();
-               TypeId typeId = p.first;
-               auto& buffer = *p.second;
-               switch (typeId)
-               {
-                  case TypeId::INT:
-                  {
-                     int v = 0;
-                     Type<int, TypeId, Allocator>::Decode(buffer, v);
-                     writer.write(fmt, v);
-                  }
-                  break;
-                  case TypeId::UINT64:
-                  {
-                     std::uint64_t v = 0;
-                     Type<std::uint64_t, TypeId, Allocator>::Decode(buffer, v);
-                     writer.write(fmt, v);
-                  }
-                  break;
-                  case TypeId::INT64:
-                  {
-                     std::int64_t v = 0;
-                     Type<std::int64_t, TypeId, Allocator>::Decode(buffer, v);
-                     writer.write(fmt, v);
-                  }
-                  break;
-                  case TypeId::DOUBLE:
-                  {
-                     double v = 0.;
-                     Type<double, TypeId, Allocator>::Decode(buffer, v);
-                     writer.write(fmt, v);
-                  }
-                  break;
-                  case TypeId::STRING:
-                  {
-                     std::string v;
-                     Type<std::string, TypeId, Allocator>::Decode(buffer, v);
-                     writer.write(fmt, v);
-                  }
-                  break;
-                  case TypeId::NONE:
-                  {
-                     assert(false);
-                  }
-                  break;
-               }
-            });
-            assert(decoder.HasNext() == false);
-         }
-         else
-         {
-            writer.write(msg.GetFormat());
-         }
-         fileWriter.WriteToFile();
-         //
-         msg.Recycle(allocator);
+         nbMessages += Drain(data, *data.m_queue, 0, signal, oldest);
+      }
+   }
+   if (m_loadShedder)
+   {
+      std::chrono::nanoseconds age{ 0 };
+      if (nbMessages)
+      {
+         timespec now;
+         ::clock_gettime(CLOCK_REALTIME, &now);
+         age = std::chrono::nanoseconds(std::max<std::int64_t>(0, now.tv_sec * 1000000000LL + now.tv_nsec - oldest));
+      }
+      m_loadShedder->Update(nbMessages, age);
+      bool shedding = m_loadShedder->GetLevel() != Level::none;
+      if (unlikely(m_shedding && !shedding))
+      {
+         ReportShed();
+      }
+      m_shedding = shedding;
+   }
+   for (auto& writerData : m_writers)
+   {
+      writerData->m_fileWriter->FlushAfterDrain();
+   }
+   if (unlikely(signal))
+   {
+      // the signal is returned once the message is written (cf SignalManager), whatever the flush policy
+      for (auto& writerData : m_writers)
+      {
+         writerData->m_fileWriter->Flush();
+         writerData->m_fileWriter->Wait();
       }
-      fileWriter.Flush();
    }
    //
    if (unlikely(!m_toRemove.empty()))
    {
       for (auto& msg : m_toRemove)
       {
-         auto end = m_queues.end();
-         auto first = std::remove_if(m_queues.begin(), end, [&msg](const QueueData& data)
+         // not std::remove_if: the removed QueueData would be overwritten by the next ones before its writer is released
+         auto first = std::find_if(m_queues.begin(), m_queues.end(), [&msg](const QueueData& data)
          {
             return data.m_queue.get() == msg.m_queue;
          });
-         assert(std::distance(first, end) == 1U);
-         m_queues.erase(first, end);
+         assert(first != m_queues.end());
+         if (first != m_queues.end())
+         {
+            // the messages the sink could not enqueue while the consumer was stalled
+            for (auto& pending : msg.m_pending)
+            {
+               Write(*first, pending, signal, oldest);
+            }
+            if (!msg.m_pending.empty())
+            {
+               first->m_writer->m_fileWriter->Flush();
+            }
+            std::lock_guard<std::mutex> lock(m_poolMutex);
+            //
+            if (m_pool.size() < m_maxPoolSize)
+            {
+               // the queue is empty: all the log messages have been dequeued above
+               AddMsg pooled;
+               pooled.m_queue = std::move(first->m_queue);
+               pooled.m_priorityQueue = std::move(first->m_priorityQueue);
+               pooled.m_allocator = std::move(first->m_allocator);
+               ReleaseWriter(*first, &pooled);
+               m_pool.emplace_back(std::move(pooled));
+            }
+            else
+            {
+               ReleaseWriter(*first, nullptr);
+            }
+            m_queues.erase(first);
+         }
       }
       m_toRemove.clear();
    }
    return signal;
 }
 
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline void AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::ProcessActions()
+{
+   while (Node* node = static_cast<Node*>(m_actions.Dequeue()))
+   {
+      details::Visitor<TypeId, SpscQueue, MpscQueue, Allocator> visitor(*this);
+      node->m_msg.ApplyVisitor(visitor);
+      //
+      delete node;
+   }
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline std::size_t AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::Drain(QueueData& data, SpscQueue& queue, std::size_t budget, common::SigNum& signal, std::int64_t& oldest)
+{
+   Msg<Allocator> msg;
+   std::size_t count = 0;
+   for (; (!budget || count < budget) && queue.Dequeue(msg); ++count)
+   {
+      Write(data, msg, signal, oldest);
+      if (unlikely(count % ConsumerHeartbeat::BEAT_INTERVAL == ConsumerHeartbeat::BEAT_INTERVAL - 1))
+      {
+         m_heartbeat.Beat();
+      }
+   }
+   return count;
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline void AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::Write(QueueData& data, Msg<Allocator>& msg, common::SigNum& signal, std::int64_t& oldest)
+{
+   auto& fileWriter = *data.m_writer->m_fileWriter.get();
+   common::SigNum sig = msg.GetSignal();
+   if (unlikely(sig && !signal))
+   {
+      signal = sig;
+   }
+   if (m_loadShedder)
+   {
+      const timespec& time = msg.GetTime();
+      oldest = std::min<std::int64_t>(oldest, time.tv_sec * 1000000000LL + time.tv_nsec);
+   }
+   if (likely(m_config.GetOutputFormat() == OutputFormat::text))
+   {
+      fileWriter.WriteHeader(msg.GetTime(), data.m_tid, msg.GetLevel(), msg.GetCategory());
+      m_formatter.Format(msg.GetFormat(), msg.GetBuffer(), fileWriter.GetWriter());
+   }
+   else
+   {
+      m_jsonFormatter.Format(msg, data.m_tid, fileWriter.GetWriter());
+   }
+   if (likely(m_config.GetRoutes().IsEmpty()))
+   {
+      fileWriter.WriteToFile();
+   }
+   else
+   {
+      WriteToRoute(msg, fileWriter);
+   }
+   fileWriter.FlushIfNeeded(msg.GetLevel());
+   //
+   msg.Recycle(*data.m_allocator);
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+void TBP_NOINLINE AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::ReportShed()
+{
+   timespec now;
+   ::clock_gettime(CLOCK_REALTIME, &now);
+   common::SigNum signal = 0;
+   std::int64_t oldest = INT64_MAX;
+   for (auto& data : m_queues)
+   {
+      m_shedCounts.clear();
+      m_loadShedder->Collect(data.m_tid, m_shedCounts);
+      for (const auto& counts : m_shedCounts)
+      {
+         const auto& nbShed = counts.second;
+         // the same string is reused: its address is the key of the JsonFormatter cache
+         m_shedText = fmt::format("load shedding: {} debug, {} info and {} warn messages dropped", nbShed[0], nbShed[1], nbShed[2]);
+         Msg<Allocator> msg(now, Level::warn, *counts.first, m_shedText.c_str(), typename Msg<Allocator>::Buf(), 0);
+         Write(data, msg, signal, oldest);
+      }
+   }
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::~AsyncLogger()
+{
+   // the messages still enqueued are written: their buffers are recycled and their BlobRefs released
+   ProcessActions();
+   common::SigNum signal = 0;
+   std::int64_t oldest = INT64_MAX;
+   for (auto& data : m_queues)
+   {
+      if (data.m_priorityQueue)
+      {
+         Drain(data, *data.m_priorityQueue, 0, signal, oldest);
+      }
+      Drain(data, *data.m_queue, 0, signal, oldest);
+   }
+   // the derived classes of FileWriter (mocks, ...) must not be destroyed while the WriterStage uses them
+   for (auto& writerData : m_writers)
+   {
+      writerData->m_fileWriter->Flush();
+      writerData->m_fileWriter->Wait();
+   }
+   for (auto& pooled : m_pool)
+   {
+      if (pooled.m_fileWriter)
+      {
+         pooled.m_fileWriter->Wait();
+      }
+   }
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline void AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::WriteToRoute(const Msg<Allocator>& msg, FileWriter& fileWriter)
+{
+   const RouteData& route = GetRoute(msg.GetCategory());
+   // the formatted line is shared by all the destinations
+   for (const auto& destination : route.m_destinations)
+   {
+      if (msg.GetLevel() >= destination.second)
+      {
+         destination.first->m_fileWriter->WriteToFile(fileWriter.GetWriter(), fileWriter.GetIndexedLine());
+         destination.first->m_fileWriter->FlushIfNeeded(msg.GetLevel());
+      }
+   }
+   if (route.m_keepDefault)
+   {
+      fileWriter.WriteToFile();
+   }
+   else
+   {
+      fileWriter.Clear();
+   }
+}
+
 template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
 inline void AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::AddQueue(AddMsg msg)
 {
+   if (unlikely(m_groupsDisabled && !msg.m_group.empty()))
+   {
+      throw common::ConfigurationException("AsyncLogger::AddQueue the groups are disabled, group[" + msg.m_group + "]");
+   }
    auto node = new Node;
    node->m_msg.Set(std::move(msg));
    m_actions.Enqueue(node);
@@ -233,19 +489,206 @@ inline void AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::OnAddQueue(Add
 {
    QueueData data;
    data.m_queue = std::move(msg.m_queue);
+   data.m_priorityQueue = std::move(msg.m_priorityQueue);
    data.m_tid = msg.m_tid;
-   data.m_fileWriter = m_injector.CreateFileWriter(m_config, msg.m_tid);
+   data.m_writer = &GetWriter(msg);
+   ++data.m_writer->m_nbQueues;
    data.m_allocator = std::move(msg.m_allocator);
    m_queues.emplace_back(std::move(data));
 }
 
 template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
-inline void AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::OnRemoveQueue(const RemoveMsg& msg)
+inline typename AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::WriterData& AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::GetWriter(AddMsg& msg)
+{
+   // the group and the limit are resolved first: the FileWriter of a pooled queue (cf CheckOut) is only reused for a file of its own
+   if (!msg.m_group.empty())
+   {
+      ReleasePooledWriter(msg);
+      return GetGroupWriter(msg.m_group);
+   }
+   std::size_t maxFileWriters = m_config.GetMaxFileWriters();
+   std::size_t nbWriters = 0;
+   if (maxFileWriters)
+   {
+      WriterData* leastUsed = nullptr;
+      for (auto& writerData : m_writers)
+      {
+         if (writerData->m_group.empty())
+         {
+            ++nbWriters;
+            if (!leastUsed || writerData->m_nbQueues < leastUsed->m_nbQueues)
+            {
+               leastUsed = writerData.get();
+            }
+         }
+      }
+      if (nbWriters >= maxFileWriters)
+      {
+         ReleasePooledWriter(msg);
+         return *leastUsed;
+      }
+   }
+   auto writerData = std::make_unique<WriterData>();
+   writerData->m_shared = maxFileWriters != 0;
+   if (msg.m_fileWriter)
+   {
+      writerData->m_fileWriter = std::move(msg.m_fileWriter);
+   }
+   else
+   {
+      // a shared FileWriter is not named after the first thread using it
+      writerData->m_fileWriter = writerData->m_shared ? CreateSharedFileWriter("shared" + std::to_string(nbWriters))
+            : m_injector.CreateFileWriter(m_config, msg.m_tid);
+      if (m_writerStage)
+      {
+         writerData->m_fileWriter->SetWriterStage(*m_writerStage);
+      }
+   }
+   m_writers.emplace_back(std::move(writerData));
+   return *m_writers.back();
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline void AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::ReleasePooledWriter(AddMsg& msg)
+{
+   if (msg.m_fileWriter)
+   {
+      msg.m_fileWriter->Flush();
+      msg.m_fileWriter->Wait();
+      msg.m_fileWriter.reset();
+   }
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline typename AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::WriterData& AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::GetGroupWriter(const std::string& group)
+{
+   for (auto& writerData : m_writers)
+   {
+      if (writerData->m_group == group)
+      {
+         return *writerData;
+      }
+   }
+   auto writerData = std::make_unique<WriterData>();
+   writerData->m_group = group;
+   writerData->m_shared = true;
+   writerData->m_fileWriter = CreateSharedFileWriter(group);
+   if (m_writerStage)
+   {
+      writerData->m_fileWriter->SetWriterStage(*m_writerStage);
+   }
+   m_writers.emplace_back(std::move(writerData));
+   return *m_writers.back();
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline std::unique_ptr<FileWriter> AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::CreateSharedFileWriter(const std::string& name)
+{
+   if (m_sharedFileSuffix.empty())
+   {
+      return m_injector.CreateSharedFileWriter(m_config, name);
+   }
+   auto fileWriter = m_injector.CreateSharedFileWriter(m_config, name + "-" + m_sharedFileSuffix);
+   fileWriter->SetFlushPolicy(m_config.GetFlushPolicy(name));
+   return fileWriter;
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline const typename AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::RouteData& AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::GetRoute(const Category& category)
+{
+   auto iter = m_routeCache.find(&category);
+   if (likely(iter != m_routeCache.end()))
+   {
+      return iter->second;
+   }
+   RouteData routeData;
+   if (const Routes::Route* route = m_config.GetRoutes().FindRoute(category.GetLabel()))
+   {
+      routeData.m_keepDefault = route->m_keepDefault;
+      for (const auto& destination : route->m_destinations)
+      {
+         routeData.m_destinations.emplace_back(&GetGroupWriter(destination.m_name), destination.m_level);
+      }
+   }
+   return m_routeCache.emplace(&category, std::move(routeData)).first->second;
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline void AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::ReleaseWriter(QueueData& data, AddMsg* pooled)
+{
+   WriterData* writerData = data.m_writer;
+   data.m_writer = nullptr;
+   if (--writerData->m_nbQueues || writerData->m_shared)
+   {
+      return;
+   }
+   if (pooled)
+   {
+      pooled->m_fileWriter = std::move(writerData->m_fileWriter);
+   }
+   else
+   {
+      writerData->m_fileWriter->Flush();
+      writerData->m_fileWriter->Wait();
+   }
+   m_writers.erase(std::remove_if(m_writers.begin(), m_writers.end(), [writerData](const std::unique_ptr<WriterData>& w)
+   {
+      return w.get() == writerData;
+   }), m_writers.end());
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline void AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::OnRemoveQueue(RemoveMsg& msg)
 {
    // only remove from m_queues once all the log messages have been dequeued
-   m_toRemove.emplace_back(msg);
+   m_toRemove.emplace_back(std::move(msg));
 }
 
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline void AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::SetPool(std::size_t maxSize, QueueFactory createQueue, AllocatorFactory createAllocator)
+{
+   std::lock_guard<std::mutex> lock(m_poolMutex);
+   //
+   m_maxPoolSize = maxSize;
+   m_createQueue = std::move(createQueue);
+   m_createAllocator = std::move(createAllocator);
 }
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline typename AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::AddMsg AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::CheckOut(common::ThreadId tid)
+{
+   std::lock_guard<std::mutex> lock(m_poolMutex);
+   //
+   AddMsg msg;
+   if (!m_pool.empty())
+   {
+      msg = std::move(m_pool.back());
+      m_pool.pop_back();
+   }
+   else
+   {
+      if (!m_createQueue || !m_createAllocator)
+      {
+         throw common::ConfigurationException("AsyncLogger::CheckOut the pool is not configured");
+      }
+      msg.m_queue = m_createQueue();
+      if (m_config.GetPriorityLevel() != Level::none)
+      {
+         msg.m_priorityQueue = m_createQueue();
+      }
+      msg.m_allocator = m_createAllocator();
+   }
+   msg.m_tid = tid;
+   return msg;
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline std::size_t AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>::GetPoolSize()
+{
+   std::lock_guard<std::mutex> lock(m_poolMutex);
+   //
+   return m_pool.size();
 }
 
+}
+}
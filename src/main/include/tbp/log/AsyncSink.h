@@ -5,9 +5,20 @@
 #include "tbp/log/Encoder.h"
 #include "tbp/log/Msg.h"
 #include "tbp/log/AsyncLogger.h"
+#include "tbp/log/MsgFormatter.h"
+#include "tbp/log/FileWriter.h"
+#include "tbp/log/ConsumerHeartbeat.h"
+#include "tbp/log/BufferAllocator.h"
+#include "tbp/log/Blob.h"
+#include "tbp/log/SignalManager.h"
 #include "tbp/common/OS.h"
+#include "tbp/common/Compiler.h"
+#include "tbp/common/ConfigurationException.h"
 #include <time.h>
 #include <memory>
+#include <string>
+#include <vector>
+#include <utility>
 
 namespace tbp
 {
@@ -16,13 +27,63 @@ namespace log
 
 class Config;
 
+// the fields logged while the consumer is stalled are encoded in a buffer of the sink, and formatted at once (cf StallMode::file)
+class StallAllocator
+{
+public:
+   using Handle = char*;
+   //
+   Handle Alloc(std::size_t size)
+   {
+      m_data.resize(size);
+      return m_data.data();
+   }
+   void Free(Handle& /*h*/) {}
+
+private:
+   std::vector<char> m_data;
+
+};
+
+namespace details
+{
+
+// true if Alloc() can wait for the consumer (cf StallPolicy)
+template <typename Allocator>
+inline bool AllocCanWait(const Allocator& /*allocator*/) { return false; }
+template <typename SpscQueue>
+inline bool AllocCanWait(const BufferAllocator<SpscQueue>& allocator) { return !allocator.HasMallocFallback(); }
+
+}
+
+/*
+- with a StallPolicy (cf Config::GetStallPolicy), Log() does not wait for a stalled consumer (cf ConsumerHeartbeat):
+the consumer is stalled when the queue is full and the heartbeat is older than the timeout
+the message which could not be enqueued is kept by the sink, the next messages are dropped or written in the emergency file of the sink
+the kept message is enqueued first once the queue has room again, followed by a warn message reporting the gap
+- the allocation of the encoded message must not wait for the consumer: a BufferAllocator without the malloc fallback
+is rejected with a ConfigurationException
+- a sink destroyed during a stall hands its kept messages to the AsyncLogger (cf AsyncLoggerRemoveMsg::m_pending)
+- a message with a signal (cf SignalManager) is never dropped during a stall: the consumer would never write it and the signal handler would wait forever
+it is written in the emergency file, then the sink calls ExitWithDefaultSignalHandler() (cf AsyncLogger::SetSignalManager)
+for the kept message, only its format string is written: its fields stay encoded for the consumer
+*/
 template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
 class AsyncSink
 {
 public:
    using Logger = AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>;
    //
-   AsyncSink(Logger& asyncLogger, std::unique_ptr<SpscQueue> queue, std::unique_ptr<Allocator> allocator, common::ThreadId tid);
+   // the sinks with the same (non-empty) group share the same log file
+   AsyncSink(Logger& asyncLogger, std::unique_ptr<SpscQueue> queue, std::unique_ptr<Allocator> allocator, common::ThreadId tid, std::string group = std::string());
+   /*
+   - the messages with a level >= Config::GetPriorityLevel() are enqueued in 'priorityQueue'
+   the AsyncLogger writes them before the messages of 'queue' (cf Config::GetDrainBudget)
+   */
+   AsyncSink(Logger& asyncLogger, std::unique_ptr<SpscQueue> queue, std::unique_ptr<SpscQueue> priorityQueue, std::unique_ptr<Allocator> allocator,
+         common::ThreadId tid, std::string group = std::string());
+   // the queue and the allocator are taken from the pool of the AsyncLogger (cf AsyncLogger::SetPool)
+   AsyncSink(Logger& asyncLogger, common::ThreadId tid, std::string group = std::string());
    ~AsyncSink();
    AsyncSink(AsyncSink&& rhs);
    AsyncSink& operator=(AsyncSink&& rhs) = delete;
@@ -34,26 +95,95 @@ public:
    but can also be a std::string as long as it is const and remains available in memory until the AsynLogger is done with this log line
    */
    template <typename... Args> void Log(const Category& category, Level level, const timespec& now, common::SigNum signal, const char* fmt, Args&&... args);
+   // log fields already encoded by another Encoder with the same TypeId (cf FlightRecorderSink)
+   void LogEncoded(const Category& category, Level level, const timespec& time, common::SigNum signal, const char* fmt, const char* data, std::size_t size);
+
+MOCK_PROTECTED:
+   MOCK_VIRTUAL void ExitWithDefaultSignalHandler(common::SigNum signalNumber);
 
 private:
+   // created at the first stall of the consumer
+   struct StallData
+   {
+      std::int64_t m_begin = 0; // time the stall was detected (cf ConsumerHeartbeat::Now), 0: the consumer is not stalled
+      std::uint64_t m_nbDropped = 0;
+      std::uint64_t m_nbWritten = 0; // in the emergency file
+      std::vector<std::pair<SpscQueue*, Msg<Allocator>>> m_pending; // messages not enqueued when the stall was detected
+      std::unique_ptr<FileWriter> m_file; // emergency file
+      StallAllocator m_allocator;
+      Encoder<TypeId, StallAllocator> m_encoder;
+      MsgFormatter<TypeId, StallAllocator> m_formatter;
+   };
+   //
+   SpscQueue* GetQueue(Level level) const { return m_priorityQueue && level >= m_priorityLevel ? m_priorityQueue : m_queue; }
+   void Init(typename Logger::AddMsg& msg);
+   bool IsStalled(std::int64_t now) const { return m_asyncLogger.GetHeartbeat().IsStalled(now, m_stallTimeout); }
+   void Enqueue(SpscQueue* queue, Msg<Allocator>&& msg);
+   bool TryEnqueue(SpscQueue* queue, Msg<Allocator>& msg);
+   StallData& BeginStall(std::int64_t now);
+   FileWriter& GetEmergencyFile(StallData& stall);
+   void TBP_NOINLINE ExitStalled(const Msg<Allocator>& msg);
+   template <typename... Args> void TBP_NOINLINE LogStalled(const Category& category, Level level, const timespec& now, common::SigNum signal, const char* fmt, Args&&... args);
+   bool TBP_NOINLINE Recover(const Category& category, const timespec& now);
+   //
    SpscQueue* m_queue = nullptr;
+   SpscQueue* m_priorityQueue = nullptr;
+   Level m_priorityLevel = Level::none;
    Logger& m_asyncLogger;
    Encoder<TypeId, Allocator> m_encoder;
    Allocator* m_allocator = nullptr;
+   common::ThreadId m_tid = 0;
+   std::int64_t m_stallTimeout = 0; // nanoseconds, 0: no StallPolicy
+   StallMode m_stallMode = StallMode::drop;
+   std::unique_ptr<StallData> m_stall;
 
 };
 
 template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
-inline AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::AsyncSink(Logger& asyncLogger, std::unique_ptr<SpscQueue> queue, std::unique_ptr<Allocator> allocator, common::ThreadId tid)
+inline AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::AsyncSink(Logger& asyncLogger, std::unique_ptr<SpscQueue> queue, std::unique_ptr<Allocator> allocator, common::ThreadId tid, std::string group)
+   : AsyncSink(asyncLogger, std::move(queue), nullptr, std::move(allocator), tid, std::move(group))
+{
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::AsyncSink(Logger& asyncLogger, std::unique_ptr<SpscQueue> queue, std::unique_ptr<SpscQueue> priorityQueue,
+      std::unique_ptr<Allocator> allocator, common::ThreadId tid, std::string group)
    : m_asyncLogger(asyncLogger)
 {
    typename Logger::AddMsg msg;
    msg.m_queue = std::move(queue);
+   msg.m_priorityQueue = std::move(priorityQueue);
    msg.m_tid = tid;
    msg.m_allocator = std::move(allocator);
+   msg.m_group = std::move(group);
    //
+   Init(msg);
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::AsyncSink(Logger& asyncLogger, common::ThreadId tid, std::string group)
+   : m_asyncLogger(asyncLogger)
+{
+   typename Logger::AddMsg msg = m_asyncLogger.CheckOut(tid);
+   msg.m_group = std::move(group);
+   Init(msg);
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline void AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::Init(typename Logger::AddMsg& msg)
+{
    m_queue = msg.m_queue.get();
+   m_priorityLevel = m_asyncLogger.GetPriorityLevel();
+   m_priorityQueue = m_priorityLevel != Level::none ? msg.m_priorityQueue.get() : nullptr;
    m_allocator = msg.m_allocator.get();
+   m_tid = msg.m_tid;
+   const StallPolicy& policy = m_asyncLogger.GetConfig().GetStallPolicy();
+   m_stallTimeout = policy.IsEnabled() ? policy.m_timeout.count() : 0;
+   m_stallMode = policy.m_mode;
+   if (m_stallTimeout && details::AllocCanWait(*m_allocator))
+   {
+      throw common::ConfigurationException("AsyncSink a StallPolicy needs an allocator which does not wait for the consumer");
+   }
    m_asyncLogger.AddQueue(std::move(msg));
 }
 
@@ -64,13 +194,28 @@ inline AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::~AsyncSink()
    {
       typename Logger::RemoveMsg msg;
       msg.m_queue = m_queue;
+      if (unlikely(m_stall && !m_stall->m_pending.empty()))
+      {
+         timespec now;
+         ::clock_gettime(CLOCK_REALTIME, &now);
+         if (!Recover(m_stall->m_pending.front().second.GetCategory(), now))
+         {
+            // the AsyncLogger writes them and recycles their buffers after draining the queue
+            for (auto& pending : m_stall->m_pending)
+            {
+               msg.m_pending.emplace_back(std::move(pending.second));
+            }
+            m_stall->m_pending.clear();
+         }
+      }
       m_asyncLogger.RemoveQueue(std::move(msg));
    }
 }
 
 template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
 inline AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::AsyncSink(AsyncSink&& rhs)
-   : m_queue(rhs.m_queue), m_asyncLogger(rhs.m_asyncLogger), m_encoder(std::move(rhs.m_encoder)), m_allocator(rhs.m_allocator)
+   : m_queue(rhs.m_queue), m_priorityQueue(rhs.m_priorityQueue), m_priorityLevel(rhs.m_priorityLevel), m_asyncLogger(rhs.m_asyncLogger), m_encoder(std::move(rhs.m_encoder)), m_allocator(rhs.m_allocator),
+   m_tid(rhs.m_tid), m_stallTimeout(rhs.m_stallTimeout), m_stallMode(rhs.m_stallMode), m_stall(std::move(rhs.m_stall))
 {
    rhs.m_queue = nullptr; // IMPORTANT: to call AsyncLogger::RemoveQueue() only once
 }
@@ -81,12 +226,171 @@ inline void /*TBP_NOINLINE*/ AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>:
       const char* fmt, // cf comment before the method declaration
       Args&&... args)
 {
+   if (unlikely(m_stall && m_stall->m_begin))
+   {
+      if (!Recover(category, now))
+      {
+         LogStalled(category, level, now, signal, fmt, std::forward<Args>(args)...);
+         return;
+      }
+   }
    Buffer<Allocator> buffer = m_encoder.Encode(*m_allocator, std::forward<Args>(args)...);
    buffer.Reset();
    Msg<Allocator> msg(now, level, category, fmt, std::move(buffer), signal);
-   while (!m_queue->Enqueue(std::move(msg))) {}
+   Enqueue(GetQueue(level), std::move(msg));
 }
 
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline void AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::LogEncoded(const Category& category, Level level, const timespec& time, common::SigNum signal,
+      const char* fmt, const char* data, std::size_t size)
+{
+   Buffer<Allocator> buffer;
+   if (size)
+   {
+      buffer = Buffer<Allocator>(m_allocator->Alloc(size));
+      buffer.Write(data, size);
+      buffer.Reset();
+   }
+   Msg<Allocator> msg(time, level, category, fmt, std::move(buffer), signal);
+   Enqueue(GetQueue(level), std::move(msg));
 }
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline void AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::Enqueue(SpscQueue* queue, Msg<Allocator>&& msg)
+{
+   if (likely(!m_stallTimeout))
+   {
+      while (!queue->Enqueue(std::move(msg))) {}
+      return;
+   }
+   if (!TryEnqueue(queue, msg))
+   {
+      common::SigNum signal = msg.GetSignal();
+      BeginStall(ConsumerHeartbeat::Now()).m_pending.emplace_back(queue, std::move(msg));
+      if (unlikely(signal))
+      {
+         ExitStalled(m_stall->m_pending.back().second);
+      }
+   }
 }
 
+// waits while the consumer is not stalled, returns false if the message is not enqueued
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline bool AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::TryEnqueue(SpscQueue* queue, Msg<Allocator>& msg)
+{
+   while (!queue->Enqueue(std::move(msg)))
+   {
+      if (IsStalled(ConsumerHeartbeat::Now()))
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline typename AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::StallData& AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::BeginStall(std::int64_t now)
+{
+   if (!m_stall)
+   {
+      m_stall = std::make_unique<StallData>();
+   }
+   if (!m_stall->m_begin)
+   {
+      m_stall->m_begin = now;
+   }
+   return *m_stall;
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+template <typename... Args>
+void TBP_NOINLINE AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::LogStalled(const Category& category, Level level, const timespec& now, common::SigNum signal,
+      const char* fmt, Args&&... args)
+{
+   StallData& stall = BeginStall(ConsumerHeartbeat::Now());
+   if (m_stallMode == StallMode::drop && likely(!signal))
+   {
+      ++stall.m_nbDropped;
+      ReleaseBlobRefs(args...);
+      return;
+   }
+   FileWriter& file = GetEmergencyFile(stall);
+   Buffer<StallAllocator> buffer = stall.m_encoder.Encode(stall.m_allocator, std::forward<Args>(args)...);
+   buffer.Reset();
+   file.WriteHeader(now, m_tid, level, category);
+   stall.m_formatter.Format(fmt, buffer, file.GetWriter());
+   file.WriteToFile();
+   ++stall.m_nbWritten;
+   if (unlikely(signal))
+   {
+      file.Flush();
+      file.Wait();
+      ExitWithDefaultSignalHandler(signal);
+   }
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline FileWriter& AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::GetEmergencyFile(StallData& stall)
+{
+   if (!stall.m_file)
+   {
+      stall.m_file = m_asyncLogger.GetInjector().CreateSharedFileWriter(m_asyncLogger.GetConfig(), "emergency-" + std::to_string(m_tid));
+   }
+   return *stall.m_file;
+}
+
+// the fields of 'msg' are not decoded: the message is still written by the consumer if it recovers
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+void TBP_NOINLINE AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::ExitStalled(const Msg<Allocator>& msg)
+{
+   FileWriter& file = GetEmergencyFile(*m_stall);
+   file.WriteHeader(msg.GetTime(), m_tid, msg.GetLevel(), msg.GetCategory());
+   file.GetWriter() << msg.GetFormat();
+   file.WriteToFile();
+   file.Flush();
+   file.Wait();
+   ExitWithDefaultSignalHandler(msg.GetSignal());
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline void AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::ExitWithDefaultSignalHandler(common::SigNum signalNumber)
+{
+   if (SignalManager* signals = m_asyncLogger.GetSignalManager())
+   {
+      signals->ExitWithDefaultSignalHandler(signalNumber, false);
+   }
+}
+
+// returns false if the consumer is still stalled
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+bool TBP_NOINLINE AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>::Recover(const Category& category, const timespec& now)
+{
+   StallData& stall = *m_stall;
+   auto& pending = stall.m_pending;
+   for (auto iter = pending.begin(); iter != pending.end(); iter = pending.erase(iter))
+   {
+      if (!TryEnqueue(iter->first, iter->second))
+      {
+         return false;
+      }
+   }
+   if (stall.m_file)
+   {
+      stall.m_file->Flush();
+   }
+   std::int64_t duration = ConsumerHeartbeat::Now() - stall.m_begin;
+   std::uint64_t nbDropped = stall.m_nbDropped;
+   std::uint64_t nbWritten = stall.m_nbWritten;
+   stall.m_begin = 0;
+   stall.m_nbDropped = 0;
+   stall.m_nbWritten = 0;
+   Buffer<Allocator> buffer = m_encoder.Encode(*m_allocator, duration / 1000000, nbDropped, nbWritten);
+   buffer.Reset();
+   Msg<Allocator> msg(now, Level::warn, category, "consumer stalled for {} ms: {} messages dropped, {} messages written in the emergency file",
+         std::move(buffer), 0);
+   Enqueue(GetQueue(Level::warn), std::move(msg));
+   return true;
+}
+
+}
+}
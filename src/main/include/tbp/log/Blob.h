@@ -0,0 +1,189 @@
+#pragma once
+
+#include "tbp/log/Type.h"
+#include "tbp/log/Buffer.h"
+#include <cppformat/format.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace tbp
+{
+namespace log
+{
+
+enum class BlobFormat : std::uint8_t
+{
+   hex, // 2 lowercase digits per byte
+   base64, // RFC 4648 with padding
+};
+
+// binary payload (packet, ...) copied into the message with one memcpy, formatted as hex or base64 (the field spec is ignored)
+struct Blob
+{
+   Blob(const void* data, std::size_t size, BlobFormat format = BlobFormat::hex) : m_data(data), m_size(size), m_format(format) {}
+   //
+   const void* m_data = nullptr;
+   std::size_t m_size = 0;
+   BlobFormat m_format = BlobFormat::hex;
+};
+
+// called by the consumer thread once the payload of a BlobRef is formatted
+using BlobRelease = void (*)(const void* data, std::size_t size, void* context);
+
+/*
+- binary payload not copied: only the pointer is encoded, the payload must not change until 'release' is called by the consumer
+'release' is called once the message is formatted, or dropped by the consumer without being formatted (cf ReleaseFields)
+- the payload is copied (as a Blob) by the Allocators which cannot release it (cf BlobByReference)
+- the arguments of a message filtered by the log macros (level, load shedding, cf Logger::ShouldLog) are not evaluated:
+no BlobRef is created, the caller keeps the payload
+*/
+struct BlobRef
+{
+   BlobRef(const void* data, std::size_t size, BlobRelease release, void* context = nullptr, BlobFormat format = BlobFormat::hex)
+      : m_data(data), m_size(size), m_release(release), m_context(context), m_format(format)
+   {}
+   //
+   const void* m_data = nullptr;
+   std::size_t m_size = 0;
+   BlobRelease m_release = nullptr;
+   void* m_context = nullptr;
+   BlobFormat m_format = BlobFormat::hex;
+};
+
+// release of the BlobRefs of a message dropped by the producer before being encoded (cf StallMode::drop)
+inline void ReleaseBlobRefs() {}
+template <typename Head, typename... Tail>
+inline void ReleaseBlobRefs(const Head& /*head*/, const Tail&... tail)
+{
+   ReleaseBlobRefs(tail...);
+}
+template <typename... Tail>
+inline void ReleaseBlobRefs(const BlobRef& head, const Tail&... tail)
+{
+   if (head.m_release)
+   {
+      head.m_release(head.m_data, head.m_size, head.m_context);
+   }
+   ReleaseBlobRefs(tail...);
+}
+
+/*
+- false if a BlobRef encoded with this Allocator could be dropped without being decoded (FlightRecorder)
+or decoded by another process (ShmRingAllocator): the payload is copied
+*/
+template <typename Allocator>
+struct BlobByReference
+{
+   static constexpr bool value = true;
+};
+
+// decoded Blob or BlobRef (cf DecodeField), Release() is called once the field is formatted
+struct BlobField
+{
+   void Release() const
+   {
+      if (m_release)
+      {
+         m_release(m_data, m_size, m_context);
+      }
+   }
+   //
+   const char* m_data = nullptr;
+   std::size_t m_size = 0;
+   BlobFormat m_format = BlobFormat::hex;
+   BlobRelease m_release = nullptr;
+   void* m_context = nullptr;
+};
+
+// releases a decoded field at the end of its scope
+struct BlobReleaser
+{
+   ~BlobReleaser() { m_field.Release(); }
+   //
+   const BlobField& m_field;
+};
+
+/*
+- encoding: format, by reference flag, size, then the payload or the pointer, the release function and its context
+- a reference is only decoded if the Allocator can encode it (cf BlobByReference): the LogDaemon never reads a client pointer
+*/
+template <typename TypeId, typename Allocator>
+struct BlobType
+{
+   static TypeId Id() { return TypeId::BLOB; }
+   static std::size_t SizeofCopy(std::size_t size) { return 2 + sizeof(std::size_t) + size; }
+   static std::size_t SizeofReference() { return 2 + sizeof(std::size_t) + 3 * sizeof(void*); }
+   static void EncodeCopy(Buffer<Allocator>& buffer, const void* data, std::size_t size, BlobFormat format)
+   {
+      std::uint8_t header[2] = { static_cast<std::uint8_t>(format), 0 };
+      buffer.Write(header, sizeof(header));
+      buffer.Write(&size, sizeof(size));
+      buffer.Write(data, size);
+   }
+   static void Decode(Buffer<Allocator>& buffer, BlobField& v)
+   {
+      std::uint8_t header[2] = { 0, 0 };
+      buffer.Read(header, sizeof(header));
+      buffer.Read(&v.m_size, sizeof(v.m_size));
+      v.m_format = static_cast<BlobFormat>(header[0]);
+      if (!header[1])
+      {
+         v.m_data = buffer.ReadInPlace(v.m_size);
+      }
+      else if (BlobByReference<Allocator>::value)
+      {
+         buffer.Read(&v.m_data, sizeof(v.m_data));
+         buffer.Read(&v.m_release, sizeof(v.m_release));
+         buffer.Read(&v.m_context, sizeof(v.m_context));
+      }
+      else
+      {
+         buffer.Advance(3 * sizeof(void*));
+         v.m_data = nullptr;
+         v.m_size = 0;
+      }
+   }
+};
+
+template <typename TypeId, typename Allocator>
+struct Type<Blob, TypeId, Allocator> : public BlobType<TypeId, Allocator>
+{
+   using Base = BlobType<TypeId, Allocator>;
+   static std::size_t Sizeof(const Blob& v) { return Base::SizeofCopy(v.m_size); }
+   static void Encode(Buffer<Allocator>& buffer, const Blob& v) { Base::EncodeCopy(buffer, v.m_data, v.m_size, v.m_format); }
+};
+
+template <typename TypeId, typename Allocator>
+struct Type<BlobRef, TypeId, Allocator> : public BlobType<TypeId, Allocator>
+{
+   using Base = BlobType<TypeId, Allocator>;
+   static std::size_t Sizeof(const BlobRef& v)
+   {
+      return BlobByReference<Allocator>::value ? Base::SizeofReference() : Base::SizeofCopy(v.m_size);
+   }
+   static void Encode(Buffer<Allocator>& buffer, const BlobRef& v)
+   {
+      if (!BlobByReference<Allocator>::value)
+      {
+         // the payload can be released as soon as it is copied
+         Base::EncodeCopy(buffer, v.m_data, v.m_size, v.m_format);
+         if (v.m_release)
+         {
+            v.m_release(v.m_data, v.m_size, v.m_context);
+         }
+         return;
+      }
+      std::uint8_t header[2] = { static_cast<std::uint8_t>(v.m_format), 1 };
+      buffer.Write(header, sizeof(header));
+      buffer.Write(&v.m_size, sizeof(v.m_size));
+      buffer.Write(&v.m_data, sizeof(v.m_data));
+      buffer.Write(&v.m_release, sizeof(v.m_release));
+      buffer.Write(&v.m_context, sizeof(v.m_context));
+   }
+};
+
+// hex or base64 according to the format of the blob, the characters are written by chunks
+void WriteBlob(fmt::MemoryWriter& writer, const BlobField& v);
+
+}
+}
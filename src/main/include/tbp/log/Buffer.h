@@ -1,38 +1,82 @@
 #pragma once
 
+#include "tbp/common/Compiler.h"
 #include <memory>
+#include <vector>
+#include <algorithm>
 #include <cstring>
+#include <cstdint>
 
 namespace tbp
 {
 namespace log
 {
 
+/*
+- a Handle is one contiguous buffer by default (char*, ...)
+- a chained Handle (cf BufferHandle) is a list of segments of the same size: each segment ends with the pointer to the next one
+*/
+template <typename Handle>
+struct BufferSegments
+{
+   static constexpr std::uintptr_t UNBOUNDED = UINTPTR_MAX;
+   // end of the first segment (where the pointer to the next segment is stored), UNBOUNDED if the buffer is contiguous
+   static std::uintptr_t GetEnd(const Handle& /*h*/) { return UNBOUNDED; }
+   // number of bytes of each segment before the pointer to the next segment
+   static std::size_t GetSize(const Handle& /*h*/) { return 0; }
+};
+
+/*
+- Write(), Read() and Advance() cross the segment boundaries of a chained buffer transparently
+- Get() is only contiguous in the current segment: the decoders which need contiguous bytes call ReadInPlace()
+*/
 template <typename Allocator>
 class Buffer
 {
 public:
+   using Segments = BufferSegments<typename Allocator::Handle>;
+   //
    Buffer() = default;
    Buffer(typename Allocator::Handle buffer);
    //
    void Write(const void* data, std::size_t size)
    {
-      memcpy(m_cursor, data, size);
-      m_cursor += size;
+      if (likely(reinterpret_cast<std::uintptr_t>(m_cursor) + size <= m_end))
+      {
+         memcpy(m_cursor, data, size);
+         m_cursor += size;
+         return;
+      }
+      WriteSegments(static_cast<const char*>(data), size);
    }
    void Read(void* data, std::size_t size)
    {
-      memcpy(data, m_cursor, size);
-      m_cursor += size;
+      if (likely(reinterpret_cast<std::uintptr_t>(m_cursor) + size <= m_end))
+      {
+         memcpy(data, m_cursor, size);
+         m_cursor += size;
+         return;
+      }
+      ReadSegments(static_cast<char*>(data), size);
    }
+   /*
+   - returns 'size' contiguous bytes and advances the cursor
+   - the bytes spanning several segments are gathered in a buffer of the calling thread, valid until its next call to ReadInPlace()
+   */
+   const char* ReadInPlace(std::size_t size);
    const char* Get() const { return m_cursor; }
-   void Advance(std::size_t size) { m_cursor += size; }
-   void Reset() { m_cursor = static_cast<char*>(m_buffer); }
+   void Advance(std::size_t size);
+   void Reset();
    void Recycle(Allocator& allocator);
 
 private:
+   void NextSegment();
+   void WriteSegments(const char* data, std::size_t size);
+   void ReadSegments(char* data, std::size_t size);
+   //
    typename Allocator::Handle m_buffer;
    char* m_cursor = nullptr;
+   std::uintptr_t m_end = Segments::UNBOUNDED; // end of the current segment
 
 };
 
@@ -42,12 +86,97 @@ inline Buffer<Allocator>::Buffer(typename Allocator::Handle buffer) : m_buffer(s
    Reset();
 }
 
+template <typename Allocator>
+inline void Buffer<Allocator>::Reset()
+{
+   m_cursor = static_cast<char*>(m_buffer);
+   m_end = Segments::GetEnd(m_buffer);
+}
+
 template <typename Allocator>
 inline void Buffer<Allocator>::Recycle(Allocator& allocator)
 {
    allocator.Free(m_buffer);
 }
 
+template <typename Allocator>
+inline void Buffer<Allocator>::NextSegment()
+{
+   char* next = nullptr;
+   memcpy(&next, reinterpret_cast<const char*>(m_end), sizeof(next));
+   m_cursor = next;
+   m_end = reinterpret_cast<std::uintptr_t>(next) + Segments::GetSize(m_buffer);
 }
+
+template <typename Allocator>
+void TBP_NOINLINE Buffer<Allocator>::WriteSegments(const char* data, std::size_t size)
+{
+   while (size)
+   {
+      if (reinterpret_cast<std::uintptr_t>(m_cursor) == m_end)
+      {
+         NextSegment();
+      }
+      std::size_t n = std::min<std::size_t>(size, m_end - reinterpret_cast<std::uintptr_t>(m_cursor));
+      memcpy(m_cursor, data, n);
+      m_cursor += n;
+      data += n;
+      size -= n;
+   }
 }
 
+template <typename Allocator>
+void TBP_NOINLINE Buffer<Allocator>::ReadSegments(char* data, std::size_t size)
+{
+   while (size)
+   {
+      if (reinterpret_cast<std::uintptr_t>(m_cursor) == m_end)
+      {
+         NextSegment();
+      }
+      std::size_t n = std::min<std::size_t>(size, m_end - reinterpret_cast<std::uintptr_t>(m_cursor));
+      memcpy(data, m_cursor, n);
+      m_cursor += n;
+      data += n;
+      size -= n;
+   }
+}
+
+template <typename Allocator>
+inline void Buffer<Allocator>::Advance(std::size_t size)
+{
+   while (unlikely(reinterpret_cast<std::uintptr_t>(m_cursor) + size > m_end))
+   {
+      size -= m_end - reinterpret_cast<std::uintptr_t>(m_cursor);
+      NextSegment();
+   }
+   m_cursor += size;
+}
+
+template <typename Allocator>
+inline const char* Buffer<Allocator>::ReadInPlace(std::size_t size)
+{
+   if (likely(reinterpret_cast<std::uintptr_t>(m_cursor) + size <= m_end))
+   {
+      const char* data = m_cursor;
+      m_cursor += size;
+      return data;
+   }
+   if (size && reinterpret_cast<std::uintptr_t>(m_cursor) == m_end)
+   {
+      NextSegment();
+      if (reinterpret_cast<std::uintptr_t>(m_cursor) + size <= m_end)
+      {
+         const char* data = m_cursor;
+         m_cursor += size;
+         return data;
+      }
+   }
+   thread_local std::vector<char> gathered;
+   gathered.resize(size);
+   ReadSegments(gathered.data(), size);
+   return gathered.data();
+}
+
+}
+}
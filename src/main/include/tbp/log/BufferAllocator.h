@@ -1,11 +1,15 @@
 #pragma once
 
 #include "tbp/log/BufferHandle.h"
+#include "tbp/log/Numa.h"
 #include "tbp/common/ConfigurationException.h"
 #include "tbp/common/CpuCache.h"
+#include "tbp/common/Compiler.h"
 #include <vector>
 #include <set>
 #include <stdlib.h>
+#include <cstring>
+#include <cstdint>
 #include <cassert>
 
 namespace tbp
@@ -13,6 +17,18 @@ namespace tbp
 namespace log
 {
 
+/*
+- one pool (SpscQueue) of preallocated buffers per size, recycled by the AsyncLogger thread
+- a message bigger than the biggest size is encoded in a chain of buffers of the biggest size (cf BufferSegments)
+- when the pools are empty a buffer is allocated with malloc and freed by the AsyncLogger thread
+without the malloc fallback the producer waits for the AsyncLogger thread to recycle buffers, with no timeout:
+a stalled AsyncLogger blocks the producers (the StallPolicy of the AsyncSinks requires the malloc fallback)
+- a message needing more segments than the biggest pool holds can never be chained: it is always allocated with malloc
+- the pools are only refilled by the AsyncLogger thread (single producer queues): the segments of a chain which cannot be completed
+are kept by the producer (m_spare) and used first by the next chain, the message is allocated with malloc
+- with a NUMA node, the buffers of each pool are carved in one block of memory bound to the node (cf NumaAlloc)
+typically the node of the producer thread (NumaGetCurrentNode) so the encoding does not cross the interconnect
+*/
 template <typename SpscQueue>
 class BufferAllocator
 {
@@ -20,28 +36,39 @@ public:
    using Handle = BufferHandle<SpscQueue>;
    using BufferSizes = std::set<std::size_t>;
    //
-   BufferAllocator(const BufferSizes& bufferSizes, std::size_t nbItemsPerQueue);
+   BufferAllocator(const BufferSizes& bufferSizes, std::size_t nbItemsPerQueue, bool mallocFallback = true, NumaNode node = NUMA_ANY_NODE);
    ~BufferAllocator();
    //
    Handle Alloc(std::size_t size);
    void Free(Handle& h);
+   // false: Alloc() waits for the AsyncLogger thread when the pools are empty
+   bool HasMallocFallback() const { return m_mallocFallback; }
 
 private:
    struct QueueData
    {
       SpscQueue m_queue;
       std::size_t m_size = 0;
+      char* m_block = nullptr; // NUMA bound memory of all the buffers of the pool
    };
    //
    char* AlignedAlloc(std::size_t size);
-   char* AllocSlow(std::size_t size);
+   // the NUMA block of a pool is allocated with one more cache line, the first buffer is aligned like AlignedAlloc()
+   std::size_t GetBlockSize(std::size_t size) const { return size * m_nbItemsPerQueue + common::CpuCacheGetLineSize(); }
+   static char* AlignBlock(char* block);
+   Handle AllocSlow(std::size_t size);
+   Handle AllocChain(std::size_t size);
+   bool TryAlloc(std::size_t size, Handle& h);
    //
    std::vector<QueueData> m_queues;
+   std::size_t m_nbItemsPerQueue = 0;
+   bool m_mallocFallback = true;
+   char* m_spare = nullptr; // segments of the biggest pool linked like a chain, only used by the producer
 
 };
 
 template <typename SpscQueue>
-inline typename BufferAllocator<SpscQueue>::Handle /*TBP_NOINLINE*/ BufferAllocator<SpscQueue>::Alloc(std::size_t size)
+inline bool BufferAllocator<SpscQueue>::TryAlloc(std::size_t size, Handle& h)
 {
    for (auto& data : m_queues)
    {
@@ -50,22 +77,101 @@ inline typename BufferAllocator<SpscQueue>::Handle /*TBP_NOINLINE*/ BufferAlloca
          char* buffer = nullptr;
          if (data.m_queue.Dequeue(buffer))
          {
-            return Handle(buffer, &data.m_queue);
+            h = Handle(buffer, &data.m_queue);
+            return true;
          }
          /*
          if the queue is empty:
-         - we can either allocate a new "aligned" buffer to be enqueued later in this queue
+         - we could allocate a new "aligned" buffer to be enqueued later in this queue
          this strategy only works if the queue used is unbounded
          otherwise the AsyncLogger could be not able to Enqueue this new buffer and it could lead to a deadlock
-         this can be done by uncommenting the line below
-         - or we can allocate a new "custom buffer" which will not be recycled in the queues
-         but will be freed by the AsyncLogger
-         this is what is currenly done by the last line of this function
+         - so a bigger buffer is tried, then AllocSlow() uses malloc (or waits for a recycled buffer without the malloc fallback)
          */
-         //return Handle(AlignedAlloc(data.m_size)), queue);
       }
    }
-   return Handle(AllocSlow(size), nullptr);
+   return false;
+}
+
+template <typename SpscQueue>
+inline typename BufferAllocator<SpscQueue>::Handle /*TBP_NOINLINE*/ BufferAllocator<SpscQueue>::Alloc(std::size_t size)
+{
+   Handle h;
+   if (likely(TryAlloc(size, h)))
+   {
+      return h;
+   }
+   return AllocSlow(size);
+}
+
+template <typename SpscQueue>
+typename BufferAllocator<SpscQueue>::Handle TBP_NOINLINE BufferAllocator<SpscQueue>::AllocSlow(std::size_t size)
+{
+   if (!m_queues.empty())
+   {
+      std::size_t biggest = m_queues.back().m_size;
+      if (size > biggest)
+      {
+         return AllocChain(size);
+      }
+      Handle h;
+      while (!m_mallocFallback)
+      {
+         if (TryAlloc(size, h))
+         {
+            return h;
+         }
+      }
+   }
+   return Handle(static_cast<char*>(malloc(size)), nullptr);
+}
+
+template <typename SpscQueue>
+typename BufferAllocator<SpscQueue>::Handle BufferAllocator<SpscQueue>::AllocChain(std::size_t size)
+{
+   QueueData& data = m_queues.back();
+   std::size_t segmentSize = data.m_size - sizeof(char*);
+   std::size_t nbSegments = (size + segmentSize - 1) / segmentSize;
+   if (nbSegments <= m_nbItemsPerQueue)
+   {
+      char* first = nullptr;
+      char* last = nullptr;
+      std::size_t count = 0;
+      while (count < nbSegments)
+      {
+         char* segment = m_spare;
+         if (segment)
+         {
+            memcpy(&m_spare, segment + segmentSize, sizeof(m_spare));
+         }
+         else if (!data.m_queue.Dequeue(segment))
+         {
+            if (m_mallocFallback)
+            {
+               // not Free(): the producer must not enqueue in the pool
+               m_spare = first;
+               break;
+            }
+            continue;
+         }
+         char* next = nullptr;
+         memcpy(segment + segmentSize, &next, sizeof(next));
+         if (last)
+         {
+            memcpy(last + segmentSize, &segment, sizeof(segment));
+         }
+         else
+         {
+            first = segment;
+         }
+         last = segment;
+         ++count;
+      }
+      if (count == nbSegments)
+      {
+         return Handle(first, &data.m_queue, segmentSize);
+      }
+   }
+   return Handle(static_cast<char*>(malloc(size)), nullptr);
 }
 
 template <typename SpscQueue>
@@ -75,7 +181,20 @@ inline void BufferAllocator<SpscQueue>::Free(Handle& h)
    {
       if (h.m_queue)
       {
-         while (!h.m_queue->Enqueue(h.m_buffer)) {}
+         if (unlikely(h.m_segmentSize))
+         {
+            for (char* segment = h.m_buffer; segment;)
+            {
+               char* next = nullptr;
+               memcpy(&next, segment + h.m_segmentSize, sizeof(next));
+               while (!h.m_queue->Enqueue(segment)) {}
+               segment = next;
+            }
+         }
+         else
+         {
+            while (!h.m_queue->Enqueue(h.m_buffer)) {}
+         }
       }
       else
       {
@@ -86,7 +205,8 @@ inline void BufferAllocator<SpscQueue>::Free(Handle& h)
 }
 
 template <typename SpscQueue>
-BufferAllocator<SpscQueue>::BufferAllocator(const BufferSizes& bufferSizes, std::size_t nbItemsPerQueue) : m_queues(bufferSizes.size())
+BufferAllocator<SpscQueue>::BufferAllocator(const BufferSizes& bufferSizes, std::size_t nbItemsPerQueue, bool mallocFallback, NumaNode node)
+   : m_queues(bufferSizes.size()), m_nbItemsPerQueue(nbItemsPerQueue), m_mallocFallback(mallocFallback)
 {
    std::size_t i = 0;
    for (const auto& size : bufferSizes)
@@ -98,9 +218,17 @@ BufferAllocator<SpscQueue>::BufferAllocator(const BufferSizes& bufferSizes, std:
       }
       QueueData& data = m_queues[i];
       data.m_size = size;
+      char* first = nullptr;
+      if (node != NUMA_ANY_NODE)
+      {
+         data.m_block = static_cast<char*>(NumaAlloc(GetBlockSize(size), node));
+         first = AlignBlock(data.m_block);
+      }
       for (std::size_t j = 0; j < nbItemsPerQueue; ++j)
       {
-         if (!data.m_queue.Enqueue(AlignedAlloc(data.m_size)))
+         // the size is a multiple of the cache line size: the buffers carved in the block are cache line aligned too
+         char* buffer = first ? first + j * size : AlignedAlloc(data.m_size);
+         if (!data.m_queue.Enqueue(buffer))
          {
             throw common::ConfigurationException("BufferAllocator queue is full");
          }
@@ -113,13 +241,26 @@ BufferAllocator<SpscQueue>::BufferAllocator(const BufferSizes& bufferSizes, std:
 template <typename SpscQueue>
 BufferAllocator<SpscQueue>::~BufferAllocator()
 {
+   if (m_spare && !m_queues.back().m_block)
+   {
+      std::size_t segmentSize = m_queues.back().m_size - sizeof(char*);
+      while (char* segment = m_spare)
+      {
+         memcpy(&m_spare, segment + segmentSize, sizeof(m_spare));
+         free(segment);
+      }
+   }
    for (auto& data : m_queues)
    {
       char* buffer;
       while (data.m_queue.Dequeue(buffer))
       {
-         free(buffer);
+         if (!data.m_block)
+         {
+            free(buffer);
+         }
       }
+      NumaFree(data.m_block, GetBlockSize(data.m_size));
    }
 }
 
@@ -137,11 +278,16 @@ char* BufferAllocator<SpscQueue>::AlignedAlloc(std::size_t size)
 }
 
 template <typename SpscQueue>
-char* BufferAllocator<SpscQueue>::AllocSlow(std::size_t size)
+char* BufferAllocator<SpscQueue>::AlignBlock(char* block)
 {
-   return static_cast<char*>(malloc(size));
+   if (!block)
+   {
+      return nullptr;
+   }
+   std::uintptr_t lineSize = common::CpuCacheGetLineSize();
+   std::uintptr_t address = reinterpret_cast<std::uintptr_t>(block);
+   return block + ((lineSize - address % lineSize) % lineSize);
 }
 
 }
 }
-
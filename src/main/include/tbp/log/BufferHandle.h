@@ -1,5 +1,6 @@
 #pragma once
 
+#include "tbp/log/Buffer.h"
 #include <cassert>
 #include <cstdlib>
 
@@ -15,7 +16,7 @@ class BufferHandle
 {
 public:
    BufferHandle() = default;
-   BufferHandle(char* buffer, SpscQueue* queue) : m_buffer(buffer), m_queue(queue) {}
+   BufferHandle(char* buffer, SpscQueue* queue, std::size_t segmentSize = 0) : m_buffer(buffer), m_queue(queue), m_segmentSize(segmentSize) {}
    ~BufferHandle();
    BufferHandle(const BufferHandle& rhs) = delete;
    BufferHandle& operator=(const BufferHandle& rhs) = delete;
@@ -23,6 +24,9 @@ public:
    BufferHandle& operator=(BufferHandle&& rhs);
    //
    explicit operator char*() { return m_buffer; }
+   const char* Get() const { return m_buffer; }
+   // 0 if the buffer is not chained, otherwise the size of each segment before the pointer to the next one (cf BufferSegments)
+   std::size_t GetSegmentSize() const { return m_segmentSize; }
 
 private:
    friend class BufferAllocator<SpscQueue>;
@@ -30,6 +34,7 @@ private:
    //
    char* m_buffer = nullptr;
    SpscQueue* m_queue = nullptr;
+   std::size_t m_segmentSize = 0;
 
 };
 
@@ -52,7 +57,7 @@ inline BufferHandle<SpscQueue>::~BufferHandle()
 }
 
 template <typename SpscQueue>
-inline BufferHandle<SpscQueue>::BufferHandle(BufferHandle&& rhs) : m_buffer(rhs.m_buffer), m_queue(rhs.m_queue)
+inline BufferHandle<SpscQueue>::BufferHandle(BufferHandle&& rhs) : m_buffer(rhs.m_buffer), m_queue(rhs.m_queue), m_segmentSize(rhs.m_segmentSize)
 {
    rhs.m_buffer = nullptr;
 }
@@ -64,11 +69,25 @@ inline BufferHandle<SpscQueue>& BufferHandle<SpscQueue>::operator=(BufferHandle&
    //
    m_buffer = rhs.m_buffer;
    m_queue = rhs.m_queue;
+   m_segmentSize = rhs.m_segmentSize;
    //
    rhs.m_buffer = nullptr;
    return *this;
 }
 
+// chained buffer allocated by BufferAllocator for a message bigger than its biggest buffer size
+template <typename SpscQueue>
+struct BufferSegments<BufferHandle<SpscQueue>>
+{
+   static constexpr std::uintptr_t UNBOUNDED = UINTPTR_MAX;
+   static std::uintptr_t GetEnd(const BufferHandle<SpscQueue>& h)
+   {
+      std::size_t size = h.GetSegmentSize();
+      return size ? reinterpret_cast<std::uintptr_t>(h.Get()) + size : UNBOUNDED;
+   }
+   static std::size_t GetSize(const BufferHandle<SpscQueue>& h) { return h.GetSegmentSize(); }
+};
+
 }
 }
 
@@ -1,12 +1,28 @@
 #pragma once
 
+#include "tbp/log/Routes.h"
+#include "tbp/log/Level.h"
+#include "tbp/log/FlushPolicy.h"
+#include "tbp/log/FileRotation.h"
+#include "tbp/log/FileIndex.h"
+#include "tbp/log/LoadShedder.h"
+#include "tbp/log/ConsumerHeartbeat.h"
+#include <map>
 #include <string>
+#include <cstddef>
+#include <cstdint>
 
 namespace tbp
 {
 namespace log
 {
 
+enum class OutputFormat : std::uint8_t
+{
+   text,
+   json, // one JSON object per line (cf JsonFormatter)
+};
+
 class Config
 {
 public:
@@ -16,13 +32,75 @@ public:
    //
    const std::string& GetOutputDir() const { return m_outputDir; }
    const std::string& GetFilePrefix() const { return m_filePrefix; }
+   /*
+   maximum number of log files shared by the AsyncLogger queues without group (0: one log file per queue)
+   the queues are spread on the least used files, the log line header contains the thread id
+   */
+   std::size_t GetMaxFileWriters() const { return m_maxFileWriters; }
+   void SetMaxFileWriters(std::size_t val) { m_maxFileWriters = val; }
+   // format of the log files written by the AsyncLogger
+   OutputFormat GetOutputFormat() const { return m_outputFormat; }
+   void SetOutputFormat(OutputFormat val) { m_outputFormat = val; }
+   // per-category output destinations (cf Routes)
+   const Routes& GetRoutes() const { return m_routes; }
+   Routes& GetRoutes() { return m_routes; }
+   /*
+   flush policy of the log files (cf FlushPolicy)
+   a named policy is used by the file of a group or of a route destination with the same name, the default policy by the other files
+   */
+   const FlushPolicy& GetFlushPolicy() const { return m_flushPolicy; }
+   void SetFlushPolicy(const FlushPolicy& val) { m_flushPolicy = val; }
+   const FlushPolicy& GetFlushPolicy(const std::string& name) const;
+   void SetFlushPolicy(const std::string& name, const FlushPolicy& val) { m_flushPolicies[name] = val; }
+   // rotation of all the log files (cf RotationPolicy)
+   const RotationPolicy& GetRotationPolicy() const { return m_rotationPolicy; }
+   void SetRotationPolicy(const RotationPolicy& val) { m_rotationPolicy = val; }
+   // sidecar index of all the log files (cf IndexPolicy)
+   const IndexPolicy& GetIndexPolicy() const { return m_indexPolicy; }
+   void SetIndexPolicy(const IndexPolicy& val) { m_indexPolicy = val; }
+   /*
+   - the messages with this level or above are enqueued in the priority lane of the AsyncSinks which have one
+   the AsyncLogger writes them before the other messages, so they can be written before older messages of the same thread
+   - Level::none: the sinks taken from the pool of the AsyncLogger have no priority lane (cf AsyncLogger::CheckOut)
+   */
+   Level GetPriorityLevel() const { return m_priorityLevel; }
+   void SetPriorityLevel(Level val) { m_priorityLevel = val; }
+   /*
+   - maximum number of messages dequeued from each queue by a call to AsyncLogger::LogMessages() (0: no limit, the queues are drained)
+   the priority lanes are drained at the beginning of each call: their latency is bounded by the budget times the number of queues
+   */
+   std::size_t GetDrainBudget() const { return m_drainBudget; }
+   void SetDrainBudget(std::size_t val) { m_drainBudget = val; }
+   // shedding of the low levels when the AsyncLogger falls behind (cf LoadShedPolicy), disabled by default
+   const LoadShedPolicy& GetLoadShedPolicy() const { return m_loadShedPolicy; }
+   void SetLoadShedPolicy(const LoadShedPolicy& val) { m_loadShedPolicy = val; }
+   // behavior of the AsyncSinks when the consumer stops making progress (cf StallPolicy), disabled by default
+   const StallPolicy& GetStallPolicy() const { return m_stallPolicy; }
+   void SetStallPolicy(const StallPolicy& val) { m_stallPolicy = val; }
 
 private:
    std::string m_outputDir;
    std::string m_filePrefix;
+   std::size_t m_maxFileWriters = 0;
+   Routes m_routes;
+   OutputFormat m_outputFormat = OutputFormat::text;
+   FlushPolicy m_flushPolicy;
+   std::map<std::string, FlushPolicy> m_flushPolicies;
+   RotationPolicy m_rotationPolicy;
+   IndexPolicy m_indexPolicy;
+   Level m_priorityLevel = Level::warn;
+   std::size_t m_drainBudget = 0;
+   LoadShedPolicy m_loadShedPolicy;
+   StallPolicy m_stallPolicy;
 
 };
 
+inline const FlushPolicy& Config::GetFlushPolicy(const std::string& name) const
+{
+   auto iter = m_flushPolicies.find(name);
+   return iter != m_flushPolicies.end() ? iter->second : m_flushPolicy;
+}
+
 }
 }
 
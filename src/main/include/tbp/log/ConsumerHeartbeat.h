@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <time.h>
+
+namespace tbp
+{
+namespace log
+{
+
+// what an AsyncSink does with its messages while the consumer is stalled
+enum class StallMode : std::uint8_t
+{
+   drop, // the messages are counted and dropped
+   file, // the messages are written synchronously in an emergency file of the thread
+};
+
+/*
+- the consumer is stalled when a queue is full and its heartbeat (cf ConsumerHeartbeat) is older than m_timeout
+an idle consumer is not stalled
+- the AsyncSinks do not wait for a stalled consumer: their messages are handled according to m_mode
+once the consumer beats again, the sinks resume and log the gap (duration and number of messages)
+*/
+struct StallPolicy
+{
+   bool IsEnabled() const { return m_timeout.count() > 0; }
+   //
+   std::chrono::nanoseconds m_timeout{ 0 }; // 0: the sinks wait for the consumer
+   StallMode m_mode = StallMode::drop;
+};
+
+/*
+- progress of the consumer: Beat() is called by AsyncLogger::LogMessages() at each pass and after each queue drained
+- Beat() is also called every BEAT_INTERVAL messages while a queue is drained
+- the time is CLOCK_MONOTONIC_COARSE (a few milliseconds of resolution): the timeout of the StallPolicy must be much bigger
+- the heartbeat is only stored when the coarse time changes, the cache line is not written at each pass
+*/
+class ConsumerHeartbeat
+{
+public:
+   static constexpr std::size_t BEAT_INTERVAL = 64;
+   //
+   ConsumerHeartbeat() : m_last(Now()) {}
+   //
+   void Beat()
+   {
+      std::int64_t now = Now();
+      if (now != m_last.load(std::memory_order_relaxed))
+      {
+         m_last.store(now, std::memory_order_relaxed);
+      }
+   }
+   std::int64_t GetLast() const { return m_last.load(std::memory_order_relaxed); }
+   bool IsStalled(std::int64_t now, std::int64_t timeout) const { return now - GetLast() > timeout; }
+   static std::int64_t Now()
+   {
+      timespec now;
+      clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+      return ToNanos(now);
+   }
+   static std::int64_t ToNanos(const timespec& time) { return static_cast<std::int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec; }
+
+private:
+   alignas(64) std::atomic<std::int64_t> m_last;
+
+};
+
+}
+}
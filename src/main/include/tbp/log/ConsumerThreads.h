@@ -0,0 +1,92 @@
+#pragma once
+
+#include "tbp/common/Compiler.h"
+#include "tbp/common/OS.h"
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <functional>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+base of the consumers running several AsyncLoggers (cf PipelinedConsumer, NumaConsumer):
+- one thread per AsyncLogger calling LogMessages() in a loop
+- a signal logged by a producer (cf SignalManager) is available with GetSignal() once the message is written
+- IMPORTANT: the derived class calls Stop() in its destructor, the threads must not outlive the AsyncLoggers
+*/
+template <typename Logger>
+class ConsumerThreads
+{
+public:
+   using OnStartThread = std::function<void(std::size_t index)>; // index of the AsyncLogger
+   //
+   // the messages already enqueued are formatted before Stop() returns
+   void Stop();
+   common::SigNum GetSignal() const { return m_signal.load(std::memory_order_acquire); }
+
+protected:
+   ConsumerThreads() : m_stop(false), m_signal(0) {}
+   ~ConsumerThreads() = default;
+   ConsumerThreads(const ConsumerThreads&) = delete;
+   ConsumerThreads& operator=(const ConsumerThreads&) = delete;
+   //
+   void Start(const std::vector<std::unique_ptr<Logger>>& loggers, OnStartThread onStart);
+
+private:
+   void Run(Logger& logger, std::size_t index, const OnStartThread& onStart);
+   //
+   std::vector<std::thread> m_threads;
+   std::atomic<bool> m_stop;
+   std::atomic<common::SigNum> m_signal;
+
+};
+
+template <typename Logger>
+inline void ConsumerThreads<Logger>::Start(const std::vector<std::unique_ptr<Logger>>& loggers, OnStartThread onStart)
+{
+   m_stop.store(false);
+   for (std::size_t i = 0; i < loggers.size(); ++i)
+   {
+      Logger* logger = loggers[i].get();
+      m_threads.emplace_back([this, logger, i, onStart] { Run(*logger, i, onStart); });
+   }
+}
+
+template <typename Logger>
+inline void ConsumerThreads<Logger>::Stop()
+{
+   m_stop.store(true);
+   for (auto& thread : m_threads)
+   {
+      thread.join();
+   }
+   m_threads.clear();
+}
+
+template <typename Logger>
+inline void ConsumerThreads<Logger>::Run(Logger& logger, std::size_t index, const OnStartThread& onStart)
+{
+   if (onStart)
+   {
+      onStart(index);
+   }
+   bool stop = false;
+   while (!stop)
+   {
+      stop = m_stop.load(std::memory_order_acquire);
+      common::SigNum signal = logger.LogMessages();
+      if (unlikely(signal))
+      {
+         common::SigNum expected = 0;
+         m_signal.compare_exchange_strong(expected, signal);
+      }
+   }
+}
+
+}
+}
@@ -2,9 +2,16 @@
 
 #include "tbp/log/Type.h"
 #include "tbp/log/Buffer.h"
+#include "tbp/log/StaticString.h"
+#include "tbp/log/Blob.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <type_traits>
+#include <vector>
 
 namespace tbp
 {
@@ -19,6 +26,9 @@ enum class DefaultTypeId : std::uint8_t
    INT64,
    DOUBLE,
    STRING,
+   ARRAY, // std::vector, std::array or Span of INT, UINT64, INT64 or DOUBLE (cf ArrayType)
+   STATIC_STRING, // pointer and size (cf StaticString)
+   BLOB, // binary payload copied or by reference (cf Blob, BlobRef)
 };
 
 template <typename T, typename Allocator, typename std::enable_if<std::is_arithmetic<T>::value>::type* = nullptr>
@@ -74,11 +84,198 @@ struct Type<std::string, TypeId, Allocator>
    {
       std::size_t size = 0;
       buffer.Read(&size, sizeof(size));
-      v.assign(buffer.Get(), size);
-      buffer.Advance(size);
+      v.resize(size);
+      buffer.Read(&v[0], size);
+   }
+};
+/*
+- maximum number of elements encoded for a container (cf ArrayType), the other elements are only counted
+- can be changed while logging: the value is read once per message (cf details::ArraySizeSnapshot)
+*/
+inline std::atomic<std::size_t>& MaxArraySize()
+{
+   static std::atomic<std::size_t> maxSize{ 1024 };
+   return maxSize;
+}
+inline std::size_t GetMaxArraySize() { return MaxArraySize().load(std::memory_order_relaxed); }
+inline void SetMaxArraySize(std::size_t val) { MaxArraySize().store(val, std::memory_order_relaxed); }
+
+namespace details
+{
+
+/*
+- the size of the fields is computed (Sizeof) before they are encoded (Encode): both must use the same maximum
+- the first container of a message takes the snapshot, it is released by the Encode of the last one
+*/
+struct ArraySizeSnapshot
+{
+   std::size_t m_value = 0;
+   std::size_t m_pending = 0; // containers sized but not encoded yet
+};
+
+inline ArraySizeSnapshot& GetArraySizeSnapshot()
+{
+   static thread_local ArraySizeSnapshot snapshot;
+   return snapshot;
+}
+
+}
+
+// contiguous elements not owned (pointer + size), to log a raw array without copying it
+template <typename T>
+struct Span
+{
+   const T* m_data = nullptr;
+   std::size_t m_size = 0;
+};
+
+template <typename T>
+inline Span<T> MakeSpan(const T* data, std::size_t size)
+{
+   return Span<T>{ data, size };
+}
+
+/*
+- the elements (trivially copyable, with the TypeId INT, UINT64, INT64 or DOUBLE) are copied with one memcpy
+- encoding: element TypeId, number of elements encoded, number of elements of the container, elements
+*/
+template <typename T, typename TypeId, typename Allocator>
+struct ArrayType
+{
+   static_assert(std::is_arithmetic<T>::value && std::is_trivially_copyable<T>::value, "ArrayType: only arithmetic elements");
+   //
+   static TypeId Id() { return TypeId::ARRAY; }
+   static std::size_t Sizeof(const T* /*data*/, std::size_t size)
+   {
+      auto& snapshot = details::GetArraySizeSnapshot();
+      if (!snapshot.m_pending++)
+      {
+         snapshot.m_value = GetMaxArraySize();
+      }
+      return sizeof(TypeId) + 2 * sizeof(std::size_t) + std::min(size, snapshot.m_value) * sizeof(T);
+   }
+   static void Encode(Buffer<Allocator>& buffer, const T* data, std::size_t size)
+   {
+      auto& snapshot = details::GetArraySizeSnapshot();
+      std::size_t encoded = std::min(size, snapshot.m_value);
+      if (snapshot.m_pending)
+      {
+         --snapshot.m_pending;
+      }
+      TypeId typeId = Type<T, TypeId, Allocator>::Id();
+      buffer.Write(&typeId, sizeof(typeId));
+      buffer.Write(&encoded, sizeof(encoded));
+      buffer.Write(&size, sizeof(size));
+      buffer.Write(data, encoded * sizeof(T));
    }
 };
 
+template <typename T, typename TypeId, typename Allocator>
+struct Type<std::vector<T>, TypeId, Allocator> : public ArrayType<T, TypeId, Allocator>
+{
+   using Base = ArrayType<T, TypeId, Allocator>;
+   static std::size_t Sizeof(const std::vector<T>& v) { return Base::Sizeof(v.data(), v.size()); }
+   static void Encode(Buffer<Allocator>& buffer, const std::vector<T>& v) { Base::Encode(buffer, v.data(), v.size()); }
+};
+
+template <typename T, std::size_t N, typename TypeId, typename Allocator>
+struct Type<std::array<T, N>, TypeId, Allocator> : public ArrayType<T, TypeId, Allocator>
+{
+   using Base = ArrayType<T, TypeId, Allocator>;
+   static std::size_t Sizeof(const std::array<T, N>& v) { return Base::Sizeof(v.data(), N); }
+   static void Encode(Buffer<Allocator>& buffer, const std::array<T, N>& v) { Base::Encode(buffer, v.data(), N); }
+};
+
+template <typename T, typename TypeId, typename Allocator>
+struct Type<Span<T>, TypeId, Allocator> : public ArrayType<T, TypeId, Allocator>
+{
+   using Base = ArrayType<T, TypeId, Allocator>;
+   static std::size_t Sizeof(const Span<T>& v) { return Base::Sizeof(v.m_data, v.m_size); }
+   static void Encode(Buffer<Allocator>& buffer, const Span<T>& v) { Base::Encode(buffer, v.m_data, v.m_size); }
+};
+
+/*
+- decoded container (cf ArrayType), the elements stay in the buffer (not aligned), or are gathered if they span several segments (cf Buffer::ReadInPlace)
+- ForEach(func) calls func(v) for each element encoded with its type (int, std::uint64_t, std::int64_t or double)
+*/
+template <typename TypeId>
+struct ArrayField
+{
+   template <typename Allocator>
+   void Decode(Buffer<Allocator>& buffer);
+   template <typename FUNC>
+   void ForEach(FUNC&& func) const;
+   template <typename T, typename FUNC>
+   void ForEachOf(FUNC& func) const;
+   //
+   TypeId m_typeId = TypeId::NONE; // of the elements
+   std::size_t m_size = 0; // number of elements encoded
+   std::size_t m_total = 0; // number of elements of the container
+   const char* m_data = nullptr;
+};
+
+template <typename TypeId>
+template <typename Allocator>
+inline void ArrayField<TypeId>::Decode(Buffer<Allocator>& buffer)
+{
+   buffer.Read(&m_typeId, sizeof(m_typeId));
+   buffer.Read(&m_size, sizeof(m_size));
+   buffer.Read(&m_total, sizeof(m_total));
+   std::size_t elementSize = 0;
+   switch (m_typeId)
+   {
+      case TypeId::INT:
+         elementSize = sizeof(int);
+         break;
+      case TypeId::UINT64:
+         elementSize = sizeof(std::uint64_t);
+         break;
+      case TypeId::INT64:
+         elementSize = sizeof(std::int64_t);
+         break;
+      case TypeId::DOUBLE:
+         elementSize = sizeof(double);
+         break;
+      default:
+         break;
+   }
+   m_data = buffer.ReadInPlace(m_size * elementSize);
 }
+
+template <typename TypeId>
+template <typename FUNC>
+inline void ArrayField<TypeId>::ForEach(FUNC&& func) const
+{
+   switch (m_typeId)
+   {
+      case TypeId::INT:
+         ForEachOf<int>(func);
+         break;
+      case TypeId::UINT64:
+         ForEachOf<std::uint64_t>(func);
+         break;
+      case TypeId::INT64:
+         ForEachOf<std::int64_t>(func);
+         break;
+      case TypeId::DOUBLE:
+         ForEachOf<double>(func);
+         break;
+      default:
+         break;
+   }
 }
 
+template <typename TypeId>
+template <typename T, typename FUNC>
+inline void ArrayField<TypeId>::ForEachOf(FUNC& func) const
+{
+   for (std::size_t i = 0; i < m_size; ++i)
+   {
+      T v;
+      std::memcpy(&v, m_data + i * sizeof(T), sizeof(T));
+      func(v);
+   }
+}
+
+}
+}
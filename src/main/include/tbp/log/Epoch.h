@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <cstddef>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- minimal epoch based reclamation (RCU like)
+- the readers use Enter()/Exit() around the access to the shared objects, they never wait
+- Synchronize() returns once all the readers which entered before the call have exited
+after an object has been unpublished, it can be destroyed once Synchronize() returns
+- the readers are split in 2 counters, the current epoch selects the counter used by new readers
+Synchronize() switches the epoch twice so that each counter can drain while the new readers use the other one
+- the Synchronize() calls are serialized: concurrent switches could send the new readers back to the counter being drained and starve it
+the wait is bounded by the longest read section (the readers are short and never wait)
+a call returns without switching if a whole Synchronize() started after it while it was waiting for the mutex (many loggers removed at once, ...)
+*/
+class Epoch
+{
+public:
+   using Token = std::size_t;
+   //
+   Epoch() : m_current(0) { m_readers[0].store(0); m_readers[1].store(0); }
+   Epoch(const Epoch&) = delete;
+   Epoch& operator=(const Epoch&) = delete;
+   //
+   Token Enter();
+   void Exit(Token token) { m_readers[token].fetch_sub(1); }
+   void Synchronize();
+
+private:
+   void Wait(Token token) const
+   {
+      while (m_readers[token].load() != 0)
+      {
+         std::this_thread::yield();
+      }
+   }
+   //
+   std::atomic<std::size_t> m_current;
+   std::atomic<std::size_t> m_readers[2];
+   std::mutex m_syncMutex;
+   std::size_t m_synchronized = 0; // epoch at the end of the last Synchronize()
+
+};
+
+inline Epoch::Token Epoch::Enter()
+{
+   while (true)
+   {
+      std::size_t epoch = m_current.load();
+      Token token = epoch & 1;
+      m_readers[token].fetch_add(1);
+      if (m_current.load() == epoch)
+      {
+         return token;
+      }
+      m_readers[token].fetch_sub(1); // the epoch changed, a Synchronize() may be waiting for this counter
+   }
+}
+
+inline void Epoch::Synchronize()
+{
+   // the epoch only changes in Synchronize(): a call which ends after start + 2 has started after this one
+   std::size_t start = m_current.load();
+   std::lock_guard<std::mutex> lock(m_syncMutex);
+   //
+   if (m_synchronized >= start + 2)
+   {
+      return;
+   }
+   // observing each counter at 0 once is enough: a reader which entered before the call is counted until it exits
+   std::size_t epoch = m_current.fetch_add(1);
+   Wait(epoch & 1);
+   m_current.fetch_add(1);
+   Wait((epoch + 1) & 1);
+   m_synchronized = epoch + 2;
+}
+
+class EpochGuard
+{
+public:
+   explicit EpochGuard(Epoch& epoch) : m_epoch(epoch), m_token(epoch.Enter()) {}
+   ~EpochGuard() { m_epoch.Exit(m_token); }
+   EpochGuard(const EpochGuard&) = delete;
+   EpochGuard& operator=(const EpochGuard&) = delete;
+
+private:
+   Epoch& m_epoch;
+   Epoch::Token m_token;
+
+};
+
+}
+}
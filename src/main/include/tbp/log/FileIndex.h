@@ -0,0 +1,204 @@
+#pragma once
+
+#include "tbp/log/Category.h"
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- sidecar index of the log files (<log file>.idx, cf FileIndex), used by tbp-log-query to seek to time ranges
+- a block is closed every m_lines lines or when a line is m_interval after the first line of the block
+*/
+struct IndexPolicy
+{
+   bool IsEnabled() const { return m_lines || m_interval.count(); }
+   //
+   std::size_t m_lines = 0; // 0: no limit on the number of lines of a block
+   std::chrono::nanoseconds m_interval{ 0 }; // 0: no limit on the duration of a block
+};
+
+// header of a line given to the FileIndex (cf FileWriter::WriteHeader)
+struct IndexedLine
+{
+   std::uint64_t m_time = 0; // nanoseconds since the epoch, 0: line without header (JSON, ...)
+   const Category* m_category = nullptr;
+};
+
+/*
+- index of a log file written by the thread writing the file (cf FileWriter), the records are appended:
+   - "TBPIDX1\n"
+   - category: CategoryRecord, then the label, written before the first block counting the category
+   - block: BlockRecord, then m_nbCounts pairs (category id, number of lines)
+- the blocks are contiguous ranges of the log file, the block being filled is written when it is closed
+the end of the log file after the last block is not indexed yet
+- the categories ids are local to the file
+*/
+class FileIndex
+{
+public:
+   static constexpr char MAGIC[] = "TBPIDX1\n";
+   static constexpr std::uint32_t CATEGORY = 1;
+   static constexpr std::uint32_t BLOCK = 2;
+   struct CategoryRecord
+   {
+      std::uint32_t m_type;
+      std::uint32_t m_id;
+      std::uint32_t m_size; // of the label
+      std::uint32_t m_padding;
+   };
+   struct BlockRecord
+   {
+      std::uint32_t m_type;
+      std::uint32_t m_nbCounts;
+      std::uint64_t m_offset;
+      std::uint64_t m_size;
+      std::uint64_t m_firstTime;
+      std::uint64_t m_lastTime;
+      std::uint64_t m_nbLines;
+   };
+   //
+   explicit FileIndex(const IndexPolicy& policy);
+   FileIndex(const FileIndex&) = delete;
+   FileIndex& operator=(const FileIndex&) = delete;
+   //
+   // 'logPath' is the path of the log file, its index is written in <logPath>.idx
+   bool Open(const std::string& logPath);
+   // a line starting at 'offset' in the log file
+   void Add(std::uint64_t offset, const IndexedLine& line);
+   // the blocks closed are written to the file
+   void Flush() { m_file.flush(); }
+   // the block being filled ends at 'end' (size of the log file)
+   void Close(std::uint64_t end);
+
+private:
+   void WriteBlock(std::uint64_t end);
+   std::uint32_t GetId(const Category* category);
+   //
+   std::ofstream m_file;
+   std::size_t m_maxLines = 0;
+   std::int64_t m_interval = 0;
+   // block being filled
+   std::uint64_t m_offset = 0;
+   std::uint64_t m_firstTime = 0;
+   std::uint64_t m_lastTime = 0;
+   std::uint64_t m_nbLines = 0;
+   std::vector<std::uint32_t> m_counts; // per category id
+   // category ids of the file
+   std::unordered_map<const Category*, std::uint32_t> m_ids;
+   const Category* m_lastCategory = nullptr;
+   std::uint32_t m_lastId = 0;
+
+};
+
+inline void FileIndex::Add(std::uint64_t offset, const IndexedLine& line)
+{
+   if (!line.m_time)
+   {
+      return;
+   }
+   if (m_nbLines && (m_nbLines >= m_maxLines || static_cast<std::int64_t>(line.m_time - m_firstTime) >= m_interval))
+   {
+      WriteBlock(offset);
+   }
+   if (!m_nbLines)
+   {
+      m_offset = offset;
+      m_firstTime = line.m_time;
+      m_lastTime = line.m_time;
+   }
+   else if (line.m_time > m_lastTime)
+   {
+      m_lastTime = line.m_time;
+   }
+   else if (line.m_time < m_firstTime)
+   {
+      // file shared by several threads (cf Config::GetMaxFileWriters)
+      m_firstTime = line.m_time;
+   }
+   ++m_nbLines;
+   if (line.m_category)
+   {
+      ++m_counts[GetId(line.m_category)];
+   }
+}
+
+inline std::uint32_t FileIndex::GetId(const Category* category)
+{
+   if (category != m_lastCategory)
+   {
+      auto res = m_ids.emplace(category, static_cast<std::uint32_t>(m_ids.size()));
+      if (res.second)
+      {
+         const std::string& label = category->GetLabel();
+         CategoryRecord record{ CATEGORY, res.first->second, static_cast<std::uint32_t>(label.size()), 0 };
+         m_file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+         m_file.write(label.data(), label.size());
+         m_counts.push_back(0);
+      }
+      m_lastCategory = category;
+      m_lastId = res.first->second;
+   }
+   return m_lastId;
+}
+
+/*
+- blocks of a log file read from its index (cf FileIndex), used by tbp-log-query
+- the lines of the log file are only read in the blocks overlapping the time range and counting one of the categories
+*/
+class FileIndexReader
+{
+public:
+   struct Block
+   {
+      std::uint64_t m_offset = 0;
+      std::uint64_t m_size = 0;
+      std::uint64_t m_firstTime = 0;
+      std::uint64_t m_lastTime = 0;
+      std::uint64_t m_nbLines = 0;
+      std::vector<std::pair<std::uint32_t, std::uint32_t>> m_counts; // category id, number of lines
+   };
+   //
+   // 'logPath' is the path of the log file, throws a ConfigurationException if its index cannot be read
+   explicit FileIndexReader(const std::string& logPath);
+   //
+   const std::vector<Block>& GetBlocks() const { return m_blocks; }
+   const std::vector<std::string>& GetCategories() const { return m_categories; }
+   struct Range
+   {
+      std::uint64_t m_offset;
+      std::uint64_t m_size;
+      std::uint64_t m_firstTime; // of the first block of the range
+   };
+   /*
+   - ranges of the log file which can contain lines between 'from' and 'to' (nanoseconds since the epoch)
+   of one of 'categories' (all the categories if empty), the adjacent blocks are merged
+   - the end of the log file after the last block (not indexed yet) is always included
+   */
+   std::vector<Range> Find(std::uint64_t from, std::uint64_t to, const std::vector<std::string>& categories = {}) const;
+   /*
+   - write to 'out' the lines of the ranges found between 'from' and 'to' of one of 'categories', returns the number of records
+   - the lines without header (message with a new line, ...) stay with the previous record
+   - the day of the time of the lines ([HH:MM:SS.nnnnnnnnn], local time) is the day nearest to the previous record
+   */
+   std::size_t Query(std::uint64_t from, std::uint64_t to, const std::vector<std::string>& categories, std::ostream& out) const;
+
+private:
+   std::string m_logPath;
+   std::vector<Block> m_blocks;
+   std::vector<std::string> m_categories; // per id
+
+};
+
+}
+}
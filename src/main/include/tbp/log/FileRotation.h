@@ -0,0 +1,87 @@
+#pragma once
+
+#include "tbp/log/LogFile.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <cstddef>
+#include <ctime>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- background thread opening the next log files and closing the rotated ones (cf RotationPolicy)
+- the tasks are executed in order, the FileOpener must outlive the FileWriters using it
+*/
+class FileOpener
+{
+public:
+   FileOpener();
+   ~FileOpener();
+   FileOpener(const FileOpener&) = delete;
+   FileOpener& operator=(const FileOpener&) = delete;
+   //
+   void Post(std::function<void()> task);
+   // returns once the tasks posted before are executed (the rotated files are closed, ...)
+   void Wait();
+
+private:
+   void Run();
+   //
+   std::mutex m_mutex;
+   std::condition_variable m_posted;
+   std::deque<std::function<void()>> m_tasks;
+   bool m_stop = false;
+   std::thread m_thread;
+
+};
+
+/*
+- rotation of the log files: <prefix>_<date>-<suffix>.log, then <prefix>_<date>-<suffix>.1.log, .2.log, ...
+- a file is rotated when it reaches m_maxSize bytes or at each m_period boundary (aligned on the local midnight)
+- the next file is opened (and pre-allocated) by the FileOpener as soon as the current file is opened
+the thread writing the file only swaps the streams, the rotated file is closed by the FileOpener
+if the next file is not ready yet, the current file is still written and the rotation is retried on the next write
+- without FileOpener the files are opened and closed by the thread writing the file
+- the checks are done before each line is written (before each block with a WriterStage): a line is in the file of its period
+*/
+struct RotationPolicy
+{
+   bool IsEnabled() const { return m_maxSize || m_period.count(); }
+   //
+   std::size_t m_maxSize = 0; // 0: no rotation by size
+   std::chrono::seconds m_period{ 0 }; // 0: no rotation by time
+   std::size_t m_preallocate = 0; // bytes reserved on disk for each new file, without changing its size (fallocate)
+   FileOpener* m_opener = nullptr;
+};
+
+// next file of a FileWriter, shared with the FileOpener task opening it
+struct PreparedFile
+{
+   enum State : int
+   {
+      pending,
+      ready,
+      cancelled, // the FileWriter is destroyed
+   };
+   //
+   LogFile m_file;
+   std::string m_path;
+   int m_syncFd = -1; // cf FlushPolicy::m_groupCommit
+   std::atomic<int> m_state{ pending };
+};
+
+// first period boundary after 'now', the boundaries are aligned on the local midnight
+std::time_t GetNextBoundary(std::time_t now, std::chrono::seconds period);
+
+}
+}
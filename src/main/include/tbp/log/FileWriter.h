@@ -2,10 +2,19 @@
 
 #include "tbp/log/Category.h"
 #include "tbp/log/Level.h"
+#include "tbp/log/WriterStage.h"
+#include "tbp/log/FlushPolicy.h"
+#include "tbp/log/FileRotation.h"
+#include "tbp/log/LogFile.h"
+#include "tbp/log/FileIndex.h"
 #include "tbp/common/OS.h"
 #include "tbp/common/Definitions.h"
+#include "tbp/common/Compiler.h"
 #include <cppformat/format.h>
 #include <fstream>
+#include <string>
+#include <memory>
+#include <atomic>
 #include <ctime>
 #include <time.h>
 
@@ -41,10 +50,24 @@ const char* ToString(Level val)
 
 class Config;
 
+/*
+- the lines are flushed according to the FlushPolicy of the file (cf Config::GetFlushPolicy):
+the writing thread calls FlushIfNeeded() after each line and FlushAfterDrain() after each batch of lines
+- the file is written with the FileBackend given by the Injector (cf Injector::CreateFileWriter)
+- the file is rotated according to the RotationPolicy of the Config, GetPath() is the path of the file being written
+- the file is indexed according to the IndexPolicy of the Config (cf FileIndex): the header of each line (WriteHeader)
+is given to the index by the thread writing the file, the routed lines are indexed with the header of their source
+- a FileWriter attached to a WriterStage (SetWriterStage) does not write its file directly:
+WriteToFile() appends the line to a block and Flush() submits the block to the WriterStage thread
+- OnWrite() is called by the thread formatting the lines, OnFileWritten() by the thread writing the file
+a derived class overriding OnFileWritten() calls StopWriterStage() in its destructor
+otherwise the WriterStage thread can call OnFileWritten() while the derived class is destroyed
+*/
 class FileWriter
 {
 public:
-   FileWriter(const Config& config, common::ThreadId tid);
+   FileWriter(const Config& config, common::ThreadId tid, FileBackend backend = FileBackend::stream);
+   FileWriter(const Config& config, const std::string& name, FileBackend backend = FileBackend::stream);
    FileWriter(FileWriter&&) = default;
    FileWriter& operator=(FileWriter&&) = default;
    MOCK_NPERF_VIRTUAL ~FileWriter();
@@ -52,40 +75,288 @@ public:
    void WriteHeader(const timespec& time, common::ThreadId tid, Level level, const Category& category);
    fmt::MemoryWriter& GetWriter() { return m_writer; }
    void WriteToFile();
+   // write the line formatted by another FileWriter (cf Routes), the line is not cleared
+   void WriteToFile(const fmt::MemoryWriter& line, const IndexedLine& header = IndexedLine());
+   // header of the last line (cf WriteHeader)
+   const IndexedLine& GetIndexedLine() const { return m_line; }
+   bool IsIndexed() const { return m_index != nullptr; }
+   void Clear() { m_writer.clear(); }
    void Flush();
+   void FlushIfNeeded(Level level);
+   void FlushAfterDrain();
+   const std::string& GetPath() const { return m_path; }
+   const FlushPolicy& GetFlushPolicy() const { return m_flushPolicy; }
+   void SetFlushPolicy(const FlushPolicy& policy);
+   //
+   void SetWriterStage(WriterStage& stage, std::size_t blockSize = 64 * 1024);
+   // wait until the blocks submitted to the WriterStage are written and the flushed lines are synced (cf GroupCommit)
+   void Wait() const;
+   //
+   // header of a log line, cf WriteHeader
+   static void FormatHeader(fmt::MemoryWriter& writer, const timespec& time, common::ThreadId tid, Level level, const Category& category);
+   // path of a new log file, 'suffix' is the thread id or the name of the file, the output directory is created if needed
+   static std::string MakePath(const Config& config, const std::string& suffix);
+   // monotonic time in nanoseconds, coarse (a few milliseconds) but cheap, used for the flush intervals
+   static std::int64_t GetCoarseNanos();
 
 MOCK_PROTECTED:
    MOCK_NPERF_VIRTUAL void OnWrite(const fmt::MemoryWriter& /*writer*/) const {}
    MOCK_NPERF_VIRTUAL void OnFileWritten(std::ofstream& /*file*/) const {}
+   // the pending blocks are written and the FileWriter is detached from the WriterStage, the file is then written directly
+   void StopWriterStage();
 
 private:
-   std::ofstream m_file;
+   friend class WriterStage;
+   friend class SyncFlusher;
+   struct StageData
+   {
+      StageData(WriterStage& stage, std::size_t blockSize) : m_stage(stage), m_blockSize(blockSize), m_pending(0) {}
+      //
+      WriterStage& m_stage;
+      std::size_t m_blockSize = 0;
+      WriterBlock* m_block = nullptr; // block being filled
+      WriterBlockQueue m_freeBlocks; // blocks written by the WriterStage
+      std::atomic<std::size_t> m_pending; // blocks submitted and not written yet
+   };
+   struct SyncData
+   {
+      SyncData(GroupCommit& groupCommit, int fd) : m_groupCommit(groupCommit), m_fd(fd), m_ticket(0) {}
+      //
+      GroupCommit& m_groupCommit;
+      int m_fd = -1; // second descriptor of the file, only used by fdatasync()
+      std::atomic<std::uint64_t> m_ticket; // last sync requested
+   };
+   // only used by the thread writing the file
+   struct RotationData
+   {
+      RotationPolicy m_policy;
+      std::string m_basePath; // path without the index and the extension
+      std::size_t m_index = 0;
+      std::size_t m_fileSize = 0;
+      std::size_t m_maxSize = 0;
+      std::time_t m_nextBoundary = 0;
+      std::shared_ptr<PreparedFile> m_next;
+   };
+   // only used by the thread writing the file
+   struct IndexData
+   {
+      explicit IndexData(const IndexPolicy& policy) : m_index(policy) {}
+      //
+      FileIndex m_index;
+      std::uint64_t m_offset = 0; // size of the file
+   };
+   //
+   void Open(const Config& config, const std::string& suffix, const FlushPolicy& policy);
+   void FlushFile();
+   void RotateIfNeeded(std::size_t size);
+   void Rotate();
+   void PrepareNextFile();
+   void WriteToBlock(const char* data, std::size_t size, const IndexedLine* line = nullptr);
+   void Submit(bool flush);
+   void WriteBlockData(WriterBlock& block);
+   void WriteBlock(WriterBlock* block);
+   //
+   LogFile m_file;
+   FileBackend m_backend = FileBackend::stream;
    fmt::MemoryWriter m_writer;
+   std::unique_ptr<StageData> m_stage; // unique_ptr to keep FileWriter movable
+   std::string m_path;
+   FlushPolicy m_flushPolicy;
+   std::size_t m_unflushed = 0; // bytes written since the last flush
+   std::int64_t m_lastFlush = 0; // cf GetCoarseNanos
+   std::unique_ptr<SyncData> m_sync;
+   std::unique_ptr<RotationData> m_rotation;
+   IndexedLine m_line;
+   std::unique_ptr<IndexData> m_index;
 
 };
 
-inline void FileWriter::WriteHeader(const timespec& time, common::ThreadId tid, Level level, const Category& category)
+inline void FileWriter::FormatHeader(fmt::MemoryWriter& writer, const timespec& time, common::ThreadId tid, Level level, const Category& category)
 {
    std::tm curr;
    std::tm* currPtr = localtime_r(&time.tv_sec, &curr);
-   m_writer.write("[{:0>2}:{:0>2}:{:0>2}.{:0>9}][{}][{}][{}] ", 
+   writer.write("[{:0>2}:{:0>2}:{:0>2}.{:0>9}][{}][{}][{}] ", 
          // each field of the timestamp is right aligned (>) with zero-padding (0>) at the beginning
          currPtr->tm_hour, currPtr->tm_min, currPtr->tm_sec, time.tv_nsec,
          tid, ToString(level), category.GetLabel());
 }
 
+inline void FileWriter::WriteHeader(const timespec& time, common::ThreadId tid, Level level, const Category& category)
+{
+   FormatHeader(m_writer, time, tid, level, category);
+   m_line.m_time = static_cast<std::uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+   m_line.m_category = &category;
+}
+
 inline void FileWriter::WriteToFile()
 {
    OnWrite(m_writer);
    m_writer.write("\n");
-   m_file.write(m_writer.data(), m_writer.size());
-   OnFileWritten(m_file);
+   if (m_stage)
+   {
+      WriteToBlock(m_writer.data(), m_writer.size(), m_index ? &m_line : nullptr);
+   }
+   else
+   {
+      if (m_rotation)
+      {
+         RotateIfNeeded(m_writer.size());
+      }
+      if (m_index)
+      {
+         m_index->m_index.Add(m_index->m_offset, m_line);
+         m_index->m_offset += m_writer.size();
+      }
+      m_file.Write(m_writer.data(), m_writer.size());
+      OnFileWritten(m_file.GetStream());
+   }
+   m_unflushed += m_writer.size();
    m_writer.clear();
 }
 
+inline void FileWriter::WriteToFile(const fmt::MemoryWriter& line, const IndexedLine& header)
+{
+   OnWrite(line);
+   if (m_stage)
+   {
+      WriteToBlock(line.data(), line.size(), m_index ? &header : nullptr);
+      WriteToBlock("\n", 1);
+   }
+   else
+   {
+      if (m_rotation)
+      {
+         RotateIfNeeded(line.size() + 1);
+      }
+      if (m_index)
+      {
+         m_index->m_index.Add(m_index->m_offset, header);
+         m_index->m_offset += line.size() + 1;
+      }
+      m_file.Write(line.data(), line.size());
+      m_file.Put('\n');
+      OnFileWritten(m_file.GetStream());
+   }
+   m_unflushed += line.size() + 1;
+}
+
 inline void FileWriter::Flush()
 {
-   m_file.flush();
+   if (m_stage)
+   {
+      Submit(true);
+   }
+   else
+   {
+      FlushFile();
+   }
+   m_unflushed = 0;
+   if (m_flushPolicy.m_mode == FlushMode::time)
+   {
+      m_lastFlush = GetCoarseNanos();
+   }
+}
+
+inline void FileWriter::FlushIfNeeded(Level level)
+{
+   switch (m_flushPolicy.m_mode)
+   {
+      case FlushMode::bytes:
+         if (m_unflushed >= m_flushPolicy.m_bytes)
+         {
+            Flush();
+         }
+         break;
+      case FlushMode::time:
+         if (GetCoarseNanos() - m_lastFlush >= std::chrono::nanoseconds(m_flushPolicy.m_interval).count())
+         {
+            Flush();
+         }
+         break;
+      case FlushMode::level:
+         if (level >= m_flushPolicy.m_level)
+         {
+            Flush();
+         }
+         break;
+      case FlushMode::drain:
+      case FlushMode::never:
+         break;
+   }
+}
+
+inline void FileWriter::FlushAfterDrain()
+{
+   if (!m_unflushed)
+   {
+      return;
+   }
+   switch (m_flushPolicy.m_mode)
+   {
+      case FlushMode::drain:
+         Flush();
+         break;
+      case FlushMode::time:
+         FlushIfNeeded(Level::none);
+         break;
+      case FlushMode::bytes:
+      case FlushMode::level:
+      case FlushMode::never:
+         break;
+   }
+}
+
+// called before 'size' bytes are written: the first line past a period boundary is written in the new file
+inline void FileWriter::RotateIfNeeded(std::size_t size)
+{
+   RotationData& rotation = *m_rotation;
+   if (unlikely(rotation.m_fileSize >= rotation.m_maxSize))
+   {
+      Rotate();
+   }
+   else if (rotation.m_nextBoundary)
+   {
+      timespec now;
+      clock_gettime(CLOCK_REALTIME_COARSE, &now);
+      if (unlikely(now.tv_sec >= rotation.m_nextBoundary))
+      {
+         Rotate();
+      }
+   }
+   rotation.m_fileSize += size;
+}
+
+inline std::int64_t FileWriter::GetCoarseNanos()
+{
+   // a few nanoseconds (vDSO), the resolution (a few milliseconds) is enough for a flush interval
+   timespec now;
+   clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+   return static_cast<std::int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+inline void FileWriter::WriteToBlock(const char* data, std::size_t size, const IndexedLine* line)
+{
+   WriterBlock* block = m_stage->m_block;
+   if (!block)
+   {
+      block = m_stage->m_freeBlocks.Dequeue();
+      if (!block)
+      {
+         block = new WriterBlock;
+         block->m_fileWriter = this;
+         block->m_data.reserve(m_stage->m_blockSize);
+      }
+      m_stage->m_block = block;
+   }
+   if (line)
+   {
+      block->m_lines.emplace_back(block->m_data.size(), *line);
+   }
+   block->m_data.insert(block->m_data.end(), data, data + size);
+   if (block->m_data.size() >= m_stage->m_blockSize)
+   {
+      Submit(false);
+   }
 }
 
 }
@@ -0,0 +1,349 @@
+#pragma once
+
+#include "tbp/log/Category.h"
+#include "tbp/log/Level.h"
+#include "tbp/log/Encoder.h"
+#include "tbp/log/Blob.h"
+#include "tbp/log/AsyncSink.h"
+#include "tbp/common/ConfigurationException.h"
+#include "tbp/common/Compiler.h"
+#include "tbp/common/OS.h"
+#include <time.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+
+namespace tbp
+{
+namespace log
+{
+
+// spin lock of a FlightRecorderSink, also used by the registry of FlightRecorderTrigger (no std::mutex on the signal path)
+class FlightRecorderLock
+{
+public:
+   class Guard
+   {
+   public:
+      explicit Guard(FlightRecorderLock& lock) : m_lock(lock) { m_lock.Lock(); }
+      ~Guard() { m_lock.Unlock(); }
+      Guard(const Guard&) = delete;
+      Guard& operator=(const Guard&) = delete;
+
+   private:
+      FlightRecorderLock& m_lock;
+
+   };
+   //
+   FlightRecorderLock() : m_locked(false) {}
+   FlightRecorderLock(const FlightRecorderLock&) = delete;
+   FlightRecorderLock& operator=(const FlightRecorderLock&) = delete;
+   //
+   void Lock() { while (m_locked.exchange(true, std::memory_order_acquire)) {} }
+   void Unlock() { m_locked.store(false, std::memory_order_release); }
+   // gives up after nbSpins attempts: the owner may be the thread which crashed
+   bool TryLock(std::size_t nbSpins);
+
+private:
+   std::atomic<bool> m_locked;
+
+};
+
+/*
+- recorder registered in FlightRecorderTrigger, implemented by FlightRecorderSink
+- the owner thread holds the lock while it logs, the other threads hold it while they dump the records (FlightRecorderTrigger)
+*/
+class FlightRecorderEntry : public FlightRecorderLock
+{
+public:
+   virtual ~FlightRecorderEntry() = default;
+   // the lock is held by the caller
+   virtual void DumpRecords() = 0;
+
+};
+
+inline bool FlightRecorderLock::TryLock(std::size_t nbSpins)
+{
+   for (std::size_t i = 0; i < nbSpins; ++i)
+   {
+      if (!m_locked.load(std::memory_order_relaxed) && !m_locked.exchange(true, std::memory_order_acquire))
+      {
+         return true;
+      }
+   }
+   return false;
+}
+
+/*
+- process-wide registry of the FlightRecorderSinks
+- TriggerAll() dumps the records of all the sinks from the calling thread, it is also called by a sink logging a message with a signal
+the records of the other threads must be enqueued before the signal is raised by the AsyncLogger
+- the locks are only tried for a bounded time: a thread blocked in the middle of a Log() call (or the thread which crashed) is skipped
+*/
+class FlightRecorderTrigger
+{
+public:
+   static void TriggerAll() { DumpAll(nullptr); }
+   // the records of 'caller' are not dumped, its lock is already held
+   static void DumpAll(const FlightRecorderEntry* caller);
+   static void Register(FlightRecorderEntry& entry);
+   static void Unregister(FlightRecorderEntry& entry);
+
+};
+
+/*
+- single-thread ring of encoded log messages, the oldest records are overwritten
+- it is also the Allocator of the Encoder (Handle = char*): the fields are encoded in place after the record header
+- a record never wraps around the end of the ring, a padding record (m_dataSize == PADDING) is written instead
+the tail of the ring can be only RECORD_ALIGN bytes: the padding marker is in the first 8 bytes of the header (m_size, m_dataSize)
+*/
+class FlightRecorder
+{
+public:
+   struct Record
+   {
+      std::uint32_t m_size; // whole record size (header + fields), multiple of RECORD_ALIGN
+      std::uint32_t m_dataSize; // size of the encoded fields, PADDING for a padding record
+      const Category* m_category;
+      const char* m_fmt;
+      timespec m_time;
+      common::SigNum m_signal;
+      Level m_level;
+   };
+   using Handle = char*;
+   static constexpr std::size_t RECORD_ALIGN = 8;
+   static constexpr std::uint32_t PADDING = UINT32_MAX;
+   //
+   // capacity is rounded up to a power of 2
+   explicit FlightRecorder(std::size_t capacity);
+   //
+   // Allocator interface used by the Encoder
+   Handle Alloc(std::size_t size);
+   void Free(Handle& /*h*/) {}
+   //
+   void Begin() { m_record = nullptr; }
+   // returns the record of the message being encoded, the fields are in the overflow buffer if the record is too big for the ring
+   Record* GetRecord() { return m_record ? m_record : Reserve(0); }
+   bool IsOverflow() const { return m_record == &m_overflowRecord; }
+   const char* GetData() const { return IsOverflow() ? m_overflow.data() : reinterpret_cast<const char*>(m_record + 1); }
+   void Commit();
+   //
+   template <typename FUNC> void ForEach(FUNC func) const;
+   void Clear() { m_head = m_tail; }
+   bool IsEmpty() const { return m_head == m_tail; }
+
+private:
+   Record* Reserve(std::size_t dataSize);
+   Record* GetRecord(std::uint64_t pos) { return reinterpret_cast<Record*>(m_data.get() + (pos & (m_capacity - 1))); }
+   const Record* GetRecord(std::uint64_t pos) const { return reinterpret_cast<const Record*>(m_data.get() + (pos & (m_capacity - 1))); }
+   //
+   std::unique_ptr<char[]> m_data;
+   std::uint64_t m_capacity = 0;
+   std::uint64_t m_head = 0; // oldest record
+   std::uint64_t m_tail = 0;
+   Record* m_record = nullptr;
+   Record m_overflowRecord;
+   std::vector<char> m_overflow;
+
+};
+
+static_assert(offsetof(FlightRecorder::Record, m_dataSize) + sizeof(std::uint32_t) <= FlightRecorder::RECORD_ALIGN, "padding marker beyond RECORD_ALIGN");
+
+// the oldest records are overwritten without being decoded: the payload of a BlobRef is copied
+template <>
+struct BlobByReference<FlightRecorder>
+{
+   static constexpr bool value = false;
+};
+
+inline FlightRecorder::FlightRecorder(std::size_t capacity)
+{
+   if (capacity < sizeof(Record) * 2)
+   {
+      throw common::ConfigurationException("FlightRecorder capacity too small");
+   }
+   m_capacity = 1;
+   while (m_capacity < capacity)
+   {
+      m_capacity <<= 1;
+   }
+   m_data.reset(new char[m_capacity]);
+}
+
+inline FlightRecorder::Handle FlightRecorder::Alloc(std::size_t size)
+{
+   Record* record = Reserve(size);
+   return IsOverflow() ? m_overflow.data() : reinterpret_cast<char*>(record + 1);
+}
+
+inline FlightRecorder::Record* FlightRecorder::Reserve(std::size_t dataSize)
+{
+   std::uint64_t size = (sizeof(Record) + dataSize + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+   if (unlikely(size > m_capacity / 2))
+   {
+      // the message is not recorded, it is written directly (cf FlightRecorderSink::Log)
+      m_overflow.resize(dataSize);
+      m_record = &m_overflowRecord;
+      m_record->m_dataSize = static_cast<std::uint32_t>(dataSize);
+      return m_record;
+   }
+   std::uint64_t offset = m_tail & (m_capacity - 1);
+   std::uint64_t padding = offset + size > m_capacity ? m_capacity - offset : 0;
+   // overwrite the oldest records
+   while (m_tail + padding + size - m_head > m_capacity)
+   {
+      m_head += GetRecord(m_head)->m_size;
+   }
+   if (padding)
+   {
+      Record* pad = GetRecord(m_tail);
+      pad->m_size = static_cast<std::uint32_t>(padding);
+      pad->m_dataSize = PADDING;
+      m_tail += padding;
+   }
+   m_record = GetRecord(m_tail);
+   m_record->m_size = static_cast<std::uint32_t>(size);
+   m_record->m_dataSize = static_cast<std::uint32_t>(dataSize);
+   return m_record;
+}
+
+inline void FlightRecorder::Commit()
+{
+   assert(m_record != nullptr);
+   if (!IsOverflow())
+   {
+      m_tail += m_record->m_size;
+   }
+   m_record = nullptr;
+}
+
+template <typename FUNC>
+inline void FlightRecorder::ForEach(FUNC func) const
+{
+   for (std::uint64_t pos = m_head; pos != m_tail; pos += GetRecord(pos)->m_size)
+   {
+      const Record* record = GetRecord(pos);
+      if (record->m_dataSize != PADDING)
+      {
+         func(*record, reinterpret_cast<const char*>(record + 1));
+      }
+   }
+}
+
+/*
+- flight-recorder mode: the log messages are encoded in a FlightRecorder owned by the sink, they are neither formatted nor written
+- the recorded messages are sent to the AsyncLogger (through the wrapped AsyncSink) only when a trigger fires:
+   - a message with a level greater or equal to the trigger level (error by default)
+   - a message with a signal (cf SignalManager): the records of all the FlightRecorderSinks are dumped before the message
+   - Dump() called by the thread owning the sink
+   - FlightRecorderTrigger::TriggerAll() called by any thread, the records of all the sinks are dumped by the calling thread
+- the records of a sink can be dumped by another thread: the wrapped AsyncSink is only used with the lock of the FlightRecorderEntry held
+- the Loggers level of the categories must be low enough (debug) for the messages to reach the sink
+- the messages too big for the FlightRecorder are sent directly to the AsyncLogger
+*/
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+class FlightRecorderSink
+{
+public:
+   using Sink = AsyncSink<TypeId, SpscQueue, MpscQueue, Allocator>;
+   //
+   FlightRecorderSink(Sink sink, std::size_t capacity, Level triggerLevel = Level::error);
+   ~FlightRecorderSink();
+   FlightRecorderSink(FlightRecorderSink&&) = default;
+   FlightRecorderSink& operator=(FlightRecorderSink&&) = delete;
+   //
+   // IMPORTANT: same constraint on 'fmt' as AsyncSink::Log, the format string must outlive the recorded messages
+   template <typename... Args> void Log(const Category& category, Level level, const timespec& now, common::SigNum signal, const char* fmt, Args&&... args);
+   void Dump();
+
+private:
+   // registered in FlightRecorderTrigger, unique_ptr for the move ctor
+   struct State : public FlightRecorderEntry
+   {
+      State(Sink sink, std::size_t capacity) : m_sink(std::move(sink)), m_recorder(capacity) {}
+      void DumpRecords() override;
+      //
+      Sink m_sink;
+      FlightRecorder m_recorder;
+   };
+   //
+   std::unique_ptr<State> m_state;
+   Encoder<TypeId, FlightRecorder> m_encoder;
+   Level m_triggerLevel = Level::error;
+
+};
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline FlightRecorderSink<TypeId, SpscQueue, MpscQueue, Allocator>::FlightRecorderSink(Sink sink, std::size_t capacity, Level triggerLevel)
+   : m_state(std::make_unique<State>(std::move(sink), capacity)), m_triggerLevel(triggerLevel)
+{
+   FlightRecorderTrigger::Register(*m_state);
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline FlightRecorderSink<TypeId, SpscQueue, MpscQueue, Allocator>::~FlightRecorderSink()
+{
+   if (m_state)
+   {
+      // a concurrent TriggerAll() holds the registry while it dumps the records
+      FlightRecorderTrigger::Unregister(*m_state);
+   }
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+template <typename... Args>
+inline void FlightRecorderSink<TypeId, SpscQueue, MpscQueue, Allocator>::Log(const Category& category, Level level, const timespec& now, common::SigNum signal,
+      const char* fmt, Args&&... args)
+{
+   auto& state = *m_state;
+   FlightRecorderLock::Guard guard(state);
+   auto& recorder = state.m_recorder;
+   recorder.Begin();
+   m_encoder.Encode(recorder, std::forward<Args>(args)...);
+   FlightRecorder::Record* record = recorder.GetRecord();
+   record->m_category = &category;
+   record->m_fmt = fmt;
+   record->m_time = now;
+   record->m_signal = signal;
+   record->m_level = level;
+   if (unlikely(signal))
+   {
+      FlightRecorderTrigger::DumpAll(&state);
+   }
+   if (unlikely(recorder.IsOverflow()))
+   {
+      state.DumpRecords();
+      state.m_sink.LogEncoded(category, level, now, signal, fmt, recorder.GetData(), record->m_dataSize);
+      recorder.Commit();
+      return;
+   }
+   recorder.Commit();
+   //
+   if (unlikely(level >= m_triggerLevel || signal))
+   {
+      state.DumpRecords();
+   }
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline void FlightRecorderSink<TypeId, SpscQueue, MpscQueue, Allocator>::Dump()
+{
+   FlightRecorderLock::Guard guard(*m_state);
+   m_state->DumpRecords();
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline void FlightRecorderSink<TypeId, SpscQueue, MpscQueue, Allocator>::State::DumpRecords()
+{
+   m_recorder.ForEach([this](const FlightRecorder::Record& record, const char* data)
+   {
+      m_sink.LogEncoded(*record.m_category, record.m_level, record.m_time, record.m_signal, record.m_fmt, data, record.m_dataSize);
+   });
+   m_recorder.Clear();
+}
+
+}
+}
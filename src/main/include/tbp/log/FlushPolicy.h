@@ -0,0 +1,116 @@
+#pragma once
+
+#include "tbp/log/Level.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- fdatasync() of the log files in a background thread
+- the syncs requested while a sync is running are grouped: a file is synced once for all the flushes requested before the sync starts
+- Request() does not wait for the sync, Wait() blocks until the batch of the ticket is synced
+- the GroupCommit must outlive the FileWriters using it (cf FlushPolicy::m_groupCommit)
+*/
+class GroupCommit
+{
+public:
+   GroupCommit();
+   ~GroupCommit();
+   GroupCommit(const GroupCommit&) = delete;
+   GroupCommit& operator=(const GroupCommit&) = delete;
+   //
+   // the data flushed to 'fd' before the call is durable once the returned ticket is synced
+   std::uint64_t Request(int fd);
+   void Wait(std::uint64_t ticket);
+   //
+   std::uint64_t GetNbSyncs() const { return m_nbSyncs.load(std::memory_order_relaxed); }
+   std::uint64_t GetNbErrors() const { return m_nbErrors.load(std::memory_order_relaxed); }
+
+private:
+   void Run();
+   //
+   std::mutex m_mutex;
+   std::condition_variable m_requested;
+   std::condition_variable m_synced;
+   std::vector<int> m_fds; // files of the next batch
+   std::uint64_t m_nextBatch = 1;
+   std::uint64_t m_syncedBatch = 0;
+   bool m_stop = false;
+   std::atomic<std::uint64_t> m_nbSyncs;
+   std::atomic<std::uint64_t> m_nbErrors;
+   std::thread m_thread;
+
+};
+
+enum class FlushMode : std::uint8_t
+{
+   drain, // after each LogMessages() pass of the AsyncLogger which wrote in the file, no explicit flush in a SyncSink
+   bytes, // once m_bytes bytes are written since the last flush
+   time, // once m_interval has elapsed since the last flush (checked when a line is written and after each LogMessages() pass)
+   level, // after each message whose level is greater or equal to m_level
+   never, // the file is written when the std::ofstream buffer (or the WriterStage block) is full
+};
+
+/*
+- when the lines written in a log file are flushed (cf FileWriter::FlushIfNeeded, Config::SetFlushPolicy)
+- a flush is a write() system call, the data is durable only if a GroupCommit is set: fdatasync() after the flush
+- the messages with a signal (cf SignalManager) are always flushed
+*/
+struct FlushPolicy
+{
+   static FlushPolicy Drain() { return FlushPolicy(); }
+   static FlushPolicy EveryBytes(std::size_t bytes);
+   static FlushPolicy Every(std::chrono::microseconds interval);
+   static FlushPolicy OnLevel(Level level);
+   static FlushPolicy Never();
+   //
+   FlushMode m_mode = FlushMode::drain;
+   std::size_t m_bytes = 0;
+   std::chrono::microseconds m_interval{ 0 };
+   Level m_level = Level::error;
+   GroupCommit* m_groupCommit = nullptr;
+};
+
+inline FlushPolicy FlushPolicy::EveryBytes(std::size_t bytes)
+{
+   FlushPolicy policy;
+   policy.m_mode = FlushMode::bytes;
+   policy.m_bytes = bytes;
+   return policy;
+}
+
+inline FlushPolicy FlushPolicy::Every(std::chrono::microseconds interval)
+{
+   FlushPolicy policy;
+   policy.m_mode = FlushMode::time;
+   policy.m_interval = interval;
+   return policy;
+}
+
+inline FlushPolicy FlushPolicy::OnLevel(Level level)
+{
+   FlushPolicy policy;
+   policy.m_mode = FlushMode::level;
+   policy.m_level = level;
+   return policy;
+}
+
+inline FlushPolicy FlushPolicy::Never()
+{
+   FlushPolicy policy;
+   policy.m_mode = FlushMode::never;
+   return policy;
+}
+
+}
+}
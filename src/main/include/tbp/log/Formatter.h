@@ -2,6 +2,7 @@
 
 #include <cppformat/format.h>
 #include <string>
+#include <cctype>
 
 namespace tbp
 {
@@ -42,8 +43,12 @@ public:
          }
          //
          // at this point we know that c == '{' and that it is not an escaped curly brace
+         const char* field = s;
          while (*s++ != '}') {}
-         m_format.assign(start, s - start);
+         // the optional field name ({name} or {name:spec}) is only used by the structured output (cf JsonFormatter)
+         const char* spec = SkipName(field);
+         m_format.assign(start, field - start);
+         m_format.append(spec, s - spec);
          //
          // the switch/case below must be replaced with the call to the 'decode functor' of the previous unit test
          func(m_format.c_str(), writer);
@@ -53,7 +58,43 @@ public:
       Write(writer, start, s);
    }
 
+   // call func(name) for each field of the format string, the name is empty if the field is not named
+   template <typename FUNC>
+   static void ForEachField(const char* fmt, FUNC func)
+   {
+      const char* s = fmt;
+      while (*s)
+      {
+         char c = *s++;
+         if (c != '{' && c != '}') continue;
+         if (*s == c)
+         {
+            ++s;
+            continue;
+         }
+         if (c == '}')
+         {
+            throw "unmatched '}' in format string";
+         }
+         const char* field = s;
+         while (*s++ != '}') {}
+         func(std::string(field, SkipName(field) - field));
+      }
+   }
+
 private:
+   // a name starts with a letter or '_', a field index is not a name
+   static const char* SkipName(const char* field)
+   {
+      if (std::isalpha(static_cast<unsigned char>(*field)) || *field == '_')
+      {
+         while (std::isalnum(static_cast<unsigned char>(*field)) || *field == '_')
+         {
+            ++field;
+         }
+      }
+      return field;
+   }
    // from cppformat / format.h / template <typename Char> void write(BasicWriter<Char> &w, const Char *start, const Char *end)
    void Write(fmt::MemoryWriter& w, const char *start, const char *end)
    {
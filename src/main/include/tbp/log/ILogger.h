@@ -2,6 +2,7 @@
 
 #include "tbp/log/CategoryId.h"
 #include "tbp/log/Level.h"
+#include "tbp/common/OS.h"
 #include <string>
 
 namespace tbp
@@ -19,6 +20,7 @@ public:
    virtual ~ILogger() {}
    //
    virtual const std::string& GetName() const = 0;
+   virtual common::ThreadId GetThreadId() const = 0;
    virtual void SetLevel(CategoryId id, Level level) = 0;
 };
 
@@ -3,6 +3,7 @@
 #include "tbp/common/OS.h"
 #include "tbp/common/Definitions.h"
 #include "tbp/common/TypeTraits.h"
+#include "tbp/log/LogFile.h"
 #include <memory>
 #include <string>
 
@@ -24,9 +25,14 @@ namespace log
 class Injector
 {
 public:
+   // the FileWriters created by the Injector write their files with 'fileBackend' (the SyncSinks always use FileBackend::stream)
+   explicit Injector(FileBackend fileBackend = FileBackend::stream) : m_fileBackend(fileBackend) {}
    MOCK_VIRTUAL ~Injector();
    //
+   FileBackend GetFileBackend() const { return m_fileBackend; }
    MOCK_VIRTUAL std::unique_ptr<FileWriter> CreateFileWriter(const log::Config& config, common::ThreadId tid) const;
+   // FileWriter shared by several producers, 'name' replaces the thread id in the file name
+   MOCK_VIRTUAL std::unique_ptr<FileWriter> CreateSharedFileWriter(const log::Config& config, const std::string& name) const;
    /*
    the method below is enabled, if Sink is "not" derived from a class listed "after" the first template parameter of is_derived_of_any (log::SyncSink, log::SyncSink1, ...)
    this is needed to have an OnNewLoggerSink() implementation for the user-defined Sink types (for instance AsyncSink is template on the TypeId which can be user-defined, ...)
@@ -36,6 +42,9 @@ public:
    //
    // tools::Injector must only be used for types than can be mock in unittests
 
+private:
+   FileBackend m_fileBackend = FileBackend::stream;
+
 };
 
 }
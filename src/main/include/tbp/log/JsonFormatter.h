@@ -0,0 +1,282 @@
+#pragma once
+
+#include "tbp/log/MsgFormatter.h"
+#include "tbp/log/NumberWriter.h"
+#include "tbp/log/FileWriter.h"
+#include "tbp/log/Formatter.h"
+#include "tbp/log/Category.h"
+#include "tbp/log/Level.h"
+#include "tbp/log/Msg.h"
+#include "tbp/common/Compiler.h"
+#include "tbp/common/OS.h"
+#include <cppformat/format.h>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- write 'size' characters as a JSON string (with the quotes)
+- the characters which do not need to be escaped are copied by blocks, the blocks are found 16 bytes at a time with SSE2
+*/
+inline void WriteJsonString(fmt::MemoryWriter& writer, const char* str, std::size_t size)
+{
+   static const char hex[] = "0123456789abcdef";
+   const char* end = str + size;
+   const char* start = str;
+   writer << '"';
+   while (str != end)
+   {
+#ifdef __SSE2__
+      const __m128i quote = _mm_set1_epi8('"');
+      const __m128i backslash = _mm_set1_epi8('\\');
+      const __m128i control = _mm_set1_epi8(0x1F);
+      while (end - str >= 16)
+      {
+         __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str));
+         // v <= 0x1F (unsigned) <=> max(v, 0x1F) == 0x1F
+         __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+               _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+         int mask = _mm_movemask_epi8(special);
+         if (mask)
+         {
+            str += __builtin_ctz(mask);
+            break;
+         }
+         str += 16;
+      }
+#endif
+      while (str != end)
+      {
+         unsigned char c = static_cast<unsigned char>(*str);
+         if (c < 0x20 || c == '"' || c == '\\')
+         {
+            break;
+         }
+         ++str;
+      }
+      if (str != start)
+      {
+         writer << fmt::StringRef(start, str - start);
+      }
+      if (str == end)
+      {
+         break;
+      }
+      unsigned char c = static_cast<unsigned char>(*str++);
+      start = str;
+      switch (c)
+      {
+         case '"':
+            writer << "\\\"";
+            break;
+         case '\\':
+            writer << "\\\\";
+            break;
+         case '\n':
+            writer << "\\n";
+            break;
+         case '\r':
+            writer << "\\r";
+            break;
+         case '\t':
+            writer << "\\t";
+            break;
+         default:
+         {
+            char escaped[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+            writer << fmt::StringRef(escaped, sizeof(escaped));
+         }
+         break;
+      }
+   }
+   writer << '"';
+}
+
+inline void WriteJsonString(fmt::MemoryWriter& writer, const std::string& str)
+{
+   WriteJsonString(writer, str.data(), str.size());
+}
+
+/*
+- format a log::Msg as one JSON object (cf OutputFormat::json):
+{"ts":<epoch nanos>,"tid":<thread id>,"level":"info","category":"cat","fmt":"<format id>","args":{"<name>":<value>,...}}
+- the format id is a hash of the format string, it does not change between two runs
+- the name of an argument is the name of its field ({name}) or its index if the field is not named
+- the arguments keep the type known by the Decoder (number, string, array or blob), a double which is not finite is written as null
+*/
+template <typename TypeId, typename Allocator>
+class JsonFormatter
+{
+public:
+   void Format(Msg<Allocator>& msg, common::ThreadId tid, fmt::MemoryWriter& writer);
+
+private:
+   struct FormatData
+   {
+      std::string m_format; // the address of a format string is reused for another content (std::string::c_str(), ...)
+      std::string m_id;
+      std::vector<std::string> m_keys; // JSON strings, quoted and escaped
+   };
+   struct ValueWriter
+   {
+      fmt::MemoryWriter& m_writer;
+      //
+      void operator()(int v) { WriteDefault(m_writer, v); }
+      void operator()(std::uint64_t v) { WriteDefault(m_writer, v); }
+      void operator()(std::int64_t v) { WriteDefault(m_writer, v); }
+      void operator()(double v);
+      void operator()(const std::string& v) { WriteJsonString(m_writer, v); }
+      void operator()(fmt::StringRef v) { WriteJsonString(m_writer, v.data(), v.size()); }
+      void operator()(const BlobField& v);
+      void operator()(const ArrayField<TypeId>& v);
+   };
+   //
+   const FormatData& GetFormatData(const char* fmt);
+   static void BuildFormatData(const char* fmt, FormatData& data);
+   //
+   // the formats which are not string literals could fill the cache, they are parsed for each message once it is full
+   static constexpr std::size_t MAX_FORMATS = 4096;
+   std::unordered_map<const char*, FormatData> m_formats;
+   FormatData m_uncached;
+
+};
+
+template <typename TypeId, typename Allocator>
+inline void JsonFormatter<TypeId, Allocator>::ValueWriter::operator()(double v)
+{
+   if (std::isfinite(v))
+   {
+      WriteDefault(m_writer, v);
+   }
+   else
+   {
+      m_writer << "null";
+   }
+}
+
+// hex or base64 string, no character to escape
+template <typename TypeId, typename Allocator>
+inline void JsonFormatter<TypeId, Allocator>::ValueWriter::operator()(const BlobField& v)
+{
+   m_writer << '"';
+   WriteBlob(m_writer, v);
+   m_writer << '"';
+}
+
+// the elements encoded (cf GetMaxArraySize), the truncation is not visible
+template <typename TypeId, typename Allocator>
+inline void JsonFormatter<TypeId, Allocator>::ValueWriter::operator()(const ArrayField<TypeId>& v)
+{
+   m_writer << '[';
+   std::size_t i = 0;
+   v.ForEach([this, &i](const auto& element)
+   {
+      if (i++)
+      {
+         m_writer << ',';
+      }
+      (*this)(element);
+   });
+   m_writer << ']';
+}
+
+template <typename TypeId, typename Allocator>
+inline void JsonFormatter<TypeId, Allocator>::Format(Msg<Allocator>& msg, common::ThreadId tid, fmt::MemoryWriter& writer)
+{
+   const FormatData& data = GetFormatData(msg.GetFormat());
+   const timespec& time = msg.GetTime();
+   writer << "{\"ts\":";
+   WriteDefault(writer, static_cast<std::int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec);
+   writer << ",\"tid\":";
+   WriteDefault(writer, static_cast<std::int64_t>(tid));
+   writer << ",\"level\":\"" << ToString(msg.GetLevel()) << '"';
+   writer << ",\"category\":";
+   WriteJsonString(writer, msg.GetCategory().GetLabel());
+   writer << ",\"fmt\":\"" << data.m_id << "\",\"args\":{";
+   auto& buffer = msg.GetBuffer();
+   if (buffer.Get())
+   {
+      Decoder<TypeId, Allocator> decoder(buffer);
+      ValueWriter valueWriter{ writer };
+      try
+      {
+         for (std::size_t i = 0; decoder.HasNext(); ++i)
+         {
+            if (i)
+            {
+               writer << ',';
+            }
+            // more arguments than fields in the format string
+            if (likely(i < data.m_keys.size()))
+            {
+               writer << data.m_keys[i];
+            }
+            else
+            {
+               WriteJsonString(writer, std::to_string(i));
+            }
+            writer << ':';
+            auto p = decoder.Next();
+            DecodeField(p.first, *p.second, valueWriter);
+         }
+      }
+      catch (...)
+      {
+         ReleaseFields(decoder);
+         throw;
+      }
+   }
+   writer << "}}";
+}
+
+template <typename TypeId, typename Allocator>
+inline const typename JsonFormatter<TypeId, Allocator>::FormatData& JsonFormatter<TypeId, Allocator>::GetFormatData(const char* fmt)
+{
+   auto iter = m_formats.find(fmt);
+   if (likely(iter != m_formats.end() && iter->second.m_format == fmt))
+   {
+      return iter->second;
+   }
+   if (iter == m_formats.end() && m_formats.size() >= MAX_FORMATS)
+   {
+      BuildFormatData(fmt, m_uncached);
+      return m_uncached;
+   }
+   FormatData& data = m_formats[fmt];
+   BuildFormatData(fmt, data);
+   return data;
+}
+
+template <typename TypeId, typename Allocator>
+inline void JsonFormatter<TypeId, Allocator>::BuildFormatData(const char* fmt, FormatData& data)
+{
+   data.m_format = fmt;
+   data.m_keys.clear();
+   // FNV-1a
+   std::uint64_t hash = 14695981039346656037ULL;
+   for (const char* s = fmt; *s; ++s)
+   {
+      hash = (hash ^ static_cast<unsigned char>(*s)) * 1099511628211ULL;
+   }
+   data.m_id = fmt::format("{:016x}", hash);
+   Formatter::ForEachField(fmt, [&data](const std::string& name)
+   {
+      fmt::MemoryWriter key;
+      WriteJsonString(key, name.empty() ? std::to_string(data.m_keys.size()) : name);
+      data.m_keys.emplace_back(key.str());
+   });
+}
+
+}
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "tbp/log/Level.h"
+#include "tbp/common/OS.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <array>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace tbp
+{
+namespace log
+{
+
+class Category;
+
+/*
+- lag of the AsyncLogger measured after each LogMessages() pass: number of messages written by the pass and age of the oldest one
+the queues are not measured, a pass writes at most Config::GetDrainBudget() messages per queue
+- the lag ratio is the biggest of nbMessages / m_nbMessages and age / m_age
+from 1 the debug messages are shed, from 2 the info messages, from 4 the warn messages, never above m_maxLevel
+- the shedding level only decreases once the lag ratio is below half of the threshold of the current level
+*/
+struct LoadShedPolicy
+{
+   bool IsEnabled() const { return m_nbMessages || m_age.count(); }
+   //
+   std::size_t m_nbMessages = 0; // messages written per pass, 0: the number of messages is not used
+   std::chrono::nanoseconds m_age{ 0 }; // 0: the age of the messages is not used
+   Level m_maxLevel = Level::info; // highest level shed: debug, info or warn
+};
+
+/*
+- messages shed by the Logger of one thread (cf Logger::ShouldLog): per category, debug, info and warn counts
+- incremented by the producer, collected (and reset) by the consumer of the thread once the shedding stops (cf AsyncLogger::LogMessages)
+or by the next Log() call of the Logger if the counts have not been collected (the sink has no consumer thread, ...)
+*/
+class ShedCounters
+{
+public:
+   using Counts = std::array<std::uint64_t, 3>;
+   //
+   ShedCounters(common::ThreadId tid, std::size_t nbCategories) : m_categories(nbCategories), m_tid(tid) {}
+   ShedCounters(const ShedCounters&) = delete;
+   ShedCounters& operator=(const ShedCounters&) = delete;
+   //
+   void SetCategory(std::size_t index, const Category& category) { m_categories[index].m_category = &category; }
+   void Add(std::size_t index, Level level);
+   bool IsEmpty() const { return !m_total.load(std::memory_order_relaxed); }
+   // calls func(const Category&, const Counts&) for each category with shed messages, the counts are reset
+   template <typename FUNC> void Collect(FUNC&& func);
+   common::ThreadId GetThreadId() const { return m_tid; }
+
+private:
+   struct CategoryData
+   {
+      const Category* m_category = nullptr;
+      std::array<std::atomic<std::uint64_t>, 3> m_nbShed{}; // debug, info, warn
+   };
+   //
+   std::vector<CategoryData> m_categories; // vector index is CategoryId - 1
+   std::atomic<std::uint64_t> m_total{ 0 }; // only a hint: a Collect() can be racing with Add()
+   common::ThreadId m_tid;
+
+};
+
+inline void ShedCounters::Add(std::size_t index, Level level)
+{
+   std::size_t i = std::min<std::size_t>(std::max(static_cast<std::size_t>(level), static_cast<std::size_t>(Level::debug)), static_cast<std::size_t>(Level::warn))
+      - static_cast<std::size_t>(Level::debug);
+   m_categories[index].m_nbShed[i].fetch_add(1, std::memory_order_relaxed);
+   m_total.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename FUNC>
+inline void ShedCounters::Collect(FUNC&& func)
+{
+   if (!m_total.exchange(0, std::memory_order_relaxed))
+   {
+      return;
+   }
+   for (auto& data : m_categories)
+   {
+      Counts counts;
+      for (std::size_t i = 0; i < counts.size(); ++i)
+      {
+         counts[i] = data.m_nbShed[i].exchange(0, std::memory_order_relaxed);
+      }
+      if (counts[0] || counts[1] || counts[2])
+      {
+         func(*data.m_category, counts);
+      }
+   }
+}
+
+/*
+- shedding level published by the AsyncLogger (cf AsyncLogger::SetLoadShedder) and read by all the Loggers (cf Logger::ShouldLog)
+the messages with a level below the shedding level are dropped by the producer before being encoded
+- each Logger registers its ShedCounters, the consumer of a thread collects them once the shedding stops
+*/
+class LoadShedder
+{
+public:
+   explicit LoadShedder(const LoadShedPolicy& policy) : m_policy(policy), m_level(Level::none) {}
+   LoadShedder(const LoadShedder&) = delete;
+   LoadShedder& operator=(const LoadShedder&) = delete;
+   //
+   // Level::none: nothing is shed
+   Level GetLevel() const { return m_level.load(std::memory_order_relaxed); }
+   // called by the consumer thread after each pass, 'age' of the oldest message written by the pass
+   void Update(std::size_t nbMessages, std::chrono::nanoseconds age);
+   const LoadShedPolicy& GetPolicy() const { return m_policy; }
+   std::uint64_t GetNbChanges() const { return m_nbChanges.load(std::memory_order_relaxed); }
+   // called by the Logger ctor/dtor, the registry is not part of the shedding state seen by the Loggers
+   void Register(ShedCounters& counters) const;
+   void Unregister(ShedCounters& counters) const;
+   // appends the counts shed by the Loggers of thread 'tid' (cf ShedCounters::Collect)
+   void Collect(common::ThreadId tid, std::vector<std::pair<const Category*, ShedCounters::Counts>>& counts);
+
+private:
+   Level GetLevel(double ratio) const;
+   //
+   LoadShedPolicy m_policy;
+   std::atomic<Level> m_level;
+   std::atomic<std::uint64_t> m_nbChanges{ 0 };
+   mutable std::mutex m_countersMutex;
+   mutable std::vector<ShedCounters*> m_counters;
+
+};
+
+}
+}
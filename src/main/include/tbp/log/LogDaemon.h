@@ -0,0 +1,93 @@
+#pragma once
+
+#include "tbp/log/ShmClient.h"
+#include "tbp/log/ShmRing.h"
+#include "tbp/log/ShmSegment.h"
+#include "tbp/log/ShmSink.h"
+#include "tbp/log/MsgFormatter.h"
+#include "tbp/log/DefaultTypes.h"
+#include "tbp/log/Category.h"
+#include "tbp/log/Config.h"
+#include "tbp/common/OS.h"
+#include <memory>
+#include <vector>
+#include <map>
+#include <string>
+
+namespace tbp
+{
+   namespace log
+   {
+      class FileWriter;
+      class Injector;
+   }
+}
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- consumer of the shared memory rings of all the ShmClient registered in the registry (tbp-logd process)
+- it does what AsyncLogger::LogMessages() does for the in-process queues: decode, format and write one file per producer thread
+- the daemon can be restarted at any time: it attaches to the registered clients and continues from the read position of each ring
+- the client segments are not trusted: a ring with an invalid capacity or an invalid record (cf ShmRing::IsCorrupt) is closed as corrupt,
+an error is written in its file and the ring is not read anymore, it is released once the client closes it
+*/
+class LogDaemon
+{
+public:
+   LogDaemon(const ShmConfig& shmConfig, const Config& config, const Injector& injector);
+   ~LogDaemon();
+   LogDaemon(const LogDaemon&) = delete;
+   LogDaemon& operator=(const LogDaemon&) = delete;
+   //
+   // returns the number of log messages consumed
+   std::size_t Poll();
+
+private:
+   struct RingData
+   {
+      std::size_t m_slot = 0;
+      ShmSegment m_segment;
+      ShmRing m_ring;
+      common::ThreadId m_tid = 0;
+      std::unique_ptr<FileWriter> m_fileWriter;
+      bool m_corrupt = false;
+   };
+   struct ClientData
+   {
+      std::size_t m_slot = 0;
+      std::int32_t m_pid = 0;
+      ShmSegment m_segment;
+      std::vector<std::unique_ptr<RingData>> m_rings;
+      std::map<ShmDictionaryId, Category> m_categories;
+      bool m_closed = false;
+   };
+   using Allocator = ShmRingAllocator;
+   //
+   ShmRegistryHeader& GetRegistry() { return *reinterpret_cast<ShmRegistryHeader*>(m_registry.Get()); }
+   static ShmClientHeader& GetHeader(const ClientData& client) { return *reinterpret_cast<ShmClientHeader*>(client.m_segment.Get()); }
+   void AttachClients();
+   void AttachRings(ClientData& client);
+   void CheckClients();
+   std::size_t Drain(ClientData& client, RingData& ring);
+   void CloseCorrupt(ClientData& client, RingData& ring);
+   static bool IsValidRing(const ShmSegment& segment);
+   void Detach(ClientData& client);
+   const char* GetString(const ClientData& client, ShmDictionaryId id) const;
+   const Category& GetCategory(ClientData& client, ShmDictionaryId id);
+   //
+   ShmConfig m_shmConfig;
+   Config m_config;
+   const Injector& m_injector;
+   ShmSegment m_registry;
+   std::vector<std::unique_ptr<ClientData>> m_clients;
+   MsgFormatter<DefaultTypeId, Allocator> m_formatter;
+   std::size_t m_nbPolls = 0;
+
+};
+
+}
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <sys/types.h>
+
+namespace tbp
+{
+namespace log
+{
+
+// how a FileWriter writes its file (cf Injector)
+enum class FileBackend : std::uint8_t
+{
+   stream, // std::ofstream
+   direct, // O_DIRECT: the pages of the file are not kept in the page cache
+   dontneed, // buffered writes, the pages already written back to the disk are dropped from the page cache (posix_fadvise)
+};
+
+/*
+- streambuf writing a file descriptor, used by the FileBackend direct and dontneed
+- direct: the lines are copied to an aligned buffer, the buffer is written when full (aligned size and offset)
+on sync() (flush), the last partial block is written padded with zeros, the partial block stays in the buffer, it is written again with the next lines
+the file is truncated to its real size only by Close(): a truncation on each flush would release the blocks pre-allocated
+(cf RotationPolicy::m_preallocate), the file ends with less than ALIGN zeros until it is closed (or if the process crashes)
+if the file system does not support O_DIRECT, the file is written as with dontneed
+- dontneed: the writeback of each written range is started (sync_file_range) and the ranges written back are dropped from the page cache
+(a few MB behind the end of the file, so the thread writing the file only waits for a writeback started long before)
+*/
+class RawFileBuf : public std::streambuf
+{
+public:
+   static constexpr std::size_t ALIGN = 4096;
+   static constexpr std::size_t ADVISE_CHUNK = 8 * 1024 * 1024;
+   //
+   explicit RawFileBuf(FileBackend backend, std::size_t bufferSize = 1024 * 1024);
+   ~RawFileBuf() override;
+   RawFileBuf(const RawFileBuf&) = delete;
+   RawFileBuf& operator=(const RawFileBuf&) = delete;
+   //
+   bool Open(const std::string& path);
+   bool IsOpen() const { return m_fd >= 0; }
+   bool IsDirect() const { return m_direct; }
+   void Close();
+
+protected:
+   int_type overflow(int_type c) override;
+   int sync() override;
+
+private:
+   struct Free
+   {
+      void operator()(char* p) const { free(p); }
+   };
+   //
+   bool WriteAll(const char* data, std::size_t size, off_t offset);
+   bool WriteBuffer();
+   void Advise(bool all);
+   //
+   FileBackend m_backend;
+   std::size_t m_bufferSize = 0; // multiple of ALIGN
+   std::unique_ptr<char, Free> m_buffer;
+   int m_fd = -1;
+   bool m_direct = false;
+   off_t m_offset = 0; // file offset of the beginning of the buffer
+   std::size_t m_tailWritten = 0; // size of the partial block at the beginning of the buffer already written (direct)
+   off_t m_started = 0; // end of the range whose writeback is started (dontneed)
+   off_t m_dropped = 0; // end of the range dropped from the page cache (dontneed)
+};
+
+/*
+- log file written by a FileWriter with one of the FileBackends
+- the std::ofstream is always available for the OnFileWritten() hooks, its streambuf is replaced by a RawFileBuf for the other FileBackends
+*/
+class LogFile
+{
+public:
+   LogFile() : m_stream(std::make_unique<std::ofstream>()) {}
+   //
+   bool Open(const std::string& path, FileBackend backend);
+   bool IsOpen() const { return m_buf ? m_buf->IsOpen() : m_stream->is_open(); }
+   // also called on a moved-from LogFile
+   void Close();
+   void Write(const char* data, std::size_t size) { m_stream->write(data, size); }
+   void Put(char c) { m_stream->put(c); }
+   void Flush() { m_stream->flush(); }
+   void Swap(LogFile& other);
+   std::ofstream& GetStream() { return *m_stream; }
+
+private:
+   std::unique_ptr<std::ofstream> m_stream; // unique_ptr: the replaced streambuf is kept when the LogFile is moved or swapped
+   std::unique_ptr<RawFileBuf> m_buf;
+};
+
+inline void LogFile::Swap(LogFile& other)
+{
+   m_stream.swap(other.m_stream);
+   m_buf.swap(other.m_buf);
+}
+
+}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- merge the log files of a run (one file per thread, cf FileWriter) into one file ordered by timestamp (cf tbp-log-merge)
+- the files are memory-mapped, each line starting with the header [HH:MM:SS.nnnnnnnnn] is a record
+the lines without header (message with a new line, ...) stay with the previous record
+- midnight rollover: the day of the first record is the date in the file name (<prefix>_<YYYYmmdd-HHMMSS>-<suffix>.log)
+the day is incremented each time the time of day goes back by more than 12 hours
+the rotated files (<...>.<n>.log) are read after the file they follow
+- the records are indexed in parallel (one task per file), then the key range is split in chunks merged in parallel (k-way merge)
+each chunk is copied at its final offset in the memory-mapped output file
+- the order of the records with the same timestamp is the order of the input files (then of the records in a file)
+*/
+class LogMerger
+{
+public:
+   explicit LogMerger(std::size_t nbThreads);
+   //
+   // returns the number of records written in 'output'
+   std::size_t Merge(const std::vector<std::string>& inputs, const std::string& output);
+   //
+   // parse the header [HH:MM:SS.nnnnnnnnn] at the beginning of 'line', returns false if there is no valid header
+   static bool ParseTime(const char* line, std::size_t size, std::uint64_t& nanosOfDay);
+   static constexpr std::size_t HEADER_SIZE = 20;
+
+private:
+   struct Record
+   {
+      std::uint64_t m_key; // local time, nanoseconds since 1970-01-01 00:00:00
+      const char* m_data;
+      std::size_t m_size; // with the new line, which is missing at the end of a file not ended by a new line
+   };
+   struct Input;
+   struct Stream;
+   //
+   void Index(Stream& stream);
+   //
+   std::size_t m_nbThreads = 1;
+
+};
+
+}
+}
@@ -6,9 +6,14 @@
 #include "tbp/log/Loggers.h"
 #include "tbp/log/Categories.h"
 #include "tbp/log/Injector.h"
+#include "tbp/log/LoadShedder.h"
+#include "tbp/common/OS.h"
+#include "tbp/common/Compiler.h"
 #include <time.h>
 #include <string>
 #include <vector>
+#include <array>
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 
@@ -24,21 +29,28 @@ class Config;
 /*
 - "theoretically" the same Logger could be used for different threads
 - Logger::m_sink is in charge to handle the different logging policies
+- the thread id is the one of the thread creating the Logger, it is used by the per-thread level overrides of Loggers
 - when used through a ThreadLocalLogger, the Logger dtor will be called:
 either by the shared_ptr dtor in ThreadLocalLogger 
 or by the shared_ptr dtor in Loggers
+- while the LoadShedder of Loggers is shedding, ShouldLog() drops the low-level messages and counts them per category (cf ShedCounters)
+the counts are logged at warn level by the consumer of the thread once the shedding stops (cf AsyncLogger::LogMessages)
+the counts it has not collected are logged by the first Log() call after the shedding stops
 */
 template <typename Sink>
 class Logger : public ILogger
 {
 public:
    Logger(std::string name, const Loggers& loggers, Sink sink);
+   ~Logger();
    //
    virtual const std::string& GetName() const override { return m_name; }
+   virtual common::ThreadId GetThreadId() const override { return m_tid; }
    Level GetLevel(CategoryId id) const { return m_categories[GetIndex(id)].GetLevel(); }
    virtual void SetLevel(CategoryId id, Level level) override { m_categories[GetIndex(id)].SetLevel(level); }
    template <typename... Args> void Log(CategoryId id, Level level, common::SigNum signal, const char* fmt, Args&&... args);
-   bool ShouldLog(CategoryId id, Level level) const { return level >= GetLevel(id); }
+   bool ShouldLog(CategoryId id, Level level) const;
+   Sink& GetSink() { return m_sink; }
 
 private:
    struct CategoryData
@@ -53,16 +65,22 @@ private:
    };
    //
    std::size_t GetIndex(CategoryId id) const;
+   void TBP_NOINLINE Shed(CategoryId id, Level level) const;
+   void TBP_NOINLINE ReportShed(const timespec& now);
    //
    Sink m_sink;
    std::vector<CategoryData> m_categories; // vector index is CategoryId - 1
+   const LoadShedder* m_loadShedder = nullptr;
+   mutable ShedCounters m_shed;
    std::string m_name;
+   common::ThreadId m_tid = 0;
 
 };
 
 template <typename Sink>
 Logger<Sink>::Logger(std::string name, const Loggers& loggers, Sink sink)
-   : m_sink(std::move(sink)), m_categories(loggers.GetCategories().GetSize()), m_name(std::move(name))
+   : m_sink(std::move(sink)), m_categories(loggers.GetCategories().GetSize()), m_loadShedder(&loggers.GetLoadShedder()),
+   m_shed(common::ThreadGetId(), m_categories.size()), m_name(std::move(name)), m_tid(common::ThreadGetId())
 {
    /*
    ATTENTION mock objects do not support copy/move
@@ -78,7 +96,15 @@ Logger<Sink>::Logger(std::string name, const Loggers& loggers, Sink sink)
       auto& data = m_categories[index];
       data.SetLevel(category.GetInitialLevel());
       data.m_category = &category;
+      m_shed.SetCategory(index, category);
    });
+   m_loadShedder->Register(m_shed);
+}
+
+template <typename Sink>
+Logger<Sink>::~Logger()
+{
+   m_loadShedder->Unregister(m_shed);
 }
 
 template <typename Sink>
@@ -90,6 +116,36 @@ inline std::size_t Logger<Sink>::GetIndex(CategoryId id) const
    return index;
 }
 
+template <typename Sink>
+inline bool Logger<Sink>::ShouldLog(CategoryId id, Level level) const
+{
+   if (level < GetLevel(id))
+   {
+      return false;
+   }
+   if (unlikely(level < m_loadShedder->GetLevel()))
+   {
+      Shed(id, level);
+      return false;
+   }
+   return true;
+}
+
+template <typename Sink>
+void TBP_NOINLINE Logger<Sink>::Shed(CategoryId id, Level level) const
+{
+   m_shed.Add(GetIndex(id), level);
+}
+
+template <typename Sink>
+void TBP_NOINLINE Logger<Sink>::ReportShed(const timespec& now)
+{
+   m_shed.Collect([this, &now](const Category& category, const ShedCounters::Counts& nbShed)
+   {
+      m_sink.Log(category, Level::warn, now, 0, "load shedding: {} debug, {} info and {} warn messages dropped", nbShed[0], nbShed[1], nbShed[2]);
+   });
+}
+
 template <typename Sink>
 template <typename... Args> 
 inline void /*TBP_NOINLINE*/ Logger<Sink>::Log(CategoryId id, Level level, common::SigNum signal, const char* fmt, Args&&... args)
@@ -98,6 +154,10 @@ inline void /*TBP_NOINLINE*/ Logger<Sink>::Log(CategoryId id, Level level, commo
    timespec now;
    ::clock_gettime(CLOCK_REALTIME, &now);
    //
+   if (unlikely(!m_shed.IsEmpty()) && m_loadShedder->GetLevel() == Level::none)
+   {
+      ReportShed(now);
+   }
    const Category& cat = *m_categories[GetIndex(id)].m_category;
    m_sink.Log(cat, level, now, signal, fmt, std::forward<Args>(args)...);
 }
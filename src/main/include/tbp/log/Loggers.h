@@ -3,9 +3,13 @@
 #include "tbp/log/Level.h"
 #include "tbp/log/Categories.h"
 #include "tbp/log/Config.h"
+#include "tbp/log/Epoch.h"
+#include "tbp/log/LoadShedder.h"
+#include "tbp/common/OS.h"
 #include <map>
 #include <mutex>
 #include <memory>
+#include <atomic>
 
 namespace tbp
 {
@@ -23,6 +27,16 @@ namespace log
 
 /*
 - the same Loggers object can be used by any thread (to change the log level, create a new logger, ...)
+- the level of a category in a Logger is, by order of precedence: 
+the level set for the thread of the Logger (SetThreadLevel), the level set for the name of the Logger (SetLoggerLevel), the level set for all the loggers (SetLevel)
+the overrides are kept for the loggers created later with the same name or in the same thread while the thread has a logger
+the overrides of a thread are removed with its last logger: a new thread can reuse its id
+- AddLogger/RemoveLogger do not take the level mutex (threads can be created and destroyed at a high rate):
+the loggers are stored in slots claimed with a CAS, the slots are read under an Epoch
+the levels are stored in an immutable LevelSnapshot, each level change publishes a new snapshot
+only the level changes are serialized with a mutex (and the removal of the last logger of a thread with overrides)
+- RemoveLogger waits for the readers of the slots (level changes, AddLogger), a few slot scans at most (cf Epoch::Synchronize)
+the concurrent removals share their waits
 - resources
 https://github.com/gabime/spdlog
 https://github.com/KjellKod/g3log
@@ -31,27 +45,62 @@ class Loggers
 {
 public:
    Loggers(const Categories& categories, const Config& config, const Injector& injector);
+   ~Loggers();
+   Loggers(const Loggers&) = delete;
+   Loggers& operator=(const Loggers&) = delete;
    //
    void AddLogger(ILogger& logger);
    bool RemoveLogger(const ILogger& logger);
    const Categories& GetCategories() const { return m_categories; }
    bool SetLevel(const Category& category, Level level);
    bool SetLevels(Level level);
+   bool SetLoggerLevel(const std::string& loggerName, const Category& category, Level level);
+   bool SetThreadLevel(common::ThreadId tid, const Category& category, Level level);
+   void ResetLoggerLevels(const std::string& loggerName);
+   void ResetThreadLevels(common::ThreadId tid);
    const Config& GetConfig() const { return m_config; }
    const Injector& GetInjector() const { return m_injector; }
+   // read by all the Loggers, updated by the AsyncLogger (cf AsyncLogger::SetLoadShedder)
+   const LoadShedder& GetLoadShedder() const { return m_loadShedder; }
+   LoadShedder& GetLoadShedder() { return m_loadShedder; }
 
 private:
-   bool SetLevelImpl(const Category& category, Level level);
+   using Levels = std::map<CategoryId, Level>;
+   struct LevelSnapshot
+   {
+      Levels m_levels;
+      std::map<std::string, Levels> m_loggerLevels;
+      std::map<common::ThreadId, Levels> m_threadLevels;
+   };
+   static constexpr std::size_t CHUNK_SIZE = 64;
+   struct Chunk
+   {
+      Chunk() : m_next(nullptr) { for (auto& slot : m_slots) { slot.store(nullptr); } }
+      //
+      std::atomic<ILogger*> m_slots[CHUNK_SIZE]; // must only be used to change "std::atomic" properties in the ILogger (log level, ...)
+      std::atomic<Chunk*> m_next;
+   };
    //
-   std::mutex m_mutex;
-   std::map<std::string, ILogger*> m_loggers; // must only be used to change "std::atomic" properties in the ILogger (log level, ...)
+   template <typename FUNC> void ForEachLogger(FUNC func);
+   void ClaimSlot(ILogger& logger);
+   bool ReleaseSlot(const ILogger& logger);
+   void ResetExitedThreadLevels(common::ThreadId tid);
+   // must be called with m_mutex locked
+   template <typename FUNC> void Publish(FUNC modify);
+   bool SetLevelImpl(LevelSnapshot& snapshot, const Category& category, Level level);
+   static Level GetLevel(const LevelSnapshot& snapshot, const ILogger& logger, CategoryId id);
+   static void ApplyLevels(const LevelSnapshot& snapshot, ILogger& logger);
+   //
+   Chunk m_head;
+   Epoch m_epoch;
+   std::mutex m_mutex; // level changes
+   std::atomic<const LevelSnapshot*> m_snapshot;
    Categories m_categories;
-   std::map<CategoryId, Level> m_levels;
    Config m_config;
    const Injector& m_injector;
+   LoadShedder m_loadShedder;
 
 };
 
 }
 }
-
@@ -0,0 +1,221 @@
+#pragma once
+
+#include "tbp/log/Formatter.h"
+#include "tbp/log/Decoder.h"
+#include "tbp/log/Buffer.h"
+#include "tbp/log/Type.h"
+#include "tbp/log/DefaultTypes.h"
+#include "tbp/log/NumberWriter.h"
+#include "tbp/common/Compiler.h"
+#include <cppformat/format.h>
+#include <cstdint>
+#include <string>
+#include <cstring>
+#include <cassert>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- decode the next field of a log::Buffer and pass its value to 'func'
+- TypeId must provide the enumerates of DefaultTypeId (INT, UINT64, INT64, DOUBLE, STRING, ARRAY, STATIC_STRING, BLOB)
+*/
+template <typename TypeId, typename Allocator, typename FUNC>
+inline void DecodeField(TypeId typeId, Buffer<Allocator>& buffer, FUNC&& func)
+{
+   switch (typeId)
+   {
+      case TypeId::INT:
+      {
+         int v = 0;
+         Type<int, TypeId, Allocator>::Decode(buffer, v);
+         func(v);
+      }
+      break;
+      case TypeId::UINT64:
+      {
+         std::uint64_t v = 0;
+         Type<std::uint64_t, TypeId, Allocator>::Decode(buffer, v);
+         func(v);
+      }
+      break;
+      case TypeId::INT64:
+      {
+         std::int64_t v = 0;
+         Type<std::int64_t, TypeId, Allocator>::Decode(buffer, v);
+         func(v);
+      }
+      break;
+      case TypeId::DOUBLE:
+      {
+         double v = 0.;
+         Type<double, TypeId, Allocator>::Decode(buffer, v);
+         func(v);
+      }
+      break;
+      case TypeId::STRING:
+      {
+         std::string v;
+         Type<std::string, TypeId, Allocator>::Decode(buffer, v);
+         func(v);
+      }
+      break;
+      case TypeId::STATIC_STRING:
+      {
+         fmt::StringRef v("", 0);
+         Type<StaticString, TypeId, Allocator>::Decode(buffer, v);
+         func(v);
+      }
+      break;
+      case TypeId::BLOB:
+      {
+         BlobField v;
+         Type<Blob, TypeId, Allocator>::Decode(buffer, v);
+         // released even if 'func' throws
+         BlobReleaser releaser{ v };
+         func(v);
+      }
+      break;
+      case TypeId::ARRAY:
+      {
+         ArrayField<TypeId> v;
+         v.Decode(buffer);
+         func(v);
+      }
+      break;
+      case TypeId::NONE:
+      {
+         assert(false);
+      }
+      break;
+   }
+}
+
+/*
+- decode the fields not decoded yet to call the release of their BlobRefs (cf BlobField::Release)
+- used for the messages which are not formatted (left in a queue, ...) or whose formatting failed
+*/
+template <typename TypeId, typename Allocator>
+inline void ReleaseFields(Decoder<TypeId, Allocator>& decoder)
+{
+   while (decoder.HasNext())
+   {
+      auto p = decoder.Next();
+      DecodeField(p.first, *p.second, [](const auto& /*v*/) {});
+   }
+}
+
+// 'buffer' must not be decoded yet
+template <typename TypeId, typename Allocator>
+inline void ReleaseFields(Buffer<Allocator>& buffer)
+{
+   if (buffer.Get())
+   {
+      Decoder<TypeId, Allocator> decoder(buffer);
+      ReleaseFields(decoder);
+   }
+}
+
+// fmt is the literal text before the field followed by the field, most fields use the default spec ({})
+template <typename T>
+inline void WriteField(fmt::MemoryWriter& writer, const char* fmt, const T& v)
+{
+   std::size_t size = std::strlen(fmt);
+   if (likely(size >= 2 && fmt[size - 2] == '{' && fmt[size - 1] == '}'))
+   {
+      writer << fmt::StringRef(fmt, size - 2);
+      WriteDefault(writer, v);
+   }
+   else
+   {
+      writer.write(fmt, v);
+   }
+}
+
+// [a, b, c], the spec of the field is the spec of each element, "..." if the container was truncated (cf GetMaxArraySize)
+template <typename TypeId>
+inline void WriteField(fmt::MemoryWriter& writer, const char* fmt, const ArrayField<TypeId>& v)
+{
+   const char* field = std::strrchr(fmt, '{');
+   writer << fmt::StringRef(fmt, field - fmt) << '[';
+   bool defaultSpec = field[1] == '}';
+   std::size_t i = 0;
+   v.ForEach([&writer, field, defaultSpec, &i](const auto& element)
+   {
+      if (i++)
+      {
+         writer << ", ";
+      }
+      if (likely(defaultSpec))
+      {
+         WriteDefault(writer, element);
+      }
+      else
+      {
+         writer.write(field, element);
+      }
+   });
+   if (v.m_total > v.m_size)
+   {
+      writer << (v.m_size ? ", ..." : "...");
+   }
+   writer << ']';
+}
+
+// the spec of the field is ignored, the format (hex or base64) is chosen by the producer
+inline void WriteField(fmt::MemoryWriter& writer, const char* fmt, const BlobField& v)
+{
+   writer << fmt::StringRef(fmt, std::strrchr(fmt, '{') - fmt);
+   WriteBlob(writer, v);
+}
+
+/*
+- format the message of a log::Msg (format string + encoded fields) into a fmt::MemoryWriter
+- shared by all the consumers of encoded messages (AsyncLogger, LogDaemon, ...)
+*/
+template <typename TypeId, typename Allocator>
+class MsgFormatter
+{
+public:
+   void Format(const char* fmt, Buffer<Allocator>& buffer, fmt::MemoryWriter& writer);
+
+private:
+   Formatter m_formatter;
+
+};
+
+template <typename TypeId, typename Allocator>
+inline void MsgFormatter<TypeId, Allocator>::Format(const char* fmt, Buffer<Allocator>& buffer, fmt::MemoryWriter& writer)
+{
+   if (buffer.Get())
+   {
+      Decoder<TypeId, Allocator> decoder(buffer);
+      try
+      {
+         m_formatter.Format(fmt, writer, [&decoder](const char* fmt, fmt::MemoryWriter& writer)
+         {
+            assert(decoder.HasNext() == true);
+            auto p = decoder.Next();
+            DecodeField(p.first, *p.second, [fmt, &writer](const auto& v)
+            {
+               WriteField(writer, fmt, v);
+            });
+         });
+      }
+      catch (...)
+      {
+         ReleaseFields(decoder);
+         throw;
+      }
+      assert(decoder.HasNext() == false);
+   }
+   else
+   {
+      writer.write(fmt);
+   }
+}
+
+}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- NUMA topology and memory placement with the raw system calls (getcpu, mbind, sched_setaffinity): no dependency on libnuma
+- without NUMA (sysfs node directory missing, mbind not supported, ...) there is one node (0) and the memory is not bound
+*/
+using NumaNode = int;
+constexpr NumaNode NUMA_ANY_NODE = -1;
+
+std::size_t NumaGetNbNodes();
+// node of the CPU the calling thread is running on
+NumaNode NumaGetCurrentNode();
+// CPUs of the node (sysfs cpulist), all the CPUs if the topology is not available
+std::vector<int> NumaGetCpus(NumaNode node);
+// pins the calling thread on the CPUs, returns false on error
+bool NumaSetAffinity(const std::vector<int>& cpus);
+/*
+- page aligned memory bound to the node, allocated with mmap: it must be freed with NumaFree()
+- if the memory cannot be bound, it is still allocated (and placed by the first touch)
+- returns nullptr if mmap fails
+*/
+void* NumaAlloc(std::size_t size, NumaNode node);
+void NumaFree(void* ptr, std::size_t size);
+
+}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "tbp/log/AsyncLogger.h"
+#include "tbp/log/ConsumerThreads.h"
+#include "tbp/log/Numa.h"
+#include "tbp/log/Config.h"
+#include "tbp/log/Injector.h"
+#include "tbp/common/ConfigurationException.h"
+#include "tbp/common/OS.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+one AsyncLogger and one consumer thread per NUMA node:
+- the sinks must be created by the producer thread with GetLogger() which returns the AsyncLogger of the node the thread runs on
+so each consumer only drains the queues of the producers of its node (the pool of its AsyncLogger only holds queues of its node)
+- the queues are placed by the first touch of the thread creating the sink, the allocator of the sink should be bound to the node
+ex: Allocator(sizes, nbItems, true, NumaGetCurrentNode())
+- by default the consumer of a node is pinned on the CPUs of the node, OnStart replaces this affinity
+- the FileWriters are per AsyncLogger: a file shared by several queues (group, route, Config::GetMaxFileWriters) has one file per node
+the node is appended to its name (ex: "orders-node1", cf AsyncLogger::SetSharedFileSuffix)
+- a signal logged by a producer (cf SignalManager) is available with GetSignal() once the message is written
+*/
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+class NumaConsumer : public ConsumerThreads<AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>>
+{
+public:
+   using Logger = AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>;
+   using OnStart = std::function<void(NumaNode node)>; // affinity, thread name, ...
+   //
+   NumaConsumer(const Config& config, const Injector& injector, std::size_t nbNodes = NumaGetNbNodes());
+   ~NumaConsumer() { Stop(); }
+   NumaConsumer(const NumaConsumer&) = delete;
+   NumaConsumer& operator=(const NumaConsumer&) = delete;
+   //
+   // AsyncLogger of the node of the calling thread
+   Logger& GetLogger() { return GetLogger(NumaGetCurrentNode()); }
+   Logger& GetLogger(NumaNode node) { return *m_loggers[static_cast<std::size_t>(node) % m_loggers.size()]; }
+   std::size_t GetNbNodes() const { return m_loggers.size(); }
+   void Start(OnStart onStart = OnStart());
+   // the messages already enqueued are written before Stop() returns
+   using ConsumerThreads<Logger>::Stop;
+
+private:
+   std::vector<std::unique_ptr<Logger>> m_loggers; // vector index is the node
+
+};
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline NumaConsumer<TypeId, SpscQueue, MpscQueue, Allocator>::NumaConsumer(const Config& config, const Injector& injector, std::size_t nbNodes)
+{
+   if (!nbNodes)
+   {
+      throw common::ConfigurationException("NumaConsumer needs at least one node");
+   }
+   for (std::size_t i = 0; i < nbNodes; ++i)
+   {
+      m_loggers.emplace_back(std::make_unique<Logger>(config, injector));
+      m_loggers.back()->SetSharedFileSuffix("node" + std::to_string(i));
+   }
+}
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline void NumaConsumer<TypeId, SpscQueue, MpscQueue, Allocator>::Start(OnStart onStart)
+{
+   ConsumerThreads<Logger>::Start(m_loggers, [onStart](std::size_t index)
+   {
+      NumaNode node = static_cast<NumaNode>(index);
+      if (onStart)
+      {
+         onStart(node);
+      }
+      else
+      {
+         NumaSetAffinity(NumaGetCpus(node));
+      }
+   });
+}
+
+}
+}
@@ -0,0 +1,418 @@
+#pragma once
+
+#include <cppformat/format.h>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- formatting of the numbers for the default format spec ({}), written directly in the fmt::MemoryWriter
+- the integers are written two digits at a time from a table of the 100 pairs of digits
+- the doubles are written with the shortest representation which reads back to the same value (round trip)
+   - values with a few decimals (prices, integral values, ...) are found by scaling with an exact power of 10
+   - the other values use Grisu2 (cf details::WriteShortest)
+   - the contract is the one of Ryu (shortest round trip) but not its algorithm, Grisu2 can return one digit more for ~0.1% of the doubles
+*/
+namespace details
+{
+
+inline const char* GetDigitPairs()
+{
+   static const char digits[] =
+      "0001020304050607080910111213141516171819"
+      "2021222324252627282930313233343536373839"
+      "4041424344454647484950515253545556575859"
+      "6061626364656667686970717273747576777879"
+      "8081828384858687888990919293949596979899";
+   return digits;
+}
+
+// write the digits of 'v' before 'end', returns the first digit
+inline char* FormatDecimal(char* end, std::uint64_t v)
+{
+   const char* digits = GetDigitPairs();
+   while (v >= 100)
+   {
+      unsigned index = static_cast<unsigned>(v % 100) * 2;
+      v /= 100;
+      *--end = digits[index + 1];
+      *--end = digits[index];
+   }
+   if (v < 10)
+   {
+      *--end = static_cast<char>('0' + v);
+      return end;
+   }
+   unsigned index = static_cast<unsigned>(v) * 2;
+   *--end = digits[index + 1];
+   *--end = digits[index];
+   return end;
+}
+
+constexpr int MAX_SCALE = 6;
+
+inline double GetPowerOf10(int exponent)
+{
+   static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6 };
+   return powers[exponent];
+}
+
+/*
+- Grisu2 (Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with Integers")
+adapted from the implementation of Milo Yip (https://github.com/miloyip/dtoa-benchmark)
+- the digits always read back to the same double, they are the shortest ones for ~99.9% of the doubles
+*/
+struct DiyFp
+{
+   DiyFp(std::uint64_t f, int e) : m_f(f), m_e(e) {}
+   explicit DiyFp(double d)
+   {
+      std::uint64_t u = 0;
+      std::memcpy(&u, &d, sizeof(u));
+      int biasedExponent = static_cast<int>((u & EXPONENT_MASK) >> 52);
+      std::uint64_t significand = u & SIGNIFICAND_MASK;
+      if (biasedExponent)
+      {
+         m_f = significand + HIDDEN_BIT;
+         m_e = biasedExponent - EXPONENT_BIAS;
+      }
+      else
+      {
+         m_f = significand;
+         m_e = 1 - EXPONENT_BIAS;
+      }
+   }
+   //
+   DiyFp operator-(const DiyFp& rhs) const { return DiyFp(m_f - rhs.m_f, m_e); }
+   DiyFp operator*(const DiyFp& rhs) const
+   {
+      unsigned __int128 p = static_cast<unsigned __int128>(m_f) * rhs.m_f;
+      std::uint64_t h = static_cast<std::uint64_t>(p >> 64);
+      std::uint64_t l = static_cast<std::uint64_t>(p);
+      if (l & (std::uint64_t(1) << 63))
+      {
+         ++h; // rounding
+      }
+      return DiyFp(h, m_e + rhs.m_e + 64);
+   }
+   DiyFp Normalize() const
+   {
+      int shift = __builtin_clzll(m_f);
+      return DiyFp(m_f << shift, m_e - shift);
+   }
+   void NormalizedBoundaries(DiyFp& minus, DiyFp& plus) const
+   {
+      DiyFp pl = DiyFp((m_f << 1) + 1, m_e - 1);
+      int shift = __builtin_clzll(pl.m_f);
+      pl = DiyFp(pl.m_f << shift, pl.m_e - shift);
+      DiyFp mi = m_f == HIDDEN_BIT ? DiyFp((m_f << 2) - 1, m_e - 2) : DiyFp((m_f << 1) - 1, m_e - 1);
+      mi.m_f <<= mi.m_e - pl.m_e;
+      mi.m_e = pl.m_e;
+      plus = pl;
+      minus = mi;
+   }
+   //
+   static constexpr std::uint64_t EXPONENT_MASK = 0x7FF0000000000000ULL;
+   static constexpr std::uint64_t SIGNIFICAND_MASK = 0x000FFFFFFFFFFFFFULL;
+   static constexpr std::uint64_t HIDDEN_BIT = 0x0010000000000000ULL;
+   static constexpr int EXPONENT_BIAS = 0x3FF + 52;
+   //
+   std::uint64_t m_f = 0;
+   int m_e = 0;
+};
+
+// normalized 10^k for k = -348, -340, ..., 340
+inline DiyFp GetCachedPower(int e, int& k)
+{
+   static const std::uint64_t significands[] = {
+      0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+      0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+      0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+      0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+      0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+      0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+      0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+      0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+      0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+      0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+      0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+      0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+      0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+      0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+      0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+      0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+      0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+      0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+      0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+      0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+      0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+      0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+   };
+   static const std::int16_t exponents[] = {
+      -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+      -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+      -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+      -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+      56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+      375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+      694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+      1013, 1039, 1066,
+   };
+   double dk = (-61 - e) * 0.30102999566398114 + 347; // dk must be positive
+   int ik = static_cast<int>(dk);
+   if (dk - ik > 0.)
+   {
+      ++ik;
+   }
+   unsigned index = static_cast<unsigned>((ik >> 3) + 1);
+   k = -(-348 + static_cast<int>(index << 3)); // decimal exponent no need lookup table
+   return DiyFp(significands[index], exponents[index]);
+}
+
+inline void GrisuRound(char* buffer, int size, std::uint64_t delta, std::uint64_t rest, std::uint64_t tenKappa, std::uint64_t wpw)
+{
+   while (rest < wpw && delta - rest >= tenKappa && (rest + tenKappa < wpw || wpw - rest > rest + tenKappa - wpw))
+   {
+      --buffer[size - 1];
+      rest += tenKappa;
+   }
+}
+
+inline int CountDecimalDigits(std::uint32_t n)
+{
+   int count = 1;
+   while (n >= 10)
+   {
+      n /= 10;
+      ++count;
+   }
+   return count;
+}
+
+inline void DigitGen(const DiyFp& w, const DiyFp& mp, std::uint64_t delta, char* buffer, int& size, int& k)
+{
+   static const std::uint32_t powers[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+   const DiyFp one(std::uint64_t(1) << -mp.m_e, mp.m_e);
+   const DiyFp wpw = mp - w;
+   std::uint32_t p1 = static_cast<std::uint32_t>(mp.m_f >> -one.m_e);
+   std::uint64_t p2 = mp.m_f & (one.m_f - 1);
+   int kappa = CountDecimalDigits(p1);
+   size = 0;
+   while (kappa > 0)
+   {
+      std::uint32_t d = p1 / powers[kappa - 1];
+      p1 %= powers[kappa - 1];
+      if (d || size)
+      {
+         buffer[size++] = static_cast<char>('0' + d);
+      }
+      --kappa;
+      std::uint64_t tmp = (static_cast<std::uint64_t>(p1) << -one.m_e) + p2;
+      if (tmp <= delta)
+      {
+         k += kappa;
+         GrisuRound(buffer, size, delta, tmp, static_cast<std::uint64_t>(powers[kappa]) << -one.m_e, wpw.m_f);
+         return;
+      }
+   }
+   while (true)
+   {
+      p2 *= 10;
+      delta *= 10;
+      char d = static_cast<char>(p2 >> -one.m_e);
+      if (d || size)
+      {
+         buffer[size++] = static_cast<char>('0' + d);
+      }
+      p2 &= one.m_f - 1;
+      --kappa;
+      if (p2 < delta)
+      {
+         k += kappa;
+         int index = -kappa;
+         GrisuRound(buffer, size, delta, p2, one.m_f, wpw.m_f * (index < 10 ? powers[index] : 0));
+         return;
+      }
+   }
+}
+
+// value > 0: digits * 10^k
+inline void Grisu2(double value, char* buffer, int& size, int& k)
+{
+   const DiyFp v(value);
+   DiyFp minus(0, 0);
+   DiyFp plus(0, 0);
+   v.NormalizedBoundaries(minus, plus);
+   const DiyFp cached = GetCachedPower(plus.m_e, k);
+   const DiyFp w = v.Normalize() * cached;
+   DiyFp wp = plus * cached;
+   DiyFp wm = minus * cached;
+   ++wm.m_f;
+   --wp.m_f;
+   DigitGen(w, wp, wp.m_f - wm.m_f, buffer, size, k);
+}
+
+// same layout as cppformat: scientific notation if the decimal exponent is < -4 or >= 16
+inline void WriteShortest(fmt::MemoryWriter& writer, double v)
+{
+   char digits[20];
+   int nbDigits = 0;
+   int k = 0;
+   Grisu2(std::fabs(v), digits, nbDigits, k);
+   int exponent = nbDigits + k - 1; // exponent of the first digit
+   char buffer[40];
+   char* out = buffer;
+   if (std::signbit(v))
+   {
+      *out++ = '-';
+   }
+   if (exponent < -4 || exponent >= 16)
+   {
+      *out++ = digits[0];
+      if (nbDigits > 1)
+      {
+         *out++ = '.';
+         std::memcpy(out, digits + 1, nbDigits - 1);
+         out += nbDigits - 1;
+      }
+      *out++ = 'e';
+      *out++ = exponent < 0 ? '-' : '+';
+      int absExponent = exponent < 0 ? -exponent : exponent;
+      char exponentBuffer[8];
+      char* exponentEnd = exponentBuffer + sizeof(exponentBuffer);
+      char* exponentBegin = FormatDecimal(exponentEnd, absExponent);
+      if (absExponent < 10)
+      {
+         *--exponentBegin = '0';
+      }
+      std::memcpy(out, exponentBegin, exponentEnd - exponentBegin);
+      out += exponentEnd - exponentBegin;
+   }
+   else if (exponent < 0)
+   {
+      *out++ = '0';
+      *out++ = '.';
+      for (int i = -1; i > exponent; --i)
+      {
+         *out++ = '0';
+      }
+      std::memcpy(out, digits, nbDigits);
+      out += nbDigits;
+   }
+   else
+   {
+      for (int i = 0; i <= exponent; ++i)
+      {
+         *out++ = i < nbDigits ? digits[i] : '0';
+      }
+      if (nbDigits > exponent + 1)
+      {
+         *out++ = '.';
+         std::memcpy(out, digits + exponent + 1, nbDigits - exponent - 1);
+         out += nbDigits - exponent - 1;
+      }
+   }
+   writer << fmt::StringRef(buffer, out - buffer);
+}
+
+}
+
+inline void WriteDefault(fmt::MemoryWriter& writer, std::uint64_t v)
+{
+   char buffer[24];
+   char* end = buffer + sizeof(buffer);
+   char* begin = details::FormatDecimal(end, v);
+   writer << fmt::StringRef(begin, end - begin);
+}
+
+inline void WriteDefault(fmt::MemoryWriter& writer, std::int64_t v)
+{
+   char buffer[24];
+   char* end = buffer + sizeof(buffer);
+   // the negation is done on the unsigned value to support the minimum value
+   std::uint64_t abs = v < 0 ? 0 - static_cast<std::uint64_t>(v) : static_cast<std::uint64_t>(v);
+   char* begin = details::FormatDecimal(end, abs);
+   if (v < 0)
+   {
+      *--begin = '-';
+   }
+   writer << fmt::StringRef(begin, end - begin);
+}
+
+inline void WriteDefault(fmt::MemoryWriter& writer, int v)
+{
+   WriteDefault(writer, static_cast<std::int64_t>(v));
+}
+
+inline void WriteDefault(fmt::MemoryWriter& writer, double v)
+{
+   if (!std::isfinite(v))
+   {
+      writer << (std::isnan(v) ? "nan" : (v < 0 ? "-inf" : "inf"));
+      return;
+   }
+   if (v == 0.)
+   {
+      writer << (std::signbit(v) ? "-0" : "0");
+      return;
+   }
+   char buffer[32];
+   char* end = buffer + sizeof(buffer);
+   double abs = std::fabs(v);
+   // the fixed notation of WriteShortest is used in this range
+   if (abs >= 1e-4 && abs < 1e16)
+   {
+      for (int scale = 0; scale <= details::MAX_SCALE; ++scale)
+      {
+         double power = details::GetPowerOf10(scale);
+         double scaled = std::nearbyint(abs * power);
+         // the division of two integers exactly represented is correctly rounded: mantissa / 10^scale reads back to the same value
+         if (scaled >= 9007199254740992. /* 2^53 */)
+         {
+            break;
+         }
+         if (scaled / power == abs)
+         {
+            char* begin = details::FormatDecimal(end, static_cast<std::uint64_t>(scaled));
+            if (scale)
+            {
+               // insert the decimal point, with leading zeros if needed
+               while (end - begin <= scale)
+               {
+                  *--begin = '0';
+               }
+               char* point = end - scale;
+               std::memmove(begin - 1, begin, point - begin);
+               --begin;
+               *(point - 1) = '.';
+            }
+            if (std::signbit(v))
+            {
+               *--begin = '-';
+            }
+            writer << fmt::StringRef(begin, end - begin);
+            return;
+         }
+      }
+   }
+   details::WriteShortest(writer, v);
+}
+
+inline void WriteDefault(fmt::MemoryWriter& writer, const std::string& v)
+{
+   writer << fmt::StringRef(v);
+}
+
+inline void WriteDefault(fmt::MemoryWriter& writer, fmt::StringRef v)
+{
+   writer << v;
+}
+
+}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "tbp/log/AsyncLogger.h"
+#include "tbp/log/ConsumerThreads.h"
+#include "tbp/log/WriterStage.h"
+#include "tbp/log/Config.h"
+#include "tbp/log/Injector.h"
+#include "tbp/common/ConfigurationException.h"
+#include "tbp/common/OS.h"
+#include <memory>
+#include <vector>
+#include <functional>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+consumer split in stages:
+- formatting workers: each worker thread runs its own AsyncLogger
+it drains the queues of its sinks, decodes and formats the messages and recycles their buffers
+the lines are appended to blocks handed to the WriterStage without lock
+- writer stage: one thread writing the blocks to the files
+so the producer queues do not back up because of the disk latency
+- a producer queue is drained by only one worker and the blocks of a file are written in order: the order of the messages of a thread is preserved
+- the sinks must be created with GetLogger(tid) which spreads the threads on the workers
+- a signal logged by a producer (cf SignalManager) is available with GetSignal() once the message is written
+- the FileWriters are per worker: with several workers, the files shared by several queues (groups, routes, Config::GetMaxFileWriters)
+would be truncated and written by each worker, they are rejected with a ConfigurationException
+*/
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+class PipelinedConsumer : public ConsumerThreads<AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>>
+{
+public:
+   using Logger = AsyncLogger<TypeId, SpscQueue, MpscQueue, Allocator>;
+   using OnStart = std::function<void(std::size_t workerIndex)>; // affinity, thread name, ...
+   //
+   PipelinedConsumer(const Config& config, const Injector& injector, std::size_t nbWorkers);
+   ~PipelinedConsumer() { Stop(); }
+   PipelinedConsumer(const PipelinedConsumer&) = delete;
+   PipelinedConsumer& operator=(const PipelinedConsumer&) = delete;
+   //
+   Logger& GetLogger(common::ThreadId tid) { return *m_loggers[tid % m_loggers.size()]; }
+   std::size_t GetNbWorkers() const { return m_loggers.size(); }
+   void Start(OnStart onStart = OnStart()) { ConsumerThreads<Logger>::Start(m_loggers, std::move(onStart)); }
+   // the messages already enqueued are formatted before Stop() returns, they are written before the PipelinedConsumer is destroyed
+   using ConsumerThreads<Logger>::Stop;
+
+private:
+   WriterStage m_writerStage; // IMPORTANT: declared before m_loggers to outlive them
+   std::vector<std::unique_ptr<Logger>> m_loggers;
+
+};
+
+template <typename TypeId, typename SpscQueue, typename MpscQueue, typename Allocator>
+inline PipelinedConsumer<TypeId, SpscQueue, MpscQueue, Allocator>::PipelinedConsumer(const Config& config, const Injector& injector, std::size_t nbWorkers)
+{
+   if (!nbWorkers)
+   {
+      throw common::ConfigurationException("PipelinedConsumer needs at least one worker");
+   }
+   if (nbWorkers > 1 && (!config.GetRoutes().IsEmpty() || config.GetMaxFileWriters()))
+   {
+      throw common::ConfigurationException("PipelinedConsumer the routes and the shared log files need a single worker");
+   }
+   for (std::size_t i = 0; i < nbWorkers; ++i)
+   {
+      m_loggers.emplace_back(std::make_unique<Logger>(config, injector));
+      m_loggers.back()->SetWriterStage(m_writerStage);
+      if (nbWorkers > 1)
+      {
+         m_loggers.back()->DisableGroups();
+      }
+   }
+}
+
+}
+}
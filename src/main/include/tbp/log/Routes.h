@@ -0,0 +1,47 @@
+#pragma once
+
+#include "tbp/log/Level.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- routing rules of the categories, used by the AsyncLogger (cf Config::GetRoutes)
+- the messages of a routed category are also written in the destinations whose level is less or equal to the message level
+a destination is a log file shared by all the producer queues: <prefix>_<date>-<destination name>.log (cf Injector::CreateSharedFileWriter)
+- a message is formatted only once whatever the number of destinations
+- the routes must be set before the AsyncLogger logs the first message of the category
+*/
+class Routes
+{
+public:
+   struct Destination
+   {
+      Destination(std::string name, Level level) : m_name(std::move(name)), m_level(level) {}
+      std::string m_name;
+      Level m_level = Level::debug;
+   };
+   struct Route
+   {
+      std::vector<Destination> m_destinations;
+      bool m_keepDefault = true; // the messages are also written in the log file of the producer queue
+   };
+   //
+   void AddDestination(const std::string& categoryLabel, std::string name, Level level);
+   void SetKeepDefault(const std::string& categoryLabel, bool keepDefault);
+   //
+   bool IsEmpty() const { return m_routes.empty(); }
+   const Route* FindRoute(const std::string& categoryLabel) const;
+
+private:
+   std::map<std::string, Route> m_routes;
+
+};
+
+}
+}
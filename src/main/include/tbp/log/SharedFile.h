@@ -0,0 +1,72 @@
+#pragma once
+
+#include "tbp/common/Compiler.h"
+#include <atomic>
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+namespace tbp
+{
+namespace log
+{
+
+class Config;
+
+/*
+- log file written by all the threads of the process without lock (cf SharedSyncSink)
+- the file is created with its capacity and mapped in memory: a line is appended by reserving its range
+with a fetch_add on the shared offset, then it is copied in the mapping, there is no system call per line
+the dirty pages are written back by the kernel, they are not lost if the process crashes
+- the lines are in the order of their reservation: the lines of different threads can be out of timestamp order
+- a line which does not fit in the capacity is dropped (GetNbDropped)
+- when the SharedFile is destroyed (or synced before a signal) the file is truncated to the lines written, there is no rotation and no index
+*/
+class SharedFile
+{
+public:
+   SharedFile(const Config& config, const std::string& name, std::size_t capacity);
+   ~SharedFile();
+   SharedFile(const SharedFile&) = delete;
+   SharedFile& operator=(const SharedFile&) = delete;
+   //
+   // can be called by any thread, returns false if the line is dropped
+   bool Append(const char* data, std::size_t size);
+   /*
+   - writes back the lines appended to the disk (msync) and truncates the file to them, used before the process is killed by a signal
+   - the lines appended after Sync() are dropped: the destructor is not called, the file is not padded with zeros up to its capacity
+   */
+   void Sync();
+   const std::string& GetPath() const { return m_path; }
+   std::size_t GetCapacity() const { return m_capacity; }
+   std::uint64_t GetNbDropped() const { return m_nbDropped.load(std::memory_order_relaxed); }
+
+private:
+   std::size_t GetSize(std::uint64_t offset) const;
+   //
+   std::string m_path;
+   int m_fd = -1;
+   char* m_data = nullptr;
+   std::size_t m_capacity = 0;
+   alignas(64) std::atomic<std::uint64_t> m_offset; // next range to reserve, can go past the capacity
+   alignas(64) std::atomic<std::uint64_t> m_nbDropped;
+   std::atomic<bool> m_synced;
+   std::size_t m_syncedSize = 0; // the file is already truncated when m_synced is set
+
+};
+
+inline bool SharedFile::Append(const char* data, std::size_t size)
+{
+   std::uint64_t offset = m_offset.fetch_add(size, std::memory_order_relaxed);
+   if (unlikely(offset + size > m_capacity))
+   {
+      m_nbDropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+   }
+   memcpy(m_data + offset, data, size);
+   return true;
+}
+
+}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "tbp/log/Level.h"
+#include "tbp/log/Category.h"
+#include "tbp/log/FileWriter.h"
+#include "tbp/log/SharedFile.h"
+#include "tbp/common/OS.h"
+#include "tbp/common/Definitions.h"
+#include "tbp/common/Compiler.h"
+#include <cppformat/format.h>
+#include <memory>
+#include <time.h>
+
+namespace tbp
+{
+namespace log
+{
+
+class SignalManager;
+
+/*
+- log synchronously into one file shared by all the threads (cf SharedFile) instead of one file per thread (cf SyncSink)
+- the line is formatted in the buffer of the sink (one sink per thread), then appended to the SharedFile without lock
+- the FlushPolicy is not used: the lines are in the page cache as soon as they are appended
+*/
+class SharedSyncSink
+{
+public:
+   SharedSyncSink(std::shared_ptr<SharedFile> file, common::ThreadId tid, SignalManager* signals);
+   MOCK_NPERF_VIRTUAL ~SharedSyncSink() {}
+   SharedSyncSink(SharedSyncSink&&) = default;
+   SharedSyncSink& operator=(SharedSyncSink&&) = default;
+   //
+   template <typename... Args> void Log(const Category& category, Level level, const timespec& now, common::SigNum signal, const char* fmt, Args&&... args);
+
+MOCK_PROTECTED:
+   MOCK_NPERF_VIRTUAL void OnWrite(const fmt::MemoryWriter& /*writer*/) const {}
+   MOCK_VIRTUAL void ExitWithDefaultSignalHandler(common::SigNum signalNumber);
+
+private:
+   std::shared_ptr<SharedFile> m_file;
+   fmt::MemoryWriter m_writer;
+   common::ThreadId m_tid;
+   SignalManager* m_signals = nullptr;
+
+};
+
+template <typename... Args>
+inline void SharedSyncSink::Log(const Category& category, Level level, const timespec& now, common::SigNum signal, const char* fmt, Args&&... args)
+{
+   FileWriter::FormatHeader(m_writer, now, m_tid, level, category);
+   m_writer.write(fmt, std::forward<Args>(args)...);
+   //
+   OnWrite(m_writer);
+   m_writer.write("\n");
+   m_file->Append(m_writer.data(), m_writer.size());
+   m_writer.clear();
+   if (unlikely(signal))
+   {
+      m_file->Sync();
+      ExitWithDefaultSignalHandler(signal);
+   }
+}
+
+}
+}
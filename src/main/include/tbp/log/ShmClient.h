@@ -0,0 +1,77 @@
+#pragma once
+
+#include "tbp/log/ShmLayout.h"
+#include "tbp/log/ShmSegment.h"
+#include "tbp/common/OS.h"
+#include <string>
+#include <mutex>
+#include <map>
+#include <cstdint>
+
+namespace tbp
+{
+namespace log
+{
+
+class ShmConfig
+{
+public:
+   ShmConfig(std::string registryName, std::size_t ringCapacity, std::size_t dictionaryCapacity)
+      : m_registryName(std::move(registryName)), m_ringCapacity(ringCapacity), m_dictionaryCapacity(dictionaryCapacity)
+   {}
+   //
+   const std::string& GetRegistryName() const { return m_registryName; }
+   std::size_t GetRingCapacity() const { return m_ringCapacity; } // must be a power of 2
+   std::size_t GetDictionaryCapacity() const { return m_dictionaryCapacity; }
+
+private:
+   std::string m_registryName;
+   std::size_t m_ringCapacity = 0;
+   std::size_t m_dictionaryCapacity = 0;
+
+};
+
+/*
+- one ShmClient per producer process, it can be used by any thread
+- it owns the client segment (ring slots + dictionary) and registers it in the registry of the tbp-logd daemon
+- the methods of this class are not used on the critical path (ShmSink keeps a cache of the dictionary ids)
+*/
+class ShmClient
+{
+public:
+   explicit ShmClient(const ShmConfig& config);
+   ~ShmClient();
+   ShmClient(const ShmClient&) = delete;
+   ShmClient& operator=(const ShmClient&) = delete;
+   //
+   const ShmConfig& GetConfig() const { return m_config; }
+   // returns ShmClientHeader::m_overflowId if the dictionary is full
+   ShmDictionaryId Intern(const char* str);
+   // create a new ring segment for a producer thread, returns the ring slot index
+   std::size_t CreateRing(common::ThreadId tid, ShmSegment& segment);
+   void CloseRing(std::size_t slot);
+   /*
+   - register again in the registry if the registry has been recreated (daemon restarted after a cleanup, ...)
+   - only needs to be called when the daemon does not consume the rings anymore
+   */
+   void CheckConnection();
+   bool IsDaemonAlive() const;
+
+private:
+   void Register();
+   ShmDictionaryId InternImpl(const char* str);
+   ShmClientHeader& GetHeader() { return *reinterpret_cast<ShmClientHeader*>(m_segment.Get()); }
+   //
+   ShmConfig m_config;
+   std::mutex m_mutex;
+   ShmSegment m_registry;
+   std::size_t m_registrySlot = SHM_MAX_CLIENTS;
+   ShmSegment m_segment;
+   std::map<std::string, ShmDictionaryId> m_dictionary; // only used to avoid duplicate entries
+   std::size_t m_nbRings = 0; // used to build the ring segment names
+   std::int32_t m_pid = 0;
+
+};
+
+}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "tbp/log/Level.h"
+#include "tbp/common/OS.h"
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+layout of the shared memory segments used between the producer processes (ShmClient, ShmSink) and the tbp-logd process (LogDaemon)
+- registry segment: created by whichever process comes first (daemon or client), never unlinked by the daemon so that it survives a daemon restart
+it lists the client processes (one slot per process)
+- client segment: one per ShmClient, created by the client process
+it contains the ring slots (one per ShmSink) and the dictionary (format strings and category labels)
+- ring segment: one per ShmSink, created by the client process
+single-producer single-consumer ring of ShmRecord
+- the client and ring segments are unlinked by the daemon once consumed (the client only marks its slots as CLOSED)
+a thread which exits before the daemon scans its ring does not lose its messages
+- all the state needed to decode the rings lives in the segments owned by the client
+so a new daemon can attach to a running client and continue from the shared read position
+- IMPORTANT: only lock-free std::atomic can be used in shared memory
+*/
+
+constexpr std::size_t SHM_NAME_SIZE = 64;
+constexpr std::size_t SHM_MAX_CLIENTS = 64;
+constexpr std::size_t SHM_MAX_RINGS = 256;
+
+enum class ShmSlotState : std::uint32_t
+{
+   FREE,
+   CLAIMED, // the owner is filling the slot
+   READY,
+   CLOSED, // the owner is gone, the daemon can release the slot once the data are consumed
+};
+
+struct ShmSlot
+{
+   std::atomic<ShmSlotState> m_state;
+   std::int32_t m_pid; // client process for a registry slot, producer thread for a ring slot
+   char m_name[SHM_NAME_SIZE]; // name of the segment
+};
+
+struct ShmRegistryHeader
+{
+   std::atomic<std::int32_t> m_daemonPid;
+   ShmSlot m_clients[SHM_MAX_CLIENTS];
+};
+
+struct ShmClientHeader
+{
+   std::atomic<std::uint32_t> m_dictionarySize; // bytes used in the dictionary, published by the client
+   std::uint32_t m_dictionaryCapacity = 0;
+   std::uint32_t m_overflowId = 0; // used instead of the format strings that do not fit in the dictionary, the fields are not logged
+   ShmSlot m_rings[SHM_MAX_RINGS];
+   // the dictionary follows the header
+};
+
+/*
+dictionary entry: std::uint32_t size + characters + '\0'
+the id of an entry is its offset in the dictionary, 0 is not a valid id
+*/
+using ShmDictionaryId = std::uint32_t;
+constexpr ShmDictionaryId SHM_INVALID_ID = 0;
+
+struct ShmRingHeader
+{
+   alignas(64) std::atomic<std::uint64_t> m_write; // only modified by the producer
+   alignas(64) std::atomic<std::uint64_t> m_read; // only modified by the consumer
+   alignas(64) std::uint64_t m_capacity = 0; // power of 2
+   // the ring data follows the header
+};
+
+// the fields encoded by the Encoder follow the record
+struct ShmRecord
+{
+   std::uint32_t m_size; // whole record size (header + fields), multiple of SHM_RECORD_ALIGN
+   ShmDictionaryId m_fmt; // SHM_INVALID_ID for a padding record
+   ShmDictionaryId m_category;
+   common::SigNum m_signal;
+   std::int64_t m_sec;
+   std::int64_t m_nsec;
+   Level m_level;
+};
+
+constexpr std::size_t SHM_RECORD_ALIGN = 8;
+
+inline std::size_t ShmAlign(std::size_t size, std::size_t align)
+{
+   return (size + align - 1) & ~(align - 1);
+}
+
+inline std::size_t ShmRingDataOffset()
+{
+   return ShmAlign(sizeof(ShmRingHeader), 64);
+}
+
+inline std::size_t ShmClientDictionaryOffset()
+{
+   return ShmAlign(sizeof(ShmClientHeader), 64);
+}
+
+inline void ShmCopyName(char* dest, const std::string& name)
+{
+   std::size_t size = std::min(name.size(), SHM_NAME_SIZE - 1);
+   name.copy(dest, size);
+   dest[size] = '\0';
+}
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "std::atomic<int> must be lock-free to be shared between processes");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "std::atomic<long long> must be lock-free to be shared between processes");
+
+}
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "tbp/log/ShmLayout.h"
+#include "tbp/common/Compiler.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- view on a ring segment (cf ShmLayout.h)
+- a record never wraps around the end of the ring, a padding record is written instead
+- the producer side (Reserve/Commit) must only be used by one thread
+the consumer side (Peek/Release) must only be used by one thread of one process
+- the consumer does not trust the producer process: a record whose size is not consistent with the positions and the end of the ring
+(smaller than its header, not aligned, beyond the write position or the end of the ring) makes the ring corrupt, it is not read anymore
+*/
+class ShmRing
+{
+public:
+   ShmRing() = default;
+   explicit ShmRing(char* segment);
+   //
+   static std::size_t GetSegmentSize(std::size_t capacity) { return ShmRingDataOffset() + capacity; }
+   static void Init(char* segment, std::size_t capacity);
+   std::size_t GetCapacity() const { return m_capacity; }
+   //
+   // producer: returns nullptr if there is not enough space
+   ShmRecord* Reserve(std::size_t size);
+   void Commit();
+   bool IsConsumed() const { return m_header->m_read.load(std::memory_order_acquire) >= m_write; }
+   //
+   // consumer: returns nullptr if the ring is empty or corrupt, the size of the record returned has been checked
+   const ShmRecord* Peek();
+   void Release(const ShmRecord* record);
+   bool IsCorrupt() const { return m_corrupt; }
+   void Publish() { m_header->m_read.store(m_read, std::memory_order_release); }
+
+private:
+   char* GetRecord(std::uint64_t pos) const { return m_data + (pos & (m_capacity - 1)); }
+   bool IsValid(std::uint64_t size, bool padding) const;
+   //
+   ShmRingHeader* m_header = nullptr;
+   char* m_data = nullptr;
+   std::uint64_t m_capacity = 0;
+   // producer
+   std::uint64_t m_write = 0;
+   std::uint64_t m_pending = 0; // size reserved by the last call to Reserve()
+   std::uint64_t m_readCache = 0;
+   // consumer
+   std::uint64_t m_read = 0;
+   std::uint64_t m_writeCache = 0;
+   std::uint64_t m_peekSize = 0; // checked size of the record returned by Peek(), read once from the segment
+   bool m_corrupt = false;
+
+};
+
+inline ShmRing::ShmRing(char* segment)
+   : m_header(reinterpret_cast<ShmRingHeader*>(segment)), m_data(segment + ShmRingDataOffset()), m_capacity(m_header->m_capacity)
+{
+   // the positions are read from the segment to be able to attach to a ring already in use (client or daemon restart)
+   m_write = m_header->m_write.load(std::memory_order_acquire);
+   m_read = m_header->m_read.load(std::memory_order_acquire);
+   m_readCache = m_read;
+   m_writeCache = m_write;
+}
+
+inline void ShmRing::Init(char* segment, std::size_t capacity)
+{
+   auto header = reinterpret_cast<ShmRingHeader*>(segment);
+   header->m_capacity = capacity;
+   header->m_write.store(0, std::memory_order_relaxed);
+   header->m_read.store(0, std::memory_order_release);
+}
+
+inline ShmRecord* ShmRing::Reserve(std::size_t size)
+{
+   size = ShmAlign(size, SHM_RECORD_ALIGN);
+   std::uint64_t offset = m_write & (m_capacity - 1);
+   std::uint64_t padding = offset + size > m_capacity ? m_capacity - offset : 0;
+   std::uint64_t needed = padding + size;
+   if (m_write + needed - m_readCache > m_capacity)
+   {
+      m_readCache = m_header->m_read.load(std::memory_order_acquire);
+      if (m_write + needed - m_readCache > m_capacity)
+      {
+         return nullptr;
+      }
+   }
+   if (padding)
+   {
+      auto pad = reinterpret_cast<ShmRecord*>(GetRecord(m_write));
+      pad->m_size = static_cast<std::uint32_t>(padding);
+      pad->m_fmt = SHM_INVALID_ID;
+      m_write += padding;
+   }
+   m_pending = size;
+   auto record = reinterpret_cast<ShmRecord*>(GetRecord(m_write));
+   record->m_size = static_cast<std::uint32_t>(size);
+   return record;
+}
+
+inline void ShmRing::Commit()
+{
+   m_write += m_pending;
+   m_pending = 0;
+   m_header->m_write.store(m_write, std::memory_order_release);
+}
+
+inline bool ShmRing::IsValid(std::uint64_t size, bool padding) const
+{
+   std::uint64_t left = m_capacity - (m_read & (m_capacity - 1));
+   std::uint64_t written = m_writeCache - m_read;
+   if (written > m_capacity || size % SHM_RECORD_ALIGN || size > written || size > left)
+   {
+      return false;
+   }
+   // a padding record fills the end of the ring
+   return padding ? size == left : size >= sizeof(ShmRecord);
+}
+
+inline const ShmRecord* ShmRing::Peek()
+{
+   while (likely(!m_corrupt))
+   {
+      if (m_read == m_writeCache)
+      {
+         m_writeCache = m_header->m_write.load(std::memory_order_acquire);
+         if (m_read == m_writeCache)
+         {
+            return nullptr;
+         }
+      }
+      // the padding marker and the size are in the first SHM_RECORD_ALIGN bytes, always before the end of the ring
+      auto record = reinterpret_cast<const ShmRecord*>(GetRecord(m_read));
+      std::uint64_t size = record->m_size;
+      bool padding = record->m_fmt == SHM_INVALID_ID;
+      if (unlikely(!IsValid(size, padding)))
+      {
+         m_corrupt = true;
+         break;
+      }
+      if (!padding)
+      {
+         m_peekSize = size;
+         return record;
+      }
+      m_read += size;
+   }
+   return nullptr;
+}
+
+inline void ShmRing::Release(const ShmRecord* /*record*/)
+{
+   m_read += m_peekSize;
+}
+
+}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace tbp
+{
+namespace log
+{
+
+// POSIX shared memory segment mapped in the address space of the process
+class ShmSegment
+{
+public:
+   ShmSegment() = default;
+   ~ShmSegment();
+   ShmSegment(const ShmSegment&) = delete;
+   ShmSegment& operator=(const ShmSegment&) = delete;
+   ShmSegment(ShmSegment&& rhs);
+   ShmSegment& operator=(ShmSegment&& rhs);
+   //
+   // create a new segment, the segment must not exist
+   static ShmSegment Create(const std::string& name, std::size_t size);
+   // open an existing segment, or create it (zero-filled) if it does not exist
+   static ShmSegment OpenOrCreate(const std::string& name, std::size_t size);
+   // open an existing segment, returns an invalid segment if it does not exist
+   static ShmSegment Open(const std::string& name);
+   static void Unlink(const std::string& name);
+   //
+   bool IsValid() const { return m_data != nullptr; }
+   char* Get() const { return m_data; }
+   std::size_t GetSize() const { return m_size; }
+   const std::string& GetName() const { return m_name; }
+
+private:
+   ShmSegment(std::string name, int fd, std::size_t size);
+   void Close();
+   //
+   std::string m_name;
+   char* m_data = nullptr;
+   std::size_t m_size = 0;
+
+};
+
+}
+}
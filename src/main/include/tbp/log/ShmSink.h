@@ -0,0 +1,247 @@
+#pragma once
+
+#include "tbp/log/Category.h"
+#include "tbp/log/Level.h"
+#include "tbp/log/Encoder.h"
+#include "tbp/log/StaticString.h"
+#include "tbp/log/Blob.h"
+#include "tbp/log/ShmClient.h"
+#include "tbp/log/ShmRing.h"
+#include "tbp/log/ShmSegment.h"
+#include "tbp/log/SignalManager.h"
+#include "tbp/common/OS.h"
+#include "tbp/common/Compiler.h"
+#include <time.h>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <thread>
+#include <chrono>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- the fields are encoded by the Encoder directly in the shared memory ring
+- the Handle is a pointer in the ring, there is nothing to free
+*/
+class ShmRingAllocator
+{
+public:
+   using Handle = char*;
+   //
+   ShmRingAllocator(ShmRing& ring, ShmClient& client) : m_ring(ring), m_client(client) {}
+   //
+   Handle Alloc(std::size_t size)
+   {
+      m_record = Reserve(sizeof(ShmRecord) + size);
+      if (unlikely(!m_record))
+      {
+         // the message is dropped but the Encoder still needs a buffer
+         m_overflow.resize(size);
+         return m_overflow.data();
+      }
+      return reinterpret_cast<char*>(m_record + 1);
+   }
+   void Free(Handle& /*h*/) {}
+   ShmRecord* Reserve(std::size_t size);
+   ShmRecord* GetRecord() const { return m_record; }
+   void Reset() { m_record = nullptr; }
+
+private:
+   ShmRing& m_ring;
+   ShmClient& m_client;
+   ShmRecord* m_record = nullptr;
+   std::vector<char> m_overflow;
+
+};
+
+inline ShmRecord* ShmRingAllocator::Reserve(std::size_t size)
+{
+   if (unlikely(size > m_ring.GetCapacity() / 2))
+   {
+      assert(false);
+      return nullptr;
+   }
+   std::size_t count = 0;
+   ShmRecord* record = nullptr;
+   while (!(record = m_ring.Reserve(size)))
+   {
+      // the ring is full: the daemon is slow, or it has been restarted and does not know this process anymore
+      if (unlikely(++count % (1 << 20) == 0))
+      {
+         m_client.CheckConnection();
+      }
+   }
+   return record;
+}
+
+/*
+- the LogDaemon cannot read the memory of the client: a StaticString is copied as a std::string
+- a STATIC_STRING field in the ring (client not trusted) is skipped without reading its pointer
+*/
+template <typename TypeId>
+struct Type<StaticString, TypeId, ShmRingAllocator>
+{
+   static TypeId Id() { return TypeId::STRING; }
+   static std::size_t Sizeof(const StaticString& v) { return sizeof(std::size_t) + v.m_size; }
+   static void Encode(Buffer<ShmRingAllocator>& buffer, const StaticString& v)
+   {
+      buffer.Write(&v.m_size, sizeof(v.m_size));
+      buffer.Write(v.m_data, v.m_size);
+   }
+   static void Decode(Buffer<ShmRingAllocator>& buffer, fmt::StringRef& v)
+   {
+      buffer.Advance(sizeof(const char*) + sizeof(std::size_t));
+      v = fmt::StringRef("[tbp-log static string]");
+   }
+};
+
+// the payload of a BlobRef is copied in the ring, the LogDaemon never reads a client pointer
+template <>
+struct BlobByReference<ShmRingAllocator>
+{
+   static constexpr bool value = false;
+};
+
+/*
+- log into a shared memory ring consumed by the tbp-logd process (LogDaemon)
+- the format strings and the category labels are interned in the dictionary of the ShmClient the first time they are used
+- only the fields supported by LogDaemon can be logged (DefaultTypeId)
+*/
+template <typename TypeId>
+class ShmSink
+{
+public:
+   ShmSink(ShmClient& client, common::ThreadId tid, SignalManager* signals);
+   ~ShmSink();
+   ShmSink(ShmSink&& rhs);
+   ShmSink& operator=(ShmSink&& rhs) = delete;
+   //
+   // cf AsyncSink::Log(), 'fmt' can be a temporary string, it is copied in the dictionary
+   template <typename... Args> void Log(const Category& category, Level level, const timespec& now, common::SigNum signal, const char* fmt, Args&&... args);
+
+private:
+   ShmDictionaryId InternFormat(const char* fmt);
+   ShmDictionaryId InternCategory(const Category& category);
+   void WaitConsumed();
+   //
+   ShmClient& m_client;
+   ShmSegment m_segment;
+   std::size_t m_slot = SHM_MAX_RINGS;
+   ShmRing m_ring;
+   ShmRingAllocator m_allocator;
+   Encoder<TypeId, ShmRingAllocator> m_encoder;
+   /*
+   - the address of a format string only identifies it while the content is the same (std::string::c_str(), buffer reused, ...)
+   the content is compared on a hit and the entry is interned again if it changed
+   */
+   std::unordered_map<const char*, std::pair<std::string, ShmDictionaryId>> m_fmtIds;
+   std::unordered_map<const Category*, ShmDictionaryId> m_categoryIds;
+   SignalManager* m_signals = nullptr;
+
+};
+
+template <typename TypeId>
+inline ShmSink<TypeId>::ShmSink(ShmClient& client, common::ThreadId tid, SignalManager* signals)
+   : m_client(client), m_allocator(m_ring, client), m_signals(signals)
+{
+   m_slot = m_client.CreateRing(tid, m_segment);
+   m_ring = ShmRing(m_segment.Get());
+}
+
+template <typename TypeId>
+inline ShmSink<TypeId>::~ShmSink()
+{
+   if (m_slot < SHM_MAX_RINGS)
+   {
+      m_client.CloseRing(m_slot);
+   }
+}
+
+template <typename TypeId>
+inline ShmSink<TypeId>::ShmSink(ShmSink&& rhs)
+   : m_client(rhs.m_client), m_segment(std::move(rhs.m_segment)), m_slot(rhs.m_slot), m_ring(rhs.m_ring), m_allocator(m_ring, rhs.m_client),
+   m_fmtIds(std::move(rhs.m_fmtIds)), m_categoryIds(std::move(rhs.m_categoryIds)), m_signals(rhs.m_signals)
+{
+   rhs.m_slot = SHM_MAX_RINGS; // IMPORTANT: to call ShmClient::CloseRing() only once
+}
+
+template <typename TypeId>
+inline ShmDictionaryId ShmSink<TypeId>::InternFormat(const char* fmt)
+{
+   auto& entry = m_fmtIds[fmt];
+   if (likely(entry.second != SHM_INVALID_ID && strcmp(entry.first.c_str(), fmt) == 0))
+   {
+      return entry.second;
+   }
+   // the dictionary of the ShmClient is keyed by content: the same format string is only stored once
+   entry.first = fmt;
+   entry.second = m_client.Intern(fmt);
+   return entry.second;
+}
+
+template <typename TypeId>
+inline ShmDictionaryId ShmSink<TypeId>::InternCategory(const Category& category)
+{
+   auto iter = m_categoryIds.find(&category);
+   if (likely(iter != m_categoryIds.end()))
+   {
+      return iter->second;
+   }
+   ShmDictionaryId id = m_client.Intern(category.GetLabel().c_str());
+   m_categoryIds.emplace(&category, id);
+   return id;
+}
+
+template <typename TypeId>
+inline void ShmSink<TypeId>::WaitConsumed()
+{
+   // the message must be written by the daemon before the process is killed
+   for (std::size_t i = 0; i < 1000 && !m_ring.IsConsumed(); ++i)
+   {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+   }
+}
+
+template <typename TypeId>
+template <typename... Args>
+inline void ShmSink<TypeId>::Log(const Category& category, Level level, const timespec& now, common::SigNum signal, const char* fmt, Args&&... args)
+{
+   ShmDictionaryId fmtId = InternFormat(fmt);
+   ShmDictionaryId categoryId = InternCategory(category);
+   //
+   m_allocator.Reset();
+   m_encoder.Encode(m_allocator, std::forward<Args>(args)...);
+   ShmRecord* record = m_allocator.GetRecord();
+   if (!record && !sizeof...(args))
+   {
+      record = m_allocator.Reserve(sizeof(ShmRecord));
+   }
+   if (unlikely(!record))
+   {
+      return; // message too big for the ring
+   }
+   m_allocator.Reset();
+   record->m_fmt = fmtId;
+   record->m_category = categoryId;
+   record->m_signal = signal;
+   record->m_sec = now.tv_sec;
+   record->m_nsec = now.tv_nsec;
+   record->m_level = level;
+   m_ring.Commit();
+   if (unlikely(signal))
+   {
+      WaitConsumed();
+      if (m_signals)
+      {
+         m_signals->ExitWithDefaultSignalHandler(signal, false);
+      }
+   }
+}
+
+}
+}
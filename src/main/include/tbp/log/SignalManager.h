@@ -87,7 +87,7 @@ void SignalManager::OnSignal(common::SigNum signalNumber)
    }
    std::string fatalReason = GetExitReason(signalNumber);
    //
-   auto logger = LocalLogger::Get();
+   auto logger = LocalLogger::GetOrCreate();
    logger->Log(m_category, Level::critical, signalNumber, "Received fatal signal[{}] signalNumber[{}]\n{}", 
          fatalReason, signalNumber, oss.str());
    //
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "tbp/log/Type.h"
+#include "tbp/log/Buffer.h"
+#include <cppformat/format.h>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- string with a static lifetime (literal, symbol table, interned string, ...), only the pointer and the size are encoded
+the consumer reads the characters when the message is formatted
+- a debug build checks that the characters are in a loaded object (executable or shared library)
+or in a region registered with RegisterStaticRegion() (cf IsStaticAddress)
+- the shared memory sinks copy the characters (cf ShmSink): the pointer is meaningless in the LogDaemon
+*/
+struct StaticString
+{
+   template <std::size_t N>
+   constexpr StaticString(const char (&str)[N]) : m_data(str), m_size(N - 1) {}
+   StaticString(const char* data, std::size_t size) : m_data(data), m_size(size) {}
+   explicit StaticString(const char* str) : m_data(str), m_size(std::strlen(str)) {}
+   //
+   const char* m_data = nullptr;
+   std::size_t m_size = 0;
+};
+
+// storage of interned strings, to be registered before logging its strings as StaticString, the region is never released
+void RegisterStaticRegion(const void* data, std::size_t size);
+// true if 'data' is in a loaded object or in a registered region, slow: only used by the debug builds
+bool IsStaticAddress(const void* data);
+
+template <typename TypeId, typename Allocator>
+struct Type<StaticString, TypeId, Allocator>
+{
+   static TypeId Id() { return TypeId::STATIC_STRING; }
+   static constexpr std::size_t Sizeof(const StaticString&) { return sizeof(const char*) + sizeof(std::size_t); }
+   static void Encode(Buffer<Allocator>& buffer, const StaticString& v)
+   {
+      assert(IsStaticAddress(v.m_data) && "StaticString: the string does not have a static lifetime");
+      buffer.Write(&v.m_data, sizeof(v.m_data));
+      buffer.Write(&v.m_size, sizeof(v.m_size));
+   }
+   static void Decode(Buffer<Allocator>& buffer, fmt::StringRef& v)
+   {
+      const char* data = nullptr;
+      std::size_t size = 0;
+      buffer.Read(&data, sizeof(data));
+      buffer.Read(&size, sizeof(size));
+      v = fmt::StringRef(data, size);
+   }
+};
+
+}
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "tbp/log/WriterStage.h"
+#include "tbp/log/FileIndex.h"
+#include "tbp/log/FileWriter.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace tbp
+{
+namespace log
+{
+
+/*
+- double buffer of the lines of a buffered SyncSink
+- only the thread of the sink appends: the line is appended to the active buffer without lock and without system call
+- the SyncFlusher swaps the buffers, waits for the end of the current Append() and writes the inactive one
+*/
+class SyncBuffers
+{
+public:
+   // the buffers are reserved with 'bufferSize' bytes (cf SyncFlusher::GetBufferSize)
+   SyncBuffers(FileWriter& fileWriter, std::size_t bufferSize);
+   SyncBuffers(const SyncBuffers&) = delete;
+   SyncBuffers& operator=(const SyncBuffers&) = delete;
+   //
+   // 'line' is the header of the line if the file is indexed (cf FileWriter::IsIndexed)
+   void Append(const char* data, std::size_t size, const IndexedLine* line);
+
+private:
+   friend class SyncFlusher;
+   //
+   FileWriter& m_fileWriter;
+   WriterBlock m_blocks[2];
+   std::atomic<std::size_t> m_sizes[2]; // size of each buffer, read by the SyncFlusher
+   std::atomic<std::int64_t> m_firsts[2]; // time of the first line of each buffer (cf FileWriter::GetCoarseNanos), 0 if empty
+   std::atomic<unsigned> m_active;
+   std::atomic<bool> m_appending;
+   std::mutex m_mutex; // swaps of the SyncFlusher thread and of the sink thread (cf SyncFlusher::Flush)
+
+};
+
+/*
+- background thread writing the buffers of the buffered SyncSinks: the file is not written by the threads logging
+- the buffers of a sink are swapped and written when the active one reaches 'bufferSize' bytes
+or when its first line is older than 'interval', the file is flushed after each write
+- the SyncFlusher must outlive the SyncSinks attached to it
+*/
+class SyncFlusher
+{
+public:
+   SyncFlusher(std::size_t bufferSize = 64 * 1024, std::chrono::nanoseconds interval = std::chrono::milliseconds(10));
+   ~SyncFlusher();
+   SyncFlusher(const SyncFlusher&) = delete;
+   SyncFlusher& operator=(const SyncFlusher&) = delete;
+   //
+   std::size_t GetBufferSize() const { return m_bufferSize; }
+   void Add(SyncBuffers& buffers);
+   // the lines not written yet are written before Remove() returns
+   void Remove(SyncBuffers& buffers);
+   // writes the lines of 'buffers' now on the calling thread (fatal signal, ...)
+   void Flush(SyncBuffers& buffers) { Write(buffers, true); }
+
+private:
+   void Run();
+   void Write(SyncBuffers& buffers, bool force);
+   //
+   std::size_t m_bufferSize = 0;
+   std::int64_t m_interval = 0; // nanoseconds
+   /*
+   - only protects the list of buffers, the file is written without it: Add() and Remove() do not wait for a write to the disk
+   - Remove() waits until the buffers are not written by the SyncFlusher thread (m_writing)
+   */
+   std::mutex m_mutex;
+   std::condition_variable m_written;
+   std::vector<SyncBuffers*> m_buffers;
+   SyncBuffers* m_writing = nullptr;
+   std::atomic<bool> m_stop;
+   std::thread m_thread;
+
+};
+
+inline void SyncBuffers::Append(const char* data, std::size_t size, const IndexedLine* line)
+{
+   // IMPORTANT: seq_cst, m_appending must be visible before m_active is read (cf SyncFlusher::Write)
+   m_appending.store(true);
+   unsigned active = m_active.load();
+   WriterBlock& block = m_blocks[active];
+   if (block.m_data.empty())
+   {
+      m_firsts[active].store(FileWriter::GetCoarseNanos(), std::memory_order_relaxed);
+   }
+   if (line)
+   {
+      block.m_lines.emplace_back(block.m_data.size(), *line);
+   }
+   block.m_data.insert(block.m_data.end(), data, data + size);
+   m_sizes[active].store(block.m_data.size(), std::memory_order_relaxed);
+   m_appending.store(false, std::memory_order_release);
+}
+
+}
+}
@@ -2,11 +2,13 @@
 
 #include "tbp/log/Level.h"
 #include "tbp/log/FileWriter.h"
+#include "tbp/log/SyncFlusher.h"
 #include "tbp/common/OS.h"
 #include "tbp/common/Definitions.h"
 #include "tbp/common/Compiler.h"
 #include <time.h>
 #include <fstream>
+#include <memory>
 #include <ctime>
 
 namespace tbp
@@ -17,14 +19,19 @@ namespace log
 class Config;
 class SignalManager;
 
-// log synchronously into one file per thread
+/*
+- log synchronously into one file per thread
+- buffered mode (with a SyncFlusher): the line is formatted by the thread logging and appended to the double buffer of the sink (cf SyncBuffers)
+the file is written by the SyncFlusher thread, the FlushPolicy of the file is not used
+a fatal signal (cf SignalManager) writes the buffers on the thread logging before ExitWithDefaultSignalHandler()
+*/
 class SyncSink
 {
 public:
-   SyncSink(const Config& config, common::ThreadId tid, SignalManager* signals);
-   MOCK_NPERF_VIRTUAL ~SyncSink() {}
+   SyncSink(const Config& config, common::ThreadId tid, SignalManager* signals, SyncFlusher* flusher = nullptr);
+   MOCK_NPERF_VIRTUAL ~SyncSink();
    SyncSink(SyncSink&&) = default;
-   SyncSink& operator=(SyncSink&&) = default;
+   SyncSink& operator=(SyncSink&&) = delete; // the buffers of the assigned sink would stay in its SyncFlusher
    //
    template <typename... Args> void Log(const Category& category, Level level, const timespec& now, common::SigNum signal, const char* fmt, Args&&... args);
 
@@ -34,27 +41,48 @@ MOCK_PROTECTED:
 
 private:
    //
-   FileWriter m_fileWriter;
+   std::unique_ptr<FileWriter> m_fileWriter; // unique_ptr: the SyncBuffers keep its address when the sink is moved
    common::ThreadId m_tid;
    SignalManager* m_signals = nullptr;
+   SyncFlusher* m_flusher = nullptr;
+   std::unique_ptr<SyncBuffers> m_buffers; // buffered mode only
 
 };
 
 template <typename... Args> 
 inline void SyncSink::Log(const Category& category, Level level, const timespec& now, common::SigNum signal, const char* fmt, Args&&... args)
 {
-   m_fileWriter.WriteHeader(now, m_tid, level, category);
-   auto& writer = m_fileWriter.GetWriter();
+   m_fileWriter->WriteHeader(now, m_tid, level, category);
+   auto& writer = m_fileWriter->GetWriter();
    writer.write(fmt, std::forward<Args>(args)...);
    //
    OnWrite(writer);
-   m_fileWriter.WriteToFile();
+   if (m_buffers)
+   {
+      writer.write("\n");
+      m_buffers->Append(writer.data(), writer.size(), m_fileWriter->IsIndexed() ? &m_fileWriter->GetIndexedLine() : nullptr);
+      m_fileWriter->Clear();
+   }
+   else
+   {
+      m_fileWriter->WriteToFile();
+      m_fileWriter->FlushIfNeeded(level);
+   }
    if (unlikely(signal))
    {
+      if (m_buffers)
+      {
+         // the buffers are written and the file flushed by the calling thread
+         m_flusher->Flush(*m_buffers);
+      }
+      else
+      {
+         m_fileWriter->Flush();
+      }
+      m_fileWriter->Wait();
       ExitWithDefaultSignalHandler(signal);
    }
 }
 
 }
 }
-
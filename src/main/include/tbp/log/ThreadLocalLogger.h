@@ -5,8 +5,14 @@
 #include "tbp/log/Loggers.h"
 #include "tbp/log/Injector.h"
 #include "tbp/common/ConfigurationException.h"
+#include "tbp/common/Compiler.h"
+#include "tbp/common/OS.h"
 #include <memory>
 #include <string>
+#include <mutex>
+#include <functional>
+#include <atomic>
+#include <cstdint>
 
 namespace tbp
 {
@@ -16,11 +22,17 @@ namespace log
 /*
 - a ThreadLocalLogger is in charge of cleaning the thread_local variable
 - a ThreadLocalLogger must be used by exactly "one" thread
+- if a sink factory is set (SetSinkFactory), the first log call of a thread without ThreadLocalLogger creates one
+this "default" ThreadLocalLogger is named <prefix>_<tid> and is destroyed when the thread exits
+- without sink factory, a thread only takes the factory mutex once per SetSinkFactory()/ResetSinkFactory() call (cf g_factoryVersion)
+IMPORTANT: ResetDefault() must be called by a thread, if the resources used by its sink are destroyed before the thread exits (main thread, ...)
 */
 template <typename Sink>
 class ThreadLocalLogger
 {
 public:
+   using SinkFactory = std::function<Sink(common::ThreadId tid)>;
+   //
    ThreadLocalLogger() = default;
    ThreadLocalLogger(std::shared_ptr<Loggers> loggers, std::string name, Sink sink);
    ~ThreadLocalLogger();
@@ -29,9 +41,32 @@ public:
    //
    void Reset();
    static Logger<Sink>* Get() { return g_threadLocalLogger; }
+   static Logger<Sink>* GetOrCreate()
+   {
+      Logger<Sink>* logger = g_threadLocalLogger;
+      return likely(logger != nullptr) ? logger : CreateDefault();
+   }
+   static void SetSinkFactory(std::shared_ptr<Loggers> loggers, std::string namePrefix, SinkFactory factory);
+   static void ResetSinkFactory() { SetFactory(nullptr); }
+   static void ResetDefault() { g_defaultLogger.reset(); }
 
 private:
+   struct Factory
+   {
+      std::shared_ptr<Loggers> m_loggers;
+      std::string m_namePrefix;
+      SinkFactory m_createSink;
+   };
+   //
+   static Logger<Sink>* TBP_NOINLINE CreateDefault();
+   static void SetFactory(std::shared_ptr<const Factory> factory);
+   //
    static thread_local Logger<Sink>* g_threadLocalLogger;
+   static thread_local std::unique_ptr<ThreadLocalLogger> g_defaultLogger;
+   static std::mutex g_factoryMutex;
+   static std::shared_ptr<const Factory> g_factory;
+   static std::atomic<std::uint64_t> g_factoryVersion; // incremented each time g_factory is set
+   static thread_local std::uint64_t g_noFactoryVersion; // version for which the thread found no factory
    std::unique_ptr<Logger<Sink>> m_logger;
    std::shared_ptr<Loggers> m_loggers; // shared_ptr to ensure that m_loggers is valid until the last Logger is destroyed
 
@@ -40,6 +75,21 @@ private:
 template <typename Sink>
 thread_local Logger<Sink>* ThreadLocalLogger<Sink>::g_threadLocalLogger = nullptr;
 
+template <typename Sink>
+thread_local std::unique_ptr<ThreadLocalLogger<Sink>> ThreadLocalLogger<Sink>::g_defaultLogger;
+
+template <typename Sink>
+std::mutex ThreadLocalLogger<Sink>::g_factoryMutex;
+
+template <typename Sink>
+std::shared_ptr<const typename ThreadLocalLogger<Sink>::Factory> ThreadLocalLogger<Sink>::g_factory;
+
+template <typename Sink>
+std::atomic<std::uint64_t> ThreadLocalLogger<Sink>::g_factoryVersion{ 1 };
+
+template <typename Sink>
+thread_local std::uint64_t ThreadLocalLogger<Sink>::g_noFactoryVersion = 0;
+
 template <typename Sink>
 ThreadLocalLogger<Sink>::ThreadLocalLogger(std::shared_ptr<Loggers> loggers, std::string name, Sink sink)
    : m_loggers(loggers)
@@ -72,13 +122,57 @@ void ThreadLocalLogger<Sink>::Reset()
    }
 }
 
+template <typename Sink>
+void ThreadLocalLogger<Sink>::SetSinkFactory(std::shared_ptr<Loggers> loggers, std::string namePrefix, SinkFactory factory)
+{
+   auto f = std::make_shared<Factory>();
+   f->m_loggers = std::move(loggers);
+   f->m_namePrefix = std::move(namePrefix);
+   f->m_createSink = std::move(factory);
+   SetFactory(std::move(f));
+}
+
+template <typename Sink>
+void ThreadLocalLogger<Sink>::SetFactory(std::shared_ptr<const Factory> factory)
+{
+   std::lock_guard<std::mutex> lock(g_factoryMutex);
+   //
+   g_factory = std::move(factory);
+   g_factoryVersion.fetch_add(1, std::memory_order_release);
+}
+
+template <typename Sink>
+Logger<Sink>* ThreadLocalLogger<Sink>::CreateDefault()
+{
+   // only called the first time a thread logs, or for each log of a thread without logger nor factory
+   std::uint64_t version = g_factoryVersion.load(std::memory_order_acquire);
+   if (version == g_noFactoryVersion)
+   {
+      return nullptr;
+   }
+   std::shared_ptr<const Factory> factory;
+   {
+      std::lock_guard<std::mutex> lock(g_factoryMutex);
+      //
+      factory = g_factory;
+   }
+   if (!factory)
+   {
+      g_noFactoryVersion = version;
+      return nullptr;
+   }
+   common::ThreadId tid = common::ThreadGetId();
+   g_defaultLogger = std::make_unique<ThreadLocalLogger>(factory->m_loggers, factory->m_namePrefix + "_" + std::to_string(tid), factory->m_createSink(tid));
+   return g_threadLocalLogger;
+}
+
 // use of a macro to avoid arguments evaluation if Logger::ShouldLog() is false
 #define TBP_LOG(Sink, category, level, ...)                  \
    do                                                        \
    {                                                         \
       using LocalLogger = tbp::log::ThreadLocalLogger<Sink>; \
-      auto logger = LocalLogger::Get();                      \
-      if (logger->ShouldLog(category, level))                \
+      auto logger = LocalLogger::GetOrCreate();              \
+      if (logger && logger->ShouldLog(category, level))      \
       {                                                      \
          logger->Log(category, level, 0, __VA_ARGS__);       \
       }                                                      \
@@ -87,4 +181,3 @@ void ThreadLocalLogger<Sink>::Reset()
 
 }
 }
-
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "tbp/log/FileIndex.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+namespace tbp
+{
+namespace log
+{
+
+class FileWriter;
+
+// block of formatted lines of one FileWriter
+struct WriterBlock
+{
+   std::atomic<WriterBlock*> m_next;
+   FileWriter* m_fileWriter = nullptr;
+   std::vector<char> m_data;
+   std::vector<std::pair<std::size_t, IndexedLine>> m_lines; // offset in m_data and header of the lines (cf FileIndex)
+   bool m_flush = false;
+   //
+   WriterBlock() : m_next(nullptr) {}
+};
+
+/*
+- intrusive multi-producer single-consumer queue of WriterBlock (Dmitry Vyukov)
+- lock-free for the producers, Dequeue() can return nullptr while a producer is between its two stores
+*/
+class WriterBlockQueue
+{
+public:
+   WriterBlockQueue() : m_head(&m_stub), m_tail(&m_stub) {}
+   WriterBlockQueue(const WriterBlockQueue&) = delete;
+   WriterBlockQueue& operator=(const WriterBlockQueue&) = delete;
+   //
+   void Enqueue(WriterBlock* block)
+   {
+      block->m_next.store(nullptr, std::memory_order_relaxed);
+      WriterBlock* prev = m_head.exchange(block, std::memory_order_acq_rel);
+      prev->m_next.store(block, std::memory_order_release);
+   }
+   WriterBlock* Dequeue();
+
+private:
+   std::atomic<WriterBlock*> m_head;
+   WriterBlock* m_tail;
+   WriterBlock m_stub;
+
+};
+
+inline WriterBlock* WriterBlockQueue::Dequeue()
+{
+   WriterBlock* tail = m_tail;
+   WriterBlock* next = tail->m_next.load(std::memory_order_acquire);
+   if (tail == &m_stub)
+   {
+      if (!next)
+      {
+         return nullptr;
+      }
+      m_tail = next;
+      tail = next;
+      next = next->m_next.load(std::memory_order_acquire);
+   }
+   if (next)
+   {
+      m_tail = next;
+      return tail;
+   }
+   if (tail != m_head.load(std::memory_order_acquire))
+   {
+      return nullptr;
+   }
+   Enqueue(&m_stub);
+   next = tail->m_next.load(std::memory_order_acquire);
+   if (next)
+   {
+      m_tail = next;
+      return tail;
+   }
+   return nullptr;
+}
+
+/*
+- I/O stage of the pipelined consumer (cf PipelinedConsumer)
+- the FileWriters attached to a WriterStage (FileWriter::SetWriterStage) append their lines to blocks
+the blocks are written to the files by the WriterStage thread, so a slow write does not stall the threads draining the producer queues
+- the blocks of a FileWriter are written in submission order
+- the WriterStage must outlive the FileWriters attached to it
+*/
+class WriterStage
+{
+public:
+   WriterStage();
+   ~WriterStage();
+   WriterStage(const WriterStage&) = delete;
+   WriterStage& operator=(const WriterStage&) = delete;
+   //
+   void Submit(WriterBlock* block) { m_blocks.Enqueue(block); }
+
+private:
+   void Run();
+   bool WriteBlocks();
+   //
+   WriterBlockQueue m_blocks;
+   std::atomic<bool> m_stop;
+   std::thread m_thread;
+
+};
+
+}
+}
@@ -0,0 +1,55 @@
+#include "tbp/log/LogMerger.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+namespace tbp
+{
+namespace log
+{
+
+int MainFunction(int argc, char** argv)
+{
+   std::size_t nbThreads = std::thread::hardware_concurrency();
+   int arg = 1;
+   if (arg + 1 < argc && std::strcmp(argv[arg], "-j") == 0)
+   {
+      nbThreads = std::strtoul(argv[arg + 1], nullptr, 10);
+      arg += 2;
+   }
+   if (argc - arg < 2 || !nbThreads)
+   {
+      std::cerr << "usage: tbp-log-merge [-j <threads>] <output file> <log file>..." << std::endl;
+      return 1;
+   }
+   std::string output = argv[arg++];
+   std::vector<std::string> inputs(argv + arg, argv + argc);
+   //
+   int res = 0;
+   try
+   {
+      auto start = std::chrono::steady_clock::now();
+      LogMerger merger(nbThreads);
+      std::size_t nbRecords = merger.Merge(inputs, output);
+      auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+      std::cout << nbRecords << " records of " << inputs.size() << " files merged in " << millis.count() << "ms" << std::endl;
+   }
+   catch (std::exception& e)
+   {
+      std::cerr << "exception in main: " << e.what() << std::endl;
+      res = 1;
+   }
+   return res;
+}
+
+}
+}
+
+int main(int argc, char** argv)
+{
+   return tbp::log::MainFunction(argc, argv);
+}
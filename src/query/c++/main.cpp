@@ -0,0 +1,79 @@
+#include "tbp/log/FileIndex.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+// YYYYmmdd-HHMMSS[.nnnnnnnnn] (local time) to nanoseconds since the epoch
+bool ParseTime(const char* str, std::uint64_t& time)
+{
+   std::tm tm = {};
+   const char* end = strptime(str, "%Y%m%d-%H%M%S", &tm);
+   if (!end)
+   {
+      return false;
+   }
+   tm.tm_isdst = -1;
+   time = static_cast<std::uint64_t>(std::mktime(&tm)) * 1000000000;
+   if (*end == '.')
+   {
+      std::uint64_t scale = 100000000;
+      for (++end; *end >= '0' && *end <= '9' && scale; ++end, scale /= 10)
+      {
+         time += (*end - '0') * scale;
+      }
+   }
+   return *end == '\0';
+}
+
+}
+
+int MainFunction(int argc, char** argv)
+{
+   std::vector<std::string> categories;
+   int arg = 1;
+   while (arg + 1 < argc && std::strcmp(argv[arg], "-c") == 0)
+   {
+      categories.emplace_back(argv[arg + 1]);
+      arg += 2;
+   }
+   std::uint64_t from = 0;
+   std::uint64_t to = 0;
+   if (argc - arg != 3 || !ParseTime(argv[arg + 1], from) || !ParseTime(argv[arg + 2], to))
+   {
+      std::cerr << "usage: tbp-log-query [-c <category>]... <log file> <from> <to>" << std::endl;
+      std::cerr << "   <from> and <to>: YYYYmmdd-HHMMSS[.nnnnnnnnn] (local time, included)" << std::endl;
+      return 1;
+   }
+   //
+   int res = 0;
+   try
+   {
+      FileIndexReader reader(argv[arg]);
+      reader.Query(from, to, categories, std::cout);
+   }
+   catch (std::exception& e)
+   {
+      std::cerr << "exception in main: " << e.what() << std::endl;
+      res = 1;
+   }
+   return res;
+}
+
+}
+}
+
+int main(int argc, char** argv)
+{
+   return tbp::log::MainFunction(argc, argv);
+}
@@ -6,12 +6,17 @@
 #include "tbp/log/ThreadLocalLogger.h"
 #include "tbp/log/DefaultTypes.h"
 #include "tbp/log/Formatter.h"
+#include "tbp/log/JsonFormatter.h"
 #include "tbp/log/AsyncLogger.h"
+#include "tbp/log/FlightRecorderSink.h"
+#include "tbp/log/PipelinedConsumer.h"
+#include "tbp/log/NumaConsumer.h"
 #include "tbp/log/FileWriter.h"
 #include "tbp/log/BufferAllocator.h"
 #include "tbp/log/SignalManager.h"
 #include "tbp/log/Injector.h"
 #include "tbp/common/Compiler.h"
+#include "tbp/common/ConfigurationException.h"
 #include "tbp/tools/ScopedThread.h"
 #include "tbp/tools/OS.h"
 #include "tbp/tools/spsc/Queue1.h"
@@ -22,9 +27,21 @@
 #include "test/Context.h"
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
+#include <array>
 #include <string>
 #include <memory>
 #include <thread>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <fstream>
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+#include <csignal>
 
 using testing::_;
 using testing::InSequence;
@@ -50,12 +67,14 @@ class InjectorMock : public Injector
 {
 public:
    MOCK_CONST_METHOD2(CreateFileWriter, std::unique_ptr<log::FileWriter>(const log::Config& config, common::ThreadId tid));
+   MOCK_CONST_METHOD2(CreateSharedFileWriter, std::unique_ptr<log::FileWriter>(const log::Config& config, const std::string& name));
 };
 
 class FileWriterMock1 : public FileWriter
 {
 public:
    FileWriterMock1(const Config& config, common::ThreadId tid) : FileWriter(config, tid) {}
+   FileWriterMock1(const Config& config, const std::string& name) : FileWriter(config, name) {}
    //
    MOCK_CONST_METHOD1(OnWrite, void(const fmt::MemoryWriter& writer));
 };
@@ -64,10 +83,21 @@ class FileWriterMock2 : public FileWriter
 {
 public:
    FileWriterMock2(const Config& config, common::ThreadId tid) : FileWriter(config, tid) {}
+   ~FileWriterMock2() { StopWriterStage(); }
    //
    MOCK_CONST_METHOD1(OnFileWritten, void(std::ofstream& file));
 };
 
+class FileWriterMock3 : public FileWriter
+{
+public:
+   FileWriterMock3(const Config& config, common::ThreadId tid) : FileWriter(config, tid) {}
+   ~FileWriterMock3() { StopWriterStage(); }
+   //
+   MOCK_CONST_METHOD1(OnWrite, void(const fmt::MemoryWriter& writer));
+   MOCK_CONST_METHOD1(OnFileWritten, void(std::ofstream& file));
+};
+
 }
 
 TEST(AsyncLoggerTest, Formatter)
@@ -120,6 +150,64 @@ TEST(AsyncLoggerTest, Formatter)
    }
 }
 
+TEST(AsyncLoggerTest, NamedFields)
+{
+   // the names are removed from the fields passed to the decode functor
+   fmt::MemoryWriter writer;
+   Formatter formatter;
+   formatter.Format("order {id} qty {} px {price:.2f} {{{0}}}", writer, [](const char* fmt, fmt::MemoryWriter& writer)
+   {
+      writer.write(fmt, 1.);
+   });
+   EXPECT_EQ(string(writer.data(), writer.size()), "order 1 qty 1 px 1.00 {1}");
+   //
+   std::vector<string> names;
+   Formatter::ForEachField("order {id} qty {} px {price:.2f} {{{0}}}", [&names](const string& name) { names.push_back(name); });
+   EXPECT_EQ(names, (std::vector<string>{ "id", "", "price", "" }));
+}
+
+TEST(AsyncLoggerTest, JsonString)
+{
+   auto toJson = [](const string& str)
+   {
+      fmt::MemoryWriter writer;
+      WriteJsonString(writer, str);
+      return string(writer.data(), writer.size());
+   };
+   EXPECT_EQ(toJson(""), "\"\"");
+   EXPECT_EQ(toJson("abc"), "\"abc\"");
+   // the special characters are found before, inside and after the blocks of 16 bytes
+   EXPECT_EQ(toJson("\"0123456789abcdef\\0123456789abcdef\n\x01\xc3\xa9"),
+         "\"\\\"0123456789abcdef\\\\0123456789abcdef\\n\\u0001\xc3\xa9\"");
+   EXPECT_EQ(toJson("0123456789abcdef0123456789\t"), "\"0123456789abcdef0123456789\\t\"");
+}
+
+TEST(AsyncLoggerTest, JsonFormatData)
+{
+   Category cat1("category1", Level::info);
+   JsonFormatter<DefaultTypeId, Allocator> formatter;
+   Encoder<DefaultTypeId, Allocator> encoder;
+   Allocator allocator(Allocator::BufferSizes({ 256 }), 10);
+   auto toJson = [&](const char* fmt, int v1, int v2)
+   {
+      Buffer<Allocator> buffer = encoder.Encode(allocator, v1, v2);
+      buffer.Reset();
+      Msg<Allocator> msg(timespec{ 0, 0 }, Level::info, cat1, fmt, std::move(buffer), 0);
+      fmt::MemoryWriter writer;
+      formatter.Format(msg, 1, writer);
+      msg.Recycle(allocator);
+      string json(writer.data(), writer.size());
+      return json.substr(json.find("\"args\""));
+   };
+   // same address, different content
+   string fmt = "{a} {b}";
+   EXPECT_EQ(toJson(fmt.c_str(), 1, 2), "\"args\":{\"a\":1,\"b\":2}}");
+   fmt = "{c} {d}";
+   EXPECT_EQ(toJson(fmt.c_str(), 1, 2), "\"args\":{\"c\":1,\"d\":2}}");
+   // more arguments than fields
+   EXPECT_EQ(toJson("{a}", 1, 2), "\"args\":{\"a\":1,\"1\":2}}");
+}
+
 // let the user of the logger api define its own macros:
 #define LOG_ASYNC(category, level, ...)          \
    TBP_LOG(MySink, category, level, __VA_ARGS__)
@@ -183,6 +271,1082 @@ TEST(AsyncLoggerTest, AsyncSink)
    // join loggerThread, queue is destroyed after the loggerThread
 }
 
+TEST(AsyncLoggerTest, SinkPool)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   const auto& affinities = context.GetAffinityManager();
+   //
+   log::Config logConfig(config.GetOutputDir() + "/AsyncLoggerTest_SinkPool", "logfile");
+   Categories categories;
+   Category cat1("category1", Level::info);
+   g_logCat1 = categories.AddCategory(cat1);
+   InjectorMock injector;
+   auto createFileWriter = [](const log::Config& config, common::ThreadId tid)
+   {
+      auto fw = std::make_unique<FileWriterMock1>(config, tid);
+      //
+      {
+         InSequence s;
+         EXPECT_CALL(*fw, OnWrite(_)).WillOnce(Invoke(
+         [](const fmt::MemoryWriter& writer)
+         {
+            string logMsg = GetLogMsg(writer);
+            EXPECT_EQ(logMsg, "[info][category1] thread 1");
+         }));
+         EXPECT_CALL(*fw, OnWrite(_)).WillOnce(Invoke(
+         [](const fmt::MemoryWriter& writer)
+         {
+            string logMsg = GetLogMsg(writer);
+            EXPECT_EQ(logMsg, "[info][category1] thread 2");
+         }));
+      }
+      return fw;
+   };
+   // the second thread reuses the queue and the FileWriter of the first thread
+   EXPECT_CALL(injector, CreateFileWriter(_, _)).WillOnce(Invoke(createFileWriter));
+   // the third thread reuses the queue but writes in the file of its group
+   EXPECT_CALL(injector, CreateSharedFileWriter(_, "orders")).WillOnce(Invoke([](const log::Config& config, const std::string& name)
+   {
+      auto fw = std::make_unique<FileWriterMock1>(config, name);
+      EXPECT_CALL(*fw, OnWrite(_)).WillOnce(Invoke(
+      [](const fmt::MemoryWriter& writer)
+      {
+         string logMsg = GetLogMsg(writer);
+         EXPECT_EQ(logMsg, "[info][category1] thread 3");
+      }));
+      return fw;
+   }));
+   auto loggers = make_shared<Loggers>(categories, logConfig, injector);
+   //
+   MyLogger asyncLogger(logConfig, injector);
+   asyncLogger.SetPool(1, [] { return std::make_unique<MyQueue>(); }, [] { return std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10); });
+   std::atomic<bool> noFactory(false);
+   std::atomic<bool> factorySet(false);
+   std::thread firstThread([&noFactory, &factorySet]
+   {
+      // no factory yet: cached by the thread until the next SetSinkFactory()
+      EXPECT_EQ(ThreadLocalLogger<MySink>::GetOrCreate(), nullptr);
+      EXPECT_EQ(ThreadLocalLogger<MySink>::GetOrCreate(), nullptr);
+      noFactory.store(true);
+      while (!factorySet.load()) {}
+      LOG_ASYNC(g_logCat1, Level::info, "thread {}", 1);
+   });
+   while (!noFactory.load()) {}
+   ThreadLocalLogger<MySink>::SetSinkFactory(loggers, "pooledLogger", [&asyncLogger](common::ThreadId tid)
+   {
+      return MySink(asyncLogger, tid);
+   });
+   std::atomic<bool> done(false);
+   auto affinity = affinities.GetSlowCpu();
+   tools::ScopedThread loggerThread(std::thread([&asyncLogger, &done, affinity]
+   {
+      tools::ThreadSetAffinity(affinity);
+      bool stop = false;
+      //
+      while (!stop)
+      {
+         stop = done.load();
+         asyncLogger.LogMessages();
+      }
+   }));
+   // no ThreadLocalLogger is created by the producer threads
+   factorySet.store(true);
+   firstThread.join();
+   while (asyncLogger.GetPoolSize() != 1) {}
+   std::thread([] { LOG_ASYNC(g_logCat1, Level::info, "thread {}", 2); }).join();
+   while (asyncLogger.GetPoolSize() != 1) {}
+   std::thread([&loggers, &asyncLogger]
+   {
+      ThreadLocalLogger<MySink> threadLocalLogger(loggers, "pooledGroupLogger", MySink(asyncLogger, common::ThreadGetId(), "orders"));
+      LOG_ASYNC(g_logCat1, Level::info, "thread {}", 3);
+   }).join();
+   while (asyncLogger.GetPoolSize() != 1) {}
+   ThreadLocalLogger<MySink>::ResetSinkFactory();
+   EXPECT_EQ(ThreadLocalLogger<MySink>::GetOrCreate(), nullptr);
+   //
+   done.store(true);
+   // join loggerThread, queue is destroyed after the loggerThread
+}
+
+TEST(AsyncLoggerTest, SharedFileWriter)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   const auto& affinities = context.GetAffinityManager();
+   //
+   log::Config logConfig(config.GetOutputDir() + "/AsyncLoggerTest_SharedFileWriter", "logfile");
+   logConfig.SetMaxFileWriters(1);
+   Categories categories;
+   Category cat1("category1", Level::info);
+   g_logCat1 = categories.AddCategory(cat1);
+   InjectorMock injector;
+   auto createFileWriter = [](const log::Config& config, const std::string& name)
+   {
+      auto fw = std::make_unique<FileWriterMock1>(config, name);
+      //
+      {
+         InSequence s;
+         EXPECT_CALL(*fw, OnWrite(_)).WillOnce(Invoke(
+         [](const fmt::MemoryWriter& writer)
+         {
+            string logMsg = GetLogMsg(writer);
+            EXPECT_EQ(logMsg, "[info][category1] thread 1");
+         }));
+         EXPECT_CALL(*fw, OnWrite(_)).WillOnce(Invoke(
+         [](const fmt::MemoryWriter& writer)
+         {
+            string logMsg = GetLogMsg(writer);
+            EXPECT_EQ(logMsg, "[info][category1] thread 2");
+         }));
+      }
+      return fw;
+   };
+   // the queue of the second thread is not pooled but it writes in the log file of the first thread
+   EXPECT_CALL(injector, CreateSharedFileWriter(_, "shared0")).WillOnce(Invoke(createFileWriter));
+   auto loggers = make_shared<Loggers>(categories, logConfig, injector);
+   //
+   MyLogger asyncLogger(logConfig, injector);
+   std::atomic<bool> done(false);
+   auto affinity = affinities.GetSlowCpu();
+   tools::ScopedThread loggerThread(std::thread([&asyncLogger, &done, affinity]
+   {
+      tools::ThreadSetAffinity(affinity);
+      bool stop = false;
+      //
+      while (!stop)
+      {
+         stop = done.load();
+         asyncLogger.LogMessages();
+      }
+   }));
+   auto producer = [&loggers, &asyncLogger](int index)
+   {
+      MySink sink(asyncLogger, std::make_unique<MyQueue>(),
+            std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10), common::ThreadGetId());
+      ThreadLocalLogger<MySink> threadLocalLogger(loggers, "sharedLogger" + std::to_string(index), std::move(sink));
+      LOG_ASYNC(g_logCat1, Level::info, "thread {}", index);
+   };
+   std::thread(producer, 1).join();
+   std::thread(producer, 2).join();
+   //
+   done.store(true);
+   // join loggerThread, queue is destroyed after the loggerThread
+}
+
+TEST(AsyncLoggerTest, Routes)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   const auto& affinities = context.GetAffinityManager();
+   //
+   log::Config logConfig(config.GetOutputDir() + "/AsyncLoggerTest_Routes", "logfile");
+   logConfig.GetRoutes().AddDestination("category1", "orders", Level::info);
+   logConfig.GetRoutes().AddDestination("category1", "errors", Level::error);
+   logConfig.GetRoutes().AddDestination("category2", "errors", Level::error);
+   logConfig.GetRoutes().SetKeepDefault("category2", false);
+   EXPECT_THROW(logConfig.GetRoutes().AddDestination("category1", "orders", Level::debug), common::ConfigurationException);
+   Categories categories;
+   Category cat1("category1", Level::info);
+   Category cat2("category2", Level::info);
+   g_logCat1 = categories.AddCategory(cat1);
+   CategoryId logCat2 = categories.AddCategory(cat2);
+   InjectorMock injector;
+   auto expectWrites = [](FileWriterMock1& fw, std::vector<string> logMsgs)
+   {
+      InSequence s;
+      for (const auto& expected : logMsgs)
+      {
+         EXPECT_CALL(fw, OnWrite(_)).WillOnce(Invoke(
+         [expected](const fmt::MemoryWriter& writer)
+         {
+            string logMsg = GetLogMsg(writer);
+            EXPECT_EQ(logMsg, expected);
+         }));
+      }
+   };
+   EXPECT_CALL(injector, CreateFileWriter(_, _)).WillOnce(Invoke([&expectWrites](const log::Config& config, common::ThreadId tid)
+   {
+      auto fw = std::make_unique<FileWriterMock1>(config, tid);
+      expectWrites(*fw, { "[info][category1] order 1", "[error][category1] order 2" });
+      return fw;
+   }));
+   // the destinations are created once and shared by the categories
+   EXPECT_CALL(injector, CreateSharedFileWriter(_, "orders")).WillOnce(Invoke([&expectWrites](const log::Config& config, const std::string& name)
+   {
+      auto fw = std::make_unique<FileWriterMock1>(config, name);
+      expectWrites(*fw, { "[info][category1] order 1", "[error][category1] order 2" });
+      return fw;
+   }));
+   EXPECT_CALL(injector, CreateSharedFileWriter(_, "errors")).WillOnce(Invoke([&expectWrites](const log::Config& config, const std::string& name)
+   {
+      auto fw = std::make_unique<FileWriterMock1>(config, name);
+      expectWrites(*fw, { "[error][category1] order 2", "[error][category2] feed 2" });
+      return fw;
+   }));
+   auto loggers = make_shared<Loggers>(categories, logConfig, injector);
+   //
+   MyLogger asyncLogger(logConfig, injector);
+   std::atomic<bool> done(false);
+   auto affinity = affinities.GetSlowCpu();
+   tools::ScopedThread loggerThread(std::thread([&asyncLogger, &done, affinity]
+   {
+      tools::ThreadSetAffinity(affinity);
+      bool stop = false;
+      //
+      while (!stop)
+      {
+         stop = done.load();
+         asyncLogger.LogMessages();
+      }
+   }));
+   MySink sink(asyncLogger, std::make_unique<MyQueue>(),
+         std::make_unique<Allocator>(Allocator::BufferSizes({ 64, 128 }), 10), common::ThreadGetId());
+   ThreadLocalLogger<MySink> threadLocalLogger(loggers, "routedLogger", std::move(sink));
+   LOG_ASYNC(g_logCat1, Level::info, "order {}", 1);
+   LOG_ASYNC(g_logCat1, Level::error, "order {}", 2);
+   // category2 is not written in the default log file
+   LOG_ASYNC(logCat2, Level::info, "feed {}", 1);
+   LOG_ASYNC(logCat2, Level::error, "feed {}", 2);
+   //
+   done.store(true);
+   // join loggerThread, queue is destroyed after the loggerThread
+}
+
+TEST(AsyncLoggerTest, JsonOutput)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   const auto& affinities = context.GetAffinityManager();
+   //
+   log::Config logConfig(config.GetOutputDir() + "/AsyncLoggerTest_JsonOutput", "logfile");
+   logConfig.SetOutputFormat(OutputFormat::json);
+   Categories categories;
+   Category cat1("category1", Level::info);
+   g_logCat1 = categories.AddCategory(cat1);
+   InjectorMock injector;
+   auto createFileWriter = [](const log::Config& config, common::ThreadId tid)
+   {
+      auto fw = std::make_unique<FileWriterMock1>(config, tid);
+      //
+      {
+         InSequence s;
+         EXPECT_CALL(*fw, OnWrite(_)).WillOnce(Invoke(
+         [tid](const fmt::MemoryWriter& writer)
+         {
+            string logMsg(writer.data(), writer.size());
+            EXPECT_EQ(logMsg.find("{\"ts\":"), 0U);
+            string fields = fmt::format(",\"tid\":{},\"level\":\"info\",\"category\":\"category1\",\"fmt\":\"", tid);
+            EXPECT_NE(logMsg.find(fields), string::npos);
+            string args = "\",\"args\":{\"id\":12,\"1\":-3,\"price\":1.5,\"text\":\"a\\\"b\"}}";
+            EXPECT_EQ(logMsg.substr(logMsg.size() - args.size()), args);
+         }));
+         EXPECT_CALL(*fw, OnWrite(_)).WillOnce(Invoke(
+         [](const fmt::MemoryWriter& writer)
+         {
+            string logMsg(writer.data(), writer.size());
+            EXPECT_EQ(logMsg.substr(logMsg.size() - 10), "\"args\":{}}");
+         }));
+         EXPECT_CALL(*fw, OnWrite(_)).WillOnce(Invoke(
+         [](const fmt::MemoryWriter& writer)
+         {
+            string logMsg(writer.data(), writer.size());
+            string args = "\"args\":{\"ids\":[1,-2],\"px\":[0.5]}}";
+            EXPECT_EQ(logMsg.substr(logMsg.size() - args.size()), args);
+         }));
+      }
+      return fw;
+   };
+   EXPECT_CALL(injector, CreateFileWriter(_, _)).WillOnce(Invoke(createFileWriter));
+   auto loggers = make_shared<Loggers>(categories, logConfig, injector);
+   //
+   MyLogger asyncLogger(logConfig, injector);
+   std::atomic<bool> done(false);
+   auto affinity = affinities.GetSlowCpu();
+   tools::ScopedThread loggerThread(std::thread([&asyncLogger, &done, affinity]
+   {
+      tools::ThreadSetAffinity(affinity);
+      bool stop = false;
+      //
+      while (!stop)
+      {
+         stop = done.load();
+         asyncLogger.LogMessages();
+      }
+   }));
+   MySink sink(asyncLogger, std::make_unique<MyQueue>(),
+         std::make_unique<Allocator>(Allocator::BufferSizes({ 64, 128 }), 10), common::ThreadGetId());
+   ThreadLocalLogger<MySink> threadLocalLogger(loggers, "jsonLogger", std::move(sink));
+   LOG_ASYNC(g_logCat1, Level::info, "order {id} qty {} px {price:.2f} {text}", 12, -3, 1.5, string("a\"b"));
+   LOG_ASYNC(g_logCat1, Level::info, "withoutFormat");
+   LOG_ASYNC(g_logCat1, Level::info, "ids {ids} px {px}", std::vector<int>{ 1, -2 }, std::array<double, 1>{ { 0.5 } });
+   //
+   done.store(true);
+   // join loggerThread, queue is destroyed after the loggerThread
+}
+
+TEST(AsyncLoggerTest, FlightRecorderRing)
+{
+   FlightRecorder recorder(512);
+   Encoder<DefaultTypeId, FlightRecorder> encoder;
+   Category cat1("category1", Level::debug);
+   const char* fmt = "msg {}";
+   for (int i = 0; i < 100; ++i)
+   {
+      recorder.Begin();
+      encoder.Encode(recorder, i);
+      auto record = recorder.GetRecord();
+      record->m_fmt = fmt;
+      record->m_category = &cat1;
+      recorder.Commit();
+   }
+   // only the most recent records are kept, in order
+   std::vector<int> values;
+   recorder.ForEach([&values](const FlightRecorder::Record& record, const char* data)
+   {
+      Buffer<FlightRecorder> buffer(const_cast<char*>(data));
+      Decoder<DefaultTypeId, FlightRecorder> decoder(buffer);
+      auto p = decoder.Next();
+      int v = 0;
+      Type<int, DefaultTypeId, FlightRecorder>::Decode(*p.second, v);
+      values.push_back(v);
+   });
+   ASSERT_FALSE(values.empty());
+   EXPECT_LT(values.size(), 100U);
+   for (std::size_t i = 0; i < values.size(); ++i)
+   {
+      EXPECT_EQ(values[i], static_cast<int>(100 - values.size() + i));
+   }
+   recorder.Clear();
+   EXPECT_TRUE(recorder.IsEmpty());
+   // 64 bytes then 56 bytes records: the tail of the ring is 8 bytes (1024 = 64 + 17 * 56 + 8), then 16 bytes (1024 = 18 * 56 + 16)
+   FlightRecorder small(1024);
+   for (int i = 0; i < 60; ++i)
+   {
+      small.Begin();
+      char* data = small.Alloc(i ? 8 : 16);
+      std::memcpy(data, &i, sizeof(i));
+      auto record = small.GetRecord();
+      record->m_fmt = fmt;
+      record->m_category = &cat1;
+      small.Commit();
+   }
+   values.clear();
+   small.ForEach([&values](const FlightRecorder::Record& record, const char* data)
+   {
+      EXPECT_EQ(record.m_dataSize, 8U);
+      int v = 0;
+      std::memcpy(&v, data, sizeof(v));
+      values.push_back(v);
+   });
+   ASSERT_FALSE(values.empty());
+   for (std::size_t i = 0; i < values.size(); ++i)
+   {
+      EXPECT_EQ(values[i], static_cast<int>(60 - values.size() + i));
+   }
+}
+
+TEST(AsyncLoggerTest, FlightRecorderBlobRef)
+{
+   FlightRecorder recorder(512);
+   Encoder<DefaultTypeId, FlightRecorder> encoder;
+   std::size_t nbReleases = 0;
+   auto release = [](const void*, std::size_t, void* context) { ++*static_cast<std::size_t*>(context); };
+   // a record can be overwritten without being decoded: the payload is copied and released at once
+   recorder.Begin();
+   encoder.Encode(recorder, BlobRef("abc", 3, release, &nbReleases));
+   recorder.Commit();
+   EXPECT_EQ(nbReleases, 1U);
+   std::vector<std::string> payloads;
+   recorder.ForEach([&payloads](const FlightRecorder::Record&, const char* data)
+   {
+      Buffer<FlightRecorder> buffer(const_cast<char*>(data));
+      Decoder<DefaultTypeId, FlightRecorder> decoder(buffer);
+      auto p = decoder.Next();
+      ASSERT_EQ(p.first, DefaultTypeId::BLOB);
+      BlobField v;
+      Type<Blob, DefaultTypeId, FlightRecorder>::Decode(*p.second, v);
+      EXPECT_EQ(v.m_release, nullptr);
+      payloads.emplace_back(v.m_data, v.m_size);
+   });
+   EXPECT_EQ(payloads, std::vector<std::string>{ "abc" });
+}
+
+TEST(AsyncLoggerTest, BlobRefNotDrained)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   //
+   log::Config logConfig(config.GetOutputDir() + "/AsyncLoggerTest_BlobRefNotDrained", "logfile");
+   Category cat1("category1", Level::info);
+   InjectorMock injector;
+   EXPECT_CALL(injector, CreateFileWriter(_, _)).WillOnce(Invoke([](const log::Config& config, common::ThreadId tid)
+   {
+      auto fw = std::make_unique<FileWriterMock1>(config, tid);
+      EXPECT_CALL(*fw, OnWrite(_)).WillOnce(Invoke(
+      [](const fmt::MemoryWriter& writer)
+      {
+         EXPECT_EQ(GetLogMsg(writer), "[info][category1] payload 616263");
+      }));
+      return fw;
+   }));
+   std::size_t nbReleases = 0;
+   auto release = [](const void*, std::size_t, void* context) { ++*static_cast<std::size_t*>(context); };
+   {
+      MyLogger asyncLogger(logConfig, injector);
+      MySink sink(asyncLogger, std::make_unique<MyQueue>(), std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10), common::ThreadGetId());
+      timespec now;
+      ::clock_gettime(CLOCK_REALTIME, &now);
+      sink.Log(cat1, Level::info, now, 0, "payload {}", BlobRef("abc", 3, release, &nbReleases));
+      EXPECT_EQ(nbReleases, 0U);
+      // the AsyncLogger is destroyed before LogMessages() is called
+   }
+   EXPECT_EQ(nbReleases, 1U);
+}
+
+using MyRecorderSink = FlightRecorderSink<DefaultTypeId, MyQueue, tools::mpsc::Queue1, Allocator>;
+
+#define LOG_RECORDER(category, level, ...)          \
+   TBP_LOG(MyRecorderSink, category, level, __VA_ARGS__)
+
+TEST(AsyncLoggerTest, FlightRecorder)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   const auto& affinities = context.GetAffinityManager();
+   //
+   log::Config logConfig(config.GetOutputDir() + "/AsyncLoggerTest_FlightRecorder", "logfile");
+   Categories categories;
+   Category cat1("category1", Level::debug);
+   g_logCat1 = categories.AddCategory(cat1);
+   InjectorMock injector;
+   std::vector<string> logMsgs;
+   std::mutex mutex;
+   auto createFileWriter = [&logMsgs, &mutex](const log::Config& config, common::ThreadId tid)
+   {
+      auto fw = std::make_unique<FileWriterMock1>(config, tid);
+      EXPECT_CALL(*fw, OnWrite(_)).WillRepeatedly(Invoke(
+      [&logMsgs, &mutex](const fmt::MemoryWriter& writer)
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         logMsgs.push_back(GetLogMsg(writer));
+      }));
+      return fw;
+   };
+   EXPECT_CALL(injector, CreateFileWriter(_, _)).Times(2).WillRepeatedly(Invoke(createFileWriter));
+   auto loggers = make_shared<Loggers>(categories, logConfig, injector);
+   //
+   MyLogger asyncLogger(logConfig, injector);
+   std::atomic<bool> done(false);
+   auto affinity = affinities.GetSlowCpu();
+   tools::ScopedThread loggerThread(std::thread([&asyncLogger, &done, affinity]
+   {
+      tools::ThreadSetAffinity(affinity);
+      bool stop = false;
+      //
+      while (!stop)
+      {
+         stop = done.load();
+         asyncLogger.LogMessages();
+      }
+   }));
+   auto waitFor = [&logMsgs, &mutex](std::size_t size)
+   {
+      while (true)
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         if (logMsgs.size() >= size)
+         {
+            break;
+         }
+      }
+   };
+   MySink sink(asyncLogger, std::make_unique<MyQueue>(),
+         std::make_unique<Allocator>(Allocator::BufferSizes({ 64, 128 }), 10), common::ThreadGetId());
+   ThreadLocalLogger<MyRecorderSink> threadLocalLogger(loggers, "recorderLogger", MyRecorderSink(std::move(sink), 4096));
+   LOG_RECORDER(g_logCat1, Level::debug, "debug {}", 1);
+   LOG_RECORDER(g_logCat1, Level::info, "info {}", 2);
+   std::this_thread::sleep_for(std::chrono::milliseconds(50));
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      EXPECT_TRUE(logMsgs.empty());
+   }
+   // trigger level
+   LOG_RECORDER(g_logCat1, Level::error, "error {}", 3);
+   waitFor(3);
+   // global trigger, the records of all the sinks are dumped by the calling thread
+   LOG_RECORDER(g_logCat1, Level::debug, "debug {}", 4);
+   LOG_RECORDER(g_logCat1, Level::debug, "debug {}", 5);
+   FlightRecorderTrigger::TriggerAll();
+   waitFor(5);
+   // explicit dump
+   LOG_RECORDER(g_logCat1, Level::debug, "withoutFormat");
+   ThreadLocalLogger<MyRecorderSink>::Get()->GetSink().Dump();
+   waitFor(6);
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      EXPECT_EQ(logMsgs, (std::vector<string>{ "[debug][category1] debug 1", "[info][category1] info 2", "[error][category1] error 3",
+            "[debug][category1] debug 4", "[debug][category1] debug 5", "[debug][category1] withoutFormat" }));
+   }
+   // a message with a signal: the records of the other threads are dumped before it
+   {
+      std::atomic<bool> recorded(false);
+      std::atomic<bool> stop(false);
+      tools::ScopedThread otherThread(std::thread([&]
+      {
+         MySink otherSink(asyncLogger, std::make_unique<MyQueue>(),
+               std::make_unique<Allocator>(Allocator::BufferSizes({ 64, 128 }), 10), common::ThreadGetId());
+         ThreadLocalLogger<MyRecorderSink> otherLogger(loggers, "otherRecorderLogger", MyRecorderSink(std::move(otherSink), 4096));
+         LOG_RECORDER(g_logCat1, Level::debug, "other {}", 7);
+         recorded.store(true);
+         while (!stop.load()) {}
+      }));
+      while (!recorded.load()) {}
+      ThreadLocalLogger<MyRecorderSink>::Get()->Log(g_logCat1, Level::info, SIGTERM, "signal {}", 8);
+      waitFor(8);
+      stop.store(true);
+   }
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      EXPECT_EQ(std::set<string>(logMsgs.begin() + 6, logMsgs.end()), (std::set<string>{ "[debug][category1] other 7", "[info][category1] signal 8" }));
+   }
+   //
+   done.store(true);
+   // join loggerThread, queue is destroyed after the loggerThread
+}
+
+TEST(AsyncLoggerTest, PipelinedConsumer)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   //
+   log::Config logConfig(config.GetOutputDir() + "/AsyncLoggerTest_PipelinedConsumer", "logfile");
+   Categories categories;
+   Category cat1("category1", Level::info);
+   g_logCat1 = categories.AddCategory(cat1);
+   InjectorMock injector;
+   const std::size_t nbProducers = 4;
+   const int nbMessages = 200;
+   std::mutex mutex;
+   std::map<common::ThreadId, std::vector<string>> logMsgs;
+   std::set<std::thread::id> formatThreads;
+   std::set<std::thread::id> writeThreads;
+   auto createFileWriter = [&](const log::Config& config, common::ThreadId tid)
+   {
+      auto fw = std::make_unique<FileWriterMock3>(config, tid);
+      EXPECT_CALL(*fw, OnWrite(_)).WillRepeatedly(Invoke(
+      [&, tid](const fmt::MemoryWriter& writer)
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         logMsgs[tid].push_back(GetLogMsg(writer));
+         formatThreads.insert(std::this_thread::get_id());
+      }));
+      EXPECT_CALL(*fw, OnFileWritten(_)).WillRepeatedly(Invoke(
+      [&](std::ofstream&)
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         writeThreads.insert(std::this_thread::get_id());
+      }));
+      return fw;
+   };
+   EXPECT_CALL(injector, CreateFileWriter(_, _)).Times(nbProducers).WillRepeatedly(Invoke(createFileWriter));
+   auto loggers = make_shared<Loggers>(categories, logConfig, injector);
+   //
+   {
+      PipelinedConsumer<DefaultTypeId, MyQueue, tools::mpsc::Queue1, Allocator> pipeline(logConfig, injector, 2);
+      pipeline.Start();
+      std::vector<std::thread> producers;
+      for (std::size_t i = 0; i < nbProducers; ++i)
+      {
+         producers.emplace_back([&pipeline, &loggers, i, nbMessages]
+         {
+            common::ThreadId tid = common::ThreadGetId();
+            MySink sink(pipeline.GetLogger(tid), std::make_unique<MyQueue>(),
+                  std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10), tid);
+            ThreadLocalLogger<MySink> threadLocalLogger(loggers, "pipelinedLogger" + std::to_string(i), std::move(sink));
+            for (int j = 0; j < nbMessages; ++j)
+            {
+               LOG_ASYNC(g_logCat1, Level::info, "msg {}", j);
+            }
+         });
+      }
+      for (auto& producer : producers)
+      {
+         producer.join();
+      }
+      // a group file would be truncated and written by each worker
+      EXPECT_THROW(MySink(pipeline.GetLogger(0), std::make_unique<MyQueue>(), std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10), 0, "orders"),
+            common::ConfigurationException);
+      // the FileWriters wait for their blocks to be written when the pipeline is destroyed
+   }
+   log::Config routesConfig(config.GetOutputDir() + "/AsyncLoggerTest_PipelinedConsumer", "logfile");
+   routesConfig.GetRoutes().AddDestination("category1", "orders", Level::info);
+   EXPECT_THROW((PipelinedConsumer<DefaultTypeId, MyQueue, tools::mpsc::Queue1, Allocator>(routesConfig, injector, 2)), common::ConfigurationException);
+   ASSERT_EQ(logMsgs.size(), nbProducers);
+   for (const auto& p : logMsgs)
+   {
+      // the order of the messages of a thread is preserved
+      ASSERT_EQ(p.second.size(), static_cast<std::size_t>(nbMessages));
+      for (int j = 0; j < nbMessages; ++j)
+      {
+         EXPECT_EQ(p.second[j], "[info][category1] msg " + std::to_string(j));
+      }
+   }
+   // the files are only written by the writer stage
+   EXPECT_EQ(writeThreads.size(), 1U);
+   for (const auto& id : writeThreads)
+   {
+      EXPECT_EQ(formatThreads.count(id), 0U);
+   }
+}
+
+TEST(AsyncLoggerTest, NumaConsumer)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   //
+   log::Config logConfig(config.GetOutputDir() + "/AsyncLoggerTest_NumaConsumer", "logfile");
+   Categories categories;
+   Category cat1("category1", Level::info);
+   g_logCat1 = categories.AddCategory(cat1);
+   InjectorMock injector;
+   const std::size_t nbNodes = 2;
+   const int nbMessages = 100;
+   std::mutex mutex;
+   std::map<common::ThreadId, std::vector<string>> logMsgs;
+   std::map<common::ThreadId, std::thread::id> consumers;
+   auto createFileWriter = [&](const log::Config& config, common::ThreadId tid)
+   {
+      auto fw = std::make_unique<FileWriterMock1>(config, tid);
+      EXPECT_CALL(*fw, OnWrite(_)).WillRepeatedly(Invoke(
+      [&, tid](const fmt::MemoryWriter& writer)
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         logMsgs[tid].push_back(GetLogMsg(writer));
+         consumers[tid] = std::this_thread::get_id();
+      }));
+      return fw;
+   };
+   EXPECT_CALL(injector, CreateFileWriter(_, _)).Times(nbNodes).WillRepeatedly(Invoke(createFileWriter));
+   EXPECT_CALL(injector, CreateSharedFileWriter(_, "orders-node1")).WillOnce(Invoke([](const log::Config& config, const std::string& name)
+   {
+      return std::make_unique<FileWriterMock1>(config, name);
+   }));
+   auto loggers = make_shared<Loggers>(categories, logConfig, injector);
+   //
+   EXPECT_GE(NumaGetNbNodes(), 1U);
+   EXPECT_FALSE(NumaGetCpus(NumaGetCurrentNode()).empty());
+   std::set<NumaNode> startedNodes;
+   {
+      // one consumer per node, whatever the topology of the test machine
+      NumaConsumer<DefaultTypeId, MyQueue, tools::mpsc::Queue1, Allocator> consumer(logConfig, injector, nbNodes);
+      consumer.Start([&](NumaNode node)
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         startedNodes.insert(node);
+      });
+      std::vector<std::thread> producers;
+      for (std::size_t i = 0; i < nbNodes; ++i)
+      {
+         producers.emplace_back([&consumer, &loggers, i, nbMessages]
+         {
+            common::ThreadId tid = common::ThreadGetId();
+            NumaNode node = static_cast<NumaNode>(i);
+            // the buffers are bound to the node of the producer
+            MySink sink(consumer.GetLogger(node), std::make_unique<MyQueue>(),
+                  std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10, true, NumaGetCurrentNode()), tid);
+            ThreadLocalLogger<MySink> threadLocalLogger(loggers, "numaLogger" + std::to_string(i), std::move(sink));
+            for (int j = 0; j < nbMessages; ++j)
+            {
+               LOG_ASYNC(g_logCat1, Level::info, "msg {}", j);
+            }
+         });
+      }
+      for (auto& producer : producers)
+      {
+         producer.join();
+      }
+      {
+         // a group has one file per node
+         MySink groupSink(consumer.GetLogger(1), std::make_unique<MyQueue>(), std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10), 0, "orders");
+      }
+      consumer.Stop();
+   }
+   EXPECT_EQ(startedNodes, std::set<NumaNode>({ 0, 1 }));
+   ASSERT_EQ(logMsgs.size(), nbNodes);
+   std::set<std::thread::id> consumerIds;
+   for (const auto& p : logMsgs)
+   {
+      ASSERT_EQ(p.second.size(), static_cast<std::size_t>(nbMessages));
+      EXPECT_EQ(p.second.back(), "[info][category1] msg " + std::to_string(nbMessages - 1));
+      consumerIds.insert(consumers[p.first]);
+   }
+   // each node has its own consumer thread
+   EXPECT_EQ(consumerIds.size(), nbNodes);
+}
+
+TEST(AsyncLoggerTest, PriorityLane)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   //
+   log::Config logConfig(config.GetOutputDir() + "/AsyncLoggerTest_PriorityLane", "logfile");
+   logConfig.SetDrainBudget(2);
+   Categories categories;
+   Category cat1("category1", Level::info);
+   g_logCat1 = categories.AddCategory(cat1);
+   InjectorMock injector;
+   std::vector<string> logMsgs;
+   auto createFileWriter = [&logMsgs](const log::Config& config, common::ThreadId tid)
+   {
+      auto fw = std::make_unique<FileWriterMock1>(config, tid);
+      EXPECT_CALL(*fw, OnWrite(_)).WillRepeatedly(Invoke(
+      [&logMsgs](const fmt::MemoryWriter& writer)
+      {
+         logMsgs.push_back(GetLogMsg(writer));
+      }));
+      return fw;
+   };
+   EXPECT_CALL(injector, CreateFileWriter(_, _)).Times(2).WillRepeatedly(Invoke(createFileWriter));
+   auto loggers = make_shared<Loggers>(categories, logConfig, injector);
+   //
+   MyLogger asyncLogger(logConfig, injector);
+   {
+      MySink sink(asyncLogger, std::make_unique<MyQueue>(), std::make_unique<MyQueue>(),
+            std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10), common::ThreadGetId());
+      ThreadLocalLogger<MySink> threadLocalLogger(loggers, "priorityLogger", std::move(sink));
+      for (int i = 0; i < 5; ++i)
+      {
+         LOG_ASYNC(g_logCat1, Level::info, "quote {}", i);
+      }
+      LOG_ASYNC(g_logCat1, Level::critical, "reject {}", 1);
+      // the priority lane first, then at most 2 messages of the queue
+      asyncLogger.LogMessages();
+      std::vector<string> expected = { "[critical][category1] reject 1", "[info][category1] quote 0", "[info][category1] quote 1" };
+      EXPECT_EQ(logMsgs, expected);
+      asyncLogger.LogMessages();
+      EXPECT_EQ(logMsgs.size(), 5U);
+   }
+   // a removed queue is drained whatever the budget
+   asyncLogger.LogMessages();
+   ASSERT_EQ(logMsgs.size(), 6U);
+   EXPECT_EQ(logMsgs.back(), "[info][category1] quote 4");
+   // a message with a signal: all the queues are drained whatever the budget
+   logMsgs.clear();
+   {
+      MySink sink(asyncLogger, std::make_unique<MyQueue>(), std::make_unique<MyQueue>(),
+            std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10), common::ThreadGetId());
+      timespec now;
+      ::clock_gettime(CLOCK_REALTIME, &now);
+      for (int i = 0; i < 4; ++i)
+      {
+         sink.Log(cat1, Level::info, now, 0, "quote {}", i);
+      }
+      sink.Log(cat1, Level::critical, now, SIGSEGV, "crash");
+      EXPECT_EQ(asyncLogger.LogMessages(), SIGSEGV);
+      ASSERT_EQ(logMsgs.size(), 5U);
+      EXPECT_EQ(logMsgs.front(), "[critical][category1] crash");
+      EXPECT_EQ(logMsgs.back(), "[info][category1] quote 3");
+   }
+   asyncLogger.LogMessages();
+}
+
+TEST(AsyncLoggerTest, LoadShedding)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   //
+   {
+      LoadShedPolicy policy;
+      policy.m_nbMessages = 10;
+      policy.m_maxLevel = Level::warn;
+      LoadShedder shedder(policy);
+      shedder.Update(15, std::chrono::nanoseconds(0));
+      EXPECT_EQ(shedder.GetLevel(), Level::info);
+      shedder.Update(50, std::chrono::nanoseconds(0));
+      EXPECT_EQ(shedder.GetLevel(), Level::error);
+      // hysteresis: below half of the threshold of the current level
+      shedder.Update(25, std::chrono::nanoseconds(0));
+      EXPECT_EQ(shedder.GetLevel(), Level::error);
+      shedder.Update(15, std::chrono::nanoseconds(0));
+      EXPECT_EQ(shedder.GetLevel(), Level::info);
+      shedder.Update(0, std::chrono::nanoseconds(0));
+      EXPECT_EQ(shedder.GetLevel(), Level::none);
+      EXPECT_EQ(shedder.GetNbChanges(), 4U);
+   }
+   //
+   log::Config logConfig(config.GetOutputDir() + "/AsyncLoggerTest_LoadShedding", "logfile");
+   LoadShedPolicy policy;
+   policy.m_nbMessages = 2;
+   logConfig.SetLoadShedPolicy(policy);
+   Categories categories;
+   Category cat1("category1", Level::info);
+   g_logCat1 = categories.AddCategory(cat1);
+   InjectorMock injector;
+   std::vector<string> logMsgs;
+   auto createFileWriter = [&logMsgs](const log::Config& config, common::ThreadId tid)
+   {
+      auto fw = std::make_unique<FileWriterMock1>(config, tid);
+      EXPECT_CALL(*fw, OnWrite(_)).WillRepeatedly(Invoke(
+      [&logMsgs](const fmt::MemoryWriter& writer)
+      {
+         logMsgs.push_back(GetLogMsg(writer));
+      }));
+      return fw;
+   };
+   EXPECT_CALL(injector, CreateFileWriter(_, _)).WillOnce(Invoke(createFileWriter));
+   auto loggers = make_shared<Loggers>(categories, logConfig, injector);
+   //
+   MyLogger asyncLogger(logConfig, injector);
+   asyncLogger.SetLoadShedder(loggers->GetLoadShedder());
+   {
+      MySink sink(asyncLogger, std::make_unique<MyQueue>(), std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10), common::ThreadGetId());
+      ThreadLocalLogger<MySink> threadLocalLogger(loggers, "sheddingLogger", std::move(sink));
+      for (int i = 0; i < 4; ++i)
+      {
+         LOG_ASYNC(g_logCat1, Level::info, "quote {}", i);
+      }
+      asyncLogger.LogMessages();
+      ASSERT_EQ(loggers->GetLoadShedder().GetLevel(), Level::warn);
+      // the info messages are shed, not the warn ones
+      LOG_ASYNC(g_logCat1, Level::info, "quote {}", 4);
+      LOG_ASYNC(g_logCat1, Level::info, "quote {}", 5);
+      LOG_ASYNC(g_logCat1, Level::warn, "reject {}", 1);
+      asyncLogger.LogMessages();
+      EXPECT_EQ(loggers->GetLoadShedder().GetLevel(), Level::none);
+      // the number of shed messages is logged by the consumer once the shedding stops, not by the next message
+      ASSERT_EQ(logMsgs.size(), 6U);
+      EXPECT_EQ(logMsgs.back(), "[warn][category1] load shedding: 0 debug, 2 info and 0 warn messages dropped");
+      LOG_ASYNC(g_logCat1, Level::info, "quote {}", 6);
+      asyncLogger.LogMessages();
+      std::vector<string> expected = { "[info][category1] quote 0", "[info][category1] quote 1", "[info][category1] quote 2",
+         "[info][category1] quote 3", "[warn][category1] reject 1", "[warn][category1] load shedding: 0 debug, 2 info and 0 warn messages dropped",
+         "[info][category1] quote 6" };
+      EXPECT_EQ(logMsgs, expected);
+   }
+   asyncLogger.LogMessages();
+}
+
+// bounded queue (the queue of the unittests is not): a consumer is only stalled when a queue is full
+template <typename T>
+class StallQueue
+{
+public:
+   bool Enqueue(T&& v)
+   {
+      if (m_queue.size() >= 3)
+      {
+         return false;
+      }
+      m_queue.push_back(std::move(v));
+      return true;
+   }
+   bool Dequeue(T& v)
+   {
+      if (m_queue.empty())
+      {
+         return false;
+      }
+      v = std::move(m_queue.front());
+      m_queue.pop_front();
+      return true;
+   }
+
+private:
+   std::deque<T> m_queue;
+
+};
+
+template <typename Sink>
+class StallSinkMock : public Sink
+{
+public:
+   using Sink::Sink;
+   //
+   MOCK_METHOD1(ExitWithDefaultSignalHandler, void(common::SigNum signalNumber));
+};
+
+TEST(AsyncLoggerTest, ConsumerStall)
+{
+   using Queue = StallQueue<Msg<Allocator>>;
+   using Sink = AsyncSink<DefaultTypeId, Queue, tools::mpsc::Queue1, Allocator>;
+   using Logger = AsyncLogger<DefaultTypeId, Queue, tools::mpsc::Queue1, Allocator>;
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   //
+   const std::string outputDir = config.GetOutputDir() + "/AsyncLoggerTest_ConsumerStall";
+   log::Config logConfig(outputDir, "logfile");
+   StallPolicy policy;
+   policy.m_timeout = std::chrono::milliseconds(20);
+   policy.m_mode = StallMode::file;
+   logConfig.SetStallPolicy(policy);
+   Category cat1("category1", Level::info);
+   InjectorMock injector;
+   std::vector<string> logMsgs;
+   auto createFileWriter = [&logMsgs](const log::Config& config, common::ThreadId tid)
+   {
+      auto fw = std::make_unique<FileWriterMock1>(config, tid);
+      EXPECT_CALL(*fw, OnWrite(_)).WillRepeatedly(Invoke(
+      [&logMsgs](const fmt::MemoryWriter& writer)
+      {
+         logMsgs.push_back(GetLogMsg(writer));
+      }));
+      return fw;
+   };
+   EXPECT_CALL(injector, CreateFileWriter(_, _)).Times(5).WillRepeatedly(Invoke(createFileWriter));
+   // the emergency files are created by the Injector too
+   std::vector<string> emergencyMsgs;
+   EXPECT_CALL(injector, CreateSharedFileWriter(_, "emergency-" + std::to_string(common::ThreadGetId()))).Times(3).WillRepeatedly(Invoke(
+   [&emergencyMsgs](const log::Config& config, const std::string& name)
+   {
+      auto fw = std::make_unique<FileWriterMock1>(config, name);
+      EXPECT_CALL(*fw, OnWrite(_)).WillRepeatedly(Invoke(
+      [&emergencyMsgs](const fmt::MemoryWriter& writer)
+      {
+         emergencyMsgs.push_back(GetLogMsg(writer));
+      }));
+      return fw;
+   }));
+   //
+   Logger asyncLogger(logConfig, injector);
+   timespec now;
+   clock_gettime(CLOCK_REALTIME, &now);
+   // the allocator must not wait for a stalled consumer
+   EXPECT_THROW(Sink(asyncLogger, std::make_unique<Queue>(), std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10, false), common::ThreadGetId()),
+         common::ConfigurationException);
+   {
+      Sink sink(asyncLogger, std::make_unique<Queue>(), std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10), common::ThreadGetId());
+      sink.Log(cat1, Level::info, now, 0, "quote {}", 0);
+      asyncLogger.LogMessages();
+      // no heartbeat but the queue is not full: an idle consumer is not stalled
+      std::this_thread::sleep_for(std::chrono::milliseconds(60));
+      for (int i = 1; i < 4; ++i)
+      {
+         sink.Log(cat1, Level::info, now, 0, "quote {}", i);
+      }
+      // the queue is full: the message is kept by the sink, the next ones are written in the emergency file of the thread
+      sink.Log(cat1, Level::info, now, 0, "quote {}", 4);
+      sink.Log(cat1, Level::info, now, 0, "quote {}", 5);
+      asyncLogger.LogMessages();
+      // the kept message and the gap are enqueued before the first message after the consumer recovers
+      sink.Log(cat1, Level::info, now, 0, "quote {}", 6);
+      asyncLogger.LogMessages();
+      ASSERT_EQ(logMsgs.size(), 7U);
+      EXPECT_EQ(logMsgs[3], "[info][category1] quote 3");
+      EXPECT_EQ(logMsgs[4], "[info][category1] quote 4");
+      EXPECT_EQ(logMsgs[5].find("[warn][category1] consumer stalled for "), 0U);
+      EXPECT_NE(logMsgs[5].find(" ms: 0 messages dropped, 1 messages written in the emergency file"), string::npos);
+      EXPECT_EQ(logMsgs[6], "[info][category1] quote 6");
+   }
+   asyncLogger.LogMessages();
+   //
+   // the other sinks drop their messages
+   policy.m_mode = StallMode::drop;
+   logConfig.SetStallPolicy(policy);
+   std::size_t nbReleases = 0;
+   auto release = [](const void*, std::size_t, void* context) { ++*static_cast<std::size_t*>(context); };
+   logMsgs.clear();
+   {
+      Sink dropSink(asyncLogger, std::make_unique<Queue>(), std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10), common::ThreadGetId());
+      std::this_thread::sleep_for(std::chrono::milliseconds(60));
+      for (int i = 1; i < 5; ++i)
+      {
+         dropSink.Log(cat1, Level::info, now, 0, "drop {}", i);
+      }
+      // the BlobRef of a dropped message is released
+      dropSink.Log(cat1, Level::info, now, 0, "drop {}", BlobRef("abc", 3, release, &nbReleases));
+      EXPECT_EQ(nbReleases, 1U);
+      asyncLogger.LogMessages();
+      dropSink.Log(cat1, Level::info, now, 0, "drop {}", 6);
+      asyncLogger.LogMessages();
+      ASSERT_EQ(logMsgs.size(), 6U);
+      EXPECT_EQ(logMsgs[3], "[info][category1] drop 4");
+      EXPECT_NE(logMsgs[4].find(" ms: 1 messages dropped, 0 messages written in the emergency file"), string::npos);
+      EXPECT_EQ(logMsgs[5], "[info][category1] drop 6");
+   }
+   asyncLogger.LogMessages();
+   // a sink destroyed while the consumer is stalled hands its kept message to the AsyncLogger
+   logMsgs.clear();
+   {
+      Sink sink(asyncLogger, std::make_unique<Queue>(), std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10), common::ThreadGetId());
+      std::this_thread::sleep_for(std::chrono::milliseconds(60));
+      for (int i = 1; i < 5; ++i)
+      {
+         sink.Log(cat1, Level::info, now, 0, "last {}", i);
+      }
+   }
+   asyncLogger.LogMessages();
+   ASSERT_EQ(logMsgs.size(), 4U);
+   EXPECT_EQ(logMsgs[3], "[info][category1] last 4");
+   // emergency files
+   auto readEmergencyFiles = [&outputDir]
+   {
+      std::vector<string> lines;
+      if (DIR* dir = ::opendir(outputDir.c_str()))
+      {
+         while (dirent* entry = ::readdir(dir))
+         {
+            string name = entry->d_name;
+            if (name.find("-emergency-") != string::npos)
+            {
+               std::ifstream file(outputDir + "/" + name);
+               string line;
+               while (std::getline(file, line))
+               {
+                  std::size_t timestampEndPos = line.find(']');
+                  lines.push_back(line.substr(line.find(']', timestampEndPos + 1) + 1));
+               }
+               ::unlink((outputDir + "/" + name).c_str());
+            }
+         }
+         ::closedir(dir);
+      }
+      return lines;
+   };
+   std::vector<string> lines = readEmergencyFiles();
+   std::vector<string> expected = { "[info][category1] quote 5" };
+   EXPECT_EQ(lines, expected);
+   EXPECT_EQ(emergencyMsgs, expected);
+   //
+   // a message with a signal is never dropped: written in the emergency file, then the sink exits (the signal handler waits for it)
+   emergencyMsgs.clear();
+   logMsgs.clear();
+   {
+      StallSinkMock<Sink> sink(asyncLogger, std::make_unique<Queue>(), std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10), common::ThreadGetId());
+      std::this_thread::sleep_for(std::chrono::milliseconds(60));
+      for (int i = 1; i < 5; ++i)
+      {
+         sink.Log(cat1, Level::info, now, 0, "signal {}", i);
+      }
+      EXPECT_CALL(sink, ExitWithDefaultSignalHandler(SIGSEGV)).Times(1);
+      sink.Log(cat1, Level::critical, now, SIGSEGV, "fatal {}", 5);
+   }
+   EXPECT_EQ(asyncLogger.LogMessages(), 0);
+   ASSERT_EQ(emergencyMsgs.size(), 1U);
+   EXPECT_EQ(emergencyMsgs[0], "[critical][category1] fatal 5");
+   // the message kept when the stall is detected: only its format string, the consumer still gets the whole message
+   emergencyMsgs.clear();
+   logMsgs.clear();
+   {
+      StallSinkMock<Sink> sink(asyncLogger, std::make_unique<Queue>(), std::make_unique<Allocator>(Allocator::BufferSizes({ 64 }), 10), common::ThreadGetId());
+      std::this_thread::sleep_for(std::chrono::milliseconds(60));
+      for (int i = 1; i < 4; ++i)
+      {
+         sink.Log(cat1, Level::info, now, 0, "kept {}", i);
+      }
+      EXPECT_CALL(sink, ExitWithDefaultSignalHandler(SIGSEGV)).Times(1);
+      sink.Log(cat1, Level::critical, now, SIGSEGV, "fatal {}", 6);
+   }
+   EXPECT_EQ(asyncLogger.LogMessages(), SIGSEGV);
+   ASSERT_EQ(emergencyMsgs.size(), 1U);
+   EXPECT_EQ(emergencyMsgs[0], "[critical][category1] fatal {}");
+   ASSERT_EQ(logMsgs.size(), 4U);
+   EXPECT_EQ(logMsgs[3], "[critical][category1] fatal 6");
+   // the emergency file of the thread is truncated by each sink
+   expected = { "[critical][category1] fatal {}" };
+   EXPECT_EQ(readEmergencyFiles(), expected);
+}
+
 void TBP_NOINLINE AsyncFunc2(common::SigNum signal)
 {
    raise(signal);
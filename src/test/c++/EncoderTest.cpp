@@ -2,10 +2,17 @@
 #include "tbp/log/DefaultTypes.h"
 #include "tbp/log/Encoder.h"
 #include "tbp/log/BufferAllocator.h"
+#include "tbp/log/MsgFormatter.h"
+#include "tbp/log/StaticString.h"
+#include "tbp/log/Blob.h"
 #include "tbp/tools/spsc/Queue1.h"
 #include "test/UserDefinedLoggable.h"
 #include <gtest/gtest.h>
+#include <array>
+#include <memory>
 #include <string>
+#include <cstring>
+#include <vector>
 
 using tbp::log::test::UserDefinedLoggable;
 using std::string;
@@ -69,6 +76,9 @@ TEST(EncoderTest, DefaultTypeId)
             break;
          case DefaultTypeId::UINT64:
          case DefaultTypeId::INT64:
+         case DefaultTypeId::ARRAY:
+         case DefaultTypeId::STATIC_STRING:
+         case DefaultTypeId::BLOB:
          case DefaultTypeId::NONE:
             {
                assert(false);
@@ -175,7 +185,206 @@ TEST(EncoderTest, MyTypeId)
    EXPECT_EQ(nbFields, 3);
    b.Recycle(allocator);
 }
+TEST(EncoderTest, Containers)
+{
+   std::vector<int> ids = { 3, -1, 42 };
+   std::array<double, 2> prices = { { 1.25, 2.5 } };
+   std::uint64_t raw[] = { 255, 16 };
+   std::vector<std::int64_t> empty;
+   Encoder<DefaultTypeId, Allocator> e;
+   Allocator allocator({ 256 }, 10);
+   Buffer<Allocator> b = e.Encode(allocator, ids, prices, MakeSpan(raw, 2), empty);
+   b.Reset();
+   Decoder<DefaultTypeId, Allocator> d(b);
+   auto p = d.Next();
+   ASSERT_EQ(p.first, DefaultTypeId::ARRAY);
+   ArrayField<DefaultTypeId> field;
+   field.Decode(*p.second);
+   EXPECT_EQ(field.m_typeId, DefaultTypeId::INT);
+   EXPECT_EQ(field.m_size, 3U);
+   EXPECT_EQ(field.m_total, 3U);
+   std::vector<int> decoded;
+   field.ForEach([&decoded](auto v) { decoded.push_back(static_cast<int>(v)); });
+   EXPECT_EQ(decoded, ids);
+   // the format spec of the field is applied to each element
+   b.Reset();
+   MsgFormatter<DefaultTypeId, Allocator> formatter;
+   fmt::MemoryWriter writer;
+   formatter.Format("ids={} prices={:.1f} raw={:x} empty={}", b, writer);
+   EXPECT_EQ(writer.str(), "ids=[3, -1, 42] prices=[1.2, 2.5] raw=[ff, 10] empty=[]");
+   b.Recycle(allocator);
+}
+
+TEST(EncoderTest, MaxArraySize)
+{
+   std::vector<std::uint64_t> big(1000, 7);
+   std::size_t maxSize = GetMaxArraySize();
+   SetMaxArraySize(2);
+   Encoder<DefaultTypeId, Allocator> e;
+   Allocator allocator({ 256 }, 10);
+   Buffer<Allocator> b = e.Encode(allocator, big, std::vector<int>{ 1, 2 });
+   SetMaxArraySize(maxSize);
+   b.Reset();
+   MsgFormatter<DefaultTypeId, Allocator> formatter;
+   fmt::MemoryWriter writer;
+   formatter.Format("{} {}", b, writer);
+   EXPECT_EQ(writer.str(), "[7, 7, ...] [1, 2]");
+   b.Recycle(allocator);
+   // changed between Sizeof and Encode (other thread): the elements encoded still fit in the buffer
+   using VectorType = Type<std::vector<std::uint64_t>, DefaultTypeId, Allocator>;
+   SetMaxArraySize(2);
+   std::size_t size = VectorType::Sizeof(big);
+   SetMaxArraySize(maxSize);
+   Buffer<Allocator> b2(allocator.Alloc(size));
+   const char* begin = b2.Get();
+   VectorType::Encode(b2, big);
+   EXPECT_EQ(static_cast<std::size_t>(b2.Get() - begin), size);
+   b2.Recycle(allocator);
+}
+namespace
+{
+
+const char g_symbol[] = "EURUSD";
+
+}
+
+TEST(EncoderTest, StaticString)
+{
+   Encoder<DefaultTypeId, Allocator> e;
+   Allocator allocator({ 64 }, 10);
+   // only the pointer and the size are encoded
+   using StaticStringType = Type<StaticString, DefaultTypeId, Allocator>;
+   EXPECT_EQ(StaticStringType::Sizeof(StaticString(g_symbol)), sizeof(const char*) + sizeof(std::size_t));
+   Buffer<Allocator> b = e.Encode(allocator, StaticString(g_symbol), StaticString("literal", 3), 1);
+   b.Reset();
+   MsgFormatter<DefaultTypeId, Allocator> formatter;
+   fmt::MemoryWriter writer;
+   formatter.Format("{} {:>5} {}", b, writer);
+   EXPECT_EQ(writer.str(), "EURUSD   lit 1");
+   b.Recycle(allocator);
+}
+
+TEST(EncoderTest, IsStaticAddress)
+{
+   static const std::string label = "label";
+   std::string local = "local";
+   EXPECT_TRUE(IsStaticAddress(g_symbol));
+   EXPECT_TRUE(IsStaticAddress("literal"));
+   EXPECT_TRUE(IsStaticAddress(&label));
+   EXPECT_FALSE(IsStaticAddress(local.data()));
+   std::unique_ptr<char[]> interned(new char[64]);
+   EXPECT_FALSE(IsStaticAddress(interned.get() + 10));
+   RegisterStaticRegion(interned.release(), 64);
+}
+TEST(EncoderTest, Blob)
+{
+   const unsigned char packet[] = { 0x00, 0x1f, 0xa0, 0xff };
+   std::size_t nbReleases = 0;
+   auto release = [](const void* data, std::size_t size, void* context)
+   {
+      EXPECT_EQ(size, 3U);
+      EXPECT_EQ(std::memcmp(data, "foo", 3), 0);
+      ++*static_cast<std::size_t*>(context);
+   };
+   Encoder<DefaultTypeId, Allocator> e;
+   Allocator allocator({ 128 }, 10);
+   Buffer<Allocator> b = e.Encode(allocator, Blob(packet, sizeof(packet)), BlobRef("foo", 3, release, &nbReleases, BlobFormat::base64),
+         Blob("fooba", 5, BlobFormat::base64), Blob("f", 1, BlobFormat::base64), Blob(nullptr, 0));
+   b.Reset();
+   EXPECT_EQ(nbReleases, 0U);
+   MsgFormatter<DefaultTypeId, Allocator> formatter;
+   fmt::MemoryWriter writer;
+   formatter.Format("packet={} ref={} {:x} {} empty=[{}]", b, writer);
+   EXPECT_EQ(writer.str(), "packet=001fa0ff ref=Zm9v Zm9vYmE= Zg== empty=[]");
+   // released by the consumer once formatted
+   EXPECT_EQ(nbReleases, 1U);
+   b.Recycle(allocator);
+   // released by the consumer if the message is not formatted
+   b = e.Encode(allocator, 1, BlobRef("foo", 3, release, &nbReleases));
+   b.Reset();
+   ReleaseFields<DefaultTypeId>(b);
+   EXPECT_EQ(nbReleases, 2U);
+   b.Recycle(allocator);
+   // or if its formatting fails
+   b = e.Encode(allocator, 1, BlobRef("foo", 3, release, &nbReleases));
+   b.Reset();
+   writer.clear();
+   EXPECT_ANY_THROW(formatter.Format("{:q} {}", b, writer));
+   EXPECT_EQ(nbReleases, 3U);
+   b.Recycle(allocator);
+}
 
+TEST(EncoderTest, LargeBlob)
+{
+   std::vector<unsigned char> packet(9000);
+   for (std::size_t i = 0; i < packet.size(); ++i)
+   {
+      packet[i] = static_cast<unsigned char>(i);
+   }
+   Encoder<DefaultTypeId, Allocator> e;
+   Allocator allocator({ 64 }, 10);
+   // by reference: the payload is not copied, the buffer comes from the pool
+   using BlobRefType = Type<BlobRef, DefaultTypeId, Allocator>;
+   EXPECT_LT(BlobRefType::Sizeof(BlobRef(packet.data(), packet.size(), nullptr)), 64U);
+   Buffer<Allocator> b = e.Encode(allocator, BlobRef(packet.data(), packet.size(), nullptr));
+   b.Reset();
+   MsgFormatter<DefaultTypeId, Allocator> formatter;
+   fmt::MemoryWriter writer;
+   formatter.Format("{}", b, writer);
+   ASSERT_EQ(writer.size(), 2 * packet.size());
+   EXPECT_EQ(writer.str().substr(0, 8), "00010203");
+   EXPECT_EQ(writer.str().substr(2 * 255, 6), "ff0001");
+   b.Recycle(allocator);
 }
+
+TEST(EncoderTest, ChainedBuffer)
+{
+   std::string text(150, 'x');
+   std::vector<int> ids(40);
+   unsigned char packet[60];
+   fmt::MemoryWriter expected;
+   expected << text << " [";
+   for (std::size_t i = 0; i < ids.size(); ++i)
+   {
+      ids[i] = static_cast<int>(i);
+      expected << (i ? ", " : "") << i;
+   }
+   expected << "] ";
+   for (std::size_t i = 0; i < sizeof(packet); ++i)
+   {
+      packet[i] = static_cast<unsigned char>(i);
+      expected.write("{:02x}", i);
+   }
+   expected << " 7";
+   Encoder<DefaultTypeId, Allocator> e;
+   Allocator allocator({ 64 }, 10, true);
+   // bigger than the biggest buffer size: encoded in a chain of buffers of 64 bytes, the fields span several segments
+   Buffer<Allocator> b = e.Encode(allocator, text, ids, Blob(packet, sizeof(packet)), 7);
+   b.Reset();
+   MsgFormatter<DefaultTypeId, Allocator> formatter;
+   fmt::MemoryWriter writer;
+   formatter.Format("{} {} {} {}", b, writer);
+   EXPECT_EQ(writer.str(), expected.str());
+   b.Recycle(allocator);
+   // all the segments are back in the pool
+   const std::size_t segmentSize = 64 - sizeof(char*);
+   Allocator::Handle h = allocator.Alloc(10 * segmentSize);
+   EXPECT_EQ(h.GetSegmentSize(), segmentSize);
+   allocator.Free(h);
+   // more segments than the pool holds: malloc
+   h = allocator.Alloc(11 * segmentSize);
+   EXPECT_EQ(h.GetSegmentSize(), 0U);
+   allocator.Free(h);
+   // the pool runs dry in the middle of the chain: malloc, the segments already taken are kept for the next chain
+   Allocator::Handle single = allocator.Alloc(64);
+   h = allocator.Alloc(10 * segmentSize);
+   EXPECT_EQ(h.GetSegmentSize(), 0U);
+   allocator.Free(h);
+   allocator.Free(single);
+   h = allocator.Alloc(10 * segmentSize);
+   EXPECT_EQ(h.GetSegmentSize(), segmentSize);
+   allocator.Free(h);
 }
 
+}
+}
@@ -0,0 +1,200 @@
+#include "tbp/log/FileWriter.h"
+#include "tbp/log/FileIndex.h"
+#include "tbp/log/WriterStage.h"
+#include "tbp/log/Category.h"
+#include "tbp/log/Config.h"
+#include "tbp/tools/Config.h"
+#include "test/Context.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <sys/stat.h>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+// 2024-01-01 10:00:00 UTC + 'millis'
+timespec GetTime(std::size_t millis)
+{
+   timespec time;
+   time.tv_sec = 1704103200 + millis / 1000;
+   time.tv_nsec = millis % 1000 * 1000000;
+   return time;
+}
+
+std::uint64_t GetNanos(std::size_t millis)
+{
+   timespec time = GetTime(millis);
+   return static_cast<std::uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+void WriteLine(FileWriter& fileWriter, const Category& category, std::size_t millis)
+{
+   fileWriter.WriteHeader(GetTime(millis), 1, Level::info, category);
+   fileWriter.GetWriter().write("line {}", millis);
+   fileWriter.WriteToFile();
+}
+
+std::string ReadFile(const std::string& path)
+{
+   std::ifstream file(path);
+   return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// the blocks are contiguous, start with a line header and end at the end of the file
+void CheckBlocks(const std::string& path)
+{
+   std::string content = ReadFile(path);
+   FileIndexReader reader(path);
+   std::uint64_t offset = 0;
+   for (const auto& block : reader.GetBlocks())
+   {
+      EXPECT_EQ(block.m_offset, offset);
+      ASSERT_LT(block.m_offset, content.size());
+      EXPECT_EQ(content[block.m_offset], '[');
+      offset += block.m_size;
+   }
+   EXPECT_EQ(offset, content.size());
+}
+
+}
+
+TEST(FileIndexTest, Lines)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   Category category1("category1", Level::info);
+   Category category2("category2", Level::info);
+   log::Config logConfig(config.GetOutputDir(), "indexLines");
+   IndexPolicy policy;
+   policy.m_lines = 100;
+   logConfig.SetIndexPolicy(policy);
+   std::string path;
+   {
+      FileWriter fileWriter(logConfig, "index");
+      path = fileWriter.GetPath();
+      // category1 in the first half of the file, category2 in the second half
+      for (std::size_t i = 0; i < 1000; ++i)
+      {
+         WriteLine(fileWriter, i < 500 ? category1 : category2, i);
+      }
+   }
+   CheckBlocks(path);
+   FileIndexReader reader(path);
+   const auto& blocks = reader.GetBlocks();
+   ASSERT_EQ(blocks.size(), 10U);
+   ASSERT_EQ(reader.GetCategories(), (std::vector<std::string>{ "category1", "category2" }));
+   for (std::size_t i = 0; i < blocks.size(); ++i)
+   {
+      EXPECT_EQ(blocks[i].m_nbLines, 100U);
+      EXPECT_EQ(blocks[i].m_firstTime, GetNanos(i * 100));
+      EXPECT_EQ(blocks[i].m_lastTime, GetNanos(i * 100 + 99));
+      ASSERT_EQ(blocks[i].m_counts.size(), 1U);
+      EXPECT_EQ(blocks[i].m_counts[0], std::make_pair(i < 5 ? 0U : 1U, 100U));
+   }
+   // blocks 2 and 3
+   auto ranges = reader.Find(GetNanos(250), GetNanos(349));
+   ASSERT_EQ(ranges.size(), 1U);
+   EXPECT_EQ(ranges[0].m_offset, blocks[2].m_offset);
+   EXPECT_EQ(ranges[0].m_size, blocks[2].m_size + blocks[3].m_size);
+   // the blocks without category2 are skipped
+   ranges = reader.Find(GetNanos(0), GetNanos(999), { "category2" });
+   ASSERT_EQ(ranges.size(), 1U);
+   EXPECT_EQ(ranges[0].m_offset, blocks[5].m_offset);
+   EXPECT_TRUE(reader.Find(GetNanos(0), GetNanos(499), { "category2" }).empty());
+   // the lines are filtered in the blocks
+   std::ostringstream out;
+   EXPECT_EQ(reader.Query(GetNanos(495), GetNanos(504), { "category2" }, out), 5U);
+   std::string lines = out.str();
+   EXPECT_EQ(std::count(lines.begin(), lines.end(), '\n'), 5);
+   EXPECT_NE(lines.find("line 500\n"), std::string::npos);
+   EXPECT_NE(lines.find("line 504\n"), std::string::npos);
+}
+
+TEST(FileIndexTest, Interval)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   Category category("category", Level::info);
+   log::Config logConfig(config.GetOutputDir(), "indexInterval");
+   IndexPolicy policy;
+   policy.m_interval = std::chrono::milliseconds(10);
+   logConfig.SetIndexPolicy(policy);
+   std::string path;
+   {
+      FileWriter fileWriter(logConfig, "index");
+      path = fileWriter.GetPath();
+      for (std::size_t i = 0; i < 95; ++i)
+      {
+         WriteLine(fileWriter, category, i);
+      }
+      // the closed blocks are written by Flush(), not the block being filled
+      fileWriter.Flush();
+      EXPECT_EQ(FileIndexReader(path).GetBlocks().size(), 9U);
+      // the end of the file is not indexed yet
+      std::ostringstream out;
+      EXPECT_EQ(FileIndexReader(path).Query(GetNanos(92), GetNanos(200), {}, out), 3U);
+   }
+   CheckBlocks(path);
+   FileIndexReader reader(path);
+   ASSERT_EQ(reader.GetBlocks().size(), 10U);
+   EXPECT_EQ(reader.GetBlocks()[0].m_nbLines, 10U);
+   EXPECT_EQ(reader.GetBlocks()[9].m_nbLines, 5U);
+}
+
+TEST(FileIndexTest, WriterStageAndRotation)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   Category category("category", Level::info);
+   log::Config logConfig(config.GetOutputDir(), "indexRotation");
+   IndexPolicy indexPolicy;
+   indexPolicy.m_lines = 64;
+   logConfig.SetIndexPolicy(indexPolicy);
+   RotationPolicy rotationPolicy;
+   rotationPolicy.m_maxSize = 16 * 1024;
+   logConfig.SetRotationPolicy(rotationPolicy);
+   std::string basePath;
+   std::size_t nbLines = 0;
+   {
+      WriterStage stage;
+      FileWriter fileWriter(logConfig, "index");
+      fileWriter.SetWriterStage(stage, 1024);
+      basePath = fileWriter.GetPath().substr(0, fileWriter.GetPath().size() - 4);
+      for (std::size_t i = 0; i < 2000; ++i)
+      {
+         WriteLine(fileWriter, category, i);
+      }
+      fileWriter.Flush();
+      fileWriter.Wait();
+   }
+   for (std::size_t index = 0;; ++index)
+   {
+      std::string path = index ? basePath + "." + std::to_string(index) + ".log" : basePath + ".log";
+      struct stat st;
+      if (stat(path.c_str(), &st) != 0)
+      {
+         EXPECT_GT(index, 2U);
+         break;
+      }
+      CheckBlocks(path);
+      FileIndexReader reader(path);
+      for (const auto& block : reader.GetBlocks())
+      {
+         nbLines += block.m_nbLines;
+      }
+   }
+   EXPECT_EQ(nbLines, 2000U);
+}
+
+}
+}
@@ -0,0 +1,187 @@
+#include "tbp/log/FileWriter.h"
+#include "tbp/log/FileRotation.h"
+#include "tbp/log/Category.h"
+#include "tbp/log/Config.h"
+#include "tbp/tools/Config.h"
+#include "test/Context.h"
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+void WriteLine(FileWriter& fileWriter, const Category& category, std::size_t i)
+{
+   timespec now;
+   clock_gettime(CLOCK_REALTIME, &now);
+   fileWriter.WriteHeader(now, 1, Level::info, category);
+   fileWriter.GetWriter().write("line {}", i);
+   fileWriter.WriteToFile();
+   fileWriter.FlushIfNeeded(Level::info);
+}
+
+std::vector<std::string> ReadLines(const std::string& path)
+{
+   std::vector<std::string> lines;
+   std::ifstream file(path);
+   std::string line;
+   while (std::getline(file, line))
+   {
+      lines.push_back(line);
+   }
+   return lines;
+}
+
+bool Exists(const std::string& path)
+{
+   struct stat st;
+   return stat(path.c_str(), &st) == 0;
+}
+
+}
+
+TEST(FileRotationTest, BySize)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   Category category("category", Level::info);
+   log::Config logConfig(config.GetOutputDir(), "rotationSize");
+   RotationPolicy policy;
+   policy.m_maxSize = 1000;
+   logConfig.SetRotationPolicy(policy);
+   //
+   std::vector<std::string> paths;
+   {
+      FileWriter fileWriter(logConfig, "size");
+      paths.push_back(fileWriter.GetPath());
+      for (std::size_t i = 0; i < 200; ++i)
+      {
+         WriteLine(fileWriter, category, i);
+         if (fileWriter.GetPath() != paths.back())
+         {
+            paths.push_back(fileWriter.GetPath());
+         }
+      }
+   }
+   ASSERT_GT(paths.size(), 5U);
+   const std::string base = paths[0].substr(0, paths[0].size() - 4);
+   std::size_t i = 0;
+   for (std::size_t index = 0; index < paths.size(); ++index)
+   {
+      EXPECT_EQ(paths[index], index ? base + "." + std::to_string(index) + ".log" : paths[0]);
+      auto lines = ReadLines(paths[index]);
+      std::size_t size = 0;
+      for (const auto& line : lines)
+      {
+         EXPECT_NE(line.find("line " + std::to_string(i++)), std::string::npos) << line;
+         size += line.size() + 1;
+      }
+      EXPECT_LT(size, policy.m_maxSize + 100);
+      if (index + 1 < paths.size())
+      {
+         EXPECT_GE(size, policy.m_maxSize);
+      }
+   }
+   EXPECT_EQ(i, 200U);
+   // the prepared file not used is removed
+   EXPECT_FALSE(Exists(base + "." + std::to_string(paths.size()) + ".log"));
+}
+
+TEST(FileRotationTest, Background)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   Category category("category", Level::info);
+   log::Config logConfig(config.GetOutputDir(), "rotationBackground");
+   FileOpener opener;
+   RotationPolicy policy;
+   policy.m_maxSize = 1000;
+   policy.m_preallocate = 1024 * 1024;
+   policy.m_opener = &opener;
+   logConfig.SetRotationPolicy(policy);
+   //
+   std::vector<std::string> paths;
+   {
+      FileWriter fileWriter(logConfig, "background");
+      paths.push_back(fileWriter.GetPath());
+      // a file is rotated only once the next one is ready
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      for (std::size_t i = 0; i < 200; ++i)
+      {
+         WriteLine(fileWriter, category, i);
+         if (fileWriter.GetPath() != paths.back())
+         {
+            paths.push_back(fileWriter.GetPath());
+            // the next file is pre-allocated by the FileOpener
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            struct stat st;
+            std::string next = paths[0].substr(0, paths[0].size() - 4) + "." + std::to_string(paths.size()) + ".log";
+            ASSERT_EQ(stat(next.c_str(), &st), 0);
+            EXPECT_EQ(st.st_size, 0);
+            EXPECT_GE(static_cast<std::size_t>(st.st_blocks) * 512, policy.m_preallocate);
+         }
+      }
+   }
+   // the rotated files are closed (flushed) by the FileOpener
+   opener.Wait();
+   ASSERT_GT(paths.size(), 5U);
+   std::size_t i = 0;
+   for (const auto& path : paths)
+   {
+      for (const auto& line : ReadLines(path))
+      {
+         EXPECT_NE(line.find("line " + std::to_string(i++)), std::string::npos) << line;
+      }
+   }
+   EXPECT_EQ(i, 200U);
+}
+
+TEST(FileRotationTest, ByTime)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   Category category("category", Level::info);
+   log::Config logConfig(config.GetOutputDir(), "rotationTime");
+   FileOpener opener;
+   RotationPolicy policy;
+   policy.m_period = std::chrono::seconds(1);
+   policy.m_opener = &opener;
+   logConfig.SetRotationPolicy(policy);
+   //
+   std::string first;
+   std::string second;
+   {
+      FileWriter fileWriter(logConfig, "time");
+      first = fileWriter.GetPath();
+      WriteLine(fileWriter, category, 0);
+      // the coarse clock can be late by a few milliseconds
+      std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+      // the first line past the boundary is written in the new file
+      WriteLine(fileWriter, category, 1);
+      second = fileWriter.GetPath();
+      WriteLine(fileWriter, category, 2);
+   }
+   opener.Wait();
+   EXPECT_NE(first, second);
+   auto lines = ReadLines(first);
+   ASSERT_EQ(lines.size(), 1U);
+   EXPECT_NE(lines[0].find("line 0"), std::string::npos);
+   lines = ReadLines(second);
+   ASSERT_EQ(lines.size(), 2U);
+   EXPECT_NE(lines[0].find("line 1"), std::string::npos);
+   EXPECT_NE(lines[1].find("line 2"), std::string::npos);
+}
+
+}
+}
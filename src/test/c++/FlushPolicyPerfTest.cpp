@@ -0,0 +1,184 @@
+#include "tbp/log/FileWriter.h"
+#include "tbp/log/FlushPolicy.h"
+#include "tbp/log/Category.h"
+#include "tbp/log/Config.h"
+#include "tbp/tools/Config.h"
+#include "test/Context.h"
+#include "test/Time.h"
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <cstdint>
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+off_t GetFileSize(const FileWriter& fileWriter)
+{
+   struct stat st;
+   return stat(fileWriter.GetPath().c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+// number of write system calls of the process (the other threads of the test do not log)
+std::uint64_t GetNbWrites()
+{
+   std::ifstream io("/proc/self/io");
+   std::string key;
+   std::uint64_t value = 0;
+   while (io >> key >> value)
+   {
+      if (key == "syscw:")
+      {
+         return value;
+      }
+   }
+   return 0;
+}
+
+// same message pattern for each policy: 1 error every 100 messages, a LogMessages() pass every 64 messages
+void WriteMessages(FileWriter& fileWriter, const Category& category, std::size_t nbMsgs)
+{
+   timespec now;
+   clock_gettime(CLOCK_REALTIME, &now);
+   for (std::size_t i = 0; i < nbMsgs; ++i)
+   {
+      Level level = i % 100 == 99 ? Level::error : Level::info;
+      fileWriter.WriteHeader(now, 1, level, category);
+      fileWriter.GetWriter().write("order id {} price {} quantity {}", i, 100.25, 300);
+      fileWriter.WriteToFile();
+      fileWriter.FlushIfNeeded(level);
+      if (i % 64 == 63)
+      {
+         fileWriter.FlushAfterDrain();
+      }
+   }
+   fileWriter.FlushAfterDrain();
+}
+
+}
+
+TEST(FlushPolicyPerfTest, Policies)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   Category category("category", Level::info);
+   timespec now;
+   clock_gettime(CLOCK_REALTIME, &now);
+   log::Config logConfig(config.GetOutputDir(), "flush");
+   logConfig.SetFlushPolicy("level", FlushPolicy::OnLevel(Level::error));
+   logConfig.SetFlushPolicy("bytes", FlushPolicy::EveryBytes(200));
+   logConfig.SetFlushPolicy("time", FlushPolicy::Every(std::chrono::milliseconds(20)));
+   logConfig.SetFlushPolicy("never", FlushPolicy::Never());
+   {
+      FileWriter fileWriter(logConfig, "level");
+      fileWriter.WriteHeader(now, 1, Level::info, category);
+      fileWriter.WriteToFile();
+      fileWriter.FlushIfNeeded(Level::info);
+      fileWriter.FlushAfterDrain();
+      EXPECT_EQ(GetFileSize(fileWriter), 0);
+      fileWriter.WriteHeader(now, 1, Level::error, category);
+      fileWriter.WriteToFile();
+      fileWriter.FlushIfNeeded(Level::error);
+      EXPECT_GT(GetFileSize(fileWriter), 0);
+   }
+   {
+      FileWriter fileWriter(logConfig, "bytes");
+      off_t size = 0;
+      while (size == 0)
+      {
+         fileWriter.WriteHeader(now, 1, Level::info, category);
+         fileWriter.WriteToFile();
+         fileWriter.FlushIfNeeded(Level::info);
+         size = GetFileSize(fileWriter);
+      }
+      EXPECT_GE(size, 200);
+      EXPECT_LT(size, 300);
+   }
+   {
+      FileWriter fileWriter(logConfig, "time");
+      fileWriter.WriteHeader(now, 1, Level::info, category);
+      fileWriter.WriteToFile();
+      fileWriter.FlushAfterDrain();
+      EXPECT_EQ(GetFileSize(fileWriter), 0);
+      std::this_thread::sleep_for(std::chrono::milliseconds(40));
+      fileWriter.FlushAfterDrain();
+      EXPECT_GT(GetFileSize(fileWriter), 0);
+   }
+   {
+      FileWriter fileWriter(logConfig, "never");
+      fileWriter.WriteHeader(now, 1, Level::critical, category);
+      fileWriter.WriteToFile();
+      fileWriter.FlushIfNeeded(Level::critical);
+      fileWriter.FlushAfterDrain();
+      EXPECT_EQ(GetFileSize(fileWriter), 0);
+   }
+   {
+      // default policy: flush after each pass
+      FileWriter fileWriter(logConfig, "drain");
+      fileWriter.WriteHeader(now, 1, Level::info, category);
+      fileWriter.WriteToFile();
+      fileWriter.FlushIfNeeded(Level::info);
+      EXPECT_EQ(GetFileSize(fileWriter), 0);
+      fileWriter.FlushAfterDrain();
+      EXPECT_GT(GetFileSize(fileWriter), 0);
+   }
+}
+
+TEST(FlushPolicyPerfTest, SyscallsPerMessage)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   Category category("category", Level::info);
+   GroupCommit groupCommit;
+   FlushPolicy syncedBytes = FlushPolicy::EveryBytes(64 * 1024);
+   syncedBytes.m_groupCommit = &groupCommit;
+   FlushPolicy syncedLevel = FlushPolicy::OnLevel(Level::error);
+   syncedLevel.m_groupCommit = &groupCommit;
+   const std::pair<const char*, FlushPolicy> policies[] =
+   {
+      { "drain", FlushPolicy::Drain() },
+      { "bytes-4K", FlushPolicy::EveryBytes(4 * 1024) },
+      { "bytes-64K", FlushPolicy::EveryBytes(64 * 1024) },
+      { "time-1ms", FlushPolicy::Every(std::chrono::milliseconds(1)) },
+      { "level-error", FlushPolicy::OnLevel(Level::error) },
+      { "never", FlushPolicy::Never() },
+      { "bytes-64K-sync", syncedBytes },
+      { "level-error-sync", syncedLevel },
+   };
+   const std::size_t nbMsgs = 100000;
+   log::Config logConfig(config.GetOutputDir(), "flushPerf");
+   for (const auto& policy : policies)
+   {
+      logConfig.SetFlushPolicy(policy.first, policy.second);
+      std::uint64_t nbSyncs = groupCommit.GetNbSyncs();
+      std::uint64_t nbWrites = 0;
+      std::chrono::nanoseconds nanos;
+      {
+         FileWriter fileWriter(logConfig, policy.first);
+         nbWrites = GetNbWrites();
+         auto start = test::Now();
+         WriteMessages(fileWriter, category, nbMsgs);
+         nanos = test::Now() - start;
+         nbWrites = GetNbWrites() - nbWrites;
+         fileWriter.Wait();
+      }
+      nbSyncs = groupCommit.GetNbSyncs() - nbSyncs;
+      std::cout << std::left << std::setw(18) << policy.first
+            << " writes per msg: " << std::setw(10) << static_cast<double>(nbWrites) / nbMsgs
+            << " fdatasyncs per msg: " << std::setw(10) << static_cast<double>(nbSyncs) / nbMsgs
+            << " nanos per msg: " << static_cast<double>(nanos.count()) / nbMsgs << std::endl;
+   }
+   EXPECT_EQ(groupCommit.GetNbErrors(), 0U);
+}
+
+}
+}
@@ -0,0 +1,100 @@
+#include "tbp/log/LogFile.h"
+#include "tbp/log/FileWriter.h"
+#include "tbp/log/Injector.h"
+#include "tbp/log/Config.h"
+#include "tbp/tools/Config.h"
+#include "test/Context.h"
+#include <gtest/gtest.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+std::string ReadFile(const std::string& path)
+{
+   std::ifstream file(path);
+   return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// lines of different sizes, flushed at random points: partial blocks and full buffers
+void CheckBackend(FileBackend backend, const char* name)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   log::Config logConfig(config.GetOutputDir(), "backend");
+   Injector injector(backend);
+   std::string expected;
+   std::string path;
+   {
+      auto fileWriter = injector.CreateSharedFileWriter(logConfig, name);
+      path = fileWriter->GetPath();
+      for (std::size_t i = 0; i < 20000; ++i)
+      {
+         auto& writer = fileWriter->GetWriter();
+         writer.write("line {} {}", i, std::string(i % 300, 'x'));
+         expected.append(writer.data(), writer.size());
+         expected += '\n';
+         fileWriter->WriteToFile();
+         if (i % 997 == 0)
+         {
+            fileWriter->Flush();
+            // the lines are in the file after a flush, followed by the padding of the last block with O_DIRECT (until the file is closed)
+            std::string content = ReadFile(path);
+            ASSERT_EQ(content.substr(0, expected.size()), expected);
+            ASSERT_LT(content.size(), expected.size() + RawFileBuf::ALIGN);
+            ASSERT_EQ(content.find_first_not_of('\0', expected.size()), std::string::npos);
+         }
+      }
+   }
+   EXPECT_EQ(ReadFile(path), expected);
+}
+
+}
+
+TEST(LogFileTest, Direct)
+{
+   CheckBackend(FileBackend::direct, "direct");
+}
+
+TEST(LogFileTest, DontNeed)
+{
+   CheckBackend(FileBackend::dontneed, "dontneed");
+}
+
+TEST(LogFileTest, Stream)
+{
+   CheckBackend(FileBackend::stream, "stream");
+}
+
+TEST(LogFileTest, Swap)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   const std::string path1 = config.GetOutputDir() + "/backend_swap1.log";
+   const std::string path2 = config.GetOutputDir() + "/backend_swap2.log";
+   {
+      LogFile file1;
+      LogFile file2;
+      ASSERT_TRUE(file1.Open(path1, FileBackend::direct));
+      ASSERT_TRUE(file2.Open(path2, FileBackend::stream));
+      file1.Write("a", 1);
+      file1.Swap(file2);
+      // the streambuf of each file follows its stream
+      file1.Write("b", 1);
+      file2.Write("c", 1);
+      file1.Close();
+      file2.Close();
+   }
+   EXPECT_EQ(ReadFile(path1), "ac");
+   EXPECT_EQ(ReadFile(path2), "b");
+}
+
+}
+}
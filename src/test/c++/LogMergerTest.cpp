@@ -0,0 +1,140 @@
+#include "tbp/log/LogMerger.h"
+#include "tbp/tools/Config.h"
+#include "test/Context.h"
+#include <gtest/gtest.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+std::string ReadFile(const std::string& path)
+{
+   std::ifstream file(path);
+   return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void WriteFile(const std::string& path, const std::string& content)
+{
+   std::ofstream file(path, std::ios::trunc);
+   file << content;
+}
+
+bool Parse(const std::string& line, std::uint64_t& nanos)
+{
+   return LogMerger::ParseTime(line.data(), line.size(), nanos);
+}
+
+}
+
+TEST(LogMergerTest, ParseTime)
+{
+   std::uint64_t nanos = 0;
+   ASSERT_TRUE(Parse("[12:34:56.123456789][1][info][cat] msg", nanos));
+   EXPECT_EQ(nanos, ((12 * 60 + 34) * 60 + 56) * 1000000000ULL + 123456789);
+   ASSERT_TRUE(Parse("[00:00:00.000000000]", nanos));
+   EXPECT_EQ(nanos, 0U);
+   ASSERT_TRUE(Parse("[23:59:59.999999999]\n", nanos));
+   EXPECT_EQ(nanos, 86400 * 1000000000ULL - 1);
+   EXPECT_FALSE(Parse("[12:34:56.12345678]", nanos));
+   EXPECT_FALSE(Parse("[12:34:56.12345678x] msg", nanos));
+   EXPECT_FALSE(Parse("[12-34:56.123456789] msg", nanos));
+   EXPECT_FALSE(Parse("[12:34:56,123456789] msg", nanos));
+   EXPECT_FALSE(Parse("(12:34:56.123456789) msg", nanos));
+   EXPECT_FALSE(Parse("[24:00:00.000000000] msg", nanos));
+   EXPECT_FALSE(Parse("[12:60:00.000000000] msg", nanos));
+   EXPECT_FALSE(Parse("[12:00:60.000000000] msg", nanos));
+   EXPECT_FALSE(Parse("   second line of a message", nanos));
+}
+
+TEST(LogMergerTest, Merge)
+{
+   auto& context = test::Context::Get();
+   const std::string dir = context.GetToolsConfig().GetOutputDir() + "/";
+   // thread 1 crosses midnight and its file is rotated, thread 2 starts after midnight
+   const std::string a = dir + "merge_20240101-235950-1.log";
+   const std::string a1 = dir + "merge_20240101-235950-1.1.log";
+   const std::string b = dir + "merge_20240102-000000-2.log";
+   const std::string c = dir + "merge_20240101-235959-3.log";
+   WriteFile(a,
+         "[23:59:58.000000001][1] a1\n"
+         "[23:59:59.500000000][1] a2\n"
+         "   second line of a2\n"
+         "[00:00:00.200000000][1] a3\n"
+         "[00:00:01.000000000][1] a4\n");
+   WriteFile(a1,
+         "[00:00:03.000000000][1] a5"); // no new line at the end of the file
+   WriteFile(b,
+         "[00:00:00.100000000][2] b1\n"
+         "[00:00:01.000000000][2] b2\n"
+         "[00:00:02.000000000][2] b3\n");
+   WriteFile(c,
+         "[23:59:59.500000000][3] c1\n"
+         "[00:00:02.500000000][3] c2\n");
+   const std::string expected =
+         "[23:59:58.000000001][1] a1\n"
+         "[23:59:59.500000000][1] a2\n"
+         "   second line of a2\n"
+         "[23:59:59.500000000][3] c1\n"
+         "[00:00:00.100000000][2] b1\n"
+         "[00:00:00.200000000][1] a3\n"
+         "[00:00:01.000000000][1] a4\n"
+         "[00:00:01.000000000][2] b2\n"
+         "[00:00:02.000000000][2] b3\n"
+         "[00:00:02.500000000][3] c2\n"
+         "[00:00:03.000000000][1] a5\n";
+   for (std::size_t nbThreads : { 1, 3 })
+   {
+      const std::string output = dir + "merge_" + std::to_string(nbThreads) + ".out";
+      LogMerger merger(nbThreads);
+      // the rotated file is read after the file it follows whatever the order of the arguments
+      EXPECT_EQ(merger.Merge({ a1, a, b, c }, output), 10U);
+      EXPECT_EQ(ReadFile(output), expected) << nbThreads;
+   }
+}
+
+TEST(LogMergerTest, ManyRecords)
+{
+   auto& context = test::Context::Get();
+   const std::string dir = context.GetToolsConfig().GetOutputDir() + "/";
+   const std::size_t nbFiles = 8;
+   const std::size_t nbLines = 20000;
+   std::vector<std::string> inputs;
+   for (std::size_t f = 0; f < nbFiles; ++f)
+   {
+      inputs.push_back(dir + "mergeMany_20240101-100000-" + std::to_string(f) + ".log");
+      std::ofstream file(inputs.back(), std::ios::trunc);
+      for (std::size_t i = 0; i < nbLines; ++i)
+      {
+         // line i of file f at 10:00:00 + (i * nbFiles + f) microseconds
+         std::uint64_t micros = i * nbFiles + f;
+         char header[64];
+         snprintf(header, sizeof(header), "[10:%02u:%02u.%09u][%u] %u\n", static_cast<unsigned>(micros / 60000000),
+               static_cast<unsigned>(micros / 1000000 % 60), static_cast<unsigned>(micros % 1000000 * 1000), static_cast<unsigned>(f),
+               static_cast<unsigned>(micros));
+         file << header;
+      }
+   }
+   const std::string output = dir + "mergeMany.out";
+   LogMerger merger(4);
+   EXPECT_EQ(merger.Merge(inputs, output), nbFiles * nbLines);
+   std::ifstream file(output);
+   std::string line;
+   std::size_t expected = 0;
+   while (std::getline(file, line))
+   {
+      ASSERT_EQ(line.substr(line.rfind(' ') + 1), std::to_string(expected)) << line;
+      ++expected;
+   }
+   EXPECT_EQ(expected, nbFiles * nbLines);
+}
+
+}
+}
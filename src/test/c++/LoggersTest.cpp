@@ -0,0 +1,147 @@
+#include "tbp/log/Loggers.h"
+#include "tbp/log/Epoch.h"
+#include "tbp/log/ILogger.h"
+#include "tbp/log/Categories.h"
+#include "tbp/log/Config.h"
+#include "tbp/log/Injector.h"
+#include "tbp/common/ConfigurationException.h"
+#include "tbp/tools/ScopedThread.h"
+#include "tbp/tools/Config.h"
+#include "test/Context.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+
+using std::string;
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+class TestLogger : public ILogger
+{
+public:
+   TestLogger(string name, std::size_t nbCategories) : m_name(std::move(name)), m_tid(common::ThreadGetId()), m_levels(nbCategories)
+   {
+      for (auto& level : m_levels)
+      {
+         level.store(Level::none);
+      }
+   }
+   //
+   virtual const string& GetName() const override { return m_name; }
+   virtual common::ThreadId GetThreadId() const override { return m_tid; }
+   virtual void SetLevel(CategoryId id, Level level) override { m_levels[id - 1].store(level); }
+   Level GetLevel(CategoryId id) const { return m_levels[id - 1].load(); }
+
+private:
+   string m_name;
+   common::ThreadId m_tid;
+   std::vector<std::atomic<Level>> m_levels;
+
+};
+
+}
+
+TEST(LoggersTest, DuplicateName)
+{
+   const auto& config = test::Context::Get().GetToolsConfig();
+   Categories categories;
+   categories.AddCategory(Category("category1", Level::info));
+   Injector injector;
+   Loggers loggers(categories, log::Config(config.GetOutputDir(), "LoggersTest"), injector);
+   //
+   TestLogger logger1("logger", categories.GetSize());
+   TestLogger logger2("logger", categories.GetSize());
+   loggers.AddLogger(logger1);
+   EXPECT_THROW(loggers.AddLogger(logger2), common::ConfigurationException);
+   EXPECT_EQ(loggers.RemoveLogger(logger1), true);
+   loggers.AddLogger(logger2);
+   EXPECT_EQ(loggers.RemoveLogger(logger2), true);
+}
+
+TEST(LoggersTest, Churn)
+{
+   const auto& config = test::Context::Get().GetToolsConfig();
+   Categories categories;
+   Category category("category1", Level::info);
+   CategoryId catId = categories.AddCategory(category);
+   Injector injector;
+   Loggers loggers(categories, log::Config(config.GetOutputDir(), "LoggersTest"), injector);
+   //
+   std::atomic<bool> done(false);
+   std::atomic<std::size_t> nbErrors(0);
+   std::vector<tools::ScopedThread> threads;
+   for (std::size_t i = 0; i < 4; ++i)
+   {
+      threads.emplace_back(std::thread([i, &loggers, &categories, &done, &nbErrors, catId]
+      {
+         std::size_t count = 0;
+         while (!done.load() || count < 100)
+         {
+            TestLogger logger("logger_" + std::to_string(i) + "_" + std::to_string(count++), categories.GetSize());
+            loggers.AddLogger(logger);
+            if (logger.GetLevel(catId) == Level::none)
+            {
+               nbErrors.fetch_add(1);
+            }
+            loggers.RemoveLogger(logger);
+         }
+      }));
+   }
+   TestLogger logger("logger", categories.GetSize());
+   loggers.AddLogger(logger);
+   for (std::size_t i = 0; i < 100; ++i)
+   {
+      loggers.SetLevel(category, i % 2 ? Level::debug : Level::error);
+   }
+   EXPECT_EQ(logger.GetLevel(catId), Level::debug);
+   done.store(true);
+   threads.clear();
+   EXPECT_EQ(nbErrors.load(), 0U);
+   loggers.RemoveLogger(logger);
+}
+
+// concurrent Synchronize() calls must not starve under continuous readers
+TEST(LoggersTest, EpochSynchronize)
+{
+   Epoch epoch;
+   std::atomic<bool> done(false);
+   std::atomic<std::size_t> nbSynchronized(0);
+   std::vector<tools::ScopedThread> readers;
+   for (std::size_t i = 0; i < 2; ++i)
+   {
+      readers.emplace_back(std::thread([&epoch, &done]
+      {
+         while (!done.load())
+         {
+            EpochGuard guard(epoch);
+         }
+      }));
+   }
+   std::vector<tools::ScopedThread> writers;
+   for (std::size_t i = 0; i < 4; ++i)
+   {
+      writers.emplace_back(std::thread([&epoch, &nbSynchronized]
+      {
+         for (std::size_t count = 0; count < 1000; ++count)
+         {
+            epoch.Synchronize();
+            nbSynchronized.fetch_add(1);
+         }
+      }));
+   }
+   writers.clear();
+   done.store(true);
+   readers.clear();
+   EXPECT_EQ(nbSynchronized.load(), 4000U);
+}
+
+}
+}
@@ -0,0 +1,147 @@
+#include "tbp/log/NumberWriter.h"
+#include "test/Time.h"
+#include <gtest/gtest.h>
+#include <cppformat/format.h>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+
+using std::string;
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+template <typename T>
+string ToString(T v)
+{
+   fmt::MemoryWriter writer;
+   WriteDefault(writer, v);
+   return string(writer.data(), writer.size());
+}
+
+// market-data-like mix: prices with a few decimals, quantities, timestamps and a few ratios
+struct Numbers
+{
+   std::vector<double> m_prices;
+   std::vector<int> m_quantities;
+   std::vector<std::uint64_t> m_timestamps;
+   std::vector<double> m_ratios;
+};
+
+Numbers MakeNumbers(std::size_t size)
+{
+   std::mt19937_64 gen(42);
+   std::uniform_int_distribution<int> ticks(1, 2000000);
+   std::uniform_int_distribution<int> quantities(1, 100000);
+   std::uniform_real_distribution<double> ratios(0., 1.);
+   Numbers numbers;
+   std::uint64_t timestamp = 1500000000000000000ULL;
+   for (std::size_t i = 0; i < size; ++i)
+   {
+      numbers.m_prices.push_back(ticks(gen) / 100.);
+      numbers.m_quantities.push_back(quantities(gen));
+      timestamp += quantities(gen);
+      numbers.m_timestamps.push_back(timestamp);
+      numbers.m_ratios.push_back(ratios(gen));
+   }
+   return numbers;
+}
+
+template <typename FUNC>
+double Measure(const Numbers& numbers, FUNC func)
+{
+   fmt::MemoryWriter writer;
+   auto start = test::Now();
+   for (std::size_t i = 0; i < numbers.m_prices.size(); ++i)
+   {
+      func(writer, numbers.m_prices[i]);
+      func(writer, numbers.m_quantities[i]);
+      func(writer, numbers.m_timestamps[i]);
+      func(writer, numbers.m_prices[i]);
+      func(writer, numbers.m_quantities[i]);
+      if (i % 8 == 0)
+      {
+         func(writer, numbers.m_ratios[i]);
+      }
+      writer.clear();
+   }
+   auto nanos = test::Now() - start;
+   return static_cast<double>(nanos.count()) / numbers.m_prices.size();
+}
+
+}
+
+TEST(NumberWriterPerfTest, Integers)
+{
+   EXPECT_EQ(ToString(0), "0");
+   EXPECT_EQ(ToString(9), "9");
+   EXPECT_EQ(ToString(10), "10");
+   EXPECT_EQ(ToString(-99), "-99");
+   EXPECT_EQ(ToString(100), "100");
+   EXPECT_EQ(ToString(std::numeric_limits<int>::min()), std::to_string(std::numeric_limits<int>::min()));
+   EXPECT_EQ(ToString(std::numeric_limits<std::int64_t>::min()), std::to_string(std::numeric_limits<std::int64_t>::min()));
+   EXPECT_EQ(ToString(std::numeric_limits<std::int64_t>::max()), std::to_string(std::numeric_limits<std::int64_t>::max()));
+   EXPECT_EQ(ToString(std::numeric_limits<std::uint64_t>::max()), std::to_string(std::numeric_limits<std::uint64_t>::max()));
+   std::mt19937_64 gen(1);
+   for (int i = 0; i < 10000; ++i)
+   {
+      std::uint64_t v = gen() >> (i % 64);
+      EXPECT_EQ(ToString(v), std::to_string(v));
+   }
+}
+
+TEST(NumberWriterPerfTest, Doubles)
+{
+   EXPECT_EQ(ToString(0.), "0");
+   EXPECT_EQ(ToString(-0.), "-0");
+   EXPECT_EQ(ToString(100.), "100");
+   EXPECT_EQ(ToString(1.25), "1.25");
+   EXPECT_EQ(ToString(0.1), "0.1");
+   EXPECT_EQ(ToString(0.3), "0.3");
+   EXPECT_EQ(ToString(-0.05), "-0.05");
+   EXPECT_EQ(ToString(123.456789), "123.456789");
+   EXPECT_EQ(ToString(1. / 3.), "0.3333333333333333");
+   EXPECT_EQ(ToString(1e300), "1e+300");
+   EXPECT_EQ(ToString(1e-5), "1e-05");
+   EXPECT_EQ(ToString(0.0001), "0.0001");
+   EXPECT_EQ(ToString(1e16), "1e+16");
+   EXPECT_EQ(ToString(5e-324), "5e-324");
+   EXPECT_EQ(ToString(std::numeric_limits<double>::infinity()), "inf");
+   EXPECT_EQ(ToString(std::numeric_limits<double>::quiet_NaN()), "nan");
+   // round trip
+   std::mt19937_64 gen(2);
+   std::uniform_real_distribution<double> mantissas(-1., 1.);
+   std::uniform_int_distribution<int> exponents(-300, 300);
+   for (int i = 0; i < 100000; ++i)
+   {
+      double v = std::ldexp(mantissas(gen), exponents(gen) % (i % 2 ? 60 : 1000));
+      string str = ToString(v);
+      EXPECT_EQ(std::strtod(str.c_str(), nullptr), v) << str;
+   }
+}
+
+TEST(NumberWriterPerfTest, MarketData)
+{
+   const Numbers numbers = MakeNumbers(200000);
+   double cppformatNanos = Measure(numbers, [](fmt::MemoryWriter& writer, const auto& v)
+   {
+      writer.write("{}", v);
+   });
+   double fastNanos = Measure(numbers, [](fmt::MemoryWriter& writer, const auto& v)
+   {
+      WriteDefault(writer, v);
+   });
+   std::cout << "nanos per row (5.125 numbers): cppformat " << cppformatNanos << ", WriteDefault " << fastNanos << std::endl;
+}
+
+}
+}
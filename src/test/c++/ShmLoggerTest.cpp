@@ -0,0 +1,246 @@
+#include "tbp/log/ShmSink.h"
+#include "tbp/log/ShmClient.h"
+#include "tbp/log/ShmRing.h"
+#include "tbp/log/LogDaemon.h"
+#include "tbp/log/Loggers.h"
+#include "tbp/log/Categories.h"
+#include "tbp/log/Config.h"
+#include "tbp/log/ThreadLocalLogger.h"
+#include "tbp/log/DefaultTypes.h"
+#include "tbp/log/FileWriter.h"
+#include "tbp/log/Injector.h"
+#include "tbp/tools/Config.h"
+#include "FileWriterHelper.h"
+#include "test/Context.h"
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+
+using testing::_;
+using testing::Invoke;
+using std::make_shared;
+using std::string;
+
+namespace tbp
+{
+namespace log
+{
+
+namespace
+{
+
+using MySink = ShmSink<DefaultTypeId>;
+
+class InjectorMock : public Injector
+{
+public:
+   MOCK_CONST_METHOD2(CreateFileWriter, std::unique_ptr<log::FileWriter>(const log::Config& config, common::ThreadId tid));
+};
+
+class FileWriterMock : public FileWriter
+{
+public:
+   FileWriterMock(const Config& config, common::ThreadId tid) : FileWriter(config, tid) {}
+   //
+   MOCK_CONST_METHOD1(OnWrite, void(const fmt::MemoryWriter& writer));
+};
+
+ShmConfig BuildShmConfig(const string& test)
+{
+   // unique registry name: the unittests can be run concurrently
+   return ShmConfig("/tbp-logd-" + test + "-" + std::to_string(getpid()), 1 << 16, 1 << 16);
+}
+
+void ConfigureInjector(InjectorMock& injector, std::vector<string>& logMsgs)
+{
+   auto createFileWriter = [&logMsgs](const log::Config& config, common::ThreadId tid)
+   {
+      auto fw = std::make_unique<FileWriterMock>(config, tid);
+      EXPECT_CALL(*fw, OnWrite(_)).WillRepeatedly(Invoke([&logMsgs](const fmt::MemoryWriter& writer)
+      {
+         logMsgs.emplace_back(GetLogMsg(writer));
+      }));
+      return fw;
+   };
+   EXPECT_CALL(injector, CreateFileWriter(_, _)).WillRepeatedly(Invoke(createFileWriter));
+}
+
+// the segments closed by the clients are unlinked by the daemon
+void ReleaseSegments(const ShmConfig& shmConfig, const log::Config& logConfig, const Injector& injector)
+{
+   {
+      LogDaemon daemon(shmConfig, logConfig, injector);
+      daemon.Poll();
+   }
+   ShmSegment::Unlink(shmConfig.GetRegistryName());
+}
+
+#define LOG_SHM(category, level, ...)            \
+   TBP_LOG(MySink, category, level, __VA_ARGS__)
+
+}
+
+TEST(ShmLoggerTest, ShmSink)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   //
+   log::Config logConfig(config.GetOutputDir() + "/ShmLoggerTest_ShmSink", "logfile");
+   Categories categories;
+   CategoryId catId = categories.AddCategory(Category("category1", Level::info));
+   ShmConfig shmConfig = BuildShmConfig("ShmSink");
+   InjectorMock injector;
+   std::vector<string> logMsgs;
+   ConfigureInjector(injector, logMsgs);
+   auto loggers = make_shared<Loggers>(categories, logConfig, injector);
+   //
+   {
+      ShmClient client(shmConfig);
+      LogDaemon daemon(shmConfig, logConfig, injector);
+      MySink sink(client, common::ThreadGetId(), nullptr);
+      ThreadLocalLogger<MySink> threadLocalLogger(loggers, "testLogger", std::move(sink));
+      LOG_SHM(catId, Level::info, "withFormat {} {} {}", 1, 2.5, string("str"));
+      LOG_SHM(catId, Level::info, "withoutFormat");
+      // copied in the ring, the LogDaemon cannot read the memory of the client
+      LOG_SHM(catId, Level::info, "static {}", StaticString("EURUSD"));
+      while (logMsgs.size() < 3)
+      {
+         daemon.Poll();
+      }
+   }
+   ASSERT_EQ(logMsgs.size(), 3U);
+   EXPECT_EQ(logMsgs[0], "[info][category1] withFormat 1 2.5 str");
+   EXPECT_EQ(logMsgs[1], "[info][category1] withoutFormat");
+   EXPECT_EQ(logMsgs[2], "[info][category1] static EURUSD");
+   ReleaseSegments(shmConfig, logConfig, injector);
+}
+
+TEST(ShmLoggerTest, DaemonRestart)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   //
+   log::Config logConfig(config.GetOutputDir() + "/ShmLoggerTest_DaemonRestart", "logfile");
+   Categories categories;
+   CategoryId catId = categories.AddCategory(Category("category1", Level::info));
+   ShmConfig shmConfig = BuildShmConfig("DaemonRestart");
+   InjectorMock injector;
+   std::vector<string> logMsgs;
+   ConfigureInjector(injector, logMsgs);
+   auto loggers = make_shared<Loggers>(categories, logConfig, injector);
+   //
+   {
+      ShmClient client(shmConfig);
+      MySink sink(client, common::ThreadGetId(), nullptr);
+      ThreadLocalLogger<MySink> threadLocalLogger(loggers, "testLogger", std::move(sink));
+      {
+         LogDaemon daemon(shmConfig, logConfig, injector);
+         LOG_SHM(catId, Level::info, "message {}", 1);
+         while (daemon.Poll() == 0) {}
+      }
+      // logged while no daemon is running
+      LOG_SHM(catId, Level::info, "message {}", 2);
+      {
+         LogDaemon daemon(shmConfig, logConfig, injector);
+         LOG_SHM(catId, Level::info, "message {}", 3);
+         while (logMsgs.size() < 3)
+         {
+            daemon.Poll();
+         }
+      }
+      threadLocalLogger.Reset();
+   }
+   ASSERT_EQ(logMsgs.size(), 3U);
+   EXPECT_EQ(logMsgs[0], "[info][category1] message 1");
+   EXPECT_EQ(logMsgs[1], "[info][category1] message 2");
+   EXPECT_EQ(logMsgs[2], "[info][category1] message 3");
+   ReleaseSegments(shmConfig, logConfig, injector);
+}
+
+TEST(ShmLoggerTest, ShortLivedThread)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   //
+   log::Config logConfig(config.GetOutputDir() + "/ShmLoggerTest_ShortLivedThread", "logfile");
+   Categories categories;
+   CategoryId catId = categories.AddCategory(Category("category1", Level::info));
+   ShmConfig shmConfig = BuildShmConfig("ShortLivedThread");
+   InjectorMock injector;
+   std::vector<string> logMsgs;
+   ConfigureInjector(injector, logMsgs);
+   auto loggers = make_shared<Loggers>(categories, logConfig, injector);
+   //
+   {
+      ShmClient client(shmConfig);
+      LogDaemon daemon(shmConfig, logConfig, injector);
+      std::thread thread([&]
+      {
+         MySink sink(client, common::ThreadGetId(), nullptr);
+         ThreadLocalLogger<MySink> threadLocalLogger(loggers, "testLogger", std::move(sink));
+         // same address, different content: the dictionary id must not be cached by address only
+         string fmt = "message {}";
+         LOG_SHM(catId, Level::info, fmt.c_str(), 1);
+         fmt = "other {}";
+         LOG_SHM(catId, Level::info, fmt.c_str(), 2);
+      });
+      thread.join();
+      // the ring has been closed before the daemon attached to it
+      while (logMsgs.size() < 2)
+      {
+         daemon.Poll();
+      }
+   }
+   ASSERT_EQ(logMsgs.size(), 2U);
+   EXPECT_EQ(logMsgs[0], "[info][category1] message 1");
+   EXPECT_EQ(logMsgs[1], "[info][category1] other 2");
+   ReleaseSegments(shmConfig, logConfig, injector);
+}
+
+// the size of the records written by the client process is checked before they are read
+TEST(ShmLoggerTest, CorruptRing)
+{
+   const std::size_t capacity = 256;
+   std::vector<std::uint64_t> segment(ShmRing::GetSegmentSize(capacity) / sizeof(std::uint64_t) + 1);
+   char* memory = reinterpret_cast<char*>(segment.data());
+   // the producer writes 'nbRecords' records of 'size' bytes, then the size of the last one is changed to 'corruptSize'
+   auto peek = [memory, capacity](std::size_t nbRecords, std::size_t size, std::uint32_t corruptSize)
+   {
+      ShmRing::Init(memory, capacity);
+      ShmRing producer(memory);
+      ShmRecord* record = nullptr;
+      for (std::size_t i = 0; i < nbRecords; ++i)
+      {
+         record = producer.Reserve(size);
+         record->m_fmt = 1;
+         producer.Commit();
+      }
+      record->m_size = corruptSize;
+      ShmRing consumer(memory);
+      std::size_t count = 0;
+      while (const ShmRecord* valid = consumer.Peek())
+      {
+         consumer.Release(valid);
+         ++count;
+      }
+      // sticky: the next records are not read
+      EXPECT_EQ(consumer.Peek(), nullptr);
+      return std::make_pair(count, consumer.IsCorrupt());
+   };
+   EXPECT_EQ(peek(3, 64, 64), std::make_pair(std::size_t(3), false));
+   // a size of 0 would read the same record forever
+   EXPECT_EQ(peek(3, 64, 0), std::make_pair(std::size_t(2), true));
+   EXPECT_EQ(peek(3, 64, 60), std::make_pair(std::size_t(2), true));
+   EXPECT_EQ(peek(3, 64, 8), std::make_pair(std::size_t(2), true));
+   // beyond the write position
+   EXPECT_EQ(peek(2, 64, 128), std::make_pair(std::size_t(1), true));
+   // beyond the end of the ring
+   EXPECT_EQ(peek(4, 64, 128), std::make_pair(std::size_t(3), true));
+}
+
+}
+}
@@ -2,6 +2,7 @@
 #include "tbp/log/Categories.h"
 #include "tbp/log/Config.h"
 #include "tbp/log/SyncSink.h"
+#include "tbp/log/SharedSyncSink.h"
 #include "tbp/log/ThreadLocalLogger.h"
 #include "tbp/log/SignalManager.h"
 #include "tbp/log/Injector.h"
@@ -11,6 +12,13 @@
 #include "test/UserDefinedLoggable.h"
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <set>
+#include <chrono>
+#include <dirent.h>
+#include <unistd.h>
 
 using tbp::log::test::UserDefinedLoggable;
 using testing::Invoke;
@@ -83,6 +91,42 @@ void ConfigureSinkExpectation(SyncSinkMock& sink, const string& expectedMsg)
 CategoryId g_logCat1 = 0;
 CategoryId g_logCat2 = 0;
 
+// paths of the log files of 'dir'
+std::vector<string> GetLogFiles(const string& dir)
+{
+   std::vector<string> paths;
+   if (DIR* d = ::opendir(dir.c_str()))
+   {
+      while (dirent* entry = ::readdir(d))
+      {
+         string name = entry->d_name;
+         if (name.size() > 4 && name.compare(name.size() - 4, 4, ".log") == 0)
+         {
+            paths.push_back(dir + "/" + name);
+         }
+      }
+      ::closedir(d);
+   }
+   return paths;
+}
+
+// lines of the log files of 'dir' without the timestamp and the thread id
+std::vector<string> ReadLogFiles(const string& dir)
+{
+   std::vector<string> lines;
+   for (const auto& path : GetLogFiles(dir))
+   {
+      std::ifstream file(path);
+      string line;
+      while (std::getline(file, line))
+      {
+         std::size_t timestampEndPos = line.find(']');
+         lines.push_back(line.substr(line.find(']', timestampEndPos + 1) + 1));
+      }
+   }
+   return lines;
+}
+
 class ComponentConfig
 {
 public:
@@ -193,6 +237,50 @@ TEST(SyncLoggerTest, Level)
    LOG_SYNC_MOCK(catId, Level::info, "msg{}", 6);
 }
 
+TEST(SyncLoggerTest, LevelOverride)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   //
+   Categories categories;
+   Category category("category1", Level::warn);
+   CategoryId catId = categories.AddCategory(category);
+   InjectorMock injector;
+   auto loggers = make_shared<Loggers>(categories, BuildLogConfig(config, "LevelOverride"), injector);
+   SyncSinkMock* sinkPtr = nullptr;
+   ConfigureInjector(injector, &sinkPtr);
+   SyncSinkMock sink(loggers->GetConfig(), common::ThreadGetId(), nullptr);
+   ThreadLocalLogger<SyncSinkMock> threadLocalLogger(loggers, "testLogger", std::move(sink));
+   //
+   loggers->SetLoggerLevel("otherLogger", category, Level::debug);
+   LOG_SYNC_MOCK(catId, Level::info, "msg{}", 1);
+   loggers->SetLoggerLevel("testLogger", category, Level::info);
+   ConfigureSinkExpectation(*sinkPtr, "[info][category1] msg2");
+   LOG_SYNC_MOCK(catId, Level::info, "msg{}", 2);
+   // the override is kept when the level of all the loggers is changed
+   loggers->SetLevels(Level::error);
+   ConfigureSinkExpectation(*sinkPtr, "[info][category1] msg3");
+   LOG_SYNC_MOCK(catId, Level::info, "msg{}", 3);
+   // the thread override has precedence over the logger override
+   loggers->SetThreadLevel(common::ThreadGetId(), category, Level::debug);
+   ConfigureSinkExpectation(*sinkPtr, "[debug][category1] msg4");
+   LOG_SYNC_MOCK(catId, Level::debug, "msg{}", 4);
+   loggers->ResetThreadLevels(common::ThreadGetId());
+   LOG_SYNC_MOCK(catId, Level::debug, "msg{}", 5);
+   loggers->ResetLoggerLevels("testLogger");
+   LOG_SYNC_MOCK(catId, Level::info, "msg{}", 6);
+   ConfigureSinkExpectation(*sinkPtr, "[error][category1] msg7");
+   LOG_SYNC_MOCK(catId, Level::error, "msg{}", 7);
+   // the thread overrides are removed with the last logger of the thread: a new thread can reuse its id
+   loggers->SetThreadLevel(common::ThreadGetId(), category, Level::debug);
+   EXPECT_EQ(ThreadLocalLogger<SyncSinkMock>::Get()->GetLevel(catId), Level::debug);
+   threadLocalLogger.Reset();
+   ConfigureInjector(injector, &sinkPtr);
+   SyncSinkMock newSink(loggers->GetConfig(), common::ThreadGetId(), nullptr);
+   ThreadLocalLogger<SyncSinkMock> newLogger(loggers, "newLogger", std::move(newSink));
+   EXPECT_EQ(ThreadLocalLogger<SyncSinkMock>::Get()->GetLevel(catId), Level::error);
+}
+
 void TBP_NOINLINE SyncFunc2(common::SigNum signal)
 {
    raise(signal);
@@ -230,6 +318,121 @@ TEST(SyncLoggerTest, FatalError)
    SyncFunc1(SIGSEGV);
 }
 
+TEST(SyncLoggerTest, Buffered)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   //
+   CategoryId catId = 0;
+   Injector injector;
+   log::Config logConfig = BuildLogConfig(config, "Buffered");
+   auto loggers = make_shared<Loggers>(BuildCategories(&catId), logConfig, injector);
+   for (const auto& path : GetLogFiles(logConfig.GetOutputDir()))
+   {
+      ::unlink(path.c_str());
+   }
+   SyncFlusher flusher(1024, std::chrono::milliseconds(1));
+   {
+      SyncSink sink(loggers->GetConfig(), common::ThreadGetId(), nullptr, &flusher);
+      ThreadLocalLogger<SyncSink> threadLocalLogger(loggers, "bufferedLogger", std::move(sink));
+      for (int i = 0; i < 3; ++i)
+      {
+         TBP_LOG(SyncSink, catId, Level::info, "msg {}", i);
+      }
+      // written by the SyncFlusher thread once the first line is older than the interval
+      std::vector<string> lines;
+      for (int i = 0; i < 2000 && lines.size() < 3; ++i)
+      {
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         lines = ReadLogFiles(logConfig.GetOutputDir());
+      }
+      std::vector<string> expected = { "[info][category1] msg 0", "[info][category1] msg 1", "[info][category1] msg 2" };
+      EXPECT_EQ(lines, expected);
+      // more than the buffer size
+      for (int i = 3; i < 100; ++i)
+      {
+         TBP_LOG(SyncSink, catId, Level::info, "msg {}", i);
+      }
+   }
+   // the lines still buffered are written when the sink is destroyed
+   std::vector<string> lines = ReadLogFiles(logConfig.GetOutputDir());
+   ASSERT_EQ(lines.size(), 100U);
+   for (int i = 0; i < 100; ++i)
+   {
+      EXPECT_EQ(lines[i], "[info][category1] msg " + std::to_string(i));
+   }
 }
+
+TEST(SyncLoggerTest, SharedFile)
+{
+   auto& context = test::Context::Get();
+   const auto& config = context.GetToolsConfig();
+   //
+   CategoryId catId = 0;
+   Injector injector;
+   auto loggers = make_shared<Loggers>(BuildCategories(&catId), BuildLogConfig(config, "SharedFile"), injector);
+   const std::size_t nbThreads = 8;
+   const int nbMessages = 500;
+   std::string path;
+   {
+      auto file = std::make_shared<SharedFile>(loggers->GetConfig(), "shared", 1024 * 1024);
+      path = file->GetPath();
+      std::vector<std::thread> threads;
+      for (std::size_t i = 0; i < nbThreads; ++i)
+      {
+         threads.emplace_back([&loggers, &file, catId, i, nbMessages]
+         {
+            SharedSyncSink sink(file, common::ThreadGetId(), nullptr);
+            ThreadLocalLogger<SharedSyncSink> threadLocalLogger(loggers, "sharedLogger" + std::to_string(i), std::move(sink));
+            for (int j = 0; j < nbMessages; ++j)
+            {
+               TBP_LOG(SharedSyncSink, catId, Level::info, "thread {} msg {}", i, j);
+            }
+         });
+      }
+      for (auto& thread : threads)
+      {
+         thread.join();
+      }
+      EXPECT_EQ(file->GetNbDropped(), 0U);
+   }
+   // all the lines are in the file, none is torn
+   std::ifstream file(path);
+   std::set<string> lines;
+   string line;
+   while (std::getline(file, line))
+   {
+      auto pos = line.find("[info][category1] ");
+      ASSERT_NE(pos, string::npos) << line;
+      lines.insert(line.substr(pos));
+   }
+   ASSERT_EQ(lines.size(), nbThreads * nbMessages);
+   EXPECT_EQ(lines.count("[info][category1] thread 3 msg 499"), 1U);
+   //
+   // the lines beyond the capacity are dropped, the file is truncated to the lines written
+   {
+      SharedFile small(loggers->GetConfig(), "small", 64);
+      EXPECT_TRUE(small.Append("0123456789012345678901234567890123456789\n", 41));
+      EXPECT_FALSE(small.Append("0123456789012345678901234567890123456789\n", 41));
+      EXPECT_EQ(small.GetNbDropped(), 1U);
+      path = small.GetPath();
+   }
+   std::ifstream smallFile(path, std::ios::binary | std::ios::ate);
+   EXPECT_EQ(smallFile.tellg(), 41);
+   //
+   // signal: the destructor is not called, the file is truncated by Sync()
+   {
+      SharedFile synced(loggers->GetConfig(), "synced", 4096);
+      EXPECT_TRUE(synced.Append("0123456789\n", 11));
+      synced.Sync();
+      path = synced.GetPath();
+      std::ifstream syncedFile(path, std::ios::binary | std::ios::ate);
+      EXPECT_EQ(syncedFile.tellg(), 11);
+      EXPECT_FALSE(synced.Append("0123456789\n", 11));
+   }
+   std::ifstream syncedFile(path, std::ios::binary | std::ios::ate);
+   EXPECT_EQ(syncedFile.tellg(), 11);
 }
 
+}
+}